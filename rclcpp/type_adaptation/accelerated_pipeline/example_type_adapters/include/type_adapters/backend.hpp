@@ -0,0 +1,237 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TYPE_ADAPTERS__BACKEND_HPP_
+#define TYPE_ADAPTERS__BACKEND_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "type_adapters/buffer_pool.hpp"
+#include "type_adapters/config.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+/// Where the pixel memory of an ImageContainer lives and where work on it is executed.
+enum class BackendType
+{
+  kHost,
+  kCuda,
+};
+
+/// An in-order queue of work on a backend.
+class StreamWrapper
+{
+public:
+  virtual ~StreamWrapper() = default;
+
+  virtual BackendType
+  backend_type() const = 0;
+
+  /// Block until all work queued on this stream has completed.
+  virtual void
+  synchronize() = 0;
+
+  /// Make work queued on this stream after this call wait for the work currently queued on other.
+  virtual void
+  wait_for(StreamWrapper & other) = 0;
+};
+
+/// Completion of a transfer queued on a stream.
+class Fence
+{
+public:
+  virtual ~Fence() = default;
+
+  /// Whether the transfer has completed, without blocking.
+  virtual bool
+  is_ready() const = 0;
+
+  /// Block until the transfer has completed.
+  virtual void
+  wait() = 0;
+};
+
+/// A block of memory owned by a backend.
+class MemoryWrapper
+{
+public:
+  virtual ~MemoryWrapper() = default;
+
+  /// Queue a copy from host memory on the stream, host_mem must stay valid until the fence is
+  /// ready.
+  virtual std::shared_ptr<Fence>
+  copy_to_device_async(const uint8_t * host_mem, size_t bytes_to_copy, StreamWrapper & stream) = 0;
+
+  /// Queue a copy to host memory on the stream, host_mem must stay valid until the fence is ready.
+  virtual std::shared_ptr<Fence>
+  copy_from_device_async(uint8_t * host_mem, size_t bytes_to_copy, StreamWrapper & stream) = 0;
+
+  /// Queue a copy of rows rows of row_bytes bytes each, the first starting offset bytes into this
+  /// memory and the next ones step bytes apart, to packed host memory, e.g. to materialize a view.
+  virtual std::shared_ptr<Fence>
+  copy_from_device_2d_async(
+    uint8_t * host_mem, size_t offset, size_t step, size_t row_bytes, size_t rows,
+    StreamWrapper & stream) = 0;
+
+  void
+  copy_to_device(const uint8_t * host_mem, size_t bytes_to_copy, StreamWrapper & stream)
+  {
+    copy_to_device_async(host_mem, bytes_to_copy, stream)->wait();
+  }
+
+  void
+  copy_from_device(uint8_t * host_mem, size_t bytes_to_copy, StreamWrapper & stream)
+  {
+    copy_from_device_async(host_mem, bytes_to_copy, stream)->wait();
+  }
+
+  /// Queue a copy from another block, which may belong to a different backend.
+  virtual void
+  copy_from(const MemoryWrapper & source, size_t bytes_to_copy, StreamWrapper & stream) = 0;
+
+  /// Queue a copy of rows rows of row_bytes bytes each from another block, which may belong to a
+  /// different backend, e.g. a tile into the frame it belongs to. The rows start source_offset
+  /// and offset bytes into the blocks, and the next ones source_step and step bytes apart.
+  virtual void
+  copy_from_2d(
+    const MemoryWrapper & source, size_t source_offset, size_t source_step, size_t offset,
+    size_t step, size_t row_bytes, size_t rows, StreamWrapper & stream) = 0;
+
+  /// Block until the transfers queued on this memory have completed, e.g. before it is reused.
+  virtual void
+  synchronize() const = 0;
+
+  /// Make synchronize() also wait for the work queued on the stream so far, e.g. kernels that
+  /// still read or write the memory when a container drops it. Backends whose work is done once
+  /// it was queued need not track it.
+  virtual void
+  record_use(StreamWrapper & /*stream*/) const
+  {
+  }
+
+  /// Move adopted host storage out into destination, leaving this memory empty. Returns false,
+  /// without touching destination, if the memory does not own a std::vector.
+  virtual bool
+  release_storage(std::vector<uint8_t> & /*destination*/)
+  {
+    return false;
+  }
+
+  /// Whether owners outside of this process, e.g. other consumers of a frame in shared memory,
+  /// can see the memory, in which case containers clone it before writing.
+  virtual bool
+  is_shared() const
+  {
+    return false;
+  }
+
+  virtual uint8_t *
+  device_memory() = 0;
+
+  virtual const uint8_t *
+  device_memory() const = 0;
+
+  virtual size_t
+  size_in_bytes() const = 0;
+};
+
+/// Factory for the streams and memory of one backend.
+class Backend
+{
+public:
+  Backend();
+
+  virtual ~Backend() = default;
+
+  virtual BackendType
+  type() const = 0;
+
+  virtual std::shared_ptr<StreamWrapper>
+  create_stream() = 0;
+
+  /// Get memory from the buffer pool of this backend, it returns there once released.
+  std::shared_ptr<MemoryWrapper>
+  allocate(size_t bytes_to_allocate);
+
+  /// Whether adopt() can use host storage as memory of this backend without a copy.
+  virtual bool
+  can_adopt() const
+  {
+    return false;
+  }
+
+  /// Take over host storage, e.g. the data of a sensor_msgs::msg::Image, as memory of this
+  /// backend. Throws std::logic_error if can_adopt() is false.
+  virtual std::shared_ptr<MemoryWrapper>
+  adopt(std::vector<uint8_t> && storage);
+
+  BufferPool &
+  buffer_pool()
+  {
+    return *buffer_pool_;
+  }
+
+protected:
+  /// Allocate new memory, called by the buffer pool on a miss.
+  virtual std::unique_ptr<MemoryWrapper>
+  allocate_memory(size_t bytes_to_allocate) = 0;
+
+private:
+  std::shared_ptr<BufferPool> buffer_pool_;
+};
+
+/// Get the shared instance of a backend, throws std::invalid_argument if it was not built.
+std::shared_ptr<Backend>
+get_backend(BackendType type);
+
+/// Whether rows rows of row_bytes bytes, starting offset bytes into size bytes of memory and step
+/// bytes apart, lie within the memory.
+inline bool
+region_fits(size_t size, size_t offset, size_t step, size_t row_bytes, size_t rows)
+{
+  if (rows == 0) {
+    return true;
+  }
+  if (rows > 1 && row_bytes > step) {
+    return false;
+  }
+  return offset + (rows - 1) * step + row_bytes <= size;
+}
+
+/// Backend used by containers that are not given a stream, e.g. in type adapter conversions.
+/// Defaults to CUDA when the package was built with it, and to host memory otherwise.
+BackendType
+default_backend_type();
+
+void
+set_default_backend_type(BackendType type);
+
+/// Parse "host" or "cuda", throws std::invalid_argument on anything else.
+BackendType
+backend_type_from_string(const std::string & name);
+
+std::string
+to_string(BackendType type);
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
+
+#endif  // TYPE_ADAPTERS__BACKEND_HPP_
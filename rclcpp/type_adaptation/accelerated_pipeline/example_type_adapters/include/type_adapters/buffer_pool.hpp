@@ -0,0 +1,117 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TYPE_ADAPTERS__BUFFER_POOL_HPP_
+#define TYPE_ADAPTERS__BUFFER_POOL_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+class MemoryWrapper;
+
+struct BufferPoolStatistics
+{
+  uint64_t hits{0};  // Requests served from a cached buffer
+  uint64_t misses{0};  // Requests that had to allocate
+  uint64_t evictions{0};  // Released buffers freed to stay under the high-water mark
+  size_t cached_bytes{0};  // Bytes held by idle buffers
+  size_t high_water_mark{0};  // Maximum number of bytes held by idle buffers
+};
+
+/// Thread-safe cache of backend buffers, bucketed by size.
+/**
+ * Buffers acquired from the pool go back to it when the last reference is dropped, instead of
+ * being freed, so that frames of a steady resolution reuse the same memory. They are only handed
+ * out again once the work recorded on them (MemoryWrapper::synchronize()) has completed. Idle
+ * buffers are freed, least recently released first, when they would exceed the high-water mark.
+ */
+class BufferPool final : public std::enable_shared_from_this<BufferPool>
+{
+public:
+  using Allocator = std::function<std::unique_ptr<MemoryWrapper>(size_t)>;
+
+  static constexpr size_t kDefaultHighWaterMark = size_t{1} << 30;
+
+  static std::shared_ptr<BufferPool>
+  make(Allocator allocator, size_t high_water_mark = kDefaultHighWaterMark);
+
+  ~BufferPool();
+
+  /// Get a buffer of at least bytes_to_allocate bytes.
+  std::shared_ptr<MemoryWrapper>
+  acquire(size_t bytes_to_allocate);
+
+  /// Allocate idle buffers up front until count of them serve requests of bytes_to_allocate, as
+  /// far as the high-water mark allows, e.g. for the frames of a resolution known at startup.
+  /// Returns the number of buffers allocated.
+  size_t
+  reserve(size_t bytes_to_allocate, size_t count);
+
+  /// Set the maximum number of bytes kept by idle buffers, evicting the excess right away.
+  void
+  set_high_water_mark(size_t bytes);
+
+  size_t
+  high_water_mark() const;
+
+  BufferPoolStatistics
+  statistics() const;
+
+  /// Free all idle buffers.
+  void
+  clear();
+
+  /// Size of the bucket a request of bytes_to_allocate is served from.
+  static size_t
+  bucket_size(size_t bytes_to_allocate);
+
+private:
+  BufferPool(Allocator allocator, size_t high_water_mark);
+
+  void
+  release(MemoryWrapper * memory);
+
+  // Must be called with mutex_ held, the evicted buffers are moved out to be freed without it.
+  void
+  evict_locked(size_t bytes_to_keep, std::list<std::unique_ptr<MemoryWrapper>> & evicted);
+
+  Allocator allocator_;
+
+  mutable std::mutex mutex_;
+
+  // Idle buffers, least recently released first.
+  std::list<std::unique_ptr<MemoryWrapper>> idle_;
+  // Idle buffers by bucket size, most recently released last.
+  std::unordered_map<size_t,
+    std::vector<std::list<std::unique_ptr<MemoryWrapper>>::iterator>> buckets_;
+
+  size_t high_water_mark_{0};
+  BufferPoolStatistics statistics_{};
+};
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
+
+#endif  // TYPE_ADAPTERS__BUFFER_POOL_HPP_
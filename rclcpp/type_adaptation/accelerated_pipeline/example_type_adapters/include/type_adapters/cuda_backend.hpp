@@ -0,0 +1,193 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+// Copyright 2021 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TYPE_ADAPTERS__CUDA_BACKEND_HPP_
+#define TYPE_ADAPTERS__CUDA_BACKEND_HPP_
+
+#include "type_adapters/config.hpp"
+
+#ifndef TYPE_ADAPTERS_USE_CUDA
+#error "example_type_adapters was built without the CUDA backend"
+#endif
+
+#include <memory>
+
+#include "type_adapters/backend.hpp"
+
+#include "cuda.h"  // NOLINT
+#include "cuda_runtime.h"  // NOLINT
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+class CUDAEventWrapper final
+{
+public:
+  CUDAEventWrapper();
+
+  void record(const cudaStream_t & stream);
+
+  cudaEvent_t & event()
+  {
+    return event_;
+  }
+
+  ~CUDAEventWrapper();
+
+private:
+  cudaEvent_t event_;
+};
+
+/// Completion of the work queued on a CUDA stream when the fence was created.
+class CUDAFence final : public Fence
+{
+public:
+  explicit CUDAFence(const cudaStream_t & stream);
+
+  bool
+  is_ready() const override;
+
+  void
+  wait() override;
+
+private:
+  mutable CUDAEventWrapper event_;
+};
+
+class CUDAStreamWrapper final : public StreamWrapper
+{
+public:
+  CUDAStreamWrapper();
+
+  ~CUDAStreamWrapper() override;
+
+  cudaStream_t & stream()
+  {
+    return main_stream_;
+  }
+
+  BackendType
+  backend_type() const override
+  {
+    return BackendType::kCuda;
+  }
+
+  void
+  synchronize() override;
+
+  void
+  wait_for(StreamWrapper & other) override;
+
+private:
+  cudaStream_t main_stream_{};
+
+  CUDAEventWrapper event_;
+};
+
+/// Managed memory, so that it is also addressable from the host.
+class CUDAMemoryWrapper final : public MemoryWrapper
+{
+public:
+  explicit CUDAMemoryWrapper(size_t size_in_bytes);
+
+  ~CUDAMemoryWrapper() override;
+
+  CUDAMemoryWrapper(const CUDAMemoryWrapper &) = delete;
+  CUDAMemoryWrapper & operator=(const CUDAMemoryWrapper &) = delete;
+
+  std::shared_ptr<Fence>
+  copy_to_device_async(
+    const uint8_t * host_mem, size_t bytes_to_copy, StreamWrapper & stream) override;
+
+  std::shared_ptr<Fence>
+  copy_from_device_async(uint8_t * host_mem, size_t bytes_to_copy, StreamWrapper & stream) override;
+
+  std::shared_ptr<Fence>
+  copy_from_device_2d_async(
+    uint8_t * host_mem, size_t offset, size_t step, size_t row_bytes, size_t rows,
+    StreamWrapper & stream) override;
+
+  void
+  copy_from(const MemoryWrapper & source, size_t bytes_to_copy, StreamWrapper & stream) override;
+
+  void
+  copy_from_2d(
+    const MemoryWrapper & source, size_t source_offset, size_t source_step, size_t offset,
+    size_t step, size_t row_bytes, size_t rows, StreamWrapper & stream) override;
+
+  void
+  synchronize() const override;
+
+  void
+  record_use(StreamWrapper & stream) const override;
+
+  uint8_t *
+  device_memory() override
+  {
+    return cuda_mem_;
+  }
+
+  const uint8_t *
+  device_memory() const override
+  {
+    return cuda_mem_;
+  }
+
+  size_t
+  size_in_bytes() const override
+  {
+    return bytes_allocated_;
+  }
+
+private:
+  size_t bytes_allocated_{0};
+
+  uint8_t * cuda_mem_{nullptr};
+
+  // Recorded after every transfer touching this memory, and after the work queued on the streams
+  // of the containers that dropped it.
+  mutable CUDAEventWrapper last_transfer_;
+};
+
+class CUDABackend final : public Backend
+{
+public:
+  BackendType
+  type() const override
+  {
+    return BackendType::kCuda;
+  }
+
+  std::shared_ptr<StreamWrapper>
+  create_stream() override;
+
+protected:
+  std::unique_ptr<MemoryWrapper>
+  allocate_memory(size_t bytes_to_allocate) override;
+};
+
+/// Get the CUDA stream behind a stream of the CUDA backend.
+inline cudaStream_t &
+cuda_stream(StreamWrapper & stream)
+{
+  return static_cast<CUDAStreamWrapper &>(stream).stream();
+}
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
+
+#endif  // TYPE_ADAPTERS__CUDA_BACKEND_HPP_
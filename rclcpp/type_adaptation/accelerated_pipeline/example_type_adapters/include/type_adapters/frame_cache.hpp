@@ -0,0 +1,112 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TYPE_ADAPTERS__FRAME_CACHE_HPP_
+#define TYPE_ADAPTERS__FRAME_CACHE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "std_msgs/msg/header.hpp"
+
+#include "type_adapters/backend.hpp"
+#include "type_adapters/image_container.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+/// Bounded cache of frames that repeat, e.g. the outputs of an animation that runs in cycles.
+/**
+ * Frames in memory are copies of the containers they were inserted as, so they share the memory
+ * of the published frame and consumers clone it before writing, see ImageContainer::data().
+ * Frames beyond the memory budget are written to files in the spill directory, which are
+ * unlinked as soon as they are mapped, and read back from the mapping. On the host backend the
+ * mapping is the memory of the frame, other backends upload it.
+ *
+ * Keys that come round in cycles longer than the cache would evict every frame before its next
+ * use under LRU, so the budgets are enforced when frames are inserted: a frame that does not fit
+ * is not kept, and the frames in the cache stay until clear().
+ */
+class FrameCache final
+{
+public:
+  /// Cache of up to memory_bytes of frames in memory and up to spill_bytes of frames in files in
+  /// spill_directory, no spilling for an empty directory.
+  FrameCache(size_t memory_bytes, size_t spill_bytes = 0, std::string spill_directory = "");
+
+  ~FrameCache();
+
+  FrameCache(const FrameCache &) = delete;
+  FrameCache & operator=(const FrameCache &) = delete;
+
+  /// Set frame to a copy of the frame cached for key. Returns false, without touching frame, if
+  /// there is none. Spilled frames come without their active pixels.
+  bool
+  find(uint64_t key, ImageContainer & frame);
+
+  /// Keep a copy of frame for key, unless key is cached already or the frame does not fit.
+  /// Throws std::runtime_error if a spill file cannot be created.
+  void
+  insert(uint64_t key, const ImageContainer & frame);
+
+  /// Drop all frames, e.g. once the keys no longer identify them.
+  void
+  clear();
+
+  /// Bytes of the frames in memory.
+  size_t
+  memory_bytes() const;
+
+  /// Bytes of the frames in spill files.
+  size_t
+  spill_bytes() const;
+
+private:
+  class SpillFile;
+
+  struct SpilledFrame
+  {
+    std::shared_ptr<SpillFile> file;
+    std_msgs::msg::Header header;
+    uint32_t height;
+    uint32_t width;
+    std::string encoding;
+    uint32_t step;
+    BackendType backend_type;
+  };
+
+  const size_t memory_budget_;
+  const size_t spill_budget_;
+  const std::string spill_directory_;
+
+  mutable std::mutex mutex_;
+  std::unordered_map<uint64_t, ImageContainer> frames_;
+  std::unordered_map<uint64_t, SpilledFrame> spilled_;
+  size_t memory_bytes_{0};
+  size_t spill_bytes_{0};
+
+  // Stream spilled frames are read back on, of the backend of the last one.
+  std::shared_ptr<StreamWrapper> spill_stream_;
+};
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
+
+#endif  // TYPE_ADAPTERS__FRAME_CACHE_HPP_
@@ -0,0 +1,245 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TYPE_ADAPTERS__HOST_BACKEND_HPP_
+#define TYPE_ADAPTERS__HOST_BACKEND_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "type_adapters/backend.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+/// Stand-in for the copy engine of a GPU: a worker thread that runs host transfers in order.
+class HostCopyEngine final
+{
+public:
+  HostCopyEngine();
+
+  ~HostCopyEngine();
+
+  HostCopyEngine(const HostCopyEngine &) = delete;
+  HostCopyEngine & operator=(const HostCopyEngine &) = delete;
+
+  /// Queue a transfer behind all previously queued ones.
+  std::shared_ptr<Fence>
+  enqueue(std::function<void()> transfer);
+
+  /// The engine shared by all host memory.
+  static HostCopyEngine &
+  instance();
+
+private:
+  void
+  run();
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::deque<std::packaged_task<void()>> queue_;
+  bool stopping_{false};
+
+  std::thread worker_;
+};
+
+class HostFence final : public Fence
+{
+public:
+  explicit HostFence(std::shared_future<void> future)
+  : future_(std::move(future))
+  {
+  }
+
+  bool
+  is_ready() const override;
+
+  void
+  wait() override;
+
+private:
+  std::shared_future<void> future_;
+};
+
+/// Transfers run on the copy engine, host work runs on the calling thread after synchronize().
+class HostStreamWrapper final : public StreamWrapper
+{
+public:
+  BackendType
+  backend_type() const override
+  {
+    return BackendType::kHost;
+  }
+
+  void
+  synchronize() override;
+
+  void
+  wait_for(StreamWrapper & other) override;
+
+  /// Make the stream wait for a transfer queued on the copy engine.
+  void
+  add_pending(std::shared_ptr<Fence> fence);
+
+private:
+  std::mutex mutex_;
+  std::vector<std::shared_ptr<Fence>> pending_;
+};
+
+/// Host memory that belongs to someone else, e.g. a slot of a shared memory segment, released
+/// when destroyed.
+class ExternalHostStorage
+{
+public:
+  virtual ~ExternalHostStorage() = default;
+
+  virtual uint8_t *
+  data() = 0;
+
+  virtual size_t
+  size() const = 0;
+
+  /// See MemoryWrapper::is_shared().
+  virtual bool
+  is_shared() const
+  {
+    return false;
+  }
+};
+
+/// Page-aligned host memory, host storage adopted from a std::vector, or external host storage.
+class HostMemoryWrapper final : public MemoryWrapper
+{
+public:
+  explicit HostMemoryWrapper(size_t bytes_to_allocate);
+
+  explicit HostMemoryWrapper(std::vector<uint8_t> && storage);
+
+  explicit HostMemoryWrapper(std::unique_ptr<ExternalHostStorage> storage);
+
+  ~HostMemoryWrapper() override;
+
+  HostMemoryWrapper(const HostMemoryWrapper &) = delete;
+  HostMemoryWrapper & operator=(const HostMemoryWrapper &) = delete;
+
+  std::shared_ptr<Fence>
+  copy_to_device_async(
+    const uint8_t * host_mem, size_t bytes_to_copy, StreamWrapper & stream) override;
+
+  std::shared_ptr<Fence>
+  copy_from_device_async(uint8_t * host_mem, size_t bytes_to_copy, StreamWrapper & stream) override;
+
+  std::shared_ptr<Fence>
+  copy_from_device_2d_async(
+    uint8_t * host_mem, size_t offset, size_t step, size_t row_bytes, size_t rows,
+    StreamWrapper & stream) override;
+
+  void
+  copy_from(const MemoryWrapper & source, size_t bytes_to_copy, StreamWrapper & stream) override;
+
+  void
+  copy_from_2d(
+    const MemoryWrapper & source, size_t source_offset, size_t source_step, size_t offset,
+    size_t step, size_t row_bytes, size_t rows, StreamWrapper & stream) override;
+
+  void
+  synchronize() const override;
+
+  bool
+  release_storage(std::vector<uint8_t> & destination) override;
+
+  bool
+  is_shared() const override
+  {
+    return external_ && external_->is_shared();
+  }
+
+  uint8_t *
+  device_memory() override
+  {
+    return host_mem_;
+  }
+
+  const uint8_t *
+  device_memory() const override
+  {
+    return host_mem_;
+  }
+
+  size_t
+  size_in_bytes() const override
+  {
+    return bytes_allocated_;
+  }
+
+private:
+  // Queue a transfer touching this memory on the engine and the stream.
+  std::shared_ptr<Fence>
+  enqueue(std::function<void()> transfer, StreamWrapper & stream) const;
+
+  size_t bytes_allocated_{0};
+
+  uint8_t * host_mem_{nullptr};
+
+  // Backs host_mem_ instead of posix_memalign when is_adopted_.
+  std::vector<uint8_t> adopted_;
+  bool is_adopted_{false};
+
+  // Backs host_mem_ instead of posix_memalign when set.
+  std::unique_ptr<ExternalHostStorage> external_;
+
+  mutable std::mutex mutex_;
+  // The engine runs transfers in order, so the last one completes after all others.
+  mutable std::shared_ptr<Fence> last_transfer_;
+};
+
+class HostBackend final : public Backend
+{
+public:
+  BackendType
+  type() const override
+  {
+    return BackendType::kHost;
+  }
+
+  std::shared_ptr<StreamWrapper>
+  create_stream() override;
+
+  bool
+  can_adopt() const override
+  {
+    return true;
+  }
+
+  std::shared_ptr<MemoryWrapper>
+  adopt(std::vector<uint8_t> && storage) override;
+
+protected:
+  std::unique_ptr<MemoryWrapper>
+  allocate_memory(size_t bytes_to_allocate) override;
+};
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
+
+#endif  // TYPE_ADAPTERS__HOST_BACKEND_HPP_
@@ -16,98 +16,95 @@
 #ifndef TYPE_ADAPTERS__IMAGE_CONTAINER_HPP_
 #define TYPE_ADAPTERS__IMAGE_CONTAINER_HPP_
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <utility>
 
 #include "rclcpp/type_adapter.hpp"
 #include "sensor_msgs/msg/image.hpp"
 #include "std_msgs/msg/header.hpp"
 
-#include "cuda.h"  // NOLINT
-#include "cuda_runtime.h"  // NOLINT
+#include "type_adapters/backend.hpp"
+#include "type_adapters/pixel_list.hpp"
 
 namespace type_adaptation
 {
 namespace example_type_adapters
 {
-class CUDAStreamWrapper final
+/// Where a tile of a frame that is streamed tile by tile lies in the frame.
+struct TilePlacement
 {
-public:
-  CUDAStreamWrapper();
-
-  ~CUDAStreamWrapper();
-
-  cudaStream_t & stream()
-  {
-    return main_stream_;
-  }
-
-private:
-  cudaStream_t main_stream_{};
-};
-
-class CUDAMemoryWrapper final
-{
-public:
-  explicit CUDAMemoryWrapper(size_t size_in_bytes);
-
-  void
-  copy_to_device(uint8_t * host_mem, size_t bytes_to_copy, const cudaStream_t & stream);
-
-  void
-  copy_from_device(uint8_t * host_mem, size_t bytes_to_copy, const cudaStream_t & stream);
-
-  uint8_t *
-  device_memory();
-
-  ~CUDAMemoryWrapper();
-
-private:
-  size_t bytes_allocated_{0};
-
-  uint8_t * cuda_mem_{nullptr};
-};
-
-class CUDAEventWrapper final
-{
-public:
-  CUDAEventWrapper();
-
-  void record(std::shared_ptr<CUDAStreamWrapper> cuda_stream);
-
-  cudaEvent_t & event()
-  {
-    return event_;
-  }
-
-  ~CUDAEventWrapper();
-
-private:
-  cudaEvent_t event_;
+  uint32_t x{0};  // Column of the first pixel of the tile in the frame
+  uint32_t y{0};  // Row of the first pixel of the tile in the frame
+  uint32_t frame_width{0};
+  uint32_t frame_height{0};
+  uint32_t index{0};  // Index of the tile among the tiles of the frame
+  uint32_t count{0};  // Tiles of the frame, 0 for a whole frame
+  // Token of the window of tiles in flight of the producer, see InFlightWindow, released once
+  // the last container carrying the tile is gone. Does not cross processes.
+  std::shared_ptr<void> in_flight;
 };
 
+/// Image on a memory backend with copy-on-write pixel memory.
+/**
+ * Copies share the pixel memory and stream of the original in O(1). A container clones its memory
+ * the first time writable access is requested through the non-const data() while the memory is
+ * shared, so fan-out to several subscribers only copies a frame for the ones that modify it.
+ *
+ * A view is a container over a region of another one. It shares the storage of its parent and
+ * keeps it alive, but is not a copy of it: writes through a view are seen by its parent and by the
+ * other views, which is what tiled processing relies on, and the parent does not clone its memory
+ * away from its views. A view only clones its region when a copy of the parent or of the view
+ * shares the memory, and is a packed image of its own from then on. Views keep the row step of the
+ * parent, and are only materialized into a packed image when converted to a
+ * sensor_msgs::msg::Image.
+ *
+ * A container can carry the pixels that later stages still have to process, e.g. those of a
+ * fractal that did not escape yet. The list travels with the container between the nodes of a
+ * process, but not in a sensor_msgs::msg::Image, so stages fall back to every pixel without it.
+ * Likewise, a container can be one tile of a larger frame and carry where it lies in it.
+ */
 class ImageContainer final
 {
 public:
   ImageContainer();
 
-  /// Store an owning pointer to a sensor_msg::msg::Image, and create CUDA memory that references it
+  /// Take ownership of a sensor_msg::msg::Image. Without a stream, the container is placed on the
+  /// default backend. Backends that can adopt host storage take over the pixel data without a
+  /// copy, others only queue the upload on the stream and keep the message until it completed.
   explicit ImageContainer(
-    std::unique_ptr<sensor_msgs::msg::Image> unique_sensor_msgs_image);
+    std::unique_ptr<sensor_msgs::msg::Image> unique_sensor_msgs_image,
+    std::shared_ptr<StreamWrapper> stream = nullptr);
 
-  /// Copy the sensor_msgs::msg::Image into this contain and create CUDA memory that references it.
-  explicit ImageContainer(const sensor_msgs::msg::Image & sensor_msgs_image);
+  /// Copy the sensor_msgs::msg::Image into this container, once. Like the constructor taking
+  /// ownership, it does not wait for an upload, which reads from a host copy of the message.
+  explicit ImageContainer(
+    const sensor_msgs::msg::Image & sensor_msgs_image,
+    std::shared_ptr<StreamWrapper> stream = nullptr);
 
+  /// Share the pixel memory of other, see data().
   ImageContainer(const ImageContainer & other);
 
+  ImageContainer(ImageContainer && other);
+
   ImageContainer(
     std_msgs::msg::Header header, uint32_t height, uint32_t width,
     std::string encoding, uint32_t step,
-    std::shared_ptr<CUDAStreamWrapper> cuda_stream =
-    std::make_shared<CUDAStreamWrapper>());
+    std::shared_ptr<StreamWrapper> stream = nullptr);
+
+  /// Place the image in existing memory of the backend of the stream, e.g. a frame in shared
+  /// memory. Throws std::invalid_argument if the memory is smaller than height * step.
+  ImageContainer(
+    std_msgs::msg::Header header, uint32_t height, uint32_t width,
+    std::string encoding, uint32_t step, std::shared_ptr<MemoryWrapper> memory,
+    std::shared_ptr<StreamWrapper> stream);
 
   ImageContainer & operator=(const ImageContainer & other);
 
+  ImageContainer & operator=(ImageContainer && other);
+
   ~ImageContainer();
 
   /// Const access the ROS Header.
@@ -118,18 +115,146 @@ public:
   std_msgs::msg::Header &
   header();
 
+  /// Copy into the sensor_msgs::msg::Image, blocking until the copy has completed.
   void
   get_sensor_msgs_image(sensor_msgs::msg::Image & destination) const;
 
+  /// Hand the image over as a sensor_msgs::msg::Image, leaving this container without memory.
+  /// Adopted storage that is not shared with other containers is moved back without a copy.
+  std::unique_ptr<sensor_msgs::msg::Image>
+  release_sensor_msgs_image();
+
+  /// Queue the copy into the sensor_msgs::msg::Image on the stream. The pixel data of destination
+  /// must not be accessed or resized before the returned fence is ready.
+  std::shared_ptr<Fence>
+  get_sensor_msgs_image_async(sensor_msgs::msg::Image & destination) const;
+
+  /// Queue a copy of the pixels, packed_step() bytes per row, into host memory of at least
+  /// height() * packed_step() bytes, which must stay valid until the returned fence is ready.
+  std::shared_ptr<Fence>
+  copy_to_host_async(uint8_t * destination) const;
+
+  /// Row step of the image without the gaps between the rows of a view, step() otherwise.
+  uint32_t
+  packed_step() const;
+
+  /// Writable pixel memory of the backend; device memory for CUDA, plain host memory otherwise.
+  /// Clones the memory first if it is shared with another container, see is_shared().
+  /// Transfers may still be in flight, so work on it is queued on stream(), or follows
+  /// stream()->synchronize().
   uint8_t *
-  cuda_mem();
+  data();
+
+  /// Read-only pixel memory, never clones.
+  const uint8_t *
+  data() const;
+
+  /// Read-only pixel memory, for non-const containers that do not need to write.
+  const uint8_t *
+  cdata() const
+  {
+    return data();
+  }
+
+  /// View of the region of width x height pixels starting at column x and row y, which must lie
+  /// within this image. Throws std::invalid_argument otherwise, or for an unknown encoding.
+  ImageContainer
+  view(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const;
+
+  bool
+  is_view() const
+  {
+    return is_view_;
+  }
+
+  /// Column of the first pixel in the image this container is, or was cloned from, a view of, 0
+  /// for other containers.
+  uint32_t
+  origin_x() const
+  {
+    return origin_x_;
+  }
+
+  /// Row of the first pixel in the image this container is, or was cloned from, a view of, 0 for
+  /// other containers.
+  uint32_t
+  origin_y() const
+  {
+    return origin_y_;
+  }
+
+  /// Whether the pixel memory is shared with a copy of this container, or with another process.
+  /// A view is shared with the copies of its parent and with its own copies, but views do not
+  /// count as copies of their parent.
+  bool
+  is_shared() const
+  {
+    return memory_ && ((owners_ && owners_->load() > 1) ||
+           (view_owners_ && view_owners_->load() > 1) || memory_->is_shared());
+  }
+
+  /// Pixels later stages still have to process, empty for all of them. Copies share the list,
+  /// views and conversions to a sensor_msgs::msg::Image drop it.
+  const PixelList &
+  active_pixels() const
+  {
+    return active_pixels_;
+  }
+
+  void
+  set_active_pixels(PixelList active_pixels)
+  {
+    active_pixels_ = std::move(active_pixels);
+  }
+
+  /// Where this image lies in the frame it is a tile of, a count of 0 for a whole frame. Copies
+  /// share the placement, views and conversions to a sensor_msgs::msg::Image drop it.
+  const TilePlacement &
+  tile() const
+  {
+    return tile_;
+  }
+
+  void
+  set_tile(const TilePlacement & tile)
+  {
+    tile_ = tile;
+  }
+
+  /// Identifies the input the pixels were computed from, e.g. a coordinate grid, so that stages
+  /// caching results can tell when it changed. 0 when unknown. Copies and views keep it,
+  /// conversions to a sensor_msgs::msg::Image drop it.
+  uint64_t
+  source_generation() const
+  {
+    return source_generation_;
+  }
+
+  void
+  set_source_generation(uint64_t source_generation)
+  {
+    source_generation_ = source_generation;
+  }
+
+  /// Queue a copy of the pixels of source, of the same width, height and pixel size, into this
+  /// image on stream(), e.g. a tile into a view of its frame. The copy follows the work queued on
+  /// the stream of source so far. Throws std::invalid_argument for images of other sizes, or of
+  /// an unknown encoding.
+  void
+  copy_from(const ImageContainer & source);
 
+  /// Bytes from the first to the last pixel, height * step unless this is a view.
   size_t
   size_in_bytes() const;
 
-  std::shared_ptr<CUDAStreamWrapper> cuda_stream() const
+  std::shared_ptr<StreamWrapper> stream() const
+  {
+    return stream_;
+  }
+
+  BackendType backend_type() const
   {
-    return cuda_stream_;
+    return stream_->backend_type();
   }
 
   uint32_t height() const
@@ -153,18 +278,40 @@ public:
   }
 
 private:
+  // Drop the pixel memory, after recording the work queued on the stream so far as its last use.
+  void
+  release_memory();
+
   std_msgs::msg::Header header_;
 
-  std::shared_ptr<CUDAStreamWrapper> cuda_stream_;
+  std::shared_ptr<StreamWrapper> stream_;
 
-  std::shared_ptr<CUDAMemoryWrapper> cuda_mem_;
+  std::shared_ptr<MemoryWrapper> memory_;
 
-  std::shared_ptr<CUDAEventWrapper> cuda_event_;
+  // Containers sharing memory_ copy-on-write, views of them are not counted.
+  std::shared_ptr<std::atomic<uint32_t>> owners_{std::make_shared<std::atomic<uint32_t>>(1)};
+
+  // Copies of a view sharing its region copy-on-write, null for other containers.
+  std::shared_ptr<std::atomic<uint32_t>> view_owners_;
+
+  // Message an upload to memory_ is still reading from, destroyed once the upload completed.
+  std::shared_ptr<const sensor_msgs::msg::Image> staging_;
 
   uint32_t height_{0};
   uint32_t width_{0};
   std::string encoding_;
   uint32_t step_{0};
+
+  // Where a view starts, in memory_ and in the pixels of the image it was taken from.
+  size_t offset_{0};
+  uint32_t origin_x_{0};
+  uint32_t origin_y_{0};
+  bool is_view_{false};
+
+  PixelList active_pixels_;
+
+  TilePlacement tile_;
+  uint64_t source_generation_{0};
 };
 
 }  // namespace example_type_adapters
@@ -178,6 +325,7 @@ struct rclcpp::TypeAdapter<type_adaptation::example_type_adapters::ImageContaine
   using custom_type = type_adaptation::example_type_adapters::ImageContainer;
   using ros_message_type = sensor_msgs::msg::Image;
 
+  /// The message is consumed as soon as this returns, so it waits for the copy into it.
   static
   void
   convert_to_ros_message(
@@ -187,6 +335,7 @@ struct rclcpp::TypeAdapter<type_adaptation::example_type_adapters::ImageContaine
     source.get_sensor_msgs_image(destination);
   }
 
+  /// Only queues the upload, the container waits for it when its data is used.
   static
   void
   convert_to_custom(
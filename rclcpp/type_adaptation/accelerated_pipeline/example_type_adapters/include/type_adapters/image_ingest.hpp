@@ -0,0 +1,128 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TYPE_ADAPTERS__IMAGE_INGEST_HPP_
+#define TYPE_ADAPTERS__IMAGE_INGEST_HPP_
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "sensor_msgs/msg/image.hpp"
+#include "type_adapters/backend.hpp"
+#include "type_adapters/image_container.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+struct ImageIngestStatistics
+{
+  uint64_t frames{0};  // Frames computed after they were staged
+  std::chrono::nanoseconds transfer_time{0};  // Time the transfer worker spent staging frames
+  std::chrono::nanoseconds compute_time{0};  // Time spent computing staged frames
+  std::chrono::nanoseconds overlapped_time{0};  // Transfer time during which a frame computed
+
+  /// Share of the transfer time hidden behind compute, 1 without any transfer time.
+  double
+  overlap_efficiency() const
+  {
+    return transfer_time.count() == 0 ?
+           1.0 : static_cast<double>(overlapped_time.count()) / transfer_time.count();
+  }
+};
+
+/// Double-buffered conversion of sensor_msgs::msg::Image messages into ImageContainers.
+/**
+ * A transfer worker thread stages each message into a container of the given backend, on one of
+ * two streams taken in turns, while the caller computes the frame staged before on the other.
+ * Backends that adopt host storage stage a message without a copy, others upload it into a
+ * pooled buffer and wait for the upload, so the computing stage finds the frame resident.
+ * Frames come out one message late; flush() computes the last one once no message follows.
+ */
+class ImageIngest final
+{
+public:
+  using Compute = std::function<void (std::unique_ptr<ImageContainer>)>;
+
+  /// Ingest into containers of backend_type, the default backend of the process if not given.
+  explicit ImageIngest(BackendType backend_type = default_backend_type());
+
+  /// Joins the transfer worker, a frame still staged is dropped.
+  ~ImageIngest();
+
+  ImageIngest(const ImageIngest &) = delete;
+  ImageIngest & operator=(const ImageIngest &) = delete;
+
+  /// Hand the message to the transfer worker, then run compute on the frame staged before, if
+  /// any, while the message is staged. Waits for the transfer of the frame before to complete,
+  /// and rethrows what staging it threw.
+  void
+  push(std::unique_ptr<sensor_msgs::msg::Image> message, const Compute & compute);
+
+  /// Run compute on the frame staged last, if any, e.g. once no message followed it in time.
+  void
+  flush(const Compute & compute);
+
+  ImageIngestStatistics
+  statistics() const;
+
+private:
+  // Loop of the transfer worker.
+  void
+  run();
+
+  // Start accounting for the compute of a staged frame, must be called with mutex_ held.
+  void
+  begin_compute_locked();
+
+  // Run compute on a staged frame once begin_compute_locked() was called for it.
+  void
+  run_compute(std::unique_ptr<ImageContainer> image, const Compute & compute);
+
+  // Time spent computing up to now, must be called with mutex_ held.
+  std::chrono::nanoseconds
+  compute_busy_locked(std::chrono::steady_clock::time_point now) const;
+
+  std::array<std::shared_ptr<StreamWrapper>, 2> streams_;
+  size_t next_stream_{0};
+
+  mutable std::mutex mutex_;
+  std::condition_variable condition_;
+  // Message handed to the transfer worker, and the frame it staged from the one before
+  std::unique_ptr<sensor_msgs::msg::Image> pending_;
+  std::unique_ptr<ImageContainer> staged_;
+  std::exception_ptr error_;
+  bool staging_{false};
+  bool stop_{false};
+  // Compute time before the frame being computed, and when that one started
+  std::chrono::nanoseconds compute_busy_{0};
+  std::chrono::steady_clock::time_point compute_since_{};
+  bool computing_{false};
+  ImageIngestStatistics statistics_{};
+
+  std::thread worker_;
+};
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
+
+#endif  // TYPE_ADAPTERS__IMAGE_INGEST_HPP_
@@ -0,0 +1,81 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef TYPE_ADAPTERS__IN_FLIGHT_WINDOW_HPP_
+#define TYPE_ADAPTERS__IN_FLIGHT_WINDOW_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+/// Bounds the number of items, e.g. the tiles of a frame, on their way down a pipeline.
+/**
+ * The producer takes a token for each item it sends and waits while the window is full. The item
+ * leaves the window once the token and all its copies are destroyed, on whichever thread that is,
+ * e.g. when the last stage is done with the item or a queue drops it. Tokens may outlive the
+ * window.
+ */
+class InFlightWindow final
+{
+public:
+  /// Window of size items, at least one.
+  explicit InFlightWindow(size_t size);
+
+  /// Closes the window.
+  ~InFlightWindow();
+
+  InFlightWindow(const InFlightWindow &) = delete;
+  InFlightWindow & operator=(const InFlightWindow &) = delete;
+
+  /// Wait for room in the window and take a token for an item. Returns null once the window is
+  /// closed.
+  std::shared_ptr<void>
+  acquire();
+
+  /// Wake up the producer waiting in acquire() and have every later call return null.
+  void
+  close();
+
+  /// Items whose tokens are still alive.
+  size_t
+  in_flight() const;
+
+  size_t
+  size() const;
+
+private:
+  // Shared with the tokens, which may be destroyed after the window.
+  struct State
+  {
+    std::mutex mutex;
+    std::condition_variable condition;
+    size_t in_flight{0};
+    bool closed{false};
+  };
+
+  const size_t size_;
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
+
+#endif  // TYPE_ADAPTERS__IN_FLIGHT_WINDOW_HPP_
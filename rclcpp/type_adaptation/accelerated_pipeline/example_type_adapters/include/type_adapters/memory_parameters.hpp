@@ -0,0 +1,43 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef TYPE_ADAPTERS__MEMORY_PARAMETERS_HPP_
+#define TYPE_ADAPTERS__MEMORY_PARAMETERS_HPP_
+
+#include "rclcpp/rclcpp.hpp"
+#include "type_adapters/backend.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+/// Declare the memory_backend and buffer_pool_max_bytes parameters of the node and return the
+/// backend it allocates its own frames on, the default backend unless memory_backend is set.
+/**
+ * Type adapter conversions have no node to ask, so they use the default backend of the process,
+ * which the first node setting memory_backend chooses. Likewise, the buffer pool of a backend is
+ * shared by the process and the first node setting buffer_pool_max_bytes sizes it. A node that
+ * sets another value than the one already chosen keeps its own backend, but is warned that the
+ * process-wide setting stays as it is. Throws std::invalid_argument for an unknown or unbuilt
+ * backend.
+ */
+BackendType
+declare_memory_backend(rclcpp::Node & node);
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
+
+#endif  // TYPE_ADAPTERS__MEMORY_PARAMETERS_HPP_
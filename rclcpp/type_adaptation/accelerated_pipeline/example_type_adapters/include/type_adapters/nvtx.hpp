@@ -0,0 +1,26 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TYPE_ADAPTERS__NVTX_HPP_
+#define TYPE_ADAPTERS__NVTX_HPP_
+
+// NVTX ranges are only available with the CUDA toolkit; without USE_NVTX they compile to nothing.
+#ifdef USE_NVTX
+#include <nvToolsExt.h>  // NOLINT
+#else
+inline int nvtxRangePushA(const char *) {return 0;}
+inline int nvtxRangePop() {return 0;}
+#endif
+
+#endif  // TYPE_ADAPTERS__NVTX_HPP_
@@ -0,0 +1,191 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef TYPE_ADAPTERS__PIPELINE_LINK_HPP_
+#define TYPE_ADAPTERS__PIPELINE_LINK_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "rclcpp/rclcpp.hpp"
+#include "type_adapters/image_container.hpp"
+#include "type_adapters/spsc_ring.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+struct PipelineLinkOptions
+{
+  /// Frames on their way to the next stage before further ones are dropped, rounded up to a
+  /// power of two. The end that creates the link sets it.
+  size_t capacity{4};
+  /// CPU the thread of the next stage is pinned to, -1 to leave it to the scheduler.
+  int cpu{-1};
+  /// Whether the next stage runs on a thread of its own. Otherwise the previous stage calls it
+  /// directly when it publishes, so a chain of such links runs its stages in order on one thread.
+  bool thread{true};
+};
+
+/// Declare the link_capacity, link_cpu and link_thread parameters of the node and take the options
+/// from them, with room for at least min_capacity frames.
+PipelineLinkOptions
+declare_pipeline_link_options(rclcpp::Node & node, size_t min_capacity);
+
+/// Hands ImageContainers from one stage to the next within a process, without a topic.
+/**
+ * Links are found by name, so the two stages only need to agree on it, like on a topic. Frames
+ * pass through an SpscRing and a thread of the consuming stage calls it back for each frame in
+ * order. It spins shortly when the ring runs empty, then parks until the producer pushes again,
+ * so a frame pushed to a busy stage is taken without any system call. Instead of a thread, the
+ * consumer may have the producer call it directly, without a queue in between. There is one
+ * producer and one consumer per link.
+ */
+class PipelineLink final
+{
+public:
+  using Callback = std::function<void (std::unique_ptr<ImageContainer>)>;
+
+  /// Link of the process named name, created with the given capacity if it does not exist.
+  static std::shared_ptr<PipelineLink>
+  get(const std::string & name, size_t capacity);
+
+  explicit PipelineLink(size_t capacity);
+
+  /// Stops the consumer thread, frames still in the ring are dropped.
+  ~PipelineLink();
+
+  PipelineLink(const PipelineLink &) = delete;
+  PipelineLink & operator=(const PipelineLink &) = delete;
+
+  /// Claim the producer side. Throws std::logic_error if another producer holds it.
+  void
+  attach_producer();
+
+  void
+  detach_producer();
+
+  /// Pass the image on to the consumer. Returns false if it was dropped because the ring is full.
+  bool
+  push(std::unique_ptr<ImageContainer> image);
+
+  /// Start the consumer thread, which calls callback on each frame, pinned to cpu unless it is
+  /// negative. Returns false if the thread could not be pinned, it runs anyway. Throws
+  /// std::logic_error if the link already has a consumer.
+  bool
+  start(Callback callback, int cpu);
+
+  /// Have push call callback directly on the thread of the producer, after any frames that were
+  /// pushed before. Throws std::logic_error if the link already has a consumer.
+  void
+  connect(Callback callback);
+
+  /// Stop and join the consumer thread, or disconnect the consumer called directly, after the
+  /// frame it is calling back for.
+  void
+  stop();
+
+  /// Frames dropped because the ring was full.
+  uint64_t
+  dropped() const;
+
+  size_t
+  capacity() const;
+
+private:
+  // Loop of the consumer thread.
+  void
+  run(Callback callback);
+
+  SpscRing<ImageContainer> ring_;
+  std::atomic<bool> producer_attached_{false};
+  std::atomic<uint64_t> dropped_{0};
+
+  // Parking of the consumer thread once the ring ran empty
+  std::atomic<bool> parked_{false};
+  std::atomic<bool> stop_{false};
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::thread consumer_;
+
+  // Consumer called on the thread of the producer, guarded by direct_mutex_ so that stop() waits
+  // for the call in flight.
+  std::atomic<bool> direct_{false};
+  std::mutex direct_mutex_;
+  Callback direct_callback_;
+};
+
+/// Publishes ImageContainers on a PipelineLink, to a PipelineLinkSubscription in the same process.
+class PipelineLinkPublisher final
+{
+public:
+  /// Throws std::logic_error if the link already has a publisher.
+  PipelineLinkPublisher(
+    rclcpp::Node & node, const std::string & link,
+    const PipelineLinkOptions & options = PipelineLinkOptions());
+
+  ~PipelineLinkPublisher();
+
+  PipelineLinkPublisher(const PipelineLinkPublisher &) = delete;
+  PipelineLinkPublisher & operator=(const PipelineLinkPublisher &) = delete;
+
+  /// Returns false if the frame was dropped because the next stage did not keep up.
+  bool
+  publish(std::unique_ptr<ImageContainer> image);
+
+private:
+  rclcpp::Logger logger_;
+  rclcpp::Clock::SharedPtr clock_;
+  std::shared_ptr<PipelineLink> link_;
+};
+
+/// Receives ImageContainers from a PipelineLinkPublisher in the same process.
+/**
+ * The callback runs on a thread of this subscription rather than on the executor, or within
+ * publish() when the options ask for no thread, from the construction of the subscription on, so
+ * nodes create it once they are set up. Destroying the subscription waits for the callback to
+ * return.
+ */
+class PipelineLinkSubscription final
+{
+public:
+  using Callback = PipelineLink::Callback;
+
+  /// Throws std::logic_error if the link already has a subscription.
+  PipelineLinkSubscription(
+    rclcpp::Node & node, const std::string & link, Callback callback,
+    const PipelineLinkOptions & options = PipelineLinkOptions());
+
+  ~PipelineLinkSubscription();
+
+  PipelineLinkSubscription(const PipelineLinkSubscription &) = delete;
+  PipelineLinkSubscription & operator=(const PipelineLinkSubscription &) = delete;
+
+private:
+  std::shared_ptr<PipelineLink> link_;
+};
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
+
+#endif  // TYPE_ADAPTERS__PIPELINE_LINK_HPP_
@@ -0,0 +1,81 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TYPE_ADAPTERS__PIXEL_LIST_HPP_
+#define TYPE_ADAPTERS__PIXEL_LIST_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "type_adapters/backend.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+/// Indices of some of the pixels of an image, row * width + column, e.g. the pixels that later
+/// stages of a pipeline still have to process.
+/**
+ * The memory of the list, on the backend of the image, holds the count followed by up to
+ * capacity() indices, so that kernels can produce a list without a round trip to the host. Lists
+ * are not modified once they were handed on: a stage reads one and produces the next.
+ */
+class PixelList final
+{
+public:
+  PixelList() = default;
+
+  /// List with room for capacity indices in memory of the backend. The count is not initialized,
+  /// the kernel filling in the list sets it.
+  PixelList(Backend & backend, uint32_t capacity)
+  : memory_(backend.allocate((static_cast<size_t>(capacity) + 1) * sizeof(uint32_t))),
+    capacity_(capacity)
+  {
+  }
+
+  explicit operator bool() const
+  {
+    return memory_ != nullptr;
+  }
+
+  /// The count followed by the indices; device memory for CUDA, plain host memory otherwise.
+  uint32_t *
+  data()
+  {
+    return reinterpret_cast<uint32_t *>(memory_->device_memory());
+  }
+
+  const uint32_t *
+  data() const
+  {
+    return reinterpret_cast<const uint32_t *>(memory_->device_memory());
+  }
+
+  uint32_t capacity() const
+  {
+    return capacity_;
+  }
+
+private:
+  std::shared_ptr<MemoryWrapper> memory_;
+  uint32_t capacity_{0};
+};
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
+
+#endif  // TYPE_ADAPTERS__PIXEL_LIST_HPP_
@@ -0,0 +1,131 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TYPE_ADAPTERS__SHARED_IMAGE_TRANSPORT_HPP_
+#define TYPE_ADAPTERS__SHARED_IMAGE_TRANSPORT_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "example_type_adapters_msgs/msg/shared_image_handle.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "std_msgs/msg/header.hpp"
+
+#include "type_adapters/backend.hpp"
+#include "type_adapters/image_container.hpp"
+#include "type_adapters/shared_memory.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+struct SharedImagePublisherOptions
+{
+  /// Frames that can be in flight at once.
+  size_t slot_count{4};
+  /// How long consumers may keep a frame, see SharedFrameSegment.
+  std::chrono::nanoseconds lease{std::chrono::seconds(1)};
+};
+
+/// Publishes ImageContainers to other processes on the same host through shared memory.
+/**
+ * Frames are placed in a SharedFrameSegment of this publisher and only a
+ * example_type_adapters_msgs::msg::SharedImageHandle is published, so the cost of a frame does
+ * not depend on its size once it is in shared memory. Frames obtained from loan() are already
+ * there, others are copied in once. Subscriptions must not use transient local durability,
+ * since only the subscriptions counted at publish time hold a reference.
+ */
+class SharedImagePublisher final
+{
+public:
+  SharedImagePublisher(
+    rclcpp::Node & node, const std::string & topic, const rclcpp::QoS & qos,
+    const SharedImagePublisherOptions & options = SharedImagePublisherOptions());
+
+  /// Host image in a free slot, which publish() passes on without a copy. Ordinary host memory
+  /// if no slot is free.
+  ImageContainer
+  loan(
+    std_msgs::msg::Header header, uint32_t height, uint32_t width,
+    const std::string & encoding, uint32_t step);
+
+  /// Wait for the work queued on the stream of the image and publish it. Returns false if the
+  /// frame was dropped because no slot was free.
+  bool
+  publish(std::unique_ptr<ImageContainer> image);
+
+  size_t
+  get_subscription_count() const;
+
+private:
+  // Segment with slots of at least bytes, replacing the current one if its slots are smaller.
+  std::shared_ptr<SharedFrameSegment>
+  segment_for(size_t bytes);
+
+  rclcpp::Logger logger_;
+  rclcpp::Clock::SharedPtr clock_;
+  rclcpp::Publisher<example_type_adapters_msgs::msg::SharedImageHandle>::SharedPtr publisher_;
+  SharedImagePublisherOptions options_;
+
+  std::mutex mutex_;
+  std::shared_ptr<SharedFrameSegment> segment_;
+};
+
+/// Receives ImageContainers from a SharedImagePublisher in another process.
+/**
+ * On the host backend, the container uses the frame in shared memory without a copy and drops
+ * its reference once destroyed; writing to it clones the frame if other consumers still use it.
+ * Other backends get a copy of the frame, and release it right away.
+ */
+class SharedImageSubscription final
+{
+public:
+  using Callback = std::function<void (std::unique_ptr<ImageContainer>)>;
+
+  /// Subscription handing frames on to callback in containers of backend_type, the default
+  /// backend of the process if not given.
+  SharedImageSubscription(
+    rclcpp::Node & node, const std::string & topic, const rclcpp::QoS & qos, Callback callback,
+    BackendType backend_type = default_backend_type());
+
+private:
+  void
+  on_handle(example_type_adapters_msgs::msg::SharedImageHandle::UniquePtr handle);
+
+  // Mapping of a segment of the publisher, kept for the frames that follow.
+  std::shared_ptr<SharedFrameSegment>
+  segment(const std::string & name);
+
+  Callback callback_;
+  const BackendType backend_type_;
+  rclcpp::Logger logger_;
+  rclcpp::Clock::SharedPtr clock_;
+  rclcpp::Subscription<example_type_adapters_msgs::msg::SharedImageHandle>::SharedPtr
+    subscription_;
+
+  std::mutex mutex_;
+  std::map<std::string, std::shared_ptr<SharedFrameSegment>> segments_;
+};
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
+
+#endif  // TYPE_ADAPTERS__SHARED_IMAGE_TRANSPORT_HPP_
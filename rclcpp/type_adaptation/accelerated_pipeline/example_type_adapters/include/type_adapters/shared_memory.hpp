@@ -0,0 +1,149 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TYPE_ADAPTERS__SHARED_MEMORY_HPP_
+#define TYPE_ADAPTERS__SHARED_MEMORY_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "type_adapters/backend.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+/// POSIX shared memory segment of fixed-size frame slots, mapped by the process that created it
+/// and by the processes it passes frames to.
+/**
+ * Every slot has a generation and references, kept in one atomic word of the segment so that any
+ * process can update them. A slot is free when it holds no references. Taking a slot starts a new
+ * generation, so that handles to the frame it held before no longer match, and references are
+ * only claimed and dropped for the generation they were taken on.
+ *
+ * Publishing adds a pending reference for each consumer, which the consumer claims when it
+ * receives the handle. Pending references of consumers that never receive a frame, e.g. because
+ * the middleware dropped it, would keep the slot forever, so the creator reclaims published slots
+ * whose lease expired and that nobody claimed when no slot is free. Claimed frames are never
+ * reclaimed, consumers that keep them make the publisher drop frames instead.
+ */
+class SharedFrameSegment final : public std::enable_shared_from_this<SharedFrameSegment>
+{
+public:
+  /// Create a segment with a unique name, which is unlinked again when it is destroyed.
+  /// Throws std::runtime_error if it cannot be created.
+  static std::shared_ptr<SharedFrameSegment>
+  create(size_t slot_count, size_t slot_bytes);
+
+  /// Map the segment of another process, throws std::runtime_error if it does not exist or is
+  /// not a frame segment.
+  static std::shared_ptr<SharedFrameSegment>
+  attach(const std::string & name);
+
+  ~SharedFrameSegment();
+
+  SharedFrameSegment(const SharedFrameSegment &) = delete;
+  SharedFrameSegment & operator=(const SharedFrameSegment &) = delete;
+
+  /// Take a free slot, or else the unclaimed published slot whose lease expired first, holding one
+  /// claimed reference on a new generation. Returns false if every slot is in use. Only called by
+  /// the creator.
+  bool
+  acquire(std::chrono::nanoseconds lease, uint32_t & slot, uint64_t & generation);
+
+  /// Add a pending reference for each consumer of the frame and start the lease of the slot.
+  /// Returns false if the generation is gone. Only called by the creator.
+  bool
+  publish(uint32_t slot, uint64_t generation, uint32_t consumers);
+
+  /// Turn a pending reference on the generation into a claimed one, which keeps the slot from
+  /// being reclaimed. Returns false if the slot has moved on, e.g. because the lease expired
+  /// before the handle was received.
+  bool
+  claim(uint32_t slot, uint64_t generation);
+
+  /// Drop one claimed reference, unless the slot has moved on to another generation.
+  void
+  release(uint32_t slot, uint64_t generation);
+
+  /// Pending and claimed references held on the generation, 0 once the slot has moved on.
+  uint32_t
+  references(uint32_t slot, uint64_t generation) const;
+
+  /// Generation of the slot.
+  uint64_t
+  generation(uint32_t slot) const;
+
+  /// Host memory of a slot, which takes over one claimed reference on the generation and drops it
+  /// once the memory is destroyed.
+  std::shared_ptr<MemoryWrapper>
+  wrap(uint32_t slot, uint64_t generation);
+
+  /// Find the slot that starts at data, returns false if data is not the start of a slot.
+  bool
+  find_slot(const uint8_t * data, uint32_t & slot) const;
+
+  uint8_t *
+  slot_data(uint32_t slot);
+
+  /// Bytes from the start of the segment to a slot.
+  size_t
+  slot_offset(uint32_t slot) const;
+
+  const std::string &
+  name() const
+  {
+    return name_;
+  }
+
+  uint32_t
+  slot_count() const
+  {
+    return slot_count_;
+  }
+
+  size_t
+  slot_bytes() const
+  {
+    return slot_bytes_;
+  }
+
+private:
+  struct SlotHeader;
+
+  SharedFrameSegment(
+    std::string name, uint8_t * mapping, size_t mapping_bytes, bool is_owner);
+
+  SlotHeader &
+  slot_header(uint32_t slot) const;
+
+  std::string name_;
+  uint8_t * mapping_{nullptr};
+  size_t mapping_bytes_{0};
+  // The creator unlinks the segment, the mappings of other processes stay valid until unmapped.
+  bool is_owner_{false};
+
+  uint32_t slot_count_{0};
+  size_t slot_bytes_{0};
+  size_t data_offset_{0};
+};
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
+
+#endif  // TYPE_ADAPTERS__SHARED_MEMORY_HPP_
@@ -0,0 +1,126 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef TYPE_ADAPTERS__SPSC_RING_HPP_
+#define TYPE_ADAPTERS__SPSC_RING_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+/// Bounded lock-free ring of std::unique_ptr<T> between one producer and one consumer thread.
+/**
+ * push() is only called by the producer and pop() only by the consumer. Each side reads the
+ * index of the other with acquire and publishes its own with release, and keeps a copy of the
+ * other index so that it only touches the cache line of the other side when the ring looks full
+ * or empty.
+ */
+template<typename T>
+class SpscRing final
+{
+public:
+  /// Capacity is rounded up to a power of two.
+  explicit SpscRing(size_t capacity)
+  : slots_(round_up_to_power_of_two(capacity)), mask_(slots_.size() - 1)
+  {
+  }
+
+  SpscRing(const SpscRing &) = delete;
+  SpscRing & operator=(const SpscRing &) = delete;
+
+  /// Move item into the ring. Returns false and leaves item untouched if the ring is full.
+  bool
+  push(std::unique_ptr<T> & item)
+  {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - producer_head_ > mask_) {
+      producer_head_ = head_.load(std::memory_order_acquire);
+      if (tail - producer_head_ > mask_) {
+        return false;
+      }
+    }
+    slots_[tail & mask_] = std::move(item);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Oldest item of the ring, nullptr if it is empty.
+  std::unique_ptr<T>
+  pop()
+  {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == consumer_tail_) {
+      consumer_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == consumer_tail_) {
+        return nullptr;
+      }
+    }
+    std::unique_ptr<T> item = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return item;
+  }
+
+  /// Whether the ring holds no item, exact only on the consumer thread.
+  bool
+  empty() const
+  {
+    return head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_acquire);
+  }
+
+  size_t
+  capacity() const
+  {
+    return slots_.size();
+  }
+
+private:
+  static size_t
+  round_up_to_power_of_two(size_t capacity)
+  {
+    if (capacity == 0) {
+      throw std::invalid_argument("A ring needs a capacity of at least one");
+    }
+    size_t rounded = 1;
+    while (rounded < capacity) {
+      rounded <<= 1;
+    }
+    return rounded;
+  }
+
+  // Keeps the indices of the two sides apart, on cache lines of their own.
+  static constexpr size_t kCacheLine = 64;
+
+  std::vector<std::unique_ptr<T>> slots_;
+  const size_t mask_;
+  // Next slot to pop, written by the consumer, and its copy of tail_
+  alignas(kCacheLine) std::atomic<size_t> head_{0};
+  size_t consumer_tail_{0};
+  // Next slot to push, written by the producer, and its copy of head_
+  alignas(kCacheLine) std::atomic<size_t> tail_{0};
+  size_t producer_head_{0};
+};
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
+
+#endif  // TYPE_ADAPTERS__SPSC_RING_HPP_
@@ -0,0 +1,268 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TYPE_ADAPTERS__TYPED_IMAGE_HPP_
+#define TYPE_ADAPTERS__TYPED_IMAGE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "std_msgs/msg/header.hpp"
+
+#include "type_adapters/backend.hpp"
+#include "type_adapters/image_container.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+/// ROS encoding of pixels of Channels values of type PixelT. Only the specializations below are
+/// defined, so an unsupported format fails to compile.
+template<typename PixelT, size_t Channels>
+struct PixelFormat;
+
+template<>
+struct PixelFormat<uint8_t, 1>
+{
+  static constexpr const char * kEncoding = "mono8";
+};
+
+template<>
+struct PixelFormat<uint8_t, 3>
+{
+  static constexpr const char * kEncoding = "rgb8";
+};
+
+template<>
+struct PixelFormat<uint8_t, 4>
+{
+  static constexpr const char * kEncoding = "rgba8";
+};
+
+template<>
+struct PixelFormat<uint16_t, 1>
+{
+  static constexpr const char * kEncoding = "mono16";
+};
+
+template<>
+struct PixelFormat<uint16_t, 3>
+{
+  static constexpr const char * kEncoding = "rgb16";
+};
+
+template<>
+struct PixelFormat<uint16_t, 4>
+{
+  static constexpr const char * kEncoding = "rgba16";
+};
+
+template<>
+struct PixelFormat<float, 1>
+{
+  static constexpr const char * kEncoding = "32FC1";
+};
+
+template<>
+struct PixelFormat<float, 2>
+{
+  static constexpr const char * kEncoding = "32FC2";
+};
+
+template<>
+struct PixelFormat<float, 3>
+{
+  static constexpr const char * kEncoding = "32FC3";
+};
+
+template<>
+struct PixelFormat<float, 4>
+{
+  static constexpr const char * kEncoding = "32FC4";
+};
+
+/// ImageContainer whose pixels are Channels values of type PixelT.
+/**
+ * The encoding follows from the type, so kernels can be written against PixelT and Channels and
+ * never look at the encoding string. The encoding of a container is checked once, when it is
+ * wrapped; views and copies keep the type. Rows are step() bytes apart, which for a view is the
+ * step of its parent.
+ */
+template<typename PixelT, size_t Channels>
+class TypedImage final
+{
+public:
+  using Format = PixelFormat<PixelT, Channels>;
+  using Pixel = PixelT;
+
+  static constexpr size_t kChannels = Channels;
+  static constexpr size_t kPixelBytes = Channels * sizeof(PixelT);
+
+  TypedImage() = default;
+
+  /// Packed image on the backend of the stream, or on the default backend without one.
+  TypedImage(
+    std_msgs::msg::Header header, uint32_t height, uint32_t width,
+    std::shared_ptr<StreamWrapper> stream = nullptr)
+  : container_(
+      std::move(header), height, width, Format::kEncoding,
+      static_cast<uint32_t>(width * kPixelBytes), std::move(stream))
+  {
+  }
+
+  /// Take over a container, throws std::invalid_argument if its encoding is not that of the
+  /// format, or if its rows cannot hold width() pixels of aligned PixelT values.
+  explicit TypedImage(ImageContainer container)
+  : container_(std::move(container))
+  {
+    if (container_.encoding() != Format::kEncoding) {
+      throw std::invalid_argument(
+              "Expected an image with encoding " + std::string(Format::kEncoding) + ", got " +
+              container_.encoding());
+    }
+    if (container_.step() % sizeof(PixelT) != 0 ||
+      container_.step() < container_.width() * kPixelBytes)
+    {
+      throw std::invalid_argument(
+              "Row step " + std::to_string(container_.step()) + " does not fit " +
+              std::to_string(container_.width()) + " pixels of encoding " + Format::kEncoding);
+    }
+  }
+
+  /// Writable pixels, see ImageContainer::data().
+  PixelT *
+  data()
+  {
+    return reinterpret_cast<PixelT *>(container_.data());
+  }
+
+  const PixelT *
+  data() const
+  {
+    return reinterpret_cast<const PixelT *>(container_.data());
+  }
+
+  const PixelT *
+  cdata() const
+  {
+    return data();
+  }
+
+  /// First value of row y, in the memory of data() and cloning like it.
+  PixelT *
+  row(uint32_t y)
+  {
+    return reinterpret_cast<PixelT *>(container_.data() + static_cast<size_t>(y) * step());
+  }
+
+  const PixelT *
+  row(uint32_t y) const
+  {
+    return reinterpret_cast<const PixelT *>(container_.data() + static_cast<size_t>(y) * step());
+  }
+
+  /// See ImageContainer::view().
+  TypedImage
+  view(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const
+  {
+    return TypedImage(container_.view(x, y, width, height), Checked{});
+  }
+
+  /// Hand the container over, e.g. to publish it, leaving this image empty.
+  std::unique_ptr<ImageContainer>
+  release_container()
+  {
+    return std::make_unique<ImageContainer>(std::move(container_));
+  }
+
+  const ImageContainer &
+  container() const
+  {
+    return container_;
+  }
+
+  ImageContainer &
+  container()
+  {
+    return container_;
+  }
+
+  const std_msgs::msg::Header &
+  header() const
+  {
+    return container_.header();
+  }
+
+  std_msgs::msg::Header &
+  header()
+  {
+    return container_.header();
+  }
+
+  std::shared_ptr<StreamWrapper> stream() const
+  {
+    return container_.stream();
+  }
+
+  uint32_t height() const
+  {
+    return container_.height();
+  }
+
+  uint32_t width() const
+  {
+    return container_.width();
+  }
+
+  uint32_t step() const
+  {
+    return container_.step();
+  }
+
+  uint32_t origin_x() const
+  {
+    return container_.origin_x();
+  }
+
+  uint32_t origin_y() const
+  {
+    return container_.origin_y();
+  }
+
+  bool is_view() const
+  {
+    return container_.is_view();
+  }
+
+private:
+  struct Checked {};
+
+  // Wrap a container known to have the format, e.g. a view of this image.
+  TypedImage(ImageContainer container, Checked)
+  : container_(std::move(container))
+  {
+  }
+
+  ImageContainer container_;
+};
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
+
+#endif  // TYPE_ADAPTERS__TYPED_IMAGE_HPP_
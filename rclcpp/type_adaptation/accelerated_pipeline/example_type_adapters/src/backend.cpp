@@ -0,0 +1,122 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "type_adapters/backend.hpp"
+#include "type_adapters/host_backend.hpp"
+#ifdef TYPE_ADAPTERS_USE_CUDA
+#include "type_adapters/cuda_backend.hpp"
+#endif
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+namespace
+{
+#ifdef TYPE_ADAPTERS_USE_CUDA
+std::atomic<BackendType> g_default_backend_type{BackendType::kCuda};
+#else
+std::atomic<BackendType> g_default_backend_type{BackendType::kHost};
+#endif
+}  // namespace
+
+Backend::Backend()
+: buffer_pool_(
+    BufferPool::make(
+      [this](size_t bytes_to_allocate) {
+        return allocate_memory(bytes_to_allocate);
+      }))
+{
+}
+
+std::shared_ptr<MemoryWrapper>
+Backend::allocate(size_t bytes_to_allocate)
+{
+  return buffer_pool_->acquire(bytes_to_allocate);
+}
+
+std::shared_ptr<MemoryWrapper>
+Backend::adopt(std::vector<uint8_t> &&)
+{
+  throw std::logic_error("Backend " + to_string(type()) + " cannot adopt host storage");
+}
+
+std::shared_ptr<Backend>
+get_backend(BackendType type)
+{
+  switch (type) {
+    case BackendType::kHost:
+      {
+        static auto host_backend = std::make_shared<HostBackend>();
+        return host_backend;
+      }
+    case BackendType::kCuda:
+      {
+#ifdef TYPE_ADAPTERS_USE_CUDA
+        static auto cuda_backend = std::make_shared<CUDABackend>();
+        return cuda_backend;
+#else
+        throw std::invalid_argument("example_type_adapters was built without the CUDA backend");
+#endif
+      }
+  }
+  throw std::invalid_argument("Unknown backend type");
+}
+
+BackendType
+default_backend_type()
+{
+  return g_default_backend_type.load();
+}
+
+void
+set_default_backend_type(BackendType type)
+{
+  // Fail early rather than on the first allocation.
+  get_backend(type);
+  g_default_backend_type.store(type);
+}
+
+BackendType
+backend_type_from_string(const std::string & name)
+{
+  if (name == "host") {
+    return BackendType::kHost;
+  }
+  if (name == "cuda") {
+    return BackendType::kCuda;
+  }
+  throw std::invalid_argument("Unknown memory backend '" + name + "', expected host or cuda");
+}
+
+std::string
+to_string(BackendType type)
+{
+  switch (type) {
+    case BackendType::kHost:
+      return "host";
+    case BackendType::kCuda:
+      return "cuda";
+  }
+  return "unknown";
+}
+
+}  //  namespace example_type_adapters
+}  //  namespace type_adaptation
@@ -0,0 +1,195 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "type_adapters/backend.hpp"
+#include "type_adapters/buffer_pool.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+namespace
+{
+// Requests are rounded up to whole pages, so that nearly equal sizes share a bucket.
+const size_t kBucketGranularity = 4096;
+}  // namespace
+
+std::shared_ptr<BufferPool>
+BufferPool::make(Allocator allocator, size_t high_water_mark)
+{
+  return std::shared_ptr<BufferPool>(new BufferPool(std::move(allocator), high_water_mark));
+}
+
+BufferPool::BufferPool(Allocator allocator, size_t high_water_mark)
+: allocator_(std::move(allocator)), high_water_mark_(high_water_mark)
+{
+}
+
+BufferPool::~BufferPool()
+{
+  clear();
+}
+
+size_t
+BufferPool::bucket_size(size_t bytes_to_allocate)
+{
+  const size_t pages = (std::max<size_t>(bytes_to_allocate, 1) + kBucketGranularity - 1) /
+    kBucketGranularity;
+  return pages * kBucketGranularity;
+}
+
+std::shared_ptr<MemoryWrapper>
+BufferPool::acquire(size_t bytes_to_allocate)
+{
+  const size_t size = bucket_size(bytes_to_allocate);
+  std::unique_ptr<MemoryWrapper> memory;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto bucket = buckets_.find(size);
+    if (bucket != buckets_.end() && !bucket->second.empty()) {
+      auto idle_it = bucket->second.back();
+      bucket->second.pop_back();
+      memory = std::move(*idle_it);
+      idle_.erase(idle_it);
+      statistics_.cached_bytes -= size;
+      ++statistics_.hits;
+    } else {
+      ++statistics_.misses;
+    }
+  }
+  if (!memory) {
+    memory = allocator_(size);
+  }
+
+  // The buffer outlives the pool if it is still in use when the pool goes away.
+  std::weak_ptr<BufferPool> weak_pool = weak_from_this();
+  return std::shared_ptr<MemoryWrapper>(
+    memory.release(), [weak_pool](MemoryWrapper * released) {
+      if (auto pool = weak_pool.lock()) {
+        pool->release(released);
+      } else {
+        delete released;
+      }
+    });
+}
+
+size_t
+BufferPool::reserve(size_t bytes_to_allocate, size_t count)
+{
+  const size_t size = bucket_size(bytes_to_allocate);
+  size_t missing = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto bucket = buckets_.find(size);
+    const size_t idle = bucket == buckets_.end() ? 0 : bucket->second.size();
+    const size_t room = (high_water_mark_ - std::min(statistics_.cached_bytes, high_water_mark_)) /
+      size;
+    missing = std::min(count - std::min(idle, count), room);
+  }
+
+  // Allocated without the lock, like on a miss, and kept like released buffers.
+  std::list<std::unique_ptr<MemoryWrapper>> reserved;
+  for (size_t index = 0; index < missing; ++index) {
+    reserved.push_back(allocator_(size));
+  }
+  std::list<std::unique_ptr<MemoryWrapper>> evicted;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto & memory : reserved) {
+    evict_locked(high_water_mark_ - std::min(size, high_water_mark_), evicted);
+    idle_.push_back(std::move(memory));
+    buckets_[size].push_back(std::prev(idle_.end()));
+    statistics_.cached_bytes += size;
+  }
+  return missing;
+}
+
+void
+BufferPool::release(MemoryWrapper * memory)
+{
+  std::unique_ptr<MemoryWrapper> owned(memory);
+  // The next owner must not see transfers or kernels of the previous one land.
+  owned->synchronize();
+  const size_t size = owned->size_in_bytes();
+  // Freed after the lock is released.
+  std::list<std::unique_ptr<MemoryWrapper>> evicted;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (size > high_water_mark_) {
+    ++statistics_.evictions;
+    evicted.push_back(std::move(owned));
+    return;
+  }
+  evict_locked(high_water_mark_ - size, evicted);
+  idle_.push_back(std::move(owned));
+  buckets_[size].push_back(std::prev(idle_.end()));
+  statistics_.cached_bytes += size;
+}
+
+void
+BufferPool::evict_locked(
+  size_t bytes_to_keep, std::list<std::unique_ptr<MemoryWrapper>> & evicted)
+{
+  while (statistics_.cached_bytes > bytes_to_keep && !idle_.empty()) {
+    auto oldest = idle_.begin();
+    const size_t size = (*oldest)->size_in_bytes();
+    auto & bucket = buckets_[size];
+    bucket.erase(std::find(bucket.begin(), bucket.end(), oldest));
+    evicted.splice(evicted.end(), idle_, oldest);
+    statistics_.cached_bytes -= size;
+    ++statistics_.evictions;
+  }
+}
+
+void
+BufferPool::set_high_water_mark(size_t bytes)
+{
+  std::list<std::unique_ptr<MemoryWrapper>> evicted;
+  std::lock_guard<std::mutex> lock(mutex_);
+  high_water_mark_ = bytes;
+  evict_locked(high_water_mark_, evicted);
+}
+
+size_t
+BufferPool::high_water_mark() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return high_water_mark_;
+}
+
+BufferPoolStatistics
+BufferPool::statistics() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  BufferPoolStatistics statistics = statistics_;
+  statistics.high_water_mark = high_water_mark_;
+  return statistics;
+}
+
+void
+BufferPool::clear()
+{
+  std::list<std::unique_ptr<MemoryWrapper>> evicted;
+  std::lock_guard<std::mutex> lock(mutex_);
+  buckets_.clear();
+  evicted.swap(idle_);
+  statistics_.cached_bytes = 0;
+}
+
+}  //  namespace example_type_adapters
+}  //  namespace type_adaptation
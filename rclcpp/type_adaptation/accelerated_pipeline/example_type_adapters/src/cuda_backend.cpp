@@ -0,0 +1,242 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+// Copyright 2021 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory>
+#include <stdexcept>
+
+#include "type_adapters/cuda_backend.hpp"
+#include "type_adapters/nvtx.hpp"
+
+#include "cuda.h"  // NOLINT
+#include "cuda_runtime.h"  // NOLINT
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+CUDAEventWrapper::CUDAEventWrapper()
+{
+  cudaEventCreate(&event_);
+}
+
+void CUDAEventWrapper::record(const cudaStream_t & stream)
+{
+  cudaEventRecord(event_, stream);
+}
+
+CUDAEventWrapper::~CUDAEventWrapper()
+{
+  cudaEventDestroy(event_);
+}
+
+CUDAFence::CUDAFence(const cudaStream_t & stream)
+{
+  event_.record(stream);
+}
+
+bool CUDAFence::is_ready() const
+{
+  return cudaEventQuery(event_.event()) == cudaSuccess;
+}
+
+void CUDAFence::wait()
+{
+  cudaEventSynchronize(event_.event());
+}
+
+CUDAStreamWrapper::CUDAStreamWrapper()
+{
+  cudaStreamCreate(&main_stream_);
+}
+
+CUDAStreamWrapper::~CUDAStreamWrapper()
+{
+  cudaStreamDestroy(main_stream_);
+}
+
+void CUDAStreamWrapper::synchronize()
+{
+  cudaStreamSynchronize(main_stream_);
+}
+
+void CUDAStreamWrapper::wait_for(StreamWrapper & other)
+{
+  if (&other == this) {
+    return;
+  }
+  if (other.backend_type() != BackendType::kCuda) {
+    other.synchronize();
+    return;
+  }
+  event_.record(cuda_stream(other));
+  cudaStreamWaitEvent(main_stream_, event_.event(), 0);
+}
+
+CUDAMemoryWrapper::CUDAMemoryWrapper(size_t bytes_to_allocate)
+: bytes_allocated_(bytes_to_allocate)
+{
+  if (cudaMallocManaged(&cuda_mem_, bytes_to_allocate) != cudaSuccess) {
+    throw std::runtime_error("Failed to allocate device memory");
+  }
+}
+
+std::shared_ptr<Fence> CUDAMemoryWrapper::copy_to_device_async(
+  const uint8_t * host_mem, size_t bytes_to_copy,
+  StreamWrapper & stream)
+{
+  nvtxRangePushA("ImageContainer:CopyToDevice");
+  if (bytes_to_copy > bytes_allocated_) {
+    throw std::invalid_argument("Tried to copy too many bytes to device");
+  }
+  if (cudaMemcpyAsync(
+      cuda_mem_, host_mem, bytes_to_copy, cudaMemcpyHostToDevice,
+      cuda_stream(stream)) != cudaSuccess)
+  {
+    throw std::runtime_error("Failed to copy memory to the GPU");
+  }
+  last_transfer_.record(cuda_stream(stream));
+  nvtxRangePop();
+  return std::make_shared<CUDAFence>(cuda_stream(stream));
+}
+
+std::shared_ptr<Fence> CUDAMemoryWrapper::copy_from_device_async(
+  uint8_t * host_mem, size_t bytes_to_copy,
+  StreamWrapper & stream)
+{
+  nvtxRangePushA("ImageContainer:CopyFromDevice");
+  if (bytes_to_copy > bytes_allocated_) {
+    throw std::invalid_argument("Tried to copy too many bytes from device");
+  }
+  if (cudaMemcpyAsync(
+      host_mem, cuda_mem_, bytes_to_copy, cudaMemcpyDeviceToHost,
+      cuda_stream(stream)) != cudaSuccess)
+  {
+    throw std::runtime_error("Failed to copy memory from the GPU");
+  }
+  last_transfer_.record(cuda_stream(stream));
+  nvtxRangePop();
+  return std::make_shared<CUDAFence>(cuda_stream(stream));
+}
+
+std::shared_ptr<Fence> CUDAMemoryWrapper::copy_from_device_2d_async(
+  uint8_t * host_mem, size_t offset, size_t step, size_t row_bytes, size_t rows,
+  StreamWrapper & stream)
+{
+  nvtxRangePushA("ImageContainer:CopyFromDevice2D");
+  if (!region_fits(bytes_allocated_, offset, step, row_bytes, rows)) {
+    throw std::invalid_argument("Tried to copy a region outside of the device memory");
+  }
+  if (rows > 0 && cudaMemcpy2DAsync(
+      host_mem, row_bytes, cuda_mem_ + offset, step, row_bytes, rows, cudaMemcpyDeviceToHost,
+      cuda_stream(stream)) != cudaSuccess)
+  {
+    throw std::runtime_error("Failed to copy memory from the GPU");
+  }
+  last_transfer_.record(cuda_stream(stream));
+  nvtxRangePop();
+  return std::make_shared<CUDAFence>(cuda_stream(stream));
+}
+
+void CUDAMemoryWrapper::copy_from(
+  const MemoryWrapper & source, size_t bytes_to_copy,
+  StreamWrapper & stream)
+{
+  if (bytes_to_copy > bytes_allocated_ || bytes_to_copy > source.size_in_bytes()) {
+    throw std::invalid_argument("Tried to copy too many bytes between buffers");
+  }
+  auto cuda_source = dynamic_cast<const CUDAMemoryWrapper *>(&source);
+  if (cuda_source == nullptr) {
+    // Transfers queued on other backends are invisible to the stream, let them finish first.
+    source.synchronize();
+  }
+  // The source may be host memory, let the driver infer the direction.
+  if (cudaMemcpyAsync(
+      cuda_mem_, source.device_memory(), bytes_to_copy, cudaMemcpyDefault,
+      cuda_stream(stream)) != cudaSuccess)
+  {
+    throw std::runtime_error("Failed to copy memory on the GPU");
+  }
+  last_transfer_.record(cuda_stream(stream));
+  if (cuda_source != nullptr) {
+    cuda_source->last_transfer_.record(cuda_stream(stream));
+  } else {
+    // Host memory can be reused without asking this memory, so the copy must be done by then.
+    cudaStreamSynchronize(cuda_stream(stream));
+  }
+}
+
+void CUDAMemoryWrapper::copy_from_2d(
+  const MemoryWrapper & source, size_t source_offset, size_t source_step, size_t offset,
+  size_t step, size_t row_bytes, size_t rows, StreamWrapper & stream)
+{
+  if (!region_fits(bytes_allocated_, offset, step, row_bytes, rows) ||
+    !region_fits(source.size_in_bytes(), source_offset, source_step, row_bytes, rows))
+  {
+    throw std::invalid_argument("Tried to copy a region outside of the buffers");
+  }
+  auto cuda_source = dynamic_cast<const CUDAMemoryWrapper *>(&source);
+  if (cuda_source == nullptr) {
+    source.synchronize();
+  }
+  if (rows > 0 && cudaMemcpy2DAsync(
+      cuda_mem_ + offset, step, source.device_memory() + source_offset, source_step, row_bytes,
+      rows, cudaMemcpyDefault, cuda_stream(stream)) != cudaSuccess)
+  {
+    throw std::runtime_error("Failed to copy memory on the GPU");
+  }
+  last_transfer_.record(cuda_stream(stream));
+  if (cuda_source != nullptr) {
+    cuda_source->last_transfer_.record(cuda_stream(stream));
+  } else {
+    cudaStreamSynchronize(cuda_stream(stream));
+  }
+}
+
+void CUDAMemoryWrapper::synchronize() const
+{
+  cudaEventSynchronize(last_transfer_.event());
+}
+
+void CUDAMemoryWrapper::record_use(StreamWrapper & stream) const
+{
+  if (stream.backend_type() != BackendType::kCuda) {
+    return;
+  }
+  // The event is recorded anew, so it has to follow the transfer it marked so far, which may have
+  // been queued on another stream.
+  cudaStreamWaitEvent(cuda_stream(stream), last_transfer_.event(), 0);
+  last_transfer_.record(cuda_stream(stream));
+}
+
+CUDAMemoryWrapper::~CUDAMemoryWrapper()
+{
+  cudaFree(cuda_mem_);
+}
+
+std::shared_ptr<StreamWrapper>
+CUDABackend::create_stream()
+{
+  return std::make_shared<CUDAStreamWrapper>();
+}
+
+std::unique_ptr<MemoryWrapper>
+CUDABackend::allocate_memory(size_t bytes_to_allocate)
+{
+  return std::make_unique<CUDAMemoryWrapper>(bytes_to_allocate);
+}
+
+}  //  namespace example_type_adapters
+}  //  namespace type_adaptation
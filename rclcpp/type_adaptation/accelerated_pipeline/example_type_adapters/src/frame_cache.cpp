@@ -0,0 +1,233 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "type_adapters/frame_cache.hpp"
+#include "type_adapters/host_backend.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+/// Unlinked file of a spilled frame, mapped for as long as the cache or a frame holds it.
+class FrameCache::SpillFile final
+{
+public:
+  /// Throws std::runtime_error if the file cannot be created or mapped.
+  static std::shared_ptr<SpillFile>
+  create(const std::string & directory, size_t bytes)
+  {
+    std::string path = directory + "/frame_cache_XXXXXX";
+    const int fd = mkstemp(&path[0]);
+    if (fd < 0) {
+      throw system_error("Failed to create", path);
+    }
+    // The mapping keeps the file, nothing is left behind once it is unmapped.
+    unlink(path.c_str());
+    if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+      auto error = system_error("Failed to size", path);
+      close(fd);
+      throw error;
+    }
+    void * mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+      throw system_error("Failed to map", path);
+    }
+    return std::shared_ptr<SpillFile>(new SpillFile(static_cast<uint8_t *>(mapping), bytes));
+  }
+
+  ~SpillFile()
+  {
+    munmap(mapping_, bytes_);
+  }
+
+  SpillFile(const SpillFile &) = delete;
+  SpillFile & operator=(const SpillFile &) = delete;
+
+  uint8_t *
+  data()
+  {
+    return mapping_;
+  }
+
+  size_t
+  size() const
+  {
+    return bytes_;
+  }
+
+private:
+  SpillFile(uint8_t * mapping, size_t bytes)
+  : mapping_(mapping), bytes_(bytes)
+  {
+  }
+
+  static std::runtime_error
+  system_error(const std::string & what, const std::string & path)
+  {
+    return std::runtime_error(
+      what + " frame cache spill file " + path + ": " + std::strerror(errno));
+  }
+
+  uint8_t * mapping_;
+  size_t bytes_;
+};
+
+namespace
+{
+
+// Host memory of a spilled frame, which consumers clone before writing.
+class SpillStorage final : public ExternalHostStorage
+{
+public:
+  SpillStorage(std::shared_ptr<void> file, uint8_t * data, size_t size)
+  : file_(std::move(file)), data_(data), size_(size)
+  {
+  }
+
+  uint8_t *
+  data() override
+  {
+    return data_;
+  }
+
+  size_t
+  size() const override
+  {
+    return size_;
+  }
+
+  bool
+  is_shared() const override
+  {
+    return true;
+  }
+
+private:
+  std::shared_ptr<void> file_;
+  uint8_t * data_;
+  size_t size_;
+};
+
+}  // namespace
+
+FrameCache::FrameCache(size_t memory_bytes, size_t spill_bytes, std::string spill_directory)
+: memory_budget_(memory_bytes),
+  spill_budget_(spill_directory.empty() ? 0 : spill_bytes),
+  spill_directory_(std::move(spill_directory))
+{
+}
+
+FrameCache::~FrameCache()
+{
+}
+
+bool
+FrameCache::find(uint64_t key, ImageContainer & frame)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto cached = frames_.find(key);
+  if (cached != frames_.end()) {
+    frame = cached->second;
+    return true;
+  }
+
+  const auto spilled = spilled_.find(key);
+  if (spilled == spilled_.end()) {
+    return false;
+  }
+  const SpilledFrame & source = spilled->second;
+  auto backend = get_backend(source.backend_type);
+  if (!spill_stream_ || spill_stream_->backend_type() != source.backend_type) {
+    spill_stream_ = backend->create_stream();
+  }
+  std::shared_ptr<MemoryWrapper> memory;
+  if (source.backend_type == BackendType::kHost) {
+    memory = std::make_shared<HostMemoryWrapper>(
+      std::make_unique<SpillStorage>(source.file, source.file->data(), source.file->size()));
+  } else {
+    memory = backend->allocate(source.file->size());
+    memory->copy_to_device(source.file->data(), source.file->size(), *spill_stream_);
+  }
+  frame = ImageContainer(
+    source.header, source.height, source.width, source.encoding, source.step, std::move(memory),
+    spill_stream_);
+  return true;
+}
+
+void
+FrameCache::insert(uint64_t key, const ImageContainer & frame)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (frames_.count(key) != 0 || spilled_.count(key) != 0) {
+    return;
+  }
+
+  const size_t bytes = frame.size_in_bytes();
+  if (memory_bytes_ + bytes <= memory_budget_) {
+    frames_.emplace(key, frame);
+    memory_bytes_ += bytes;
+    return;
+  }
+
+  // Spill files hold packed rows, so views only take up the bytes of their pixels.
+  const size_t spill_bytes = static_cast<size_t>(frame.height()) * frame.packed_step();
+  if (spill_bytes == 0 || spill_bytes_ + spill_bytes > spill_budget_) {
+    return;
+  }
+  auto file = SpillFile::create(spill_directory_, spill_bytes);
+  frame.copy_to_host_async(file->data())->wait();
+  spilled_.emplace(
+    key, SpilledFrame{std::move(file), frame.header(), frame.height(), frame.width(),
+      frame.encoding(), frame.packed_step(), frame.backend_type()});
+  spill_bytes_ += spill_bytes;
+}
+
+void
+FrameCache::clear()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  frames_.clear();
+  spilled_.clear();
+  memory_bytes_ = 0;
+  spill_bytes_ = 0;
+}
+
+size_t
+FrameCache::memory_bytes() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return memory_bytes_;
+}
+
+size_t
+FrameCache::spill_bytes() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return spill_bytes_;
+}
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
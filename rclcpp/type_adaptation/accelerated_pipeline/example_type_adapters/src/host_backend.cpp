@@ -0,0 +1,346 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "type_adapters/host_backend.hpp"
+#include "type_adapters/nvtx.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+HostCopyEngine::HostCopyEngine()
+: worker_(&HostCopyEngine::run, this)
+{
+}
+
+HostCopyEngine::~HostCopyEngine()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  condition_.notify_one();
+  worker_.join();
+}
+
+std::shared_ptr<Fence>
+HostCopyEngine::enqueue(std::function<void()> transfer)
+{
+  std::packaged_task<void()> task(std::move(transfer));
+  auto fence = std::make_shared<HostFence>(task.get_future().share());
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(task));
+  }
+  condition_.notify_one();
+  return fence;
+}
+
+HostCopyEngine &
+HostCopyEngine::instance()
+{
+  static HostCopyEngine engine;
+  return engine;
+}
+
+void
+HostCopyEngine::run()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    condition_.wait(lock, [this] {return stopping_ || !queue_.empty();});
+    // Drain the queue before stopping, so that no fence is left unsignaled.
+    if (queue_.empty()) {
+      return;
+    }
+    std::packaged_task<void()> task = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    task();
+    lock.lock();
+  }
+}
+
+bool
+HostFence::is_ready() const
+{
+  return future_.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+void
+HostFence::wait()
+{
+  // Rethrows if the transfer failed.
+  future_.get();
+}
+
+void HostStreamWrapper::synchronize()
+{
+  std::vector<std::shared_ptr<Fence>> pending;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending.swap(pending_);
+  }
+  for (auto & fence : pending) {
+    fence->wait();
+  }
+}
+
+void HostStreamWrapper::wait_for(StreamWrapper & other)
+{
+  if (&other == this) {
+    return;
+  }
+  if (other.backend_type() != BackendType::kHost) {
+    other.synchronize();
+    return;
+  }
+  std::vector<std::shared_ptr<Fence>> pending;
+  {
+    auto & host_other = static_cast<HostStreamWrapper &>(other);
+    std::lock_guard<std::mutex> lock(host_other.mutex_);
+    pending = host_other.pending_;
+  }
+  for (auto & fence : pending) {
+    add_pending(std::move(fence));
+  }
+}
+
+void HostStreamWrapper::add_pending(std::shared_ptr<Fence> fence)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_.erase(
+    std::remove_if(
+      pending_.begin(), pending_.end(),
+      [](const std::shared_ptr<Fence> & pending) {return pending->is_ready();}),
+    pending_.end());
+  pending_.push_back(std::move(fence));
+}
+
+HostMemoryWrapper::HostMemoryWrapper(size_t bytes_to_allocate)
+: bytes_allocated_(bytes_to_allocate)
+{
+  const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  void * host_mem = nullptr;
+  if (posix_memalign(&host_mem, page_size, std::max<size_t>(bytes_to_allocate, 1)) != 0) {
+    throw std::runtime_error("Failed to allocate host memory");
+  }
+  host_mem_ = static_cast<uint8_t *>(host_mem);
+}
+
+HostMemoryWrapper::HostMemoryWrapper(std::vector<uint8_t> && storage)
+: bytes_allocated_(storage.size()), adopted_(std::move(storage)), is_adopted_(true)
+{
+  host_mem_ = adopted_.data();
+}
+
+HostMemoryWrapper::HostMemoryWrapper(std::unique_ptr<ExternalHostStorage> storage)
+: bytes_allocated_(storage->size()), host_mem_(storage->data()), external_(std::move(storage))
+{
+}
+
+HostMemoryWrapper::~HostMemoryWrapper()
+{
+  synchronize();
+  // Adopted storage is freed with adopted_, external storage released with external_.
+  if (!is_adopted_ && !external_) {
+    free(host_mem_);
+  }
+}
+
+std::shared_ptr<Fence> HostMemoryWrapper::copy_to_device_async(
+  const uint8_t * host_mem, size_t bytes_to_copy,
+  StreamWrapper & stream)
+{
+  if (bytes_to_copy > bytes_allocated_) {
+    throw std::invalid_argument("Tried to copy too many bytes to device");
+  }
+  uint8_t * device_mem = host_mem_;
+  return enqueue(
+    [device_mem, host_mem, bytes_to_copy]() {
+      nvtxRangePushA("ImageContainer:CopyToDevice");
+      std::memcpy(device_mem, host_mem, bytes_to_copy);
+      nvtxRangePop();
+    }, stream);
+}
+
+std::shared_ptr<Fence> HostMemoryWrapper::copy_from_device_async(
+  uint8_t * host_mem, size_t bytes_to_copy,
+  StreamWrapper & stream)
+{
+  if (bytes_to_copy > bytes_allocated_) {
+    throw std::invalid_argument("Tried to copy too many bytes from device");
+  }
+  const uint8_t * device_mem = host_mem_;
+  return enqueue(
+    [device_mem, host_mem, bytes_to_copy]() {
+      nvtxRangePushA("ImageContainer:CopyFromDevice");
+      std::memcpy(host_mem, device_mem, bytes_to_copy);
+      nvtxRangePop();
+    }, stream);
+}
+
+std::shared_ptr<Fence> HostMemoryWrapper::copy_from_device_2d_async(
+  uint8_t * host_mem, size_t offset, size_t step, size_t row_bytes, size_t rows,
+  StreamWrapper & stream)
+{
+  if (!region_fits(bytes_allocated_, offset, step, row_bytes, rows)) {
+    throw std::invalid_argument("Tried to copy a region outside of the device memory");
+  }
+  const uint8_t * device_mem = host_mem_ + offset;
+  return enqueue(
+    [device_mem, host_mem, step, row_bytes, rows]() {
+      nvtxRangePushA("ImageContainer:CopyFromDevice2D");
+      for (size_t row = 0; row < rows; ++row) {
+        std::memcpy(host_mem + row * row_bytes, device_mem + row * step, row_bytes);
+      }
+      nvtxRangePop();
+    }, stream);
+}
+
+void HostMemoryWrapper::copy_from(
+  const MemoryWrapper & source, size_t bytes_to_copy,
+  StreamWrapper & stream)
+{
+  if (bytes_to_copy > bytes_allocated_ || bytes_to_copy > source.size_in_bytes()) {
+    throw std::invalid_argument("Tried to copy too many bytes between buffers");
+  }
+  // Memory of every backend is host addressable (CUDA memory is managed).
+  uint8_t * device_mem = host_mem_;
+  const uint8_t * source_mem = source.device_memory();
+  auto transfer = [device_mem, source_mem, bytes_to_copy]() {
+      std::memcpy(device_mem, source_mem, bytes_to_copy);
+    };
+
+  auto host_source = dynamic_cast<const HostMemoryWrapper *>(&source);
+  if (host_source == nullptr) {
+    // The engine cannot track memory of other backends, copy right away once both are idle.
+    source.synchronize();
+    synchronize();
+    transfer();
+    return;
+  }
+  auto fence = enqueue(transfer, stream);
+  // The source must not be reused before it has been read either.
+  std::lock_guard<std::mutex> lock(host_source->mutex_);
+  host_source->last_transfer_ = fence;
+}
+
+void HostMemoryWrapper::copy_from_2d(
+  const MemoryWrapper & source, size_t source_offset, size_t source_step, size_t offset,
+  size_t step, size_t row_bytes, size_t rows, StreamWrapper & stream)
+{
+  if (!region_fits(bytes_allocated_, offset, step, row_bytes, rows) ||
+    !region_fits(source.size_in_bytes(), source_offset, source_step, row_bytes, rows))
+  {
+    throw std::invalid_argument("Tried to copy a region outside of the buffers");
+  }
+  uint8_t * device_mem = host_mem_ + offset;
+  const uint8_t * source_mem = source.device_memory() + source_offset;
+  auto transfer = [device_mem, source_mem, source_step, step, row_bytes, rows]() {
+      nvtxRangePushA("ImageContainer:Copy2D");
+      for (size_t row = 0; row < rows; ++row) {
+        std::memcpy(device_mem + row * step, source_mem + row * source_step, row_bytes);
+      }
+      nvtxRangePop();
+    };
+
+  auto host_source = dynamic_cast<const HostMemoryWrapper *>(&source);
+  if (host_source == nullptr) {
+    source.synchronize();
+    synchronize();
+    transfer();
+    return;
+  }
+  auto fence = enqueue(transfer, stream);
+  std::lock_guard<std::mutex> lock(host_source->mutex_);
+  host_source->last_transfer_ = fence;
+}
+
+void HostMemoryWrapper::synchronize() const
+{
+  std::shared_ptr<Fence> last_transfer;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    last_transfer = last_transfer_;
+  }
+  if (last_transfer) {
+    last_transfer->wait();
+  }
+}
+
+bool HostMemoryWrapper::release_storage(std::vector<uint8_t> & destination)
+{
+  if (!is_adopted_) {
+    return false;
+  }
+  synchronize();
+  destination = std::move(adopted_);
+  adopted_.clear();
+  host_mem_ = nullptr;
+  bytes_allocated_ = 0;
+  return true;
+}
+
+std::shared_ptr<Fence> HostMemoryWrapper::enqueue(
+  std::function<void()> transfer,
+  StreamWrapper & stream) const
+{
+  auto fence = HostCopyEngine::instance().enqueue(std::move(transfer));
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    last_transfer_ = fence;
+  }
+  if (stream.backend_type() == BackendType::kHost) {
+    static_cast<HostStreamWrapper &>(stream).add_pending(fence);
+  }
+  return fence;
+}
+
+std::shared_ptr<StreamWrapper>
+HostBackend::create_stream()
+{
+  return std::make_shared<HostStreamWrapper>();
+}
+
+std::shared_ptr<MemoryWrapper>
+HostBackend::adopt(std::vector<uint8_t> && storage)
+{
+  // Not pooled, the storage goes back to its owner or is freed with it.
+  return std::make_shared<HostMemoryWrapper>(std::move(storage));
+}
+
+std::unique_ptr<MemoryWrapper>
+HostBackend::allocate_memory(size_t bytes_to_allocate)
+{
+  return std::make_unique<HostMemoryWrapper>(bytes_to_allocate);
+}
+
+}  //  namespace example_type_adapters
+}  //  namespace type_adaptation
@@ -13,18 +13,20 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <atomic>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "sensor_msgs/image_encodings.hpp"
 #include "sensor_msgs/msg/image.hpp"
 #include "std_msgs/msg/header.hpp"
 
 #include "type_adapters/image_container.hpp"
 
-#include "cuda.h"  // NOLINT
-#include "cuda_runtime.h"  // NOLINT
-#include <nvToolsExt.h>  // NOLINT
+#include "type_adapters/nvtx.hpp"
 
 namespace type_adaptation
 {
@@ -46,179 +48,192 @@ struct NotNull
   const T * pointer;
 };
 
-}  // namespace
-
-CUDAStreamWrapper::CUDAStreamWrapper()
+std::shared_ptr<StreamWrapper>
+stream_or_default(std::shared_ptr<StreamWrapper> stream)
 {
-  cudaStreamCreate(&main_stream_);
-}
-
-CUDAStreamWrapper::~CUDAStreamWrapper()
-{
-  cudaStreamDestroy(main_stream_);
-}
-
-CUDAMemoryWrapper::CUDAMemoryWrapper(size_t bytes_to_allocate)
-: bytes_allocated_(bytes_to_allocate)
-{
-  if (cudaMallocManaged(&cuda_mem_, bytes_to_allocate) != cudaSuccess) {
-    throw std::runtime_error("Failed to allocate device memory");
+  if (stream) {
+    return stream;
   }
+  return get_backend(default_backend_type())->create_stream();
 }
 
-void CUDAMemoryWrapper::copy_to_device(
-  uint8_t * host_mem, size_t bytes_to_copy,
-  const cudaStream_t & stream)
+void
+check_data_size(const sensor_msgs::msg::Image & image)
 {
-  nvtxRangePushA("ImageContainer:CopyToDevice");
-  if (bytes_to_copy > bytes_allocated_) {
-    throw std::invalid_argument("Tried to copy too many bytes to device");
-  }
-  if (cudaMemcpyAsync(
-      cuda_mem_, host_mem, bytes_to_copy, cudaMemcpyHostToDevice,
-      stream) != cudaSuccess)
-  {
-    throw std::runtime_error("Failed to copy memory to the GPU");
+  if (image.data.size() < static_cast<size_t>(image.height) * image.step) {
+    throw std::invalid_argument("sensor_msgs_image data is smaller than height * step");
   }
-  cudaStreamSynchronize(stream);
-  nvtxRangePop();
 }
 
-void CUDAMemoryWrapper::copy_from_device(
-  uint8_t * host_mem, size_t bytes_to_copy,
-  const cudaStream_t & stream)
+size_t
+pixel_size(const std::string & encoding)
 {
-  nvtxRangePushA("ImageContainer:CopyFromDevice");
-  if (bytes_to_copy > bytes_allocated_) {
-    throw std::invalid_argument("Tried to copy too many bytes from device");
+  try {
+    return static_cast<size_t>(
+      sensor_msgs::image_encodings::bitDepth(encoding) / 8 *
+      sensor_msgs::image_encodings::numChannels(encoding));
+  } catch (const std::runtime_error &) {
+    throw std::invalid_argument("Unknown pixel size of encoding " + encoding);
   }
-  if (cudaMemcpyAsync(
-      host_mem, cuda_mem_, bytes_to_copy, cudaMemcpyDeviceToHost,
-      stream) != cudaSuccess)
-  {
-    throw std::runtime_error("Failed to copy memory from the GPU");
-  }
-  cudaStreamSynchronize(stream);
-  nvtxRangePop();
-}
-
-uint8_t * CUDAMemoryWrapper::device_memory()
-{
-  return cuda_mem_;
-}
-
-CUDAMemoryWrapper::~CUDAMemoryWrapper()
-{
-  cudaFree(cuda_mem_);
-}
-
-CUDAEventWrapper::CUDAEventWrapper()
-{
-  cudaEventCreate(&event_);
 }
 
-void CUDAEventWrapper::record(std::shared_ptr<CUDAStreamWrapper> cuda_stream)
-{
-  cudaEventRecord(event_, cuda_stream->stream());
-}
-
-CUDAEventWrapper::~CUDAEventWrapper()
-{
-  cudaEventDestroy(event_);
-}
+}  // namespace
 
 ImageContainer::ImageContainer()
+: stream_(stream_or_default(nullptr))
 {
-  cuda_stream_ = std::make_shared<CUDAStreamWrapper>();
-  cuda_event_ = std::make_shared<CUDAEventWrapper>();
 }
 
 ImageContainer::ImageContainer(
   std_msgs::msg::Header header, uint32_t height,
   uint32_t width, std::string encoding, uint32_t step,
-  std::shared_ptr<CUDAStreamWrapper> cuda_stream)
-: header_(header), cuda_stream_(cuda_stream), height_(height),
+  std::shared_ptr<StreamWrapper> stream)
+: header_(header), stream_(stream_or_default(std::move(stream))), height_(height),
   width_(width),
   encoding_(encoding),
   step_(step)
 {
   nvtxRangePushA("ImageContainer:Create");
-  cuda_mem_ = std::make_shared<CUDAMemoryWrapper>(size_in_bytes());
-  cuda_event_ = std::make_shared<CUDAEventWrapper>();
+  memory_ = get_backend(stream_->backend_type())->allocate(size_in_bytes());
   nvtxRangePop();
 }
 
 ImageContainer::ImageContainer(
-  std::unique_ptr<sensor_msgs::msg::Image> unique_sensor_msgs_image)
-: ImageContainer(
+  std::unique_ptr<sensor_msgs::msg::Image> unique_sensor_msgs_image,
+  std::shared_ptr<StreamWrapper> stream)
+: header_(
     NotNull(
-      unique_sensor_msgs_image.get(), "unique_sensor_msgs_image cannot be nullptr").pointer->header,
-    unique_sensor_msgs_image->height,
-    unique_sensor_msgs_image->width,
-    unique_sensor_msgs_image->encoding,
-    unique_sensor_msgs_image->step)
+      unique_sensor_msgs_image.get(),
+      "unique_sensor_msgs_image cannot be nullptr").pointer->header),
+  stream_(stream_or_default(std::move(stream))),
+  height_(unique_sensor_msgs_image->height),
+  width_(unique_sensor_msgs_image->width),
+  encoding_(unique_sensor_msgs_image->encoding),
+  step_(unique_sensor_msgs_image->step)
 {
   nvtxRangePushA("ImageContainer:CreateFromMessage");
-  cuda_mem_->copy_to_device(
+  check_data_size(*unique_sensor_msgs_image);
+  auto backend = get_backend(backend_type());
+  if (backend->can_adopt()) {
+    // The message is ours, so its storage can become the pixel memory as is.
+    memory_ = backend->adopt(std::move(unique_sensor_msgs_image->data));
+    nvtxRangePop();
+    return;
+  }
+
+  memory_ = backend->allocate(size_in_bytes());
+  auto fence = memory_->copy_to_device_async(
     &unique_sensor_msgs_image->data[0],
-    size_in_bytes(), cuda_stream_->stream());
+    size_in_bytes(), *stream_);
+  // Work on the stream is ordered after the upload, only the message has to wait for it.
+  staging_ = std::shared_ptr<const sensor_msgs::msg::Image>(
+    unique_sensor_msgs_image.release(), [fence](const sensor_msgs::msg::Image * message) {
+      fence->wait();
+      delete message;
+    });
   nvtxRangePop();
 }
 
 ImageContainer::ImageContainer(
-  const sensor_msgs::msg::Image & sensor_msgs_image)
-: ImageContainer(std::make_unique<sensor_msgs::msg::Image>(sensor_msgs_image))
+  const sensor_msgs::msg::Image & sensor_msgs_image,
+  std::shared_ptr<StreamWrapper> stream)
+: ImageContainer(std::make_unique<sensor_msgs::msg::Image>(sensor_msgs_image), std::move(stream))
 {
+  // The message is not ours to keep alive, so the upload reads from a host copy of it, which
+  // costs no more than the copy adopted by backends that can adopt host storage.
 }
 
-ImageContainer::ImageContainer(const ImageContainer & other)
+ImageContainer::ImageContainer(
+  std_msgs::msg::Header header, uint32_t height,
+  uint32_t width, std::string encoding, uint32_t step,
+  std::shared_ptr<MemoryWrapper> memory,
+  std::shared_ptr<StreamWrapper> stream)
+: header_(header), stream_(stream_or_default(std::move(stream))),
+  memory_(std::move(memory)),
+  height_(height),
+  width_(width),
+  encoding_(encoding),
+  step_(step)
 {
-  nvtxRangePushA("ImageContainer:Copy");
-  header_ = other.header_;
-  height_ = other.height_;
-  width_ = other.width_;
-  encoding_ = other.encoding_;
-  step_ = other.step_;
+  if (!memory_) {
+    throw std::invalid_argument("memory cannot be nullptr");
+  }
+  if (memory_->size_in_bytes() < size_in_bytes()) {
+    throw std::invalid_argument("memory is smaller than height * step");
+  }
+}
 
-  // Make a new stream and have it wait on the previous one.
-  cuda_stream_ = std::make_shared<CUDAStreamWrapper>();
-  cuda_event_ = std::make_shared<CUDAEventWrapper>();
-  cuda_event_->record(other.cuda_stream_);
-  cudaStreamWaitEvent(cuda_stream_->stream(), cuda_event_->event());
-
-  // Copy the image data over so that this is an independent copy (deep copy).
-  cuda_mem_ = std::make_shared<CUDAMemoryWrapper>(size_in_bytes());
-  if (cudaMemcpyAsync(
-      other.cuda_mem_->device_memory(), cuda_mem_->device_memory(), size_in_bytes(),
-      cudaMemcpyDeviceToDevice, cuda_stream_->stream()) != cudaSuccess)
-  {
-    throw std::runtime_error("Failed to copy memory from the GPU");
+ImageContainer::ImageContainer(const ImageContainer & other)
+: header_(other.header_), stream_(other.stream_), memory_(other.memory_), owners_(other.owners_),
+  view_owners_(other.view_owners_), staging_(other.staging_), height_(other.height_),
+  width_(other.width_), encoding_(other.encoding_), step_(other.step_), offset_(other.offset_),
+  origin_x_(other.origin_x_), origin_y_(other.origin_y_), is_view_(other.is_view_),
+  active_pixels_(other.active_pixels_), tile_(other.tile_),
+  source_generation_(other.source_generation_)
+{
+  if (view_owners_) {
+    view_owners_->fetch_add(1);
+  } else if (owners_ && !is_view_) {
+    owners_->fetch_add(1);
   }
-  nvtxRangePop();
 }
 
+ImageContainer::ImageContainer(ImageContainer && other) = default;
 
-// Equals operator makes this container become another, shallow copy only.
 ImageContainer & ImageContainer::operator=(const ImageContainer & other)
+{
+  if (this != &other) {
+    *this = ImageContainer(other);
+  }
+  return *this;
+}
+
+ImageContainer & ImageContainer::operator=(ImageContainer && other)
 {
   if (this == &other) {
     return *this;
   }
-
-  header_ = other.header_;
+  release_memory();
+  header_ = std::move(other.header_);
+  stream_ = std::move(other.stream_);
+  memory_ = std::move(other.memory_);
+  owners_ = std::move(other.owners_);
+  view_owners_ = std::move(other.view_owners_);
+  staging_ = std::move(other.staging_);
   height_ = other.height_;
   width_ = other.width_;
-  encoding_ = other.encoding_;
+  encoding_ = std::move(other.encoding_);
   step_ = other.step_;
-  cuda_stream_ = other.cuda_stream_;
-  cuda_event_ = other.cuda_event_;
-  cuda_mem_ = other.cuda_mem_;
-
+  offset_ = other.offset_;
+  origin_x_ = other.origin_x_;
+  origin_y_ = other.origin_y_;
+  is_view_ = other.is_view_;
+  active_pixels_ = std::move(other.active_pixels_);
+  tile_ = std::move(other.tile_);
+  source_generation_ = other.source_generation_;
   return *this;
 }
 
 ImageContainer::~ImageContainer()
 {
+  release_memory();
+}
+
+void
+ImageContainer::release_memory()
+{
+  if (memory_ && stream_) {
+    // Kernels queued on the stream may still use the memory, it must not be reused before them.
+    memory_->record_use(*stream_);
+  }
+  if (view_owners_) {
+    view_owners_->fetch_sub(1);
+  } else if (owners_ && !is_view_) {
+    owners_->fetch_sub(1);
+  }
+  memory_.reset();
+  owners_.reset();
+  view_owners_.reset();
 }
 
 const std_msgs::msg::Header &
@@ -234,29 +249,168 @@ ImageContainer::header()
 }
 
 uint8_t *
-ImageContainer::cuda_mem()
+ImageContainer::data()
 {
-  return cuda_mem_->device_memory();
+  if (is_shared()) {
+    nvtxRangePushA("ImageContainer:CopyOnWrite");
+    // Clone on a new stream of the same backend, after the work queued so far on the shared one.
+    auto backend = get_backend(backend_type());
+    auto stream = backend->create_stream();
+    stream->wait_for(*stream_);
+    const uint32_t step = packed_step();
+    auto memory = backend->allocate(static_cast<size_t>(height_) * step);
+    if (is_view_) {
+      // A view only clones its region, packed, and leaves its parent and its copies behind.
+      memory->copy_from_2d(*memory_, offset_, step_, 0, step, step, height_, *stream);
+    } else {
+      memory->copy_from(*memory_, size_in_bytes(), *stream);
+    }
+    // The owners left with the shared memory must not write it before the clone has read it.
+    stream_->wait_for(*stream);
+    release_memory();
+    stream_ = std::move(stream);
+    memory_ = std::move(memory);
+    owners_ = std::make_shared<std::atomic<uint32_t>>(1);
+    step_ = step;
+    offset_ = 0;
+    is_view_ = false;
+    nvtxRangePop();
+  }
+  return memory_->device_memory() + offset_;
+}
+
+const uint8_t *
+ImageContainer::data() const
+{
+  return memory_->device_memory() + offset_;
+}
+
+ImageContainer
+ImageContainer::view(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const
+{
+  if (static_cast<uint64_t>(x) + width > width_ || static_cast<uint64_t>(y) + height > height_) {
+    throw std::invalid_argument("View does not lie within the image");
+  }
+  const size_t bytes_per_pixel = pixel_size(encoding_);
+
+  ImageContainer view(*this);
+  // Views write through to the memory of their parent, they do not count as copies of it, but
+  // their own copies do count as copies of the view.
+  if (view.view_owners_) {
+    view.view_owners_->fetch_sub(1);
+  } else if (view.owners_) {
+    view.owners_->fetch_sub(1);
+  }
+  view.view_owners_ = std::make_shared<std::atomic<uint32_t>>(1);
+  view.width_ = width;
+  view.height_ = height;
+  view.offset_ = offset_ + static_cast<size_t>(y) * step_ + x * bytes_per_pixel;
+  view.origin_x_ = origin_x_ + x;
+  view.origin_y_ = origin_y_ + y;
+  view.is_view_ = true;
+  // Indices are relative to the width of the parent.
+  view.active_pixels_ = PixelList();
+  view.tile_ = TilePlacement();
+  return view;
+}
+
+void
+ImageContainer::copy_from(const ImageContainer & source)
+{
+  const size_t bytes_per_pixel = pixel_size(encoding_);
+  if (source.width_ != width_ || source.height_ != height_ ||
+    pixel_size(source.encoding_) != bytes_per_pixel)
+  {
+    throw std::invalid_argument("Tried to copy between images of different sizes");
+  }
+  nvtxRangePushA("ImageContainer:CopyFrom");
+  // Writable access clones shared memory first, so it comes before the stream.
+  data();
+  stream_->wait_for(*source.stream_);
+  memory_->copy_from_2d(
+    *source.memory_, source.offset_, source.step_, offset_, step_, width_ * bytes_per_pixel,
+    height_, *stream_);
+  nvtxRangePop();
 }
 
 void
 ImageContainer::get_sensor_msgs_image(sensor_msgs::msg::Image & destination) const
+{
+  get_sensor_msgs_image_async(destination)->wait();
+}
+
+std::unique_ptr<sensor_msgs::msg::Image>
+ImageContainer::release_sensor_msgs_image()
+{
+  nvtxRangePushA("ImageContainer:ReleaseMsg");
+  auto destination = std::make_unique<sensor_msgs::msg::Image>();
+  // Only memory that no other container can see may be handed over.
+  if (!is_view_ && memory_.use_count() == 1 && !is_shared() &&
+    memory_->release_storage(destination->data))
+  {
+    destination->header = header_;
+    destination->height = height_;
+    destination->width = width_;
+    destination->encoding = encoding_;
+    destination->step = step_;
+    destination->data.resize(size_in_bytes());
+  } else {
+    get_sensor_msgs_image(*destination);
+  }
+  release_memory();
+  staging_.reset();
+  active_pixels_ = PixelList();
+  tile_ = TilePlacement();
+  source_generation_ = 0;
+  nvtxRangePop();
+  return destination;
+}
+
+std::shared_ptr<Fence>
+ImageContainer::get_sensor_msgs_image_async(sensor_msgs::msg::Image & destination) const
 {
   nvtxRangePushA("ImageContainer:GetMsg");
   destination.header = header_;
   destination.height = height_;
   destination.width = width_;
   destination.encoding = encoding_;
-  destination.step = step_;
-  destination.data.resize(size_in_bytes());
-  cuda_mem_->copy_from_device(&destination.data[0], size_in_bytes(), cuda_stream_->stream());
+  destination.step = packed_step();
+  destination.data.resize(static_cast<size_t>(height_) * destination.step);
+  auto fence = copy_to_host_async(destination.data.data());
   nvtxRangePop();
+  return fence;
+}
+
+std::shared_ptr<Fence>
+ImageContainer::copy_to_host_async(uint8_t * destination) const
+{
+  if (!is_view_) {
+    return memory_->copy_from_device_async(destination, size_in_bytes(), *stream_);
+  }
+  // Materialize the region into a packed image.
+  return memory_->copy_from_device_2d_async(
+    destination, offset_, step_, packed_step(), height_, *stream_);
+}
+
+uint32_t
+ImageContainer::packed_step() const
+{
+  if (!is_view_) {
+    return step_;
+  }
+  return static_cast<uint32_t>(width_ * pixel_size(encoding_));
 }
 
 size_t
 ImageContainer::size_in_bytes() const
 {
-  return height_ * step_;
+  if (!is_view_) {
+    return static_cast<size_t>(height_) * step_;
+  }
+  if (height_ == 0) {
+    return 0;
+  }
+  return static_cast<size_t>(height_ - 1) * step_ + width_ * pixel_size(encoding_);
 }
 
 }  //  namespace example_type_adapters
@@ -0,0 +1,181 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "type_adapters/backend.hpp"
+#include "type_adapters/image_ingest.hpp"
+#include "type_adapters/nvtx.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+ImageIngest::ImageIngest(BackendType backend_type)
+{
+  auto backend = get_backend(backend_type);
+  for (auto & stream : streams_) {
+    stream = backend->create_stream();
+  }
+  worker_ = std::thread(&ImageIngest::run, this);
+}
+
+ImageIngest::~ImageIngest()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_all();
+  worker_.join();
+}
+
+void
+ImageIngest::push(std::unique_ptr<sensor_msgs::msg::Image> message, const Compute & compute)
+{
+  std::unique_ptr<ImageContainer> staged;
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // One message is staged at a time, the second buffer is the frame computed meanwhile.
+    condition_.wait(lock, [this] {return !staging_;});
+    staged = std::move(staged_);
+    error = std::exchange(error_, nullptr);
+    pending_ = std::move(message);
+    staging_ = true;
+    // The compute of the staged frame counts from here, the transfer starts meanwhile.
+    if (staged) {
+      begin_compute_locked();
+    }
+  }
+  condition_.notify_all();
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  if (staged) {
+    run_compute(std::move(staged), compute);
+  }
+}
+
+void
+ImageIngest::flush(const Compute & compute)
+{
+  std::unique_ptr<ImageContainer> staged;
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this] {return !staging_;});
+    staged = std::move(staged_);
+    error = std::exchange(error_, nullptr);
+    if (staged) {
+      begin_compute_locked();
+    }
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  if (staged) {
+    run_compute(std::move(staged), compute);
+  }
+}
+
+ImageIngestStatistics
+ImageIngest::statistics() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return statistics_;
+}
+
+void
+ImageIngest::run()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    condition_.wait(lock, [this] {return stop_ || pending_;});
+    if (stop_) {
+      return;
+    }
+    auto message = std::move(pending_);
+    auto stream = streams_[next_stream_];
+    next_stream_ = 1 - next_stream_;
+    const auto start = std::chrono::steady_clock::now();
+    const auto busy_at_start = compute_busy_locked(start);
+    lock.unlock();
+
+    std::unique_ptr<ImageContainer> image;
+    std::exception_ptr error;
+    try {
+      nvtxRangePushA("ImageIngest: Stage");
+      image = std::make_unique<ImageContainer>(std::move(message), stream);
+      // Uploads complete before the frame is handed over, its compute does not wait for them.
+      stream->synchronize();
+      nvtxRangePop();
+    } catch (...) {
+      nvtxRangePop();
+      error = std::current_exception();
+    }
+
+    lock.lock();
+    const auto end = std::chrono::steady_clock::now();
+    statistics_.transfer_time += end - start;
+    statistics_.overlapped_time += compute_busy_locked(end) - busy_at_start;
+    staged_ = std::move(image);
+    error_ = error;
+    staging_ = false;
+    condition_.notify_all();
+  }
+}
+
+void
+ImageIngest::run_compute(std::unique_ptr<ImageContainer> image, const Compute & compute)
+{
+  const auto done = [this]() {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const auto elapsed = std::chrono::steady_clock::now() - compute_since_;
+      compute_busy_ += elapsed;
+      computing_ = false;
+      statistics_.compute_time += elapsed;
+      statistics_.frames++;
+    };
+  try {
+    compute(std::move(image));
+  } catch (...) {
+    done();
+    throw;
+  }
+  done();
+}
+
+void
+ImageIngest::begin_compute_locked()
+{
+  compute_since_ = std::chrono::steady_clock::now();
+  computing_ = true;
+}
+
+std::chrono::nanoseconds
+ImageIngest::compute_busy_locked(std::chrono::steady_clock::time_point now) const
+{
+  return computing_ ? compute_busy_ + (now - compute_since_) : compute_busy_;
+}
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
@@ -0,0 +1,84 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+#include "type_adapters/in_flight_window.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+InFlightWindow::InFlightWindow(size_t size)
+: size_(std::max<size_t>(size, 1)), state_(std::make_shared<State>())
+{
+}
+
+InFlightWindow::~InFlightWindow()
+{
+  close();
+}
+
+std::shared_ptr<void>
+InFlightWindow::acquire()
+{
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  state_->condition.wait(lock, [this] {return state_->closed || state_->in_flight < size_;});
+  if (state_->closed) {
+    return nullptr;
+  }
+  state_->in_flight = state_->in_flight + 1;
+  // The token points at the state it keeps alive, so that it is not null.
+  std::shared_ptr<State> state = state_;
+  State * raw_state = state.get();
+  return std::shared_ptr<void>(
+    raw_state, [state = std::move(state)](void *) {
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->in_flight = state->in_flight - 1;
+      }
+      state->condition.notify_all();
+    });
+}
+
+void
+InFlightWindow::close()
+{
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->closed = true;
+  }
+  state_->condition.notify_all();
+}
+
+size_t
+InFlightWindow::in_flight() const
+{
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->in_flight;
+}
+
+size_t
+InFlightWindow::size() const
+{
+  return size_;
+}
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
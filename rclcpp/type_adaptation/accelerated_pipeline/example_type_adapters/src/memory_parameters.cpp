@@ -0,0 +1,100 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "rclcpp/rclcpp.hpp"
+
+#include "type_adapters/backend.hpp"
+#include "type_adapters/buffer_pool.hpp"
+#include "type_adapters/memory_parameters.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+namespace
+{
+// Process-wide settings nodes chose, so that the next ones can tell whether they conflict.
+struct ChosenSettings
+{
+  std::mutex mutex;
+  bool default_backend{false};
+  std::map<BackendType, size_t> buffer_pool_bytes;
+};
+
+ChosenSettings &
+chosen_settings()
+{
+  static ChosenSettings settings;
+  return settings;
+}
+
+// Whether the parameter was given to the node, rather than left to its default.
+bool
+is_set(rclcpp::Node & node, const std::string & name)
+{
+  return node.get_node_parameters_interface()->get_parameter_overrides().count(name) != 0;
+}
+}  // namespace
+
+BackendType
+declare_memory_backend(rclcpp::Node & node)
+{
+  const BackendType type = backend_type_from_string(
+    node.declare_parameter<std::string>("memory_backend", to_string(default_backend_type())));
+  // Fail early rather than on the first allocation.
+  BufferPool & buffer_pool = get_backend(type)->buffer_pool();
+  const size_t buffer_pool_bytes = static_cast<size_t>(
+    std::max<int64_t>(
+      node.declare_parameter<int64_t>(
+        "buffer_pool_max_bytes", static_cast<int64_t>(buffer_pool.high_water_mark())), 0));
+
+  ChosenSettings & chosen = chosen_settings();
+  std::lock_guard<std::mutex> lock(chosen.mutex);
+  if (is_set(node, "memory_backend")) {
+    if (!chosen.default_backend) {
+      set_default_backend_type(type);
+      chosen.default_backend = true;
+    } else if (type != default_backend_type()) {
+      RCLCPP_WARN(
+        node.get_logger(), "Another node of the process chose the %s memory backend, type adapter "
+        "conversions stay on it while this node allocates on %s",
+        to_string(default_backend_type()).c_str(), to_string(type).c_str());
+    }
+  }
+
+  if (is_set(node, "buffer_pool_max_bytes")) {
+    const auto pool = chosen.buffer_pool_bytes.find(type);
+    if (pool == chosen.buffer_pool_bytes.end()) {
+      buffer_pool.set_high_water_mark(buffer_pool_bytes);
+      chosen.buffer_pool_bytes.emplace(type, buffer_pool_bytes);
+    } else if (pool->second != buffer_pool_bytes) {
+      RCLCPP_WARN(
+        node.get_logger(), "Another node of the process limited the %s buffer pool to %zu bytes, "
+        "ignoring buffer_pool_max_bytes of %zu", to_string(type).c_str(), pool->second,
+        buffer_pool_bytes);
+    }
+  }
+  return type;
+}
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
@@ -0,0 +1,279 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "rclcpp/rclcpp.hpp"
+
+#include "type_adapters/image_container.hpp"
+#include "type_adapters/nvtx.hpp"
+#include "type_adapters/pipeline_link.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+namespace
+{
+// Polls of an empty ring before the consumer thread parks.
+constexpr int kSpinCount = 1000;
+
+constexpr int kWarningPeriodMs = 1000;
+}  // namespace
+
+PipelineLinkOptions
+declare_pipeline_link_options(rclcpp::Node & node, size_t min_capacity)
+{
+  PipelineLinkOptions options;
+  options.capacity = std::max(
+    static_cast<size_t>(std::max<int64_t>(
+      node.declare_parameter<int64_t>(
+        "link_capacity", static_cast<int64_t>(options.capacity)), 1)), min_capacity);
+  options.cpu = static_cast<int>(node.declare_parameter<int64_t>("link_cpu", options.cpu));
+  options.thread = node.declare_parameter<bool>("link_thread", options.thread);
+  return options;
+}
+
+std::shared_ptr<PipelineLink>
+PipelineLink::get(const std::string & name, size_t capacity)
+{
+  static std::mutex mutex;
+  static std::map<std::string, std::weak_ptr<PipelineLink>> links;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto & entry = links[name];
+  auto link = entry.lock();
+  if (!link) {
+    link = std::make_shared<PipelineLink>(capacity);
+    entry = link;
+  }
+  return link;
+}
+
+PipelineLink::PipelineLink(size_t capacity)
+: ring_(capacity)
+{
+}
+
+PipelineLink::~PipelineLink()
+{
+  stop();
+}
+
+void
+PipelineLink::attach_producer()
+{
+  if (producer_attached_.exchange(true)) {
+    throw std::logic_error("A pipeline link takes frames from one publisher only");
+  }
+}
+
+void
+PipelineLink::detach_producer()
+{
+  producer_attached_.store(false);
+}
+
+bool
+PipelineLink::push(std::unique_ptr<ImageContainer> image)
+{
+  if (direct_.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock(direct_mutex_);
+    if (direct_callback_) {
+      // Frames pushed before the consumer connected keep their order.
+      while (auto queued = ring_.pop()) {
+        direct_callback_(std::move(queued));
+      }
+      direct_callback_(std::move(image));
+      return true;
+    }
+  }
+  if (!ring_.push(image)) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  // Pairs with the fence of the consumer once it parks: either it sees the frame, or this sees
+  // it parked.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (parked_.load(std::memory_order_relaxed)) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+    }
+    condition_.notify_one();
+  }
+  return true;
+}
+
+bool
+PipelineLink::start(Callback callback, int cpu)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (consumer_.joinable() || direct_.load()) {
+    throw std::logic_error("A pipeline link passes frames to one subscription only");
+  }
+  stop_.store(false);
+  consumer_ = std::thread(&PipelineLink::run, this, std::move(callback));
+  if (cpu < 0) {
+    return true;
+  }
+  if (cpu >= CPU_SETSIZE) {
+    return false;
+  }
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  return pthread_setaffinity_np(consumer_.native_handle(), sizeof(cpus), &cpus) == 0;
+}
+
+void
+PipelineLink::connect(Callback callback)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (consumer_.joinable() || direct_.load()) {
+    throw std::logic_error("A pipeline link passes frames to one subscription only");
+  }
+  {
+    std::lock_guard<std::mutex> direct_lock(direct_mutex_);
+    direct_callback_ = std::move(callback);
+  }
+  direct_.store(true, std::memory_order_release);
+}
+
+void
+PipelineLink::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (direct_.load()) {
+      std::lock_guard<std::mutex> direct_lock(direct_mutex_);
+      direct_callback_ = nullptr;
+      direct_.store(false);
+      return;
+    }
+    if (!consumer_.joinable()) {
+      return;
+    }
+    stop_.store(true);
+  }
+  condition_.notify_one();
+  consumer_.join();
+}
+
+uint64_t
+PipelineLink::dropped() const
+{
+  return dropped_.load(std::memory_order_relaxed);
+}
+
+size_t
+PipelineLink::capacity() const
+{
+  return ring_.capacity();
+}
+
+void
+PipelineLink::run(Callback callback)
+{
+  int idle = 0;
+  while (!stop_.load(std::memory_order_acquire)) {
+    if (auto image = ring_.pop()) {
+      idle = 0;
+      callback(std::move(image));
+      continue;
+    }
+    if (++idle < kSpinCount) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    nvtxRangePushA("PipelineLink: Park");
+    parked_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      condition_.wait(lock, [this] {return stop_.load() || !ring_.empty();});
+    }
+    parked_.store(false, std::memory_order_relaxed);
+    idle = 0;
+    nvtxRangePop();
+  }
+}
+
+PipelineLinkPublisher::PipelineLinkPublisher(
+  rclcpp::Node & node, const std::string & link, const PipelineLinkOptions & options)
+: logger_(node.get_logger()),
+  clock_(node.get_clock()),
+  link_(PipelineLink::get(link, options.capacity))
+{
+  link_->attach_producer();
+  RCLCPP_INFO(
+    logger_, "Publishing on pipeline link %s of %zu frames", link.c_str(), link_->capacity());
+}
+
+PipelineLinkPublisher::~PipelineLinkPublisher()
+{
+  link_->detach_producer();
+}
+
+bool
+PipelineLinkPublisher::publish(std::unique_ptr<ImageContainer> image)
+{
+  if (!link_->push(std::move(image))) {
+    RCLCPP_WARN_THROTTLE(
+      logger_, *clock_, kWarningPeriodMs,
+      "Dropping frame, the next stage is %zu frames behind", link_->capacity());
+    return false;
+  }
+  return true;
+}
+
+PipelineLinkSubscription::PipelineLinkSubscription(
+  rclcpp::Node & node, const std::string & link, Callback callback,
+  const PipelineLinkOptions & options)
+: link_(PipelineLink::get(link, options.capacity))
+{
+  if (!options.thread) {
+    link_->connect(std::move(callback));
+    RCLCPP_INFO(node.get_logger(), "Called directly through pipeline link %s", link.c_str());
+    return;
+  }
+  if (!link_->start(std::move(callback), options.cpu)) {
+    RCLCPP_WARN(
+      node.get_logger(), "Failed to pin the thread of pipeline link %s to CPU %d",
+      link.c_str(), options.cpu);
+  }
+  RCLCPP_INFO(
+    node.get_logger(), "Subscribed to pipeline link %s of %zu frames", link.c_str(),
+    link_->capacity());
+}
+
+PipelineLinkSubscription::~PipelineLinkSubscription()
+{
+  link_->stop();
+}
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
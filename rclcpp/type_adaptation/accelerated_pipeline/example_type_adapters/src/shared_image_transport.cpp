@@ -0,0 +1,252 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "example_type_adapters_msgs/msg/shared_image_handle.hpp"
+#include "rclcpp/rclcpp.hpp"
+
+#include "type_adapters/backend.hpp"
+#include "type_adapters/image_container.hpp"
+#include "type_adapters/nvtx.hpp"
+#include "type_adapters/shared_image_transport.hpp"
+#include "type_adapters/shared_memory.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+namespace
+{
+// Mappings a subscription keeps, publishers only move to a new segment when frames grow.
+constexpr size_t kMaxSegments = 8;
+
+constexpr int kWarningPeriodMs = 1000;
+}  // namespace
+
+SharedImagePublisher::SharedImagePublisher(
+  rclcpp::Node & node, const std::string & topic, const rclcpp::QoS & qos,
+  const SharedImagePublisherOptions & options)
+: logger_(node.get_logger()),
+  clock_(node.get_clock()),
+  publisher_(node.create_publisher<example_type_adapters_msgs::msg::SharedImageHandle>(
+      topic, qos)),
+  options_(options)
+{
+  if (options_.slot_count == 0) {
+    throw std::invalid_argument("A shared image publisher needs at least one slot");
+  }
+}
+
+ImageContainer
+SharedImagePublisher::loan(
+  std_msgs::msg::Header header, uint32_t height, uint32_t width,
+  const std::string & encoding, uint32_t step)
+{
+  auto stream = get_backend(BackendType::kHost)->create_stream();
+  auto segment = segment_for(static_cast<size_t>(height) * step);
+  uint32_t slot = 0;
+  uint64_t generation = 0;
+  if (!segment->acquire(options_.lease, slot, generation)) {
+    return ImageContainer(std::move(header), height, width, encoding, step, std::move(stream));
+  }
+  return ImageContainer(
+    std::move(header), height, width, encoding, step, segment->wrap(slot, generation),
+    std::move(stream));
+}
+
+bool
+SharedImagePublisher::publish(std::unique_ptr<ImageContainer> image)
+{
+  nvtxRangePushA("SharedImagePublisher:Publish");
+  const size_t subscriptions = publisher_->get_subscription_count();
+  if (subscriptions == 0) {
+    nvtxRangePop();
+    return true;
+  }
+
+  std::shared_ptr<SharedFrameSegment> segment;
+  uint32_t slot = 0;
+  uint64_t generation = 0;
+  // Holds the reference of this publisher on a frame that is copied in, dropped once published.
+  std::shared_ptr<MemoryWrapper> slot_memory;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    segment = segment_;
+  }
+  if (segment && image->backend_type() == BackendType::kHost && !image->is_view() &&
+    segment->find_slot(image->cdata(), slot))
+  {
+    // Loaned, the image itself holds the reference of this publisher.
+    generation = segment->generation(slot);
+    image->stream()->synchronize();
+  } else {
+    segment = segment_for(static_cast<size_t>(image->height()) * image->packed_step());
+    if (!segment->acquire(options_.lease, slot, generation)) {
+      RCLCPP_WARN_THROTTLE(
+        logger_, *clock_, kWarningPeriodMs,
+        "Dropping frame, all %u shared memory slots are in use", segment->slot_count());
+      nvtxRangePop();
+      return false;
+    }
+    slot_memory = segment->wrap(slot, generation);
+    image->copy_to_host_async(slot_memory->device_memory())->wait();
+  }
+
+  auto handle = std::make_unique<example_type_adapters_msgs::msg::SharedImageHandle>();
+  handle->header = image->header();
+  handle->segment = segment->name();
+  handle->slot = slot;
+  handle->offset = segment->slot_offset(slot);
+  handle->generation = generation;
+  handle->height = image->height();
+  handle->width = image->width();
+  handle->encoding = image->encoding();
+  handle->step = image->packed_step();
+  handle->tile_x = image->tile().x;
+  handle->tile_y = image->tile().y;
+  handle->tile_frame_width = image->tile().frame_width;
+  handle->tile_frame_height = image->tile().frame_height;
+  handle->tile_index = image->tile().index;
+  handle->tile_count = image->tile().count;
+  handle->source_generation = image->source_generation();
+
+  const uint32_t consumers = static_cast<uint32_t>(
+    std::min<size_t>(subscriptions, std::numeric_limits<uint32_t>::max()));
+  if (!segment->publish(slot, generation, consumers)) {
+    nvtxRangePop();
+    return false;
+  }
+  publisher_->publish(std::move(handle));
+  nvtxRangePop();
+  return true;
+}
+
+size_t
+SharedImagePublisher::get_subscription_count() const
+{
+  return publisher_->get_subscription_count();
+}
+
+std::shared_ptr<SharedFrameSegment>
+SharedImagePublisher::segment_for(size_t bytes)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!segment_ || segment_->slot_bytes() < bytes) {
+    // Frames in the old segment keep it mapped until they are released.
+    segment_ = SharedFrameSegment::create(options_.slot_count, bytes);
+    RCLCPP_INFO(
+      logger_, "Created shared memory segment %s with %u slots of %zu bytes",
+      segment_->name().c_str(), segment_->slot_count(), segment_->slot_bytes());
+  }
+  return segment_;
+}
+
+SharedImageSubscription::SharedImageSubscription(
+  rclcpp::Node & node, const std::string & topic, const rclcpp::QoS & qos, Callback callback,
+  BackendType backend_type)
+: callback_(std::move(callback)),
+  backend_type_(backend_type),
+  logger_(node.get_logger()),
+  clock_(node.get_clock()),
+  subscription_(node.create_subscription<example_type_adapters_msgs::msg::SharedImageHandle>(
+      topic, qos, std::bind(&SharedImageSubscription::on_handle, this, std::placeholders::_1)))
+{
+}
+
+void
+SharedImageSubscription::on_handle(
+  example_type_adapters_msgs::msg::SharedImageHandle::UniquePtr handle)
+{
+  nvtxRangePushA("SharedImageSubscription:OnHandle");
+  std::shared_ptr<SharedFrameSegment> frame_segment;
+  try {
+    frame_segment = segment(handle->segment);
+  } catch (const std::runtime_error & error) {
+    RCLCPP_WARN_THROTTLE(logger_, *clock_, kWarningPeriodMs, "Dropping frame: %s", error.what());
+    nvtxRangePop();
+    return;
+  }
+  const size_t bytes = static_cast<size_t>(handle->height) * handle->step;
+  if (handle->slot >= frame_segment->slot_count() ||
+    handle->offset != frame_segment->slot_offset(handle->slot) ||
+    bytes > frame_segment->slot_bytes())
+  {
+    RCLCPP_WARN_THROTTLE(
+      logger_, *clock_, kWarningPeriodMs, "Dropping frame that does not fit segment %s",
+      handle->segment.c_str());
+    nvtxRangePop();
+    return;
+  }
+  // Checks the generation and claims the reference the publisher counted for this subscription in
+  // one step, the slot cannot be reclaimed in between.
+  if (!frame_segment->claim(handle->slot, handle->generation)) {
+    RCLCPP_WARN_THROTTLE(
+      logger_, *clock_, kWarningPeriodMs,
+      "Dropping frame whose lease expired before it was received");
+    nvtxRangePop();
+    return;
+  }
+
+  // Takes over the claimed reference.
+  auto slot_memory = frame_segment->wrap(handle->slot, handle->generation);
+  auto backend = get_backend(backend_type_);
+  auto stream = backend->create_stream();
+  std::shared_ptr<MemoryWrapper> memory = slot_memory;
+  if (backend_type_ != BackendType::kHost) {
+    memory = backend->allocate(bytes);
+    memory->copy_to_device(slot_memory->device_memory(), bytes, *stream);
+    slot_memory.reset();
+  }
+  auto image = std::make_unique<ImageContainer>(
+    handle->header, handle->height, handle->width, handle->encoding, handle->step,
+    std::move(memory), std::move(stream));
+  TilePlacement tile;
+  tile.x = handle->tile_x;
+  tile.y = handle->tile_y;
+  tile.frame_width = handle->tile_frame_width;
+  tile.frame_height = handle->tile_frame_height;
+  tile.index = handle->tile_index;
+  tile.count = handle->tile_count;
+  image->set_tile(tile);
+  image->set_source_generation(handle->source_generation);
+  nvtxRangePop();
+  callback_(std::move(image));
+}
+
+std::shared_ptr<SharedFrameSegment>
+SharedImageSubscription::segment(const std::string & name)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = segments_.find(name);
+  if (found != segments_.end()) {
+    return found->second;
+  }
+  if (segments_.size() >= kMaxSegments) {
+    // Frames still in use keep their segment mapped.
+    segments_.clear();
+  }
+  auto attached = SharedFrameSegment::attach(name);
+  segments_.emplace(name, attached);
+  return attached;
+}
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
@@ -0,0 +1,428 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "type_adapters/host_backend.hpp"
+#include "type_adapters/shared_memory.hpp"
+
+namespace type_adaptation
+{
+namespace example_type_adapters
+{
+
+// Generation and references of a slot, packed so that all change in one atomic operation.
+struct SharedFrameSegment::SlotHeader
+{
+  std::atomic<uint64_t> state;
+  // Steady clock time of the last publish, 0 while the creator fills the slot.
+  std::atomic<int64_t> published_ns;
+};
+
+namespace
+{
+constexpr uint64_t kMagic = 0x31454d4152465441;  // "ATFRAME1"
+constexpr size_t kCacheLine = 64;
+
+// References of handles published but not claimed yet in the low bits, claimed ones above them.
+constexpr int kCountBits = 12;
+constexpr uint64_t kCountMask = (uint64_t{1} << kCountBits) - 1;
+constexpr int kReferenceBits = 2 * kCountBits;
+constexpr uint64_t kGenerationMask = (uint64_t{1} << (64 - kReferenceBits)) - 1;
+
+static_assert(
+  std::atomic<uint64_t>::is_always_lock_free && std::atomic<int64_t>::is_always_lock_free,
+  "Slot headers are shared between processes and need address-free atomics");
+
+struct SegmentHeader
+{
+  uint64_t magic;
+  uint64_t slot_count;
+  uint64_t slot_bytes;
+  uint64_t data_offset;
+};
+
+uint64_t
+generation_of(uint64_t state)
+{
+  return state >> kReferenceBits;
+}
+
+uint32_t
+pending_of(uint64_t state)
+{
+  return static_cast<uint32_t>(state & kCountMask);
+}
+
+uint32_t
+claimed_of(uint64_t state)
+{
+  return static_cast<uint32_t>((state >> kCountBits) & kCountMask);
+}
+
+uint32_t
+references_of(uint64_t state)
+{
+  return pending_of(state) + claimed_of(state);
+}
+
+uint64_t
+make_state(uint64_t generation, uint64_t claimed, uint64_t pending)
+{
+  return ((generation & kGenerationMask) << kReferenceBits) |
+         ((claimed & kCountMask) << kCountBits) | (pending & kCountMask);
+}
+
+size_t
+round_up(size_t value, size_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+size_t
+slot_headers_offset()
+{
+  return round_up(sizeof(SegmentHeader), kCacheLine);
+}
+
+int64_t
+now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::runtime_error
+system_error(const std::string & what, const std::string & name)
+{
+  return std::runtime_error(what + " shared memory segment " + name + ": " + std::strerror(errno));
+}
+
+// Slot memory that drops its reference on the generation when destroyed.
+class SlotStorage final : public ExternalHostStorage
+{
+public:
+  SlotStorage(std::shared_ptr<SharedFrameSegment> segment, uint32_t slot, uint64_t generation)
+  : segment_(std::move(segment)), slot_(slot), generation_(generation)
+  {
+  }
+
+  ~SlotStorage() override
+  {
+    segment_->release(slot_, generation_);
+  }
+
+  uint8_t *
+  data() override
+  {
+    return segment_->slot_data(slot_);
+  }
+
+  size_t
+  size() const override
+  {
+    return segment_->slot_bytes();
+  }
+
+  bool
+  is_shared() const override
+  {
+    return segment_->references(slot_, generation_) > 1;
+  }
+
+private:
+  std::shared_ptr<SharedFrameSegment> segment_;
+  uint32_t slot_;
+  uint64_t generation_;
+};
+
+}  // namespace
+
+std::shared_ptr<SharedFrameSegment>
+SharedFrameSegment::create(size_t slot_count, size_t slot_bytes)
+{
+  static std::atomic<uint64_t> counter{0};
+  const std::string name = "/type_adapters_" + std::to_string(getpid()) + "_" +
+    std::to_string(counter++);
+
+  const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  slot_bytes = round_up(std::max<size_t>(slot_bytes, 1), page_size);
+  const size_t data_offset = round_up(
+    slot_headers_offset() + slot_count * kCacheLine, page_size);
+  const size_t mapping_bytes = data_offset + slot_count * slot_bytes;
+
+  const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    throw system_error("Failed to create", name);
+  }
+  if (ftruncate(fd, static_cast<off_t>(mapping_bytes)) != 0) {
+    auto error = system_error("Failed to size", name);
+    close(fd);
+    shm_unlink(name.c_str());
+    throw error;
+  }
+  void * mapping = mmap(nullptr, mapping_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    auto error = system_error("Failed to map", name);
+    shm_unlink(name.c_str());
+    throw error;
+  }
+
+  new (mapping) SegmentHeader{kMagic, slot_count, slot_bytes, data_offset};
+  for (size_t slot = 0; slot < slot_count; ++slot) {
+    uint8_t * slot_header = static_cast<uint8_t *>(mapping) + slot_headers_offset() +
+      slot * kCacheLine;
+    new (slot_header) SlotHeader{{0}, {0}};
+  }
+
+  return std::shared_ptr<SharedFrameSegment>(
+    new SharedFrameSegment(name, static_cast<uint8_t *>(mapping), mapping_bytes, true));
+}
+
+std::shared_ptr<SharedFrameSegment>
+SharedFrameSegment::attach(const std::string & name)
+{
+  const int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    throw system_error("Failed to open", name);
+  }
+  struct stat status {};
+  if (fstat(fd, &status) != 0) {
+    auto error = system_error("Failed to stat", name);
+    close(fd);
+    throw error;
+  }
+  const size_t mapping_bytes = static_cast<size_t>(status.st_size);
+  if (mapping_bytes < sizeof(SegmentHeader)) {
+    close(fd);
+    throw std::runtime_error("Shared memory segment " + name + " is not a frame segment");
+  }
+  void * mapping = mmap(nullptr, mapping_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    throw system_error("Failed to map", name);
+  }
+
+  // Owns the mapping from here on, so that it is unmapped if the checks below throw.
+  std::shared_ptr<SharedFrameSegment> segment(
+    new SharedFrameSegment(name, static_cast<uint8_t *>(mapping), mapping_bytes, false));
+  const auto & header = *static_cast<const SegmentHeader *>(mapping);
+  if (header.magic != kMagic || header.slot_count > UINT32_MAX || header.slot_bytes == 0 ||
+    header.data_offset < slot_headers_offset() + header.slot_count * kCacheLine ||
+    header.data_offset + header.slot_count * header.slot_bytes > mapping_bytes)
+  {
+    throw std::runtime_error("Shared memory segment " + name + " is not a frame segment");
+  }
+  return segment;
+}
+
+SharedFrameSegment::SharedFrameSegment(
+  std::string name, uint8_t * mapping, size_t mapping_bytes, bool is_owner)
+: name_(std::move(name)), mapping_(mapping), mapping_bytes_(mapping_bytes), is_owner_(is_owner)
+{
+  const auto & header = *reinterpret_cast<const SegmentHeader *>(mapping_);
+  slot_count_ = static_cast<uint32_t>(header.slot_count);
+  slot_bytes_ = static_cast<size_t>(header.slot_bytes);
+  data_offset_ = static_cast<size_t>(header.data_offset);
+}
+
+SharedFrameSegment::~SharedFrameSegment()
+{
+  munmap(mapping_, mapping_bytes_);
+  if (is_owner_) {
+    shm_unlink(name_.c_str());
+  }
+}
+
+bool
+SharedFrameSegment::acquire(std::chrono::nanoseconds lease, uint32_t & slot, uint64_t & generation)
+{
+  for (uint32_t candidate = 0; candidate < slot_count_; ++candidate) {
+    SlotHeader & header = slot_header(candidate);
+    uint64_t state = header.state.load();
+    if (references_of(state) != 0) {
+      continue;
+    }
+    const uint64_t next = make_state(generation_of(state) + 1, 1, 0);
+    if (header.state.compare_exchange_strong(state, next)) {
+      header.published_ns.store(0);
+      slot = candidate;
+      generation = generation_of(next);
+      return true;
+    }
+  }
+
+  // Every slot is referenced, reclaim the one whose lease expired first among those that only
+  // hold references of handles nobody claimed. A claimed frame may still be read or written in
+  // place, so its slot is never taken away.
+  const int64_t now = now_ns();
+  bool found = false;
+  int64_t oldest = 0;
+  for (uint32_t candidate = 0; candidate < slot_count_; ++candidate) {
+    const SlotHeader & header = slot_header(candidate);
+    const int64_t published = header.published_ns.load();
+    if (published == 0 || now - published < lease.count() ||
+      claimed_of(header.state.load()) != 0)
+    {
+      continue;
+    }
+    if (!found || published < oldest) {
+      found = true;
+      oldest = published;
+      slot = candidate;
+    }
+  }
+  if (!found) {
+    return false;
+  }
+  SlotHeader & header = slot_header(slot);
+  uint64_t state = header.state.load();
+  uint64_t next;
+  // Late claims and releases of the old generation fail from here on.
+  do {
+    if (claimed_of(state) != 0) {
+      // Claimed in the meantime.
+      return false;
+    }
+    next = make_state(generation_of(state) + 1, 1, 0);
+  } while (!header.state.compare_exchange_weak(state, next));
+  header.published_ns.store(0);
+  generation = generation_of(next);
+  return true;
+}
+
+bool
+SharedFrameSegment::publish(uint32_t slot, uint64_t generation, uint32_t consumers)
+{
+  SlotHeader & header = slot_header(slot);
+  uint64_t state = header.state.load();
+  do {
+    if (generation_of(state) != generation) {
+      return false;
+    }
+    if (pending_of(state) + static_cast<uint64_t>(consumers) > kCountMask) {
+      throw std::overflow_error("Too many references on a shared memory frame");
+    }
+  } while (!header.state.compare_exchange_weak(state, state + consumers));
+  header.published_ns.store(now_ns());
+  return true;
+}
+
+bool
+SharedFrameSegment::claim(uint32_t slot, uint64_t generation)
+{
+  SlotHeader & header = slot_header(slot);
+  uint64_t state = header.state.load();
+  uint64_t next;
+  do {
+    if (generation_of(state) != generation || pending_of(state) == 0 ||
+      claimed_of(state) == kCountMask)
+    {
+      return false;
+    }
+    next = make_state(generation, claimed_of(state) + 1, pending_of(state) - 1);
+  } while (!header.state.compare_exchange_weak(state, next));
+  return true;
+}
+
+void
+SharedFrameSegment::release(uint32_t slot, uint64_t generation)
+{
+  SlotHeader & header = slot_header(slot);
+  uint64_t state = header.state.load();
+  uint64_t next;
+  do {
+    if (generation_of(state) != generation || claimed_of(state) == 0) {
+      return;
+    }
+    next = make_state(generation, claimed_of(state) - 1, pending_of(state));
+  } while (!header.state.compare_exchange_weak(state, next));
+}
+
+uint32_t
+SharedFrameSegment::references(uint32_t slot, uint64_t generation) const
+{
+  const uint64_t state = slot_header(slot).state.load();
+  return generation_of(state) == generation ? references_of(state) : 0;
+}
+
+uint64_t
+SharedFrameSegment::generation(uint32_t slot) const
+{
+  return generation_of(slot_header(slot).state.load());
+}
+
+std::shared_ptr<MemoryWrapper>
+SharedFrameSegment::wrap(uint32_t slot, uint64_t generation)
+{
+  return std::make_shared<HostMemoryWrapper>(
+    std::make_unique<SlotStorage>(shared_from_this(), slot, generation));
+}
+
+bool
+SharedFrameSegment::find_slot(const uint8_t * data, uint32_t & slot) const
+{
+  const uint8_t * first = mapping_ + data_offset_;
+  if (data < first || data >= first + slot_count_ * slot_bytes_) {
+    return false;
+  }
+  const size_t offset = static_cast<size_t>(data - first);
+  if (offset % slot_bytes_ != 0) {
+    return false;
+  }
+  slot = static_cast<uint32_t>(offset / slot_bytes_);
+  return true;
+}
+
+uint8_t *
+SharedFrameSegment::slot_data(uint32_t slot)
+{
+  return mapping_ + slot_offset(slot);
+}
+
+size_t
+SharedFrameSegment::slot_offset(uint32_t slot) const
+{
+  return data_offset_ + static_cast<size_t>(slot) * slot_bytes_;
+}
+
+SharedFrameSegment::SlotHeader &
+SharedFrameSegment::slot_header(uint32_t slot) const
+{
+  // Every slot header gets a cache line of its own.
+  static_assert(sizeof(SlotHeader) <= kCacheLine, "Slot header does not fit a cache line");
+  if (slot >= slot_count_) {
+    throw std::out_of_range("No slot " + std::to_string(slot) + " in segment " + name_);
+  }
+  return *reinterpret_cast<SlotHeader *>(
+    mapping_ + slot_headers_offset() + slot * kCacheLine);
+}
+
+}  // namespace example_type_adapters
+}  // namespace type_adaptation
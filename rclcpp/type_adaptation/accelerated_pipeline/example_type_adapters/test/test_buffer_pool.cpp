@@ -0,0 +1,137 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <memory>
+
+#include "type_adapters/backend.hpp"
+#include "type_adapters/buffer_pool.hpp"
+#include "type_adapters/host_backend.hpp"
+
+using type_adaptation::example_type_adapters::BufferPool;
+using type_adaptation::example_type_adapters::HostMemoryWrapper;
+using type_adaptation::example_type_adapters::MemoryWrapper;
+
+namespace
+{
+const size_t kPage = 4096;
+
+// Pool of host memory that counts what it allocated.
+std::shared_ptr<BufferPool> make_pool(size_t high_water_mark, size_t & allocations)
+{
+  return BufferPool::make(
+    [&allocations](size_t bytes) -> std::unique_ptr<MemoryWrapper> {
+      ++allocations;
+      return std::make_unique<HostMemoryWrapper>(bytes);
+    }, high_water_mark);
+}
+}  // namespace
+
+TEST(BufferPool, RoundsRequestsUpToPages)
+{
+  EXPECT_EQ(BufferPool::bucket_size(0), kPage);
+  EXPECT_EQ(BufferPool::bucket_size(1), kPage);
+  EXPECT_EQ(BufferPool::bucket_size(kPage), kPage);
+  EXPECT_EQ(BufferPool::bucket_size(kPage + 1), 2 * kPage);
+}
+
+TEST(BufferPool, ReusesReleasedBuffers)
+{
+  size_t allocations = 0;
+  auto pool = make_pool(16 * kPage, allocations);
+
+  const uint8_t * first = nullptr;
+  {
+    auto memory = pool->acquire(100);
+    first = memory->device_memory();
+    EXPECT_EQ(memory->size_in_bytes(), kPage);
+  }
+  auto stats = pool->statistics();
+  EXPECT_EQ(stats.misses, 1u);
+  EXPECT_EQ(stats.hits, 0u);
+  EXPECT_EQ(stats.cached_bytes, kPage);
+
+  // Nearly equal sizes share the bucket.
+  auto memory = pool->acquire(kPage - 1);
+  EXPECT_EQ(memory->device_memory(), first);
+  stats = pool->statistics();
+  EXPECT_EQ(stats.hits, 1u);
+  EXPECT_EQ(stats.cached_bytes, 0u);
+
+  // Another bucket misses.
+  auto other = pool->acquire(kPage + 1);
+  EXPECT_EQ(pool->statistics().misses, 2u);
+  EXPECT_EQ(allocations, 2u);
+}
+
+TEST(BufferPool, EvictsLeastRecentlyReleasedAboveHighWaterMark)
+{
+  size_t allocations = 0;
+  auto pool = make_pool(2 * kPage, allocations);
+  {
+    auto a = pool->acquire(kPage);
+    auto b = pool->acquire(kPage);
+    auto c = pool->acquire(kPage);
+  }
+  auto stats = pool->statistics();
+  EXPECT_EQ(stats.misses, 3u);
+  EXPECT_EQ(stats.evictions, 1u);
+  EXPECT_EQ(stats.cached_bytes, 2 * kPage);
+
+  // Buffers larger than the high-water mark are never kept.
+  pool->acquire(3 * kPage).reset();
+  stats = pool->statistics();
+  EXPECT_EQ(stats.evictions, 2u);
+  EXPECT_EQ(stats.cached_bytes, 2 * kPage);
+
+  pool->set_high_water_mark(kPage);
+  stats = pool->statistics();
+  EXPECT_EQ(stats.evictions, 3u);
+  EXPECT_EQ(stats.cached_bytes, kPage);
+  EXPECT_EQ(stats.high_water_mark, kPage);
+
+  pool->clear();
+  EXPECT_EQ(pool->statistics().cached_bytes, 0u);
+}
+
+TEST(BufferPool, ReserveServesLaterRequests)
+{
+  size_t allocations = 0;
+  auto pool = make_pool(3 * kPage, allocations);
+  // Only as many as the high-water mark allows.
+  EXPECT_EQ(pool->reserve(kPage, 4), 3u);
+  EXPECT_EQ(pool->reserve(kPage, 3), 0u);
+  EXPECT_EQ(allocations, 3u);
+
+  auto a = pool->acquire(kPage);
+  auto b = pool->acquire(kPage);
+  auto c = pool->acquire(kPage);
+  const auto stats = pool->statistics();
+  EXPECT_EQ(stats.hits, 3u);
+  EXPECT_EQ(stats.misses, 0u);
+  EXPECT_EQ(allocations, 3u);
+}
+
+TEST(BufferPool, BuffersOutliveThePool)
+{
+  size_t allocations = 0;
+  auto pool = make_pool(16 * kPage, allocations);
+  auto memory = pool->acquire(kPage);
+  pool.reset();
+  memory->device_memory()[0] = 1;
+  memory.reset();
+}
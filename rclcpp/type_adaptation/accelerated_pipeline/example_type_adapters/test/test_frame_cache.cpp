@@ -0,0 +1,218 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "std_msgs/msg/header.hpp"
+#include "type_adapters/backend.hpp"
+#include "type_adapters/frame_cache.hpp"
+#include "type_adapters/image_container.hpp"
+
+using type_adaptation::example_type_adapters::BackendType;
+using type_adaptation::example_type_adapters::FrameCache;
+using type_adaptation::example_type_adapters::ImageContainer;
+using type_adaptation::example_type_adapters::set_default_backend_type;
+
+namespace
+{
+const uint32_t kHeight = 4;
+const uint32_t kWidth = 4;
+const size_t kFrameBytes = kHeight * kWidth * 3;
+
+// Write value to every byte of frame, once the work queued on it ran.
+void fill(ImageContainer & frame, uint8_t value)
+{
+  uint8_t * pixels = frame.data();
+  frame.stream()->synchronize();
+  std::memset(pixels, value, frame.size_in_bytes());
+}
+
+ImageContainer make_frame(uint8_t value, const std::string & frame_id = "")
+{
+  std_msgs::msg::Header header;
+  header.frame_id = frame_id;
+  ImageContainer frame(header, kHeight, kWidth, "rgb8", kWidth * 3);
+  fill(frame, value);
+  return frame;
+}
+
+// Whether every pixel of frame, which may be a view, is value.
+bool holds(const ImageContainer & frame, uint8_t value)
+{
+  frame.stream()->synchronize();
+  for (uint32_t row = 0; row < frame.height(); ++row) {
+    const uint8_t * pixels = frame.cdata() + static_cast<size_t>(row) * frame.step();
+    for (uint32_t byte = 0; byte < frame.packed_step(); ++byte) {
+      if (pixels[byte] != value) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+class FrameCacheTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    set_default_backend_type(BackendType::kHost);
+  }
+};
+}  // namespace
+
+TEST_F(FrameCacheTest, FindsOnlyInsertedKeys)
+{
+  FrameCache cache(1 << 20);
+  ImageContainer found;
+  EXPECT_FALSE(cache.find(1, found));
+
+  cache.insert(1, make_frame(1, "first"));
+  ASSERT_TRUE(cache.find(1, found));
+  EXPECT_EQ(found.header().frame_id, "first");
+  EXPECT_TRUE(holds(found, 1));
+
+  // A key that is cached already keeps its frame.
+  cache.insert(1, make_frame(2, "second"));
+  ASSERT_TRUE(cache.find(1, found));
+  EXPECT_EQ(found.header().frame_id, "first");
+  EXPECT_EQ(cache.memory_bytes(), kFrameBytes);
+}
+
+TEST_F(FrameCacheTest, DropsFramesBeyondTheMemoryBudgetWithoutEvicting)
+{
+  FrameCache cache(2 * kFrameBytes + 1);
+  cache.insert(1, make_frame(1));
+  cache.insert(2, make_frame(2));
+  cache.insert(3, make_frame(3));
+  EXPECT_EQ(cache.memory_bytes(), 2 * kFrameBytes);
+  EXPECT_EQ(cache.spill_bytes(), 0u);
+
+  // Cyclic keys would evict every frame before its next use, so the old ones stay.
+  ImageContainer found;
+  EXPECT_TRUE(cache.find(1, found));
+  EXPECT_TRUE(cache.find(2, found));
+  EXPECT_FALSE(cache.find(3, found));
+}
+
+TEST_F(FrameCacheTest, CachedFramesSurviveWritesDownstream)
+{
+  FrameCache cache(1 << 20);
+  ImageContainer published = make_frame(1);
+  cache.insert(1, published);
+  EXPECT_TRUE(published.is_shared());
+
+  ImageContainer found;
+  ASSERT_TRUE(cache.find(1, found));
+  EXPECT_TRUE(found.is_shared());
+  fill(found, 2);
+  fill(published, 3);
+  EXPECT_TRUE(holds(found, 2));
+  EXPECT_TRUE(holds(published, 3));
+
+  ImageContainer again;
+  ASSERT_TRUE(cache.find(1, again));
+  EXPECT_TRUE(holds(again, 1));
+}
+
+TEST_F(FrameCacheTest, SpillsFramesBeyondTheMemoryBudgetToFiles)
+{
+  FrameCache cache(kFrameBytes, 2 * kFrameBytes, ::testing::TempDir());
+  cache.insert(1, make_frame(1));
+  cache.insert(2, make_frame(2, "spilled"));
+  cache.insert(3, make_frame(3));
+  cache.insert(4, make_frame(4));
+  EXPECT_EQ(cache.memory_bytes(), kFrameBytes);
+  EXPECT_EQ(cache.spill_bytes(), 2 * kFrameBytes);
+
+  ImageContainer found;
+  EXPECT_FALSE(cache.find(4, found));
+  ASSERT_TRUE(cache.find(2, found));
+  EXPECT_EQ(found.header().frame_id, "spilled");
+  EXPECT_EQ(found.height(), kHeight);
+  EXPECT_EQ(found.width(), kWidth);
+  EXPECT_EQ(found.encoding(), "rgb8");
+  EXPECT_TRUE(holds(found, 2));
+
+  // Frames read back from the mapping clone it before they are written.
+  EXPECT_TRUE(found.is_shared());
+  fill(found, 5);
+  ImageContainer again;
+  ASSERT_TRUE(cache.find(2, again));
+  EXPECT_TRUE(holds(again, 2));
+  EXPECT_TRUE(holds(found, 5));
+}
+
+TEST_F(FrameCacheTest, SpillsViewsAsPackedImages)
+{
+  std_msgs::msg::Header header;
+  ImageContainer parent(header, 8, 8, "mono8", 8);
+  uint8_t * pixels = parent.data();
+  parent.stream()->synchronize();
+  for (size_t row = 0; row < 8; ++row) {
+    std::memset(pixels + row * 8, static_cast<int>(row), 8);
+  }
+
+  FrameCache cache(0, 1 << 20, ::testing::TempDir());
+  cache.insert(1, parent.view(2, 3, 5, 2));
+  EXPECT_EQ(cache.spill_bytes(), 10u);
+
+  ImageContainer found;
+  ASSERT_TRUE(cache.find(1, found));
+  EXPECT_FALSE(found.is_view());
+  EXPECT_EQ(found.step(), 5u);
+  EXPECT_TRUE(holds(found.view(0, 0, 5, 1), 3));
+  EXPECT_TRUE(holds(found.view(0, 1, 5, 1), 4));
+}
+
+TEST_F(FrameCacheTest, ClearDropsFramesButNotTheirCopies)
+{
+  FrameCache cache(kFrameBytes, kFrameBytes, ::testing::TempDir());
+  cache.insert(1, make_frame(1));
+  cache.insert(2, make_frame(2));
+  ImageContainer in_memory;
+  ImageContainer spilled;
+  ASSERT_TRUE(cache.find(1, in_memory));
+  ASSERT_TRUE(cache.find(2, spilled));
+
+  // What a node does once the keys of its frames change meaning, e.g. on a new grid generation.
+  cache.clear();
+  EXPECT_EQ(cache.memory_bytes(), 0u);
+  EXPECT_EQ(cache.spill_bytes(), 0u);
+  ImageContainer found;
+  EXPECT_FALSE(cache.find(1, found));
+  EXPECT_FALSE(cache.find(2, found));
+  EXPECT_TRUE(holds(in_memory, 1));
+  EXPECT_TRUE(holds(spilled, 2));
+
+  // The budgets are free again.
+  cache.insert(1, make_frame(3));
+  cache.insert(2, make_frame(4));
+  EXPECT_EQ(cache.memory_bytes(), kFrameBytes);
+  EXPECT_EQ(cache.spill_bytes(), kFrameBytes);
+}
+
+TEST_F(FrameCacheTest, ThrowsIfASpillFileCannotBeCreated)
+{
+  FrameCache cache(0, 1 << 20, "/nonexistent/frame_cache");
+  EXPECT_THROW(cache.insert(1, make_frame(1)), std::runtime_error);
+  EXPECT_EQ(cache.spill_bytes(), 0u);
+}
@@ -0,0 +1,250 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "sensor_msgs/msg/image.hpp"
+#include "std_msgs/msg/header.hpp"
+#include "type_adapters/backend.hpp"
+#include "type_adapters/host_backend.hpp"
+#include "type_adapters/image_container.hpp"
+
+using type_adaptation::example_type_adapters::BackendType;
+using type_adaptation::example_type_adapters::Fence;
+using type_adaptation::example_type_adapters::HostCopyEngine;
+using type_adaptation::example_type_adapters::HostMemoryWrapper;
+using type_adaptation::example_type_adapters::HostStreamWrapper;
+using type_adaptation::example_type_adapters::ImageContainer;
+using type_adaptation::example_type_adapters::set_default_backend_type;
+
+namespace
+{
+// Holds the shared copy engine until released, so that the transfers queued behind it are
+// still pending.
+class EngineGate
+{
+public:
+  EngineGate()
+  : opened_(open_.get_future().share())
+  {
+    auto opened = opened_;
+    fence_ = HostCopyEngine::instance().enqueue([opened] {opened.wait();});
+  }
+
+  ~EngineGate()
+  {
+    release();
+  }
+
+  void
+  release()
+  {
+    if (!released_) {
+      released_ = true;
+      open_.set_value();
+      fence_->wait();
+    }
+  }
+
+private:
+  std::promise<void> open_;
+  std::shared_future<void> opened_;
+  std::shared_ptr<Fence> fence_;
+  bool released_{false};
+};
+}  // namespace
+
+TEST(HostCopyEngine, RunsTransfersInOrder)
+{
+  HostCopyEngine engine;
+  std::vector<int> order;
+  std::vector<std::shared_ptr<Fence>> fences;
+  for (int index = 0; index < 16; ++index) {
+    fences.push_back(engine.enqueue([&order, index] {order.push_back(index);}));
+  }
+  fences.back()->wait();
+  for (const auto & fence : fences) {
+    EXPECT_TRUE(fence->is_ready());
+  }
+  ASSERT_EQ(order.size(), 16u);
+  for (int index = 0; index < 16; ++index) {
+    EXPECT_EQ(order[index], index);
+  }
+}
+
+TEST(HostCopyEngine, FenceSignalsOnceTheTransferRan)
+{
+  HostCopyEngine engine;
+  std::promise<void> open;
+  auto opened = open.get_future().share();
+  auto blocked = engine.enqueue([opened] {opened.wait();});
+  auto behind = engine.enqueue([] {});
+  EXPECT_FALSE(blocked->is_ready());
+  EXPECT_FALSE(behind->is_ready());
+  open.set_value();
+  behind->wait();
+  EXPECT_TRUE(blocked->is_ready());
+}
+
+TEST(HostCopyEngine, FenceRethrowsAFailedTransfer)
+{
+  HostCopyEngine engine;
+  auto fence = engine.enqueue([] {throw std::runtime_error("failed");});
+  EXPECT_THROW(fence->wait(), std::runtime_error);
+}
+
+TEST(HostStreamWrapper, SynchronizeWaitsForQueuedTransfers)
+{
+  HostMemoryWrapper memory(64);
+  HostStreamWrapper stream;
+  std::vector<uint8_t> source(64, 3);
+  std::shared_ptr<Fence> fence;
+  {
+    EngineGate gate;
+    fence = memory.copy_to_device_async(source.data(), source.size(), stream);
+    EXPECT_FALSE(fence->is_ready());
+  }
+  stream.synchronize();
+  EXPECT_TRUE(fence->is_ready());
+  EXPECT_EQ(memory.device_memory()[63], 3);
+}
+
+TEST(HostStreamWrapper, WaitForTakesOverTheTransfersOfAnotherStream)
+{
+  HostMemoryWrapper memory(64);
+  HostStreamWrapper writer;
+  HostStreamWrapper reader;
+  std::vector<uint8_t> source(64, 5);
+  EngineGate gate;
+  auto fence = memory.copy_to_device_async(source.data(), source.size(), writer);
+  reader.wait_for(writer);
+  gate.release();
+  reader.synchronize();
+  EXPECT_TRUE(fence->is_ready());
+  EXPECT_EQ(memory.device_memory()[0], 5);
+}
+
+TEST(HostMemoryWrapper, CopiesBetweenMemoriesFollowTheirTransfers)
+{
+  HostMemoryWrapper source(64);
+  HostMemoryWrapper destination(64);
+  HostStreamWrapper stream;
+  std::vector<uint8_t> host(64, 7);
+  {
+    EngineGate gate;
+    source.copy_to_device_async(host.data(), host.size(), stream);
+    destination.copy_from(source, 64, stream);
+  }
+  std::vector<uint8_t> result(64, 0);
+  destination.copy_from_device(result.data(), result.size(), stream);
+  EXPECT_EQ(result, host);
+}
+
+TEST(ImageContainer, CopyOnWriteCloneReadsBeforeTheOriginalIsWritten)
+{
+  set_default_backend_type(BackendType::kHost);
+  std_msgs::msg::Header header;
+  ImageContainer original(header, 64, 64, "rgba8", 64 * 4);
+  std::memset(original.data(), 1, original.size_in_bytes());
+  original.stream()->synchronize();
+  ImageContainer copy(original);
+  EXPECT_TRUE(copy.is_shared());
+
+  EngineGate gate;
+  // The clone is queued behind the gate, the original must not be written before it ran.
+  copy.data();
+  EXPECT_FALSE(copy.is_shared());
+  EXPECT_FALSE(original.is_shared());
+  auto synchronized = std::async(
+    std::launch::async, [&original] {original.stream()->synchronize();});
+  EXPECT_EQ(
+    synchronized.wait_for(std::chrono::milliseconds(50)), std::future_status::timeout);
+  gate.release();
+  synchronized.get();
+
+  std::memset(original.data(), 2, original.size_in_bytes());
+  copy.stream()->synchronize();
+  for (size_t index = 0; index < copy.size_in_bytes(); ++index) {
+    ASSERT_EQ(copy.cdata()[index], 1) << "byte " << index;
+  }
+}
+
+TEST(ImageContainer, CopiesOfAViewShareItCopyOnWrite)
+{
+  set_default_backend_type(BackendType::kHost);
+  std_msgs::msg::Header header;
+  ImageContainer original(header, 4, 4, "mono8", 4);
+  std::memset(original.data(), 1, original.size_in_bytes());
+  ImageContainer view = original.view(1, 1, 2, 2);
+  EXPECT_FALSE(view.is_shared());
+  EXPECT_FALSE(original.is_shared());
+
+  // What intra-process fan-out of a published view does.
+  ImageContainer copy(view);
+  EXPECT_TRUE(view.is_shared());
+  EXPECT_TRUE(copy.is_shared());
+  EXPECT_FALSE(original.is_shared());
+
+  // The clone is queued on the stream of the copy, the host writes after it.
+  uint8_t * pixels = copy.data();
+  copy.stream()->synchronize();
+  pixels[0] = 42;
+  EXPECT_FALSE(copy.is_view());
+  EXPECT_EQ(copy.step(), 2u);
+  EXPECT_EQ(copy.origin_x(), 1u);
+  EXPECT_FALSE(copy.is_shared());
+  EXPECT_FALSE(view.is_shared());
+  EXPECT_EQ(view.cdata()[0], 1);
+  EXPECT_EQ(copy.cdata()[0], 42);
+  EXPECT_EQ(copy.cdata()[3], 1);
+
+  // The clone counts its own copies.
+  ImageContainer copy_of_clone(copy);
+  EXPECT_TRUE(copy.is_shared());
+  pixels = copy_of_clone.data();
+  copy_of_clone.stream()->synchronize();
+  pixels[0] = 7;
+  EXPECT_EQ(copy.cdata()[0], 42);
+
+  // The view still writes through to its parent.
+  pixels = view.data();
+  view.stream()->synchronize();
+  pixels[1] = 9;
+  EXPECT_EQ(original.cdata()[1 * 4 + 2], 9);
+}
+
+TEST(ImageContainer, ConversionQueuesTheUploadOfAConstMessage)
+{
+  set_default_backend_type(BackendType::kHost);
+  sensor_msgs::msg::Image message;
+  message.height = 2;
+  message.width = 2;
+  message.encoding = "rgb8";
+  message.step = 6;
+  message.data.assign(12, 7);
+  ImageContainer image(message);
+  // The container keeps its own copy of the message until the upload ran.
+  message.data.assign(12, 9);
+  image.stream()->synchronize();
+  EXPECT_EQ(image.cdata()[11], 7);
+}
@@ -0,0 +1,147 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "sensor_msgs/msg/image.hpp"
+#include "type_adapters/backend.hpp"
+#include "type_adapters/image_container.hpp"
+#include "type_adapters/image_ingest.hpp"
+
+using type_adaptation::example_type_adapters::BackendType;
+using type_adaptation::example_type_adapters::ImageContainer;
+using type_adaptation::example_type_adapters::ImageIngest;
+using type_adaptation::example_type_adapters::ImageIngestStatistics;
+using type_adaptation::example_type_adapters::set_default_backend_type;
+
+namespace
+{
+std::unique_ptr<sensor_msgs::msg::Image> make_message(uint8_t value)
+{
+  auto message = std::make_unique<sensor_msgs::msg::Image>();
+  message->height = 4;
+  message->width = 4;
+  message->encoding = "mono8";
+  message->step = 4;
+  message->data.assign(16, value);
+  return message;
+}
+
+// Wait until the transfer worker added to the transfer time, as staging a frame does last.
+ImageIngestStatistics wait_for_transfer(
+  const ImageIngest & ingest, std::chrono::nanoseconds transfer_time)
+{
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  ImageIngestStatistics statistics = ingest.statistics();
+  while (statistics.transfer_time <= transfer_time &&
+    std::chrono::steady_clock::now() < deadline)
+  {
+    std::this_thread::yield();
+    statistics = ingest.statistics();
+  }
+  return statistics;
+}
+
+class ImageIngestTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    set_default_backend_type(BackendType::kHost);
+  }
+};
+}  // namespace
+
+TEST(ImageIngestStatistics, OverlapEfficiencyIsTheShareOfHiddenTransferTime)
+{
+  ImageIngestStatistics statistics;
+  EXPECT_DOUBLE_EQ(statistics.overlap_efficiency(), 1.0);
+  statistics.transfer_time = std::chrono::nanoseconds(400);
+  statistics.overlapped_time = std::chrono::nanoseconds(100);
+  EXPECT_DOUBLE_EQ(statistics.overlap_efficiency(), 0.25);
+}
+
+TEST_F(ImageIngestTest, FramesComeOutOneMessageLate)
+{
+  ImageIngest ingest;
+  std::vector<uint8_t> computed;
+  const auto compute = [&computed](std::unique_ptr<ImageContainer> image) {
+      image->stream()->synchronize();
+      computed.push_back(image->cdata()[15]);
+    };
+  for (uint8_t value = 1; value <= 3; ++value) {
+    ingest.push(make_message(value), compute);
+    EXPECT_EQ(computed.size(), value - 1u);
+  }
+  ingest.flush(compute);
+  EXPECT_EQ(computed, (std::vector<uint8_t>{1, 2, 3}));
+  // Nothing left to compute.
+  ingest.flush(compute);
+  EXPECT_EQ(computed.size(), 3u);
+  EXPECT_EQ(ingest.statistics().frames, 3u);
+}
+
+TEST_F(ImageIngestTest, TransferDuringComputeCountsAsOverlapped)
+{
+  ImageIngest ingest;
+  ingest.push(make_message(1), [](std::unique_ptr<ImageContainer>) {});
+  // Nothing computed while the first frame was staged.
+  const auto first = wait_for_transfer(ingest, std::chrono::nanoseconds(0));
+  ASSERT_GT(first.transfer_time.count(), 0);
+  EXPECT_EQ(first.overlapped_time.count(), 0);
+
+  // The first frame computes until the second one is staged.
+  ingest.push(
+    make_message(2), [&ingest, &first](std::unique_ptr<ImageContainer>) {
+      wait_for_transfer(ingest, first.transfer_time);
+    });
+  const auto second = ingest.statistics();
+  ASSERT_GT(second.transfer_time, first.transfer_time);
+  EXPECT_EQ(second.overlapped_time, second.transfer_time - first.transfer_time);
+  EXPECT_EQ(second.frames, 1u);
+  EXPECT_GT(second.overlap_efficiency(), 0.0);
+  EXPECT_LT(second.overlap_efficiency(), 1.0);
+
+  ingest.flush([](std::unique_ptr<ImageContainer>) {});
+  const auto last = ingest.statistics();
+  EXPECT_EQ(last.frames, 2u);
+  EXPECT_EQ(last.transfer_time, second.transfer_time);
+  EXPECT_GE(last.compute_time, second.compute_time);
+}
+
+TEST_F(ImageIngestTest, StagingErrorsAreRethrownByTheNextCall)
+{
+  ImageIngest ingest;
+  auto message = make_message(1);
+  message->data.resize(4);
+  ingest.push(std::move(message), [](std::unique_ptr<ImageContainer>) {});
+  EXPECT_THROW(ingest.flush([](std::unique_ptr<ImageContainer>) {}), std::invalid_argument);
+  // The ingest goes on with the messages after.
+  std::vector<uint8_t> computed;
+  const auto compute = [&computed](std::unique_ptr<ImageContainer> image) {
+      image->stream()->synchronize();
+      computed.push_back(image->cdata()[0]);
+    };
+  ingest.push(make_message(2), compute);
+  ingest.flush(compute);
+  EXPECT_EQ(computed, (std::vector<uint8_t>{2}));
+}
@@ -0,0 +1,82 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "type_adapters/in_flight_window.hpp"
+
+using type_adaptation::example_type_adapters::InFlightWindow;
+
+namespace
+{
+const std::chrono::milliseconds kWait(50);
+}  // namespace
+
+TEST(InFlightWindow, WaitsUntilATokenIsDestroyed)
+{
+  InFlightWindow window(2);
+  std::vector<std::shared_ptr<void>> tokens{window.acquire(), window.acquire()};
+  ASSERT_TRUE(tokens[0] && tokens[1]);
+  EXPECT_EQ(window.in_flight(), 2u);
+
+  std::atomic<bool> acquired{false};
+  std::thread producer([&window, &acquired] {
+      auto token = window.acquire();
+      acquired = token != nullptr;
+    });
+  std::this_thread::sleep_for(kWait);
+  EXPECT_FALSE(acquired);
+
+  // Copies keep the item in the window.
+  std::shared_ptr<void> copy = tokens[0];
+  tokens[0].reset();
+  std::this_thread::sleep_for(kWait);
+  EXPECT_FALSE(acquired);
+
+  copy.reset();
+  producer.join();
+  EXPECT_TRUE(acquired);
+  EXPECT_EQ(window.in_flight(), 1u);
+}
+
+TEST(InFlightWindow, CloseWakesUpTheProducer)
+{
+  InFlightWindow window(1);
+  auto token = window.acquire();
+  std::thread producer([&window] {EXPECT_EQ(window.acquire(), nullptr);});
+  std::this_thread::sleep_for(kWait);
+  window.close();
+  producer.join();
+  EXPECT_EQ(window.acquire(), nullptr);
+}
+
+TEST(InFlightWindow, TokensMayOutliveTheWindow)
+{
+  std::shared_ptr<void> token;
+  {
+    InFlightWindow window(0);
+    EXPECT_EQ(window.size(), 1u);
+    token = window.acquire();
+    ASSERT_NE(token, nullptr);
+  }
+  token.reset();
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "rclcpp/rclcpp.hpp"
+
+#include "type_adapters/backend.hpp"
+#include "type_adapters/buffer_pool.hpp"
+#include "type_adapters/memory_parameters.hpp"
+
+using type_adaptation::example_type_adapters::BackendType;
+using type_adaptation::example_type_adapters::declare_memory_backend;
+using type_adaptation::example_type_adapters::get_backend;
+
+namespace
+{
+// Node with the given parameters, its memory backend declared.
+BackendType declare(const std::vector<rclcpp::Parameter> & parameters)
+{
+  rclcpp::Node node("memory_parameters", rclcpp::NodeOptions().parameter_overrides(parameters));
+  return declare_memory_backend(node);
+}
+}  // namespace
+
+// The settings are process-wide, so a single test walks through the nodes of one process.
+TEST(MemoryParameters, FirstNodeSettingTheBufferPoolSizesIt)
+{
+  rclcpp::init(0, nullptr);
+  auto & buffer_pool = get_backend(BackendType::kHost)->buffer_pool();
+  const size_t default_bytes = buffer_pool.high_water_mark();
+
+  EXPECT_EQ(declare({rclcpp::Parameter("memory_backend", "host")}), BackendType::kHost);
+  EXPECT_EQ(buffer_pool.high_water_mark(), default_bytes);
+
+  declare({rclcpp::Parameter("memory_backend", "host"),
+      rclcpp::Parameter("buffer_pool_max_bytes", 4096)});
+  EXPECT_EQ(buffer_pool.high_water_mark(), 4096u);
+
+  // A later node asking for another size only gets a warning.
+  declare({rclcpp::Parameter("memory_backend", "host"),
+      rclcpp::Parameter("buffer_pool_max_bytes", 8192)});
+  EXPECT_EQ(buffer_pool.high_water_mark(), 4096u);
+
+  // Nor does a node leaving the parameter to its default reset it.
+  declare({rclcpp::Parameter("memory_backend", "host")});
+  EXPECT_EQ(buffer_pool.high_water_mark(), 4096u);
+
+  EXPECT_THROW(
+    declare({rclcpp::Parameter("memory_backend", "tpu")}), std::invalid_argument);
+  rclcpp::shutdown();
+}
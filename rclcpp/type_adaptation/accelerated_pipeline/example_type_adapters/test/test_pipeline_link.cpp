@@ -0,0 +1,271 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "std_msgs/msg/header.hpp"
+#include "type_adapters/backend.hpp"
+#include "type_adapters/image_container.hpp"
+#include "type_adapters/pipeline_link.hpp"
+#include "type_adapters/spsc_ring.hpp"
+
+using type_adaptation::example_type_adapters::BackendType;
+using type_adaptation::example_type_adapters::ImageContainer;
+using type_adaptation::example_type_adapters::PipelineLink;
+using type_adaptation::example_type_adapters::SpscRing;
+using type_adaptation::example_type_adapters::set_default_backend_type;
+
+namespace
+{
+const std::chrono::seconds kTimeout(10);
+
+// Frame whose stamp numbers it.
+std::unique_ptr<ImageContainer> make_frame(int index)
+{
+  std_msgs::msg::Header header;
+  header.stamp.sec = index;
+  return std::make_unique<ImageContainer>(header, 1, 1, "mono8", 1);
+}
+
+// Frame numbers the consumer received, on any thread.
+class Received
+{
+public:
+  void
+  add(const ImageContainer & image)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      indices_.push_back(image.header().stamp.sec);
+      threads_.push_back(std::this_thread::get_id());
+    }
+    condition_.notify_all();
+  }
+
+  bool
+  wait_for(size_t count)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return condition_.wait_for(lock, kTimeout, [this, count] {return indices_.size() >= count;});
+  }
+
+  std::vector<int>
+  indices()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return indices_;
+  }
+
+  std::vector<std::thread::id>
+  threads()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return threads_;
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::vector<int> indices_;
+  std::vector<std::thread::id> threads_;
+};
+
+std::vector<int> range(int count)
+{
+  std::vector<int> indices;
+  for (int index = 0; index < count; ++index) {
+    indices.push_back(index);
+  }
+  return indices;
+}
+
+class PipelineLinkTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    set_default_backend_type(BackendType::kHost);
+  }
+};
+}  // namespace
+
+TEST(SpscRing, RoundsCapacityUpToAPowerOfTwo)
+{
+  EXPECT_EQ(SpscRing<int>(1).capacity(), 1u);
+  EXPECT_EQ(SpscRing<int>(3).capacity(), 4u);
+  EXPECT_EQ(SpscRing<int>(8).capacity(), 8u);
+  EXPECT_THROW(SpscRing<int>(0), std::invalid_argument);
+}
+
+TEST(SpscRing, PopsInOrderAndRefusesWhenFull)
+{
+  SpscRing<int> ring(2);
+  EXPECT_TRUE(ring.empty());
+  EXPECT_EQ(ring.pop(), nullptr);
+  for (int value = 0; value < 2; ++value) {
+    auto item = std::make_unique<int>(value);
+    EXPECT_TRUE(ring.push(item));
+    EXPECT_EQ(item, nullptr);
+  }
+  auto extra = std::make_unique<int>(2);
+  EXPECT_FALSE(ring.push(extra));
+  ASSERT_NE(extra, nullptr);
+  EXPECT_EQ(*extra, 2);
+
+  EXPECT_EQ(*ring.pop(), 0);
+  EXPECT_TRUE(ring.push(extra));
+  EXPECT_EQ(*ring.pop(), 1);
+  EXPECT_EQ(*ring.pop(), 2);
+  EXPECT_TRUE(ring.empty());
+}
+
+TEST(SpscRing, PassesItemsBetweenThreadsInOrder)
+{
+  const int count = 100000;
+  SpscRing<int> ring(8);
+  std::thread producer([&ring] {
+      for (int value = 0; value < count; ++value) {
+        auto item = std::make_unique<int>(value);
+        while (!ring.push(item)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  int expected = 0;
+  while (expected < count) {
+    if (auto item = ring.pop()) {
+      ASSERT_EQ(*item, expected);
+      ++expected;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+  EXPECT_TRUE(ring.empty());
+}
+
+TEST_F(PipelineLinkTest, ConsumerThreadReceivesFramesInOrder)
+{
+  PipelineLink link(256);
+  Received received;
+  EXPECT_TRUE(link.start([&received](std::unique_ptr<ImageContainer> image) {
+      received.add(*image);
+    }, -1));
+  for (int index = 0; index < 100; ++index) {
+    ASSERT_TRUE(link.push(make_frame(index)));
+  }
+  ASSERT_TRUE(received.wait_for(100));
+  EXPECT_EQ(received.indices(), range(100));
+  EXPECT_NE(received.threads()[0], std::this_thread::get_id());
+  EXPECT_EQ(link.dropped(), 0u);
+  link.stop();
+}
+
+TEST_F(PipelineLinkTest, ParkedConsumerWakesUpForTheNextFrame)
+{
+  PipelineLink link(4);
+  Received received;
+  link.start([&received](std::unique_ptr<ImageContainer> image) {received.add(*image);}, -1);
+  for (int index = 0; index < 5; ++index) {
+    // Long enough for the consumer to run out of spins and park.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ASSERT_TRUE(link.push(make_frame(index)));
+    ASSERT_TRUE(received.wait_for(index + 1)) << "frame " << index << " was not taken";
+  }
+  EXPECT_EQ(received.indices(), range(5));
+  link.stop();
+}
+
+TEST_F(PipelineLinkTest, DropsFramesWhileTheConsumerIsBehind)
+{
+  PipelineLink link(2);
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool busy = false;
+  bool release = false;
+  Received received;
+  link.start([&](std::unique_ptr<ImageContainer> image) {
+      std::unique_lock<std::mutex> lock(mutex);
+      busy = true;
+      condition.notify_all();
+      condition.wait(lock, [&release] {return release;});
+      lock.unlock();
+      received.add(*image);
+    }, -1);
+
+  ASSERT_TRUE(link.push(make_frame(0)));
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    ASSERT_TRUE(condition.wait_for(lock, kTimeout, [&busy] {return busy;}));
+  }
+  // The consumer holds frame 0, the ring takes two more.
+  EXPECT_TRUE(link.push(make_frame(1)));
+  EXPECT_TRUE(link.push(make_frame(2)));
+  EXPECT_FALSE(link.push(make_frame(3)));
+  EXPECT_EQ(link.dropped(), 1u);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    release = true;
+  }
+  condition.notify_all();
+  ASSERT_TRUE(received.wait_for(3));
+  EXPECT_EQ(received.indices(), range(3));
+  link.stop();
+}
+
+TEST_F(PipelineLinkTest, DirectConsumerRunsOnTheProducerThread)
+{
+  PipelineLink link(4);
+  Received received;
+  // Frames pushed before the consumer connected come first.
+  ASSERT_TRUE(link.push(make_frame(0)));
+  link.connect([&received](std::unique_ptr<ImageContainer> image) {received.add(*image);});
+  ASSERT_TRUE(link.push(make_frame(1)));
+  EXPECT_EQ(received.indices(), range(2));
+  for (const auto & thread : received.threads()) {
+    EXPECT_EQ(thread, std::this_thread::get_id());
+  }
+  link.stop();
+  // Without a consumer, frames wait in the ring again.
+  EXPECT_TRUE(link.push(make_frame(2)));
+  EXPECT_EQ(received.indices().size(), 2u);
+}
+
+TEST_F(PipelineLinkTest, TakesOneProducerAndOneConsumer)
+{
+  auto link = PipelineLink::get("test_pipeline_link", 4);
+  EXPECT_EQ(PipelineLink::get("test_pipeline_link", 16), link);
+  EXPECT_EQ(link->capacity(), 4u);
+
+  link->attach_producer();
+  EXPECT_THROW(link->attach_producer(), std::logic_error);
+  link->detach_producer();
+  link->attach_producer();
+  link->detach_producer();
+
+  link->start([](std::unique_ptr<ImageContainer>) {}, -1);
+  EXPECT_THROW(link->start([](std::unique_ptr<ImageContainer>) {}, -1), std::logic_error);
+  EXPECT_THROW(link->connect([](std::unique_ptr<ImageContainer>) {}), std::logic_error);
+  link->stop();
+}
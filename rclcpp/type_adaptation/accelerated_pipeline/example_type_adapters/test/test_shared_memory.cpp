@@ -0,0 +1,164 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "type_adapters/backend.hpp"
+#include "type_adapters/shared_memory.hpp"
+
+using type_adaptation::example_type_adapters::SharedFrameSegment;
+
+namespace
+{
+const std::chrono::milliseconds kLease(1);
+
+// Let the lease of every published slot expire.
+void expire_leases()
+{
+  std::this_thread::sleep_for(4 * kLease);
+}
+}  // namespace
+
+TEST(SharedFrameSegment, AttachedSegmentSharesSlotsAndState)
+{
+  auto segment = SharedFrameSegment::create(2, 64);
+  auto attached = SharedFrameSegment::attach(segment->name());
+  EXPECT_EQ(attached->slot_count(), 2u);
+  EXPECT_GE(attached->slot_bytes(), 64u);
+
+  uint32_t slot = 0;
+  uint64_t generation = 0;
+  ASSERT_TRUE(segment->acquire(kLease, slot, generation));
+  segment->slot_data(slot)[0] = 42;
+  EXPECT_EQ(attached->slot_data(slot)[0], 42);
+  EXPECT_EQ(attached->generation(slot), generation);
+  EXPECT_EQ(attached->references(slot, generation), 1u);
+
+  uint32_t found = 0;
+  EXPECT_TRUE(segment->find_slot(segment->slot_data(slot), found));
+  EXPECT_EQ(found, slot);
+  EXPECT_FALSE(segment->find_slot(segment->slot_data(slot) + 1, found));
+}
+
+TEST(SharedFrameSegment, SlotIsFreeOnceEveryReferenceIsDropped)
+{
+  auto segment = SharedFrameSegment::create(1, 64);
+  uint32_t slot = 0;
+  uint64_t generation = 0;
+  ASSERT_TRUE(segment->acquire(kLease, slot, generation));
+  ASSERT_TRUE(segment->publish(slot, generation, 2));
+  // The publisher drops its own reference once published.
+  segment->release(slot, generation);
+  EXPECT_EQ(segment->references(slot, generation), 2u);
+
+  for (int consumer = 0; consumer < 2; ++consumer) {
+    ASSERT_TRUE(segment->claim(slot, generation));
+    segment->release(slot, generation);
+  }
+  EXPECT_EQ(segment->references(slot, generation), 0u);
+  // Every reference was claimed, no more claims.
+  EXPECT_FALSE(segment->claim(slot, generation));
+
+  uint32_t next_slot = 0;
+  uint64_t next_generation = 0;
+  ASSERT_TRUE(segment->acquire(kLease, next_slot, next_generation));
+  EXPECT_EQ(next_slot, slot);
+  EXPECT_NE(next_generation, generation);
+}
+
+TEST(SharedFrameSegment, WrappedMemoryHoldsAClaimedReference)
+{
+  auto segment = SharedFrameSegment::create(1, 64);
+  uint32_t slot = 0;
+  uint64_t generation = 0;
+  ASSERT_TRUE(segment->acquire(kLease, slot, generation));
+  auto memory = segment->wrap(slot, generation);
+  EXPECT_EQ(memory->device_memory(), segment->slot_data(slot));
+  EXPECT_FALSE(memory->is_shared());
+  ASSERT_TRUE(segment->publish(slot, generation, 1));
+  // Shared with the consumer the frame was published to.
+  EXPECT_TRUE(memory->is_shared());
+
+  ASSERT_TRUE(segment->claim(slot, generation));
+  auto consumer_memory = segment->wrap(slot, generation);
+  memory.reset();
+  EXPECT_FALSE(consumer_memory->is_shared());
+  consumer_memory.reset();
+  EXPECT_EQ(segment->references(slot, generation), 0u);
+}
+
+TEST(SharedFrameSegment, ReclaimsUnclaimedSlotsWhoseLeaseExpired)
+{
+  auto segment = SharedFrameSegment::create(1, 64);
+  uint32_t slot = 0;
+  uint64_t generation = 0;
+  ASSERT_TRUE(segment->acquire(kLease, slot, generation));
+  ASSERT_TRUE(segment->publish(slot, generation, 1));
+  segment->release(slot, generation);
+
+  uint32_t next_slot = 0;
+  uint64_t next_generation = 0;
+  // Lost handle: nobody claims the frame.
+  EXPECT_FALSE(segment->acquire(std::chrono::hours(1), next_slot, next_generation));
+  expire_leases();
+  ASSERT_TRUE(segment->acquire(kLease, next_slot, next_generation));
+  EXPECT_EQ(next_slot, slot);
+  EXPECT_NE(next_generation, generation);
+
+  // A handle of the old generation arriving late is dropped, releases of it are ignored.
+  EXPECT_FALSE(segment->claim(slot, generation));
+  segment->release(slot, generation);
+  EXPECT_EQ(segment->references(slot, next_generation), 1u);
+}
+
+TEST(SharedFrameSegment, NeverReclaimsAClaimedSlot)
+{
+  auto segment = SharedFrameSegment::create(1, 64);
+  uint32_t slot = 0;
+  uint64_t generation = 0;
+  ASSERT_TRUE(segment->acquire(kLease, slot, generation));
+  ASSERT_TRUE(segment->publish(slot, generation, 2));
+  segment->release(slot, generation);
+  // One consumer holds the frame, the handle of the other got lost.
+  ASSERT_TRUE(segment->claim(slot, generation));
+  expire_leases();
+
+  uint32_t next_slot = 0;
+  uint64_t next_generation = 0;
+  EXPECT_FALSE(segment->acquire(kLease, next_slot, next_generation));
+  EXPECT_EQ(segment->generation(slot), generation);
+
+  segment->release(slot, generation);
+  ASSERT_TRUE(segment->acquire(kLease, next_slot, next_generation));
+  EXPECT_NE(next_generation, generation);
+}
+
+TEST(SharedFrameSegment, PublishFailsForAGenerationThatIsGone)
+{
+  auto segment = SharedFrameSegment::create(1, 64);
+  uint32_t slot = 0;
+  uint64_t generation = 0;
+  ASSERT_TRUE(segment->acquire(kLease, slot, generation));
+  segment->release(slot, generation);
+  uint64_t next_generation = 0;
+  ASSERT_TRUE(segment->acquire(kLease, slot, next_generation));
+  EXPECT_FALSE(segment->publish(slot, generation, 1));
+  EXPECT_TRUE(segment->publish(slot, next_generation, 1));
+}
@@ -18,9 +18,16 @@
 #include <memory>
 
 #include "cuda/julia_set.hpp"
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
+#include "julia_set/iteration_budget.hpp"
+#include "julia_set/julia_set_handles.hpp"
+#include "julia_set/julia_set_images.hpp"
 #include "rclcpp/rclcpp.hpp"
 #include "sensor_msgs/msg/image.hpp"
+#include "type_adapters/backend.hpp"
 #include "type_adapters/image_container.hpp"
+#include "type_adapters/pipeline_link.hpp"
+#include "type_adapters/shared_image_transport.hpp"
 
 RCLCPP_USING_CUSTOM_TYPE_AS_ROS_MESSAGE_TYPE(
   type_adaptation::example_type_adapters::ImageContainer,
@@ -51,17 +58,31 @@ private:
   void ColorizeCallbackCustomType(
     std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image);
   void ColorizeCallback(std::unique_ptr<sensor_msgs::msg::Image> image_msg);
+  // Colors of the image, in whichever layout it comes in.
+  ColorImage Colorize(const type_adaptation::example_type_adapters::ImageContainer & image);
+  // Handle for julia_set_handles_.
+  std::unique_ptr<JuliaSet> CreateHandle(const ImageGeometry & geometry) const;
+  // Account for a frame that made it through the pipeline, and publish the iteration budget
+  // when it changed or is due for a report.
+  void UpdateIterationBudget(const std_msgs::msg::Header & header);
+  // Publish on whichever publisher the node was configured with.
+  void PublishImage(
+    std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image);
 
   // Flag for enabling or disabling type adaptation
   const bool type_adaptation_enabled_;
-  // Flag for intialization.
-  bool is_initialized;
+  // Backend of the frames the node creates itself, see declare_memory_backend()
+  type_adaptation::example_type_adapters::BackendType memory_backend_{};
   // JuliaSet prams
   JuliaSetParams julia_set_params_{}; \
-  // Image properties to be sent to CUDA kernel
-  ImageMsgProperties img_property_{};
-  // JuliaSet handle
-  std::unique_ptr<JuliaSet> julia_set_handle_;
+  // Split of the CPU kernels across threads
+  CpuTiling cpu_tiling_{};
+  // JuliaSet handles, for the resolution and layout of the last image and of the one before
+  JuliaSetHandles julia_set_handles_;
+  // Iterations of the Julia Set nodes, adapted to the frame deadline when there is one
+  std::unique_ptr<IterationBudgetController> iteration_budget_;
+  rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr iteration_budget_pub_{
+    nullptr};
 
   // Publisher and subscriber when type_adaptation is enabled
   rclcpp::Subscription<type_adaptation::example_type_adapters::ImageContainer>::SharedPtr
@@ -73,6 +94,19 @@ private:
   // Publisher and subscriber when type_adaptation is disabled
   rclcpp::Subscription<sensor_msgs::msg::Image>::SharedPtr sub_{nullptr};
   rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr pub_{nullptr};
+
+  // Subscriber and publisher when the pipeline is split across processes at this node
+  std::shared_ptr<type_adaptation::example_type_adapters::SharedImageSubscription>
+    shared_image_sub_{nullptr};
+  std::shared_ptr<type_adaptation::example_type_adapters::SharedImagePublisher>
+    shared_image_pub_{nullptr};
+
+  // Publisher and subscriber when frames are handed over through pipeline links, the subscriber
+  // last so that its thread stops before the rest of the node is destroyed
+  std::shared_ptr<type_adaptation::example_type_adapters::PipelineLinkPublisher> link_pub_{
+    nullptr};
+  std::shared_ptr<type_adaptation::example_type_adapters::PipelineLinkSubscription> link_sub_{
+    nullptr};
 };
 }  // namespace julia_set
 }  // namespace type_adaptation
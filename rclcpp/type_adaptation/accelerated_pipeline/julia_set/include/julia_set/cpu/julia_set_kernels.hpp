@@ -0,0 +1,112 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef JULIA_SET__CPU__JULIA_SET_KERNELS_HPP_
+#define JULIA_SET__CPU__JULIA_SET_KERNELS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "julia_set/cuda/julia_set.hpp"
+
+namespace type_adaptation
+{
+namespace julia_set
+{
+namespace cpu
+{
+
+// Host implementations of the CUDA kernels, with the same memory layout and results.
+// Regions are resolved, see JuliaSet::resolve(). The escape time loops run on AVX-512 or AVX2
+// when the CPU supports them, picked at runtime.
+
+// Vector extension the kernels use on this CPU, "none" for scalar code.
+const char * vector_extension();
+
+// Have the kernels use another vector extension, named as by vector_extension(), e.g. to compare
+// their results. Returns false and keeps the current one if the build or the CPU lacks it.
+bool set_vector_extension(const std::string & name);
+
+// Escape iterations with an entry in the color LUT, 0 to kMaxIterations - 1.
+size_t color_lut_entries(const JuliaSetParams & params);
+
+// Fill the color LUT the colorize kernels blend into the image, 6 planes of color_lut_entries()
+// floats: red, green and blue of colorize(), then of julia_set_composite(), whose hue is
+// truncated to whole degrees. The color only depends on the escape iteration, so the LUT takes
+// the hsv conversion, fmod() and pow() out of the per pixel work.
+void color_lut(const JuliaSetParams & params, float * lut);
+
+void julia_set_composite(
+  uint8_t * image, const ImageMsgProperties & img_properties, const JuliaSetParams & params,
+  const float * lut, const ImageRegion & region);
+
+void map(
+  float * out_mat, const ImageMsgProperties & img_properties, const JuliaSetParams & params,
+  const ImageRegion & region);
+
+// Iterations curr_iteration to curr_iteration + iteration_count - 1 in one pass over the image.
+void julia_set_iteration(
+  size_t curr_iteration, size_t iteration_count, float * image,
+  const ImageMsgProperties & img_properties, const JuliaSetParams & params,
+  const ImageRegion & region);
+
+// julia_set_iteration() on pixels first to first + count - 1 of the region, counted row-major,
+// or on the pixels at those positions of active when given, which must be in ascending order.
+// Writes the pixels still active afterwards to active_out, in the same order, and returns how
+// many there are.
+size_t julia_set_iteration_active(
+  size_t curr_iteration, size_t iteration_count, float * image,
+  const ImageMsgProperties & img_properties, const JuliaSetParams & params,
+  const ImageRegion & region, const uint32_t * active, size_t first, size_t count,
+  uint32_t * active_out);
+
+// Progressive rendering: the pixels at every scale-th column and row of the region, from its
+// first one on, into coarse, an interleaved image of ceil(width / scale) by
+// ceil(height / scale) pixels with packed rows.
+void downsample(
+  const float * image, const ImageRegion & region, unsigned int scale, float * coarse);
+
+// Once the coarse pixels ran every iteration, each stands for the block of scale by scale pixels
+// from it on. Among pixels first to first + count - 1 of the region, counted row-major, those of
+// blocks whose coarse pixel escaped at the same iteration as its neighbours are filled with it,
+// and the others are written to active_out in ascending order. Returns how many.
+size_t refine(
+  float * image, const ImageRegion & region, unsigned int scale, const float * coarse,
+  size_t first, size_t count, uint32_t * active_out);
+
+void colorize(
+  uint8_t * output, const float * input, const ImageMsgProperties & img_properties,
+  const JuliaSetParams & params, const float * lut, const ImageRegion & region);
+
+// The kernels above on images in a planar layout, see PixelLayout. Buffers point to the first
+// row of the region, whose columns are found in each plane from region.x on.
+void map_planar(
+  uint8_t * out, PixelLayout layout, const ImageMsgProperties & img_properties,
+  const JuliaSetParams & params, const ImageRegion & region);
+
+void julia_set_iteration_planar(
+  size_t curr_iteration, size_t iteration_count, uint8_t * image, PixelLayout layout,
+  const ImageMsgProperties & img_properties, const JuliaSetParams & params,
+  const ImageRegion & region);
+
+void colorize_planar(
+  uint8_t * output, const uint8_t * input, PixelLayout layout,
+  const ImageMsgProperties & img_properties, const JuliaSetParams & params, const float * lut,
+  const ImageRegion & region);
+
+}  // namespace cpu
+}  // namespace julia_set
+}  // namespace type_adaptation
+#endif  // JULIA_SET__CPU__JULIA_SET_KERNELS_HPP_
@@ -0,0 +1,90 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef JULIA_SET__CPU__JULIA_SET_SIMD_HPP_
+#define JULIA_SET__CPU__JULIA_SET_SIMD_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "julia_set/cuda/julia_set.hpp"
+
+namespace type_adaptation
+{
+namespace julia_set
+{
+namespace cpu
+{
+
+// Vectorized inner loops of the CPU kernels, one row at a time. Each handles the leading pixels
+// of the row that fill whole vectors and returns how many it handled, the caller finishes the
+// rest with the scalar code. Results are identical to the scalar code, so no FMA is used.
+
+// Constants of the escape time loop, the same for every pixel of a frame.
+struct EscapeParams
+{
+  float orig_real_part;
+  float orig_img_part;
+  float boundary;  // Squared boundary radius
+  uint32_t max_iterations;
+};
+
+#ifdef JULIA_SET_HAS_AVX2
+namespace avx2
+{
+// Escape iterations of count pixels from column first_col on, all in the row at img_part.
+size_t escape_counts(
+  size_t first_col, size_t count, float img_part, const JuliaSetParams & params,
+  const EscapeParams & escape, uint32_t * counts);
+
+// Julia Set iterations from curr_iteration on, on count packed x, y, z float pixels. Fills
+// active_masks, if given, with a byte per 8 pixels whose bits are set for the pixels that are
+// still active afterwards.
+size_t iterate(
+  float * pixels, size_t count, size_t curr_iteration, size_t iteration_count,
+  const EscapeParams & escape, uint8_t * active_masks);
+
+// iterate() on count pixels held in a plane per channel.
+size_t iterate_planes(
+  float * x, float * y, float * z, size_t count, size_t curr_iteration, size_t iteration_count,
+  const EscapeParams & escape);
+
+// Colors of count packed x, y, z float pixels, from the colorize() planes of a color LUT with
+// lut_entries entries, written to a plane per channel.
+size_t colorize(
+  const float * pixels, size_t count, const float * lut, size_t lut_entries, uint8_t * red,
+  uint8_t * green, uint8_t * blue);
+
+// colorize() on count pixels held in a plane per channel.
+size_t colorize_planes(
+  const float * x, const float * y, const float * z, size_t count, const float * lut,
+  size_t lut_entries, uint8_t * red, uint8_t * green, uint8_t * blue);
+}  // namespace avx2
+#endif
+
+#ifdef JULIA_SET_HAS_AVX512
+// A few iterations are bound by memory, and AVX-512 has no cheaper way to split packed pixels
+// into channels than avx2::iterate(), so only the escape time loop is widened.
+namespace avx512
+{
+size_t escape_counts(
+  size_t first_col, size_t count, float img_part, const JuliaSetParams & params,
+  const EscapeParams & escape, uint32_t * counts);
+}  // namespace avx512
+#endif
+
+}  // namespace cpu
+}  // namespace julia_set
+}  // namespace type_adaptation
+#endif  // JULIA_SET__CPU__JULIA_SET_SIMD_HPP_
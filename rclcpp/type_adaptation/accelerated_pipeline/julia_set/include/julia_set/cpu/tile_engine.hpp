@@ -0,0 +1,118 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef JULIA_SET__CPU__TILE_ENGINE_HPP_
+#define JULIA_SET__CPU__TILE_ENGINE_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "julia_set/cuda/julia_set.hpp"
+
+namespace type_adaptation
+{
+namespace julia_set
+{
+namespace cpu
+{
+
+/// Thread pool that runs a kernel over an image region tile by tile.
+/**
+ * Tiles are dealt out to the workers in contiguous blocks, and a worker that runs out of tiles
+ * steals from the far end of the block of another. Julia Set tiles differ a lot in cost, pixels
+ * outside the set escape after a few iterations while those inside run all of them, so a
+ * static split would leave most workers waiting for the one with the interior of the set.
+ *
+ * The thread calling run() works along and returns once every tile is done. Runs of different
+ * callers are serialized, each already uses every worker.
+ */
+class TileEngine final
+{
+public:
+  /// Kernel for one tile, the region has the origin and size of the tile and the row steps of
+  /// the whole region.
+  using TileKernel = std::function<void (const ImageRegion & tile)>;
+
+  /// Engine with thread_count threads including the caller, 0 for one per hardware thread.
+  explicit TileEngine(size_t thread_count);
+  ~TileEngine();
+
+  TileEngine(const TileEngine &) = delete;
+  TileEngine & operator=(const TileEngine &) = delete;
+
+  /// Engine with thread_count threads shared by the whole process, so that the nodes of a
+  /// container do not each start a thread per core.
+  static std::shared_ptr<TileEngine>
+  shared(size_t thread_count);
+
+  /// Run kernel on every tile of a resolved region, at most tile_width by tile_height pixels.
+  /// Rethrows the first exception of a kernel once all tiles are done. Fills timings, if
+  /// given, with a TileTiming per tile in row-major order.
+  void
+  run(
+    const ImageRegion & region, unsigned int tile_width, unsigned int tile_height,
+    const TileKernel & kernel, std::vector<TileTiming> * timings = nullptr);
+
+  size_t
+  thread_count() const
+  {
+    return workers_.size() + 1;
+  }
+
+private:
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<size_t> tiles;
+  };
+
+  void
+  work(size_t worker);
+
+  // Next tile for a worker, from the front of its own queue or the back of another's.
+  bool
+  next_tile(size_t worker, size_t & tile, bool & stolen);
+
+  std::vector<std::thread> workers_;
+  std::vector<std::unique_ptr<Queue>> queues_;
+
+  std::mutex run_mutex_;
+
+  // Current run, guarded by mutex_ while workers join or leave it.
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  uint64_t run_id_{0};
+  size_t busy_workers_{0};
+  bool stop_{false};
+  const TileKernel * kernel_{nullptr};
+  std::vector<ImageRegion> tiles_;
+  std::vector<TileTiming> timings_;
+  bool record_timings_{false};
+  std::exception_ptr error_;
+};
+
+}  // namespace cpu
+}  // namespace julia_set
+}  // namespace type_adaptation
+#endif  // JULIA_SET__CPU__TILE_ENGINE_HPP_
@@ -16,11 +16,14 @@
 #ifndef JULIA_SET__CUDA__JULIA_SET_HPP_
 #define JULIA_SET__CUDA__JULIA_SET_HPP_
 
+#include <chrono>
 #include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
 
-#include "cuda.h"  // NOLINT - include .h without directory
-#include "cuda_runtime.h"  // NOLINT - include .h without directory
+#include "type_adapters/backend.hpp"
+#include "type_adapters/pixel_list.hpp"
 
 namespace type_adaptation
 {
@@ -32,7 +35,7 @@ namespace julia_set
 */
 struct ImageMsgProperties
 {
-  unsigned int row_step{0};  // Length of a row
+  unsigned int row_step{0};  // Bytes between the rows of the RGB image
   unsigned int height{0};  // Height of the RGB image
   unsigned int width{0};  // Width of the RGB image
   std::string encoding{""};  // Data format of the RGB image
@@ -53,43 +56,308 @@ struct JuliaSetParams
   float kStartY{0.7885};
   float kBoundaryRadius{16.0};
   size_t kMaxIterations{50};
-  uint32_t kMinColRange{0};
-  uint32_t kMaxColRange{0};
-  uint32_t kMinRowRange{0};
-  uint32_t kMaxRowRange{0};
+  // Columns and rows mapped to the X and Y ranges. A tile of a frame maps its own pixels, so its
+  // ranges start at minus its position in the frame.
+  int64_t kMinColRange{0};
+  int64_t kMaxColRange{0};
+  int64_t kMinRowRange{0};
+  int64_t kMaxRowRange{0};
 };
 
+/**
+* @brief Layout of the x, y and escape iteration of every pixel, as passed between the nodes.
+* Images tell their layout by their encoding, so every stage takes whichever it is given.
+*/
+enum class PixelLayout
+{
+  kInterleaved,  // 32FC3, float x, y and escape iteration per pixel
+  kPlanar32,  // Each row holds float x for all pixels, then float y, then uint16_t iterations
+  kPlanar16,  // The same with half precision x and y, and uint8_t escape iterations
+};
+
+/**
+* @brief Bytes of the x or the y of a pixel in a layout.
+*/
+inline size_t coordinate_bytes(PixelLayout layout)
+{
+  return layout == PixelLayout::kPlanar16 ? 2 : 4;
+}
+
+/**
+* @brief Bytes of the escape iteration of a pixel in a layout.
+*/
+inline size_t escape_iteration_bytes(PixelLayout layout)
+{
+  switch (layout) {
+    case PixelLayout::kPlanar32:
+      return 2;
+    case PixelLayout::kPlanar16:
+      return 1;
+    default:
+      return 4;
+  }
+}
+
+/**
+* @brief Largest escape iteration, and so kMaxIterations, a layout holds.
+*/
+inline size_t max_escape_iteration(PixelLayout layout)
+{
+  switch (layout) {
+    case PixelLayout::kPlanar32:
+      return UINT16_MAX;
+    case PixelLayout::kPlanar16:
+      return UINT8_MAX;
+    default:
+      // Whole numbers up to 2^24 are exact in a float.
+      return size_t{1} << 24;
+  }
+}
+
+/**
+* @brief Bytes between the rows of an image in a layout. Planar rows start at multiples of 64
+* bytes, so that the planes of every row are aligned.
+*/
+inline size_t pixel_layout_row_step(PixelLayout layout, size_t width)
+{
+  const size_t row_bytes = width * (2 * coordinate_bytes(layout) + escape_iteration_bytes(layout));
+  if (layout == PixelLayout::kInterleaved) {
+    return row_bytes;
+  }
+  return (row_bytes + 63) / 64 * 64;
+}
+
+/**
+* @brief Encoding of images in a layout.
+*/
+inline const char * pixel_layout_encoding(PixelLayout layout)
+{
+  switch (layout) {
+    case PixelLayout::kPlanar32:
+      return "julia_set_planar32";
+    case PixelLayout::kPlanar16:
+      return "julia_set_planar16";
+    default:
+      return "32FC3";
+  }
+}
+
+/**
+* @brief Layout of images of an encoding, returns false for an encoding of no layout.
+*/
+inline bool pixel_layout_from_encoding(const std::string & encoding, PixelLayout & layout)
+{
+  for (PixelLayout candidate :
+    {PixelLayout::kInterleaved, PixelLayout::kPlanar32, PixelLayout::kPlanar16})
+  {
+    if (encoding == pixel_layout_encoding(candidate)) {
+      layout = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+* @brief Part of the image a kernel runs on, e.g. an example_type_adapters::ImageContainer view.
+* Buffers passed along with a region point to its first pixel. A zero width or height selects the
+* whole image, and a zero row step the packed row step of the buffer for the whole image.
+*/
+struct ImageRegion
+{
+  unsigned int x{0};  // Column of the first pixel in the whole image
+  unsigned int y{0};  // Row of the first pixel in the whole image
+  unsigned int width{0};  // Width of the region
+  unsigned int height{0};  // Height of the region
+  size_t in_row_step{0};  // Bytes between the rows of the input buffer
+  size_t out_row_step{0};  // Bytes between the rows of the output buffer
+};
+
+/**
+* @brief How the CPU kernels split a frame into tiles and spread them over threads.
+*/
+struct CpuTiling
+{
+  unsigned int thread_count{1};  // Threads including the caller, 0 for one per hardware thread
+  unsigned int tile_width{128};  // Width of a tile, 0 for the width of the frame
+  unsigned int tile_height{32};  // Height of a tile, 0 for the height of the frame
+};
+
+/**
+* @brief One image of a batch of stages, see JuliaSet::compute_julia_set_stages().
+*/
+struct StageJob
+{
+  void * image{nullptr};  // Buffer of the region, in the layout of the handle
+  ImageRegion region;  // Part of the image to run the stage on
+  float angle{0.0};  // Animation angle of the image
+  size_t iteration_count{0};  // Iterations to run from the first one of the stage on
+  example_type_adapters::StreamWrapper * stream{nullptr};  // Stream of the image
+};
+
+/**
+* @brief Time a CPU kernel took on one tile.
+*/
+struct TileTiming
+{
+  ImageRegion tile;  // Origin and size of the tile
+  size_t worker{0};  // Thread that ran the tile, 0 is the caller
+  bool stolen{false};  // Taken from the tiles of another thread
+  std::chrono::nanoseconds duration{0};
+};
+
+namespace cpu
+{
+class TileEngine;
+}  // namespace cpu
+
+/**
+* @brief Julia Set kernels, run with CUDA or on the CPU depending on the backend of the stream.
+* CPU kernels run once the transfers queued on the stream have completed, on the calling thread
+* or, with more than one thread in the CpuTiling, tile by tile on a thread pool shared by the
+* process.
+*
+* Buffers of x, y and escape iterations are in the layout the handle was constructed with.
+* Interleaved buffers point to the first pixel of a region, planar ones to the first column of
+* its first row, since each plane of a row spans the whole width of the image.
+*/
 class JuliaSet
 {
 public:
-  explicit JuliaSet(ImageMsgProperties img_properties, JuliaSetParams parameters);
+  using StreamWrapper = type_adaptation::example_type_adapters::StreamWrapper;
+  using PixelList = type_adaptation::example_type_adapters::PixelList;
+
+  explicit JuliaSet(
+    ImageMsgProperties img_properties, JuliaSetParams parameters,
+    CpuTiling tiling = CpuTiling(), PixelLayout layout = PixelLayout::kInterleaved);
   ~JuliaSet() = default;
 
+  PixelLayout layout() const
+  {
+    return layout_;
+  }
+
+  void compute_julia_set_composite(
+    float & current_angle, uint8_t * image, StreamWrapper & stream);
+
   void compute_julia_set_composite(
-    float & current_angle, u_int8_t * image, const cudaStream_t & stream);
+    float & current_angle, uint8_t * image, const ImageRegion & region, StreamWrapper & stream);
+
+  void map(void * out_mat, StreamWrapper & stream);
 
-  void map(float * out_mat, const cudaStream_t & stream);
+  void map(void * out_mat, const ImageRegion & region, StreamWrapper & stream);
 
   void compute_julia_set_pipeline(
-    size_t curr_iteration, float & current_angle, float * image, const cudaStream_t & stream);
+    size_t curr_iteration, float & current_angle, void * image, StreamWrapper & stream);
+
+  void compute_julia_set_pipeline(
+    size_t curr_iteration, float & current_angle, void * image, const ImageRegion & region,
+    StreamWrapper & stream);
+
+  /// Iterations curr_iteration to curr_iteration + iteration_count - 1 in one kernel, the same
+  /// as as many compute_julia_set_pipeline() calls but with one pass over the image.
+  void compute_julia_set_stage(
+    size_t curr_iteration, size_t iteration_count, float & current_angle, void * image,
+    const ImageRegion & region, StreamWrapper & stream);
+
+  /// compute_julia_set_stage() on each image of a batch, e.g. frames that queued up at a stage,
+  /// from curr_iteration on. The CPU kernels run the tiles of every image in one go on the
+  /// thread pool, and leave no tile timings; CUDA kernels are queued on the stream of each image.
+  void compute_julia_set_stages(size_t curr_iteration, const std::vector<StageJob> & jobs);
+
+  /// compute_julia_set_stage() on the pixels of active alone, or on every pixel of the region
+  /// without a list. Returns the pixels of the region that are still active after the stage, so
+  /// that later stages skip the ones that escaped. Planar layouts visit every pixel and return
+  /// no list.
+  PixelList compute_julia_set_stage(
+    size_t curr_iteration, size_t iteration_count, float & current_angle, void * image,
+    const ImageRegion & region, const PixelList & active, StreamWrapper & stream);
+
+  /// Progressive rendering: the pixels at every scale-th column and row of the region into
+  /// coarse, an interleaved image of ceil(width / scale) by ceil(height / scale) pixels with
+  /// packed rows. Throws std::invalid_argument for a planar layout.
+  void downsample(
+    const void * image, const ImageRegion & region, unsigned int scale, void * coarse,
+    StreamWrapper & stream);
+
+  /// Once the pixels of downsample() ran every iteration, fill the blocks of scale by scale
+  /// pixels whose coarse pixel escaped at the same iteration as its neighbours with it. Returns
+  /// the pixels of the other blocks, which the stages compute at full resolution. Throws
+  /// std::invalid_argument for a planar layout.
+  PixelList refine(
+    void * image, const ImageRegion & region, unsigned int scale, const void * coarse,
+    StreamWrapper & stream);
 
   void colorize(
-    uint8_t * output, const float * input, const cudaStream_t & stream);
+    uint8_t * output, const void * input, StreamWrapper & stream);
+
+  void colorize(
+    uint8_t * output, const void * input, const ImageRegion & region, StreamWrapper & stream);
+
+  /// Set up what the kernels would otherwise set up on their first frame on the backend of the
+  /// stream: the color LUT, and the thread pool of the CPU kernels.
+  void warm_up(StreamWrapper & stream);
+
+  /// Vector extension of the CPU kernels on this machine (AVX-512 | AVX2 | none).
+  static const char * cpu_vector_extension();
+
+  /// Time per tile of the last CPU kernel in row-major order, empty when it ran on one thread.
+  /// Tiles of a stage on a PixelList are runs of its pixels, one row high.
+  const std::vector<TileTiming> & last_tile_timings() const
+  {
+    return tile_timings_;
+  }
 
 private:
-  void configure_kernel_execution();
+  // Color LUT of the colorize kernels on the backend of the stream, built once per
+  // kMaxIterations.
+  const float * color_lut(StreamWrapper & stream);
+
+  // Fill in the defaults of a region, given the packed row steps of the kernel's buffers.
+  ImageRegion resolve(
+    const ImageRegion & region, size_t default_in_row_step, size_t default_out_row_step) const;
+
+  // Row step of the x, y and escape iteration buffers that map() produces.
+  size_t layout_row_step() const;
+
+  // Bytes from one pixel of a region to the next in the buffers of the layout, 0 for planar
+  // layouts, whose kernels find the columns of a tile in each plane themselves.
+  size_t layout_pixel_bytes() const;
+
+  // Run a CPU kernel on a resolved region, whole or tile by tile. The kernel gets the region
+  // of a tile along with the offsets of the tile in the input and output buffers.
+  template<typename Kernel>
+  void run_cpu(
+    const ImageRegion & region, size_t in_pixel_bytes, size_t out_pixel_bytes,
+    const Kernel & kernel);
+
+  // Run a CPU kernel on count pixels of a list of a resolved region, whole or in runs as long as
+  // a tile. The kernel gets the first and the number of pixels of a run along with where to
+  // write the pixels it keeps, and returns how many. Returns the number of pixels kept, moved
+  // together at the start of active_out.
+  template<typename Kernel>
+  size_t run_cpu_list(
+    const ImageRegion & region, size_t count, uint32_t * active_out, const Kernel & kernel);
+
+  static constexpr size_t kFloatChannels = 3;
+  // Red, green and blue for colorize() and for compute_julia_set_composite()
+  static constexpr size_t kColorLutPlanes = 6;
+
   // Properties of image msg from ROS
   ImageMsgProperties image_msg_property_{};
   // Params for JuliaSet calculations
   JuliaSetParams parameters_{};
-  // The number of CUDA threads per block in the x direction
-  const int num_threads_per_block_x_{32};
-  // The number of CUDA threads per block in the y direction
-  const int num_threads_per_block_y_{32};
-  // The number of blocks for kernel execution
-  dim3 num_of_blocks_;
-  // The number of CUDA threads per block
-  dim3 threads_per_block_;
+  // Split of the CPU kernels across threads
+  CpuTiling tiling_{};
+  // Layout of the x, y and escape iteration buffers
+  PixelLayout layout_{PixelLayout::kInterleaved};
+  std::shared_ptr<cpu::TileEngine> tile_engine_;
+  std::vector<TileTiming> tile_timings_;
+  // Color LUTs on the host and on the device, and the kMaxIterations they were built for
+  std::vector<float> color_lut_;
+  size_t color_lut_iterations_{0};
+  std::shared_ptr<example_type_adapters::MemoryWrapper> cuda_color_lut_;
+  size_t cuda_color_lut_iterations_{0};
 };
 
 }  // namespace julia_set
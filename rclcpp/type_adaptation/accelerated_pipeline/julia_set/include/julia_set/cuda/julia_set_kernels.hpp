@@ -0,0 +1,93 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef JULIA_SET__CUDA__JULIA_SET_KERNELS_HPP_
+#define JULIA_SET__CUDA__JULIA_SET_KERNELS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "julia_set/cuda/julia_set.hpp"
+
+#include "cuda.h"  // NOLINT - include .h without directory
+#include "cuda_runtime.h"  // NOLINT - include .h without directory
+
+namespace type_adaptation
+{
+namespace julia_set
+{
+namespace cuda
+{
+
+// Regions are resolved, see JuliaSet::resolve().
+
+// Color LUT of the colorize kernels, laid out like cpu::color_lut().
+void color_lut(const JuliaSetParams & params, float * lut, const cudaStream_t & stream);
+
+void julia_set_composite(
+  uint8_t * image, const ImageMsgProperties & img_properties, const JuliaSetParams & params,
+  const float * lut, const ImageRegion & region, const cudaStream_t & stream);
+
+void map(
+  float * out_mat, const ImageMsgProperties & img_properties, const JuliaSetParams & params,
+  const ImageRegion & region, const cudaStream_t & stream);
+
+void julia_set_iteration(
+  size_t curr_iteration, size_t iteration_count, float * image,
+  const ImageMsgProperties & img_properties, const JuliaSetParams & params,
+  const ImageRegion & region, const cudaStream_t & stream);
+
+// julia_set_iteration() on the pixels of the active list, or on every pixel of the region
+// without one. Appends the pixels still active afterwards to active_out, which has room for
+// capacity of them, in no particular order.
+void julia_set_iteration_active(
+  size_t curr_iteration, size_t iteration_count, float * image,
+  const ImageMsgProperties & img_properties, const JuliaSetParams & params,
+  const ImageRegion & region, const uint32_t * active, uint32_t capacity, uint32_t * active_out,
+  const cudaStream_t & stream);
+
+// Progressive rendering, see cpu::downsample() and cpu::refine(). Appends the pixels to refine
+// to active_out, which has room for capacity of them, in no particular order.
+void downsample(
+  const float * image, const ImageRegion & region, unsigned int scale, float * coarse,
+  const cudaStream_t & stream);
+
+void refine(
+  float * image, const ImageRegion & region, unsigned int scale, const float * coarse,
+  uint32_t capacity, uint32_t * active_out, const cudaStream_t & stream);
+
+void colorize(
+  uint8_t * output, const float * input, const ImageMsgProperties & img_properties,
+  const JuliaSetParams & params, const float * lut, const ImageRegion & region,
+  const cudaStream_t & stream);
+
+// The kernels above on images in a planar layout, see cpu::map_planar().
+void map_planar(
+  uint8_t * out, PixelLayout layout, const ImageMsgProperties & img_properties,
+  const JuliaSetParams & params, const ImageRegion & region, const cudaStream_t & stream);
+
+void julia_set_iteration_planar(
+  size_t curr_iteration, size_t iteration_count, uint8_t * image, PixelLayout layout,
+  const ImageMsgProperties & img_properties, const JuliaSetParams & params,
+  const ImageRegion & region, const cudaStream_t & stream);
+
+void colorize_planar(
+  uint8_t * output, const uint8_t * input, PixelLayout layout,
+  const ImageMsgProperties & img_properties, const JuliaSetParams & params, const float * lut,
+  const ImageRegion & region, const cudaStream_t & stream);
+
+}  // namespace cuda
+}  // namespace julia_set
+}  // namespace type_adaptation
+#endif  // JULIA_SET__CUDA__JULIA_SET_KERNELS_HPP_
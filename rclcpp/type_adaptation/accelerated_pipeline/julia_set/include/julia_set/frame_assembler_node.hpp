@@ -0,0 +1,110 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef JULIA_SET__FRAME_ASSEMBLER_NODE_HPP_
+#define JULIA_SET__FRAME_ASSEMBLER_NODE_HPP_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "julia_set/julia_set_images.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "sensor_msgs/msg/image.hpp"
+#include "type_adapters/backend.hpp"
+#include "type_adapters/image_container.hpp"
+#include "type_adapters/pipeline_link.hpp"
+#include "type_adapters/shared_image_transport.hpp"
+
+RCLCPP_USING_CUSTOM_TYPE_AS_ROS_MESSAGE_TYPE(
+  type_adaptation::example_type_adapters::ImageContainer,
+  sensor_msgs::msg::Image);
+
+namespace type_adaptation
+{
+namespace julia_set
+{
+
+/**
+ * @brief Puts the colors of frames streamed in tiles back together, and publishes each frame
+ * once all of its tiles came in. Whole frames pass through.
+ *
+ */
+
+class FrameAssemblerNode : public rclcpp::Node
+{
+public:
+  explicit FrameAssemblerNode(const rclcpp::NodeOptions options = rclcpp::NodeOptions());
+  ~FrameAssemblerNode() {}
+
+private:
+/**
+* @brief Callback method on each image msg.
+*
+* @param img_msg Pointer to the image msg
+*/
+  void AssembleCallbackCustomType(
+    std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image);
+  void AssembleCallback(std::unique_ptr<sensor_msgs::msg::Image> image_msg);
+  // Copy a tile into its frame, and publish the frame with its last tile.
+  void Assemble(std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image);
+  // Publish on whichever publisher the node was configured with.
+  void PublishImage(
+    std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image);
+
+  // Frame the tiles of one stamp are copied into, which of them did so and how many
+  struct PendingFrame
+  {
+    ColorImage image;
+    uint32_t tile_count{0};
+    std::vector<bool> received_tiles;
+    uint32_t received{0};
+  };
+
+  // Flag for enabling or disabling type adaptation
+  const bool type_adaptation_enabled_;
+  // Backend of the frames the node creates itself, see declare_memory_backend()
+  type_adaptation::example_type_adapters::BackendType memory_backend_{};
+  // Frames still missing tiles, by stamp, at most max_pending_frames_ of them
+  std::map<int64_t, PendingFrame> pending_frames_;
+  size_t max_pending_frames_{2};
+
+  // Publisher and subscriber when type_adaptation is enabled
+  rclcpp::Subscription<type_adaptation::example_type_adapters::ImageContainer>::SharedPtr
+    custom_type_sub_ {
+    nullptr};
+  rclcpp::Publisher<type_adaptation::example_type_adapters::ImageContainer>::SharedPtr
+    custom_type_pub_{nullptr};
+
+  // Publisher and subscriber when type_adaptation is disabled
+  rclcpp::Subscription<sensor_msgs::msg::Image>::SharedPtr sub_{nullptr};
+  rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr pub_{nullptr};
+
+  // Subscriber and publisher when the pipeline is split across processes at this node
+  std::shared_ptr<type_adaptation::example_type_adapters::SharedImageSubscription>
+    shared_image_sub_{nullptr};
+  std::shared_ptr<type_adaptation::example_type_adapters::SharedImagePublisher>
+    shared_image_pub_{nullptr};
+
+  // Publisher and subscriber when frames are handed over through pipeline links, the subscriber
+  // last so that its thread stops before the rest of the node is destroyed
+  std::shared_ptr<type_adaptation::example_type_adapters::PipelineLinkPublisher> link_pub_{
+    nullptr};
+  std::shared_ptr<type_adaptation::example_type_adapters::PipelineLinkSubscription> link_sub_{
+    nullptr};
+};
+}  // namespace julia_set
+}  // namespace type_adaptation
+#endif  // JULIA_SET__FRAME_ASSEMBLER_NODE_HPP_
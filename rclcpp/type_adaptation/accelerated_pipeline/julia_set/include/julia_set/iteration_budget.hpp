@@ -0,0 +1,112 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef JULIA_SET__ITERATION_BUDGET_HPP_
+#define JULIA_SET__ITERATION_BUDGET_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace type_adaptation
+{
+namespace julia_set
+{
+
+/// Iterations the Julia Set pipeline runs per frame, adapted so that frames meet a deadline.
+/**
+ * The budget takes the place of kMaxIterations for the stages: no stage runs an iteration at or
+ * beyond it, and the pixels still active then are colored as if they never escaped. Frames that
+ * miss the deadline on average cut the budget in proportion to the overshoot, frames well
+ * within it raise the budget again step by step.
+ *
+ * A new budget applies to frames stamped from the time it was set on, so every stage of a frame
+ * runs with the same one. Frames stamped before were computed with the budget before, they are
+ * counted but do not steer the new one.
+ */
+class IterationBudgetController final
+{
+public:
+  /// Budget between min_iterations and max_iterations, starting at max_iterations.
+  IterationBudgetController(
+    std::chrono::nanoseconds deadline, size_t min_iterations, size_t max_iterations);
+
+  /// Account for a frame stamped at stamp that came out of the pipeline at now. Returns whether
+  /// the budget changed, it applies to the frames stamped from now on.
+  bool
+  update(std::chrono::nanoseconds stamp, std::chrono::nanoseconds now);
+
+  size_t
+  budget() const
+  {
+    return budget_;
+  }
+
+  /// Stamp of the first frame computed with budget().
+  std::chrono::nanoseconds
+  budget_since() const
+  {
+    return budget_since_;
+  }
+
+  /// Frame time averaged over the frames computed with budget().
+  std::chrono::nanoseconds
+  frame_time() const
+  {
+    return frame_time_;
+  }
+
+  std::chrono::nanoseconds
+  deadline() const
+  {
+    return deadline_;
+  }
+
+  size_t
+  max_iterations() const
+  {
+    return max_iterations_;
+  }
+
+  uint64_t
+  frames() const
+  {
+    return frames_;
+  }
+
+  /// Frames that took longer than the deadline.
+  uint64_t
+  deadline_misses() const
+  {
+    return deadline_misses_;
+  }
+
+private:
+  const std::chrono::nanoseconds deadline_;
+  const size_t min_iterations_;
+  const size_t max_iterations_;
+
+  size_t budget_;
+  std::chrono::nanoseconds budget_since_{0};
+  std::chrono::nanoseconds frame_time_{0};
+  // Frames computed with budget_ so far
+  size_t samples_{0};
+  uint64_t frames_{0};
+  uint64_t deadline_misses_{0};
+};
+
+}  // namespace julia_set
+}  // namespace type_adaptation
+#endif  // JULIA_SET__ITERATION_BUDGET_HPP_
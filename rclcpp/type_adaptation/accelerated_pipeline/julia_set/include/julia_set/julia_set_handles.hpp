@@ -0,0 +1,191 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef JULIA_SET__JULIA_SET_HANDLES_HPP_
+#define JULIA_SET__JULIA_SET_HANDLES_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "julia_set/cuda/julia_set.hpp"
+#include "julia_set/julia_set_images.hpp"
+#include "type_adapters/image_container.hpp"
+
+namespace type_adaptation
+{
+namespace julia_set
+{
+
+/**
+* @brief Height, width and layout of the images a JuliaSet handle is built for.
+*/
+struct ImageGeometry
+{
+  uint32_t height{0};
+  uint32_t width{0};
+  PixelLayout layout{PixelLayout::kInterleaved};
+};
+
+inline bool operator==(const ImageGeometry & lhs, const ImageGeometry & rhs)
+{
+  return lhs.height == rhs.height && lhs.width == rhs.width && lhs.layout == rhs.layout;
+}
+
+inline bool operator!=(const ImageGeometry & lhs, const ImageGeometry & rhs)
+{
+  return !(lhs == rhs);
+}
+
+/**
+* @brief Geometry of an image of x, y and escape iterations. Throws std::invalid_argument like
+* pixel_layout_of().
+*/
+inline ImageGeometry geometry_of(const example_type_adapters::ImageContainer & image)
+{
+  return ImageGeometry{image.height(), image.width(), pixel_layout_of(image)};
+}
+
+/**
+* @brief Geometry declared by the width, height and encoding parameters of a node. Returns false
+* if no width or height is declared, or for an encoding of no layout.
+*/
+inline bool geometry_from_parameters(
+  int64_t height, int64_t width, const std::string & encoding, ImageGeometry & geometry)
+{
+  if (height <= 0 || width <= 0 || height > UINT32_MAX || width > UINT32_MAX) {
+    return false;
+  }
+  if (!pixel_layout_from_encoding(encoding, geometry.layout)) {
+    return false;
+  }
+  geometry.height = static_cast<uint32_t>(height);
+  geometry.width = static_cast<uint32_t>(width);
+  return true;
+}
+
+/**
+* @brief Tiles of a frame of the resolution declared by the height and width parameters of a
+* node, streamed in tiles of up to tile_height x tile_width pixels. 1 for whole frames, or if no
+* resolution is declared.
+*/
+inline size_t stream_tiles_from_parameters(
+  int64_t height, int64_t width, uint32_t tile_height, uint32_t tile_width)
+{
+  ImageGeometry geometry;
+  if (tile_height == 0 || tile_width == 0 ||
+    !geometry_from_parameters(
+      height, width, pixel_layout_encoding(PixelLayout::kInterleaved), geometry))
+  {
+    return 1;
+  }
+  return stream_tile_count(geometry.height, geometry.width, tile_height, tile_width);
+}
+
+/// Default of the stream_tiles_in_flight parameter.
+constexpr int64_t kDefaultStreamTilesInFlight = 4;
+
+/**
+* @brief Tiles MapNode has on their way down the pipeline at most, given the stream tile size
+* and the stream_tiles_in_flight parameter of a node, which the queues of the stages hold. 1 for
+* whole frames.
+*/
+inline size_t stream_tiles_in_flight(
+  uint32_t tile_height, uint32_t tile_width, int64_t tiles_in_flight)
+{
+  if (tile_height == 0 || tile_width == 0) {
+    return 1;
+  }
+  return static_cast<size_t>(std::max<int64_t>(tiles_in_flight, 1));
+}
+
+/**
+* @brief JuliaSet handles of a node for the geometries of its last frames, by default the current
+* one and a spare one for the geometry before. Frames of a geometry that has a handle take it,
+* and only the handle of a geometry that is new to the set is built, in place of the least
+* recently used one. A node that goes back and forth between two resolutions or layouts, or
+* between the tile sizes of frames streamed in tiles, builds each handle once.
+*/
+class JuliaSetHandles
+{
+public:
+  using Factory = std::function<std::unique_ptr<JuliaSet>(const ImageGeometry &)>;
+
+  explicit JuliaSetHandles(Factory factory, size_t capacity = 2)
+  : factory_(std::move(factory)), capacity_(std::max<size_t>(capacity, 1))
+  {
+  }
+
+  /// Handle for frames of a geometry.
+  JuliaSet & get(const ImageGeometry & geometry)
+  {
+    auto found = std::find_if(
+      handles_.begin(), handles_.end(),
+      [&geometry](const Entry & entry) {return entry.first == geometry;});
+    if (found == handles_.end()) {
+      if (handles_.size() >= capacity_) {
+        handles_.pop_back();
+      }
+      handles_.emplace_front(geometry, factory_(geometry));
+    } else if (found != handles_.begin()) {
+      handles_.splice(handles_.begin(), handles_, found);
+    }
+    return *handles_.front().second;
+  }
+
+  /// Handle of the last geometry, nullptr before the first one.
+  JuliaSet * current() const
+  {
+    return handles_.empty() ? nullptr : handles_.front().second.get();
+  }
+
+  /// The last geometry, or an empty one before the first.
+  ImageGeometry geometry() const
+  {
+    return handles_.empty() ? ImageGeometry{} : handles_.front().first;
+  }
+
+  /// Keep the handles of up to capacity geometries from now on.
+  void set_capacity(size_t capacity)
+  {
+    capacity_ = std::max<size_t>(capacity, 1);
+    while (handles_.size() > capacity_) {
+      handles_.pop_back();
+    }
+  }
+
+  /// Drop all handles, e.g. once the parameters they were built with changed.
+  void reset()
+  {
+    handles_.clear();
+  }
+
+private:
+  using Entry = std::pair<ImageGeometry, std::unique_ptr<JuliaSet>>;
+
+  Factory factory_;
+  size_t capacity_;
+  // Most recently used first
+  std::list<Entry> handles_;
+};
+
+}  // namespace julia_set
+}  // namespace type_adaptation
+#endif  // JULIA_SET__JULIA_SET_HANDLES_HPP_
@@ -0,0 +1,139 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef JULIA_SET__JULIA_SET_IMAGES_HPP_
+#define JULIA_SET__JULIA_SET_IMAGES_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include "julia_set/cuda/julia_set.hpp"
+#include "type_adapters/image_container.hpp"
+#include "type_adapters/typed_image.hpp"
+
+namespace type_adaptation
+{
+namespace julia_set
+{
+
+/**
+* @brief x, y and escape iteration of every pixel in the interleaved layout, produced by
+* MapNode and updated by JuliaSetNode.
+*/
+using FloatImage = example_type_adapters::TypedImage<float, 3>;
+
+/**
+* @brief Layout named by a pixel_layout parameter, "interleaved", "planar32" or "planar16".
+* Throws std::invalid_argument for any other name.
+*/
+inline PixelLayout pixel_layout_from_string(const std::string & name)
+{
+  if (name == "interleaved") {
+    return PixelLayout::kInterleaved;
+  }
+  if (name == "planar32") {
+    return PixelLayout::kPlanar32;
+  }
+  if (name == "planar16") {
+    return PixelLayout::kPlanar16;
+  }
+  throw std::invalid_argument("Unknown pixel layout " + name);
+}
+
+/**
+* @brief Layout of the x, y and escape iterations in an image, told by its encoding. Throws
+* std::invalid_argument for an encoding of no layout, or for rows too short for the layout.
+*/
+inline PixelLayout pixel_layout_of(const example_type_adapters::ImageContainer & image)
+{
+  PixelLayout layout;
+  if (!pixel_layout_from_encoding(image.encoding(), layout)) {
+    throw std::invalid_argument("Image encoding " + image.encoding() + " is no pixel layout");
+  }
+  if (image.step() < pixel_layout_row_step(layout, image.width())) {
+    throw std::invalid_argument("Image rows are too short for encoding " + image.encoding());
+  }
+  return layout;
+}
+
+/**
+* @brief Image produced by ColorizeNode.
+*/
+using ColorImage = example_type_adapters::TypedImage<uint8_t, 3>;
+
+/**
+* @brief Properties of a ColorImage, whose layout is fixed by its type.
+*/
+inline ImageMsgProperties color_image_properties(uint32_t height, uint32_t width)
+{
+  ImageMsgProperties properties;
+  properties.row_step = width * ColorImage::kPixelBytes;
+  properties.height = height;
+  properties.width = width;
+  properties.encoding = ColorImage::Format::kEncoding;
+  properties.red_offset = 0;
+  properties.green_offset = 1;
+  properties.blue_offset = 2;
+  properties.color_step = ColorImage::kChannels;
+  return properties;
+}
+
+/**
+* @brief Region of the whole image that a typed image, or a view of it, covers.
+*/
+template<typename ImageT>
+ImageRegion region_of(const ImageT & image, size_t in_row_step, size_t out_row_step)
+{
+  ImageRegion region;
+  region.x = image.origin_x();
+  region.y = image.origin_y();
+  region.width = image.width();
+  region.height = image.height();
+  region.in_row_step = in_row_step;
+  region.out_row_step = out_row_step;
+  return region;
+}
+
+/**
+* @brief Tiles of a frame streamed in tiles of up to tile_height x tile_width pixels, row-major.
+*/
+inline uint32_t stream_tile_count(
+  uint32_t height, uint32_t width, uint32_t tile_height, uint32_t tile_width)
+{
+  return ((height + tile_height - 1) / tile_height) * ((width + tile_width - 1) / tile_width);
+}
+
+/**
+* @brief Placement of tile index of such a frame. Tiles at the right and bottom edges are cut to
+* the frame, to width - x and height - y pixels.
+*/
+inline example_type_adapters::TilePlacement stream_tile(
+  uint32_t height, uint32_t width, uint32_t tile_height, uint32_t tile_width, uint32_t index)
+{
+  const uint32_t columns = (width + tile_width - 1) / tile_width;
+  example_type_adapters::TilePlacement tile;
+  tile.x = (index % columns) * tile_width;
+  tile.y = (index / columns) * tile_height;
+  tile.frame_width = width;
+  tile.frame_height = height;
+  tile.index = index;
+  tile.count = stream_tile_count(height, width, tile_height, tile_width);
+  return tile;
+}
+
+}  // namespace julia_set
+}  // namespace type_adaptation
+#endif  // JULIA_SET__JULIA_SET_IMAGES_HPP_
@@ -16,12 +16,23 @@
 #define JULIA_SET__JULIA_SET_NODE_HPP_
 
 #include "cuda/julia_set.hpp"
+#include "julia_set/julia_set_handles.hpp"
+#include "julia_set/julia_set_images.hpp"
 
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <vector>
 
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
 #include "rclcpp/rclcpp.hpp"
 #include "sensor_msgs/msg/image.hpp"
+#include "type_adapters/backend.hpp"
+#include "type_adapters/frame_cache.hpp"
 #include "type_adapters/image_container.hpp"
+#include "type_adapters/image_ingest.hpp"
+#include "type_adapters/pipeline_link.hpp"
+#include "type_adapters/shared_image_transport.hpp"
 
 RCLCPP_USING_CUSTOM_TYPE_AS_ROS_MESSAGE_TYPE(
   type_adaptation::example_type_adapters::ImageContainer,
@@ -52,25 +63,120 @@ private:
   void JuliaSetCallbackCustomType(
     std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image);
   void JuliaSetCallback(std::unique_ptr<sensor_msgs::msg::Image> image_msg);
+  // Compute and publish an image, or queue it to its batch.
+  void ProcessImage(std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image);
+  // Compute the frame the ingest staged last, once no message followed it in time.
+  void FlushIngest();
+  // Take over the iteration budget ColorizeNode adapts to the frame deadline.
+  void IterationBudgetCallback(std::unique_ptr<diagnostic_msgs::msg::DiagnosticArray> diagnostics);
+  // Iteration budget of a frame, the one in effect when it was stamped.
+  size_t IterationBudget(const std_msgs::msg::Header & header);
+  // Iterations of this stage on a frame, cut short by its iteration budget.
+  size_t StageIterations(const std_msgs::msg::Header & header);
+  // Progressive rendering: run every iteration up to the budget on a coarse sample of the image,
+  // publish it as a preview and fill the blocks it resolves. Returns the pixels left to compute.
+  type_adaptation::example_type_adapters::PixelList RenderPreview(
+    type_adaptation::example_type_adapters::ImageContainer & image, float angle,
+    size_t iteration_budget);
+  // Queue a frame of a batch, which is computed once it is full or its time is up.
+  void QueueFrame(std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image);
+  // Compute and publish the frames queued so far, must be called with batch_mutex_ held.
+  void FlushBatch();
+  // FlushBatch() once the first frame of the batch waited batch_timeout_ms.
+  void BatchTimeout();
+
+  // Angle and iterations of this stage on a frame
+  struct StageFrame
+  {
+    size_t angle_index{0};
+    float angle{0.0};
+    size_t iteration_count{0};
+    bool use_frame_cache{false};
+    uint64_t frame_cache_key{0};
+  };
+  // Run the iterations of this stage on the image, in whichever layout it comes in.
+  void ComputeStage(type_adaptation::example_type_adapters::ImageContainer & image);
+  // ComputeStage() on a batch of frames, in one call into the Julia Set handle.
+  void ComputeStages(
+    std::vector<std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer>> & images);
+  // Steps of ComputeStage(). BeginStage() returns false for frames that are done already, passed
+  // through or served from the frame cache.
+  bool BeginStage(
+    type_adaptation::example_type_adapters::ImageContainer & image, StageFrame & frame);
+  void RunStage(
+    type_adaptation::example_type_adapters::ImageContainer & image, StageFrame & frame);
+  void EndStage(
+    const type_adaptation::example_type_adapters::ImageContainer & image,
+    const StageFrame & frame);
+  // Handle for julia_set_handles_ and preview_handles_.
+  std::unique_ptr<JuliaSet> CreateHandle(const ImageGeometry & geometry) const;
+  // Build the handles and fill the buffer pool for frames of a geometry ahead of the first one.
+  void WarmUp(const ImageGeometry & geometry);
+  // Hash of what the cached frames were computed from, besides the angle.
+  uint64_t FrameCacheGeneration(
+    const type_adaptation::example_type_adapters::ImageContainer & image) const;
+  // Key of the image among the cached frames, the angle for whole frames, the angle and the index
+  // of the tile for tiles.
+  uint64_t FrameCacheKey(
+    const type_adaptation::example_type_adapters::ImageContainer & image,
+    size_t angle_index) const;
+  // Publish on whichever publisher the node was configured with.
+  void PublishImage(
+    std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image);
 
   // Flag for enabling or disabling type adaptation
   const bool type_adaptation_enabled_;
-  // Current node number in the pipeline
+  // Backend of the frames the node creates itself, see declare_memory_backend()
+  type_adaptation::example_type_adapters::BackendType memory_backend_{};
+  // Current node number in the pipeline, the first iteration the node runs
   const uint8_t proc_id_;
-  // Flag for intialization.
-  bool is_initialized;
+  // Iterations the node runs on each frame, from proc_id_ on
+  const size_t iterations_per_stage_;
+  // Flag for passing the pixels that did not escape yet on to the next stage
+  const bool compact_active_pixels_;
+  // Frames computed together, 1 for frame by frame
+  const size_t batch_size_;
+  // Side of the blocks of pixels of the coarse pass, below 2 without progressive rendering
+  unsigned int progressive_scale_{0};
   // Counter
   size_t counter_{0};
+  // Angle of the last frame, and its stamp when it came in tiles, which all take that angle
+  size_t angle_index_{0};
+  int64_t tile_frame_stamp_{INT64_MIN};
   // Julia Set start x
   float start_x_{0.0};
   // Julia Set start y
   float start_y_{0.0};
   // Julia Set prams
   JuliaSetParams julia_set_params_{}; \
-  // Image properties to be sent to CUDA kernel
-  ImageMsgProperties img_property_{};
-  // Julia Set handle
-  std::unique_ptr<JuliaSet> julia_set_handle_;
+  // Split of the CPU kernels across threads
+  CpuTiling cpu_tiling_{};
+  // Julia Set handles, for the resolution and layout of the last image and of the one before
+  JuliaSetHandles julia_set_handles_;
+  // Julia Set handles of the coarse pass, for its resolution
+  JuliaSetHandles preview_handles_;
+  // Frames of this stage by angle, when enabled
+  std::unique_ptr<type_adaptation::example_type_adapters::FrameCache> frame_cache_;
+  // FrameCacheGeneration() of the frames in frame_cache_
+  uint64_t frame_cache_generation_{0};
+  // Frames of the batch so far, the timer that caps how long they wait for the rest, and what
+  // guards them when frames come in on the thread of a pipeline link
+  std::vector<std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer>> batch_;
+  rclcpp::TimerBase::SharedPtr batch_timer_{nullptr};
+  std::mutex batch_mutex_;
+  // Double-buffered conversion of sensor_msgs images, when enabled, and the timer that caps how
+  // long a staged frame waits for the next message
+  std::unique_ptr<type_adaptation::example_type_adapters::ImageIngest> ingest_;
+  rclcpp::TimerBase::SharedPtr ingest_timer_{nullptr};
+  // Iteration budget of the frames stamped from iteration_budget_since_ on, in nanoseconds, and
+  // of those before. No budget until ColorizeNode sets one.
+  size_t iteration_budget_{SIZE_MAX};
+  size_t previous_iteration_budget_{SIZE_MAX};
+  int64_t iteration_budget_since_{0};
+  // Guards the iteration budget, which arrives on its own topic
+  std::mutex iteration_budget_mutex_;
+  rclcpp::Subscription<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr iteration_budget_sub_{
+    nullptr};
 
   // Publisher and subscriber when type_adaptation is enabled
   rclcpp::Subscription<type_adaptation::example_type_adapters::ImageContainer>::SharedPtr
@@ -82,6 +188,24 @@ private:
   // Publisher and subscriber when type_adaptation is disabled
   rclcpp::Subscription<sensor_msgs::msg::Image>::SharedPtr sub_{nullptr};
   rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr pub_{nullptr};
+
+  // Publishers of the preview of progressive rendering
+  rclcpp::Publisher<type_adaptation::example_type_adapters::ImageContainer>::SharedPtr
+    custom_type_preview_pub_{nullptr};
+  rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr preview_pub_{nullptr};
+
+  // Subscriber and publisher when the pipeline is split across processes at this node
+  std::shared_ptr<type_adaptation::example_type_adapters::SharedImageSubscription>
+    shared_image_sub_{nullptr};
+  std::shared_ptr<type_adaptation::example_type_adapters::SharedImagePublisher>
+    shared_image_pub_{nullptr};
+
+  // Publisher and subscriber when frames are handed over through pipeline links, the subscriber
+  // last so that its thread stops before the rest of the node is destroyed
+  std::shared_ptr<type_adaptation::example_type_adapters::PipelineLinkPublisher> link_pub_{
+    nullptr};
+  std::shared_ptr<type_adaptation::example_type_adapters::PipelineLinkSubscription> link_sub_{
+    nullptr};
 };
 }  // namespace julia_set
 }  // namespace type_adaptation
@@ -15,12 +15,24 @@
 #ifndef JULIA_SET__MAP_NODE_HPP_
 #define JULIA_SET__MAP_NODE_HPP_
 
+#include <condition_variable>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "cuda/julia_set.hpp"
+#include "julia_set/julia_set_handles.hpp"
+#include "julia_set/julia_set_images.hpp"
 
 #include "rclcpp/rclcpp.hpp"
 #include "sensor_msgs/msg/image.hpp"
+#include "type_adapters/backend.hpp"
 #include "type_adapters/image_container.hpp"
+#include "type_adapters/image_ingest.hpp"
+#include "type_adapters/in_flight_window.hpp"
+#include "type_adapters/pipeline_link.hpp"
+#include "type_adapters/shared_image_transport.hpp"
 
 RCLCPP_USING_CUSTOM_TYPE_AS_ROS_MESSAGE_TYPE(
   type_adaptation::example_type_adapters::ImageContainer,
@@ -40,7 +52,7 @@ class MapNode : public rclcpp::Node
 {
 public:
   explicit MapNode(const rclcpp::NodeOptions options = rclcpp::NodeOptions());
-  ~MapNode() {}
+  ~MapNode();
 
 private:
 /**
@@ -51,17 +63,72 @@ private:
   void MapCallbackCustomType(
     std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image);
   void MapCallback(std::unique_ptr<sensor_msgs::msg::Image> image_msg);
+  // Publish the grid of an image whole, or hand it to the tile thread.
+  void ProcessImage(std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image);
+  // Publish the grid of the frame the ingest staged last, once no message followed it in time.
+  void FlushIngest();
+  // Copy of the coordinate grid for the resolution of the image, computed again only when the
+  // resolution or the ranges changed.
+  type_adaptation::example_type_adapters::ImageContainer Grid(
+    const type_adaptation::example_type_adapters::ImageContainer & image);
+  // Compute the grid of a geometry on the stream.
+  void ComputeGrid(
+    const ImageGeometry & geometry,
+    std::shared_ptr<type_adaptation::example_type_adapters::StreamWrapper> stream);
+  // Handle for julia_set_handles_, with the ranges of the grid.
+  std::unique_ptr<JuliaSet> CreateHandle(const ImageGeometry & geometry) const;
+  // Handle for a tile of a frame, with the ranges of its part of the grid.
+  std::unique_ptr<JuliaSet> CreateTileHandle(
+    const ImageGeometry & geometry,
+    const type_adaptation::example_type_adapters::TilePlacement & tile,
+    const JuliaSetParams & ranges) const;
+  // Loop of the tile thread, which publishes the tiles of the frames handed to it.
+  void StreamTiles();
+  // Compute and publish the grid of the frame of the image tile by tile, each once there is room
+  // for it in the window of tiles in flight.
+  void PublishTiles(const type_adaptation::example_type_adapters::ImageContainer & image);
+  // Take over new ranges of the grid.
+  rcl_interfaces::msg::SetParametersResult OnSetParameters(
+    const std::vector<rclcpp::Parameter> & parameters);
+  // Publish on whichever publisher the node was configured with.
+  void PublishImage(
+    std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image);
 
   // Flag for enabling or disabling type adaptation
   const bool type_adaptation_enabled_;
-  // Flag for intialization.
-  bool is_initialized;
+  // Backend of the frames the node creates itself, see declare_memory_backend()
+  type_adaptation::example_type_adapters::BackendType memory_backend_{};
   // JuliaSet prams
   JuliaSetParams julia_set_params_{}; \
-  // Image properties to be sent to CUDA kernel
-  ImageMsgProperties img_property_{};
-  // JuliaSet handle
-  std::unique_ptr<JuliaSet> julia_set_handle_;
+  // Split of the CPU kernels across threads
+  CpuTiling cpu_tiling_{};
+  // Layout of the grid, which every later stage takes over
+  PixelLayout pixel_layout_{PixelLayout::kInterleaved};
+  // Size of the tiles frames are streamed in, 0 to publish whole frames
+  uint32_t stream_tile_height_{0};
+  uint32_t stream_tile_width_{0};
+  // JuliaSet handles of the last two resolutions, reset when the ranges change
+  JuliaSetHandles julia_set_handles_;
+  // Coordinate grid every frame is published as a copy-on-write copy of, and the one of the
+  // resolution before
+  type_adaptation::example_type_adapters::ImageContainer grid_;
+  type_adaptation::example_type_adapters::ImageContainer spare_grid_;
+  // Stamped on every frame as its source generation, moves on when the ranges change. Starts from
+  // the time the node was created, so that a MapNode started again does not repeat the ones of
+  // the node before.
+  uint64_t grid_generation_{0};
+  // Guards the parameters, the handle and the grid against parameter updates between frames
+  std::mutex grid_mutex_;
+  rclcpp::node_interfaces::OnSetParametersCallbackHandle::SharedPtr parameters_callback_;
+
+  // Window of the tiles on their way down the pipeline when streaming tiles, the thread that
+  // publishes them, and the frame it publishes next. A newer frame replaces one still waiting.
+  std::unique_ptr<type_adaptation::example_type_adapters::InFlightWindow> tile_window_;
+  std::thread tile_thread_;
+  std::mutex tile_mutex_;
+  std::condition_variable tile_condition_;
+  std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> pending_frame_;
+  bool stop_tiles_{false};
 
   // Publisher and subscriber when type_adaptation is enabled
   rclcpp::Subscription<type_adaptation::example_type_adapters::ImageContainer>::SharedPtr
@@ -73,6 +140,23 @@ private:
   // Publisher and subscriber when type_adaptation is disabled
   rclcpp::Subscription<sensor_msgs::msg::Image>::SharedPtr sub_{nullptr};
   rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr pub_{nullptr};
+  // Double-buffered conversion of sensor_msgs images, when enabled, and the timer that caps how
+  // long a staged frame waits for the next message
+  std::unique_ptr<type_adaptation::example_type_adapters::ImageIngest> ingest_;
+  rclcpp::TimerBase::SharedPtr ingest_timer_{nullptr};
+
+  // Subscriber and publisher when the pipeline is split across processes at this node
+  std::shared_ptr<type_adaptation::example_type_adapters::SharedImageSubscription>
+    shared_image_sub_{nullptr};
+  std::shared_ptr<type_adaptation::example_type_adapters::SharedImagePublisher>
+    shared_image_pub_{nullptr};
+
+  // Publisher and subscriber when frames are handed over through pipeline links, the subscriber
+  // last so that its thread stops before the rest of the node is destroyed
+  std::shared_ptr<type_adaptation::example_type_adapters::PipelineLinkPublisher> link_pub_{
+    nullptr};
+  std::shared_ptr<type_adaptation::example_type_adapters::PipelineLinkSubscription> link_sub_{
+    nullptr};
 };
 }  // namespace julia_set
 }  // namespace type_adaptation
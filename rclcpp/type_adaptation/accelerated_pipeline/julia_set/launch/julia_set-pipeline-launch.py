@@ -14,6 +14,8 @@
 
 """Launch the GPU pipeline for Julia Set Example."""
 
+import math
+import os
 import platform
 
 from launch import LaunchDescription
@@ -31,6 +33,11 @@ RESOLUTIONS = {'16K': (15360, 8640),
                '480p': (852, 480)}
 IMAGE_HZ = 100.0
 
+# Encodings of the images between the nodes, by pixel_layout.
+PIXEL_LAYOUT_ENCODINGS = {'interleaved': '32FC3',
+                          'planar32': 'julia_set_planar32',
+                          'planar16': 'julia_set_planar16'}
+
 MAX_ITERATION = 50
 
 JULIASET_PARAMS = [{'min_x_range': -2.5},
@@ -46,6 +53,87 @@ launch_args = [DeclareLaunchArgument('enable_type_adapt', default_value='true',
                                      description='Enable type adaptation mode'),
                DeclareLaunchArgument('resolution', default_value='1080p',
                                      description='Resolution key (16K|8K|4K|1080p|720p|480p)'),
+               DeclareLaunchArgument('memory_backend', default_value='',
+                                     description='Image memory backend (host|cuda), '
+                                                 'empty for the build default'),
+               DeclareLaunchArgument('cpu_threads', default_value='0',
+                                     description='Threads of the CPU kernels, '
+                                                 '0 for one per hardware thread'),
+               DeclareLaunchArgument('iterations_per_stage', default_value='1',
+                                     description='Julia Set iterations each node runs, the '
+                                                 'chain collapses into fewer, fused stages'),
+               DeclareLaunchArgument('compact_active_pixels', default_value='false',
+                                     description='Pass the pixels that did not escape yet on '
+                                                 'to later stages, which skip the others'),
+               DeclareLaunchArgument('batch_size', default_value='1',
+                                     description='Frames each Julia Set node queues up and '
+                                                 'computes together, 1 for frame by frame'),
+               DeclareLaunchArgument('batch_timeout_ms', default_value='10.0',
+                                     description='Longest a queued frame waits for the rest of '
+                                                 'its batch'),
+               DeclareLaunchArgument('double_buffered_ingest', default_value='false',
+                                     description='Without type adaptation, convert each image '
+                                                 'on a transfer thread while the one before is '
+                                                 'computed'),
+               DeclareLaunchArgument('ingest_timeout_ms', default_value='50.0',
+                                     description='Longest a converted image waits for the next '
+                                                 'one before it is computed'),
+               DeclareLaunchArgument('progressive_scale', default_value='0',
+                                     description='Render a preview from every n-th pixel of '
+                                                 'each row and column first, and only refine the '
+                                                 'blocks it does not resolve, 0 to compute every '
+                                                 'pixel'),
+               DeclareLaunchArgument('pixel_layout', default_value='interleaved',
+                                     description='Layout of the pixels between the nodes '
+                                                 '(interleaved|planar32|planar16)'),
+               DeclareLaunchArgument('frame_cache_bytes', default_value='0',
+                                     description='Bytes of frames each Julia Set node keeps in '
+                                                 'memory to serve the repeating animation from, '
+                                                 '0 to compute every frame'),
+               DeclareLaunchArgument('frame_cache_spill_bytes', default_value='0',
+                                     description='Bytes of frames each Julia Set node keeps in '
+                                                 'memory-mapped files beyond frame_cache_bytes'),
+               DeclareLaunchArgument('frame_cache_spill_directory', default_value='',
+                                     description='Directory of the frame cache files, empty to '
+                                                 'not spill frames to disk'),
+               DeclareLaunchArgument('frame_deadline_ms', default_value='0',
+                                     description='Deadline of each frame through the pipeline, '
+                                                 'the iterations are cut down to meet it, e.g. '
+                                                 '10 at 100 Hz, 0 to always run them all'),
+               DeclareLaunchArgument('min_iterations', default_value='10',
+                                     description='Iterations the frame deadline never cuts '
+                                                 'below'),
+               DeclareLaunchArgument('stream_tile_width', default_value='0',
+                                     description='Width of the tiles map_node streams each '
+                                                 'frame in, which a frame_assembler_node puts '
+                                                 'back together, 0 for whole frames'),
+               DeclareLaunchArgument('stream_tile_height', default_value='0',
+                                     description='Height of the tiles map_node streams each '
+                                                 'frame in, 0 for whole frames'),
+               DeclareLaunchArgument('stream_tiles_in_flight', default_value='4',
+                                     description='Tiles map_node has on their way down the '
+                                                 'pipeline at most, it computes the next one once '
+                                                 'frame_assembler_node took one'),
+               DeclareLaunchArgument('split_at', default_value='0',
+                                     description='Run the nodes from juliaset_node<split_at> on '
+                                                 'in a second process fed through shared '
+                                                 'memory, 0 for a single process'),
+               DeclareLaunchArgument('pipeline_links', default_value='false',
+                                     description='Hand frames from each node to the next through '
+                                                 'a lock-free ring rather than a topic, on a '
+                                                 'thread of the next node'),
+               DeclareLaunchArgument('pin_link_threads', default_value='false',
+                                     description='Pin the thread of each node fed through a '
+                                                 'pipeline link to a CPU of its own'),
+               DeclareLaunchArgument('static_graph', default_value='false',
+                                     description='Run the nodes of each process as a static '
+                                                 'graph, each node calls the next directly '
+                                                 'through a pipeline link, topics only remain at '
+                                                 'the ends'),
+               DeclareLaunchArgument('stage_threads', default_value='',
+                                     description='Comma-separated names of the nodes of the '
+                                                 'static graph that run on a thread of their '
+                                                 'own, e.g. juliaset_node25,colorize_node'),
                DeclareLaunchArgument('enable_mt', default_value='false',
                                      description='Enable multithreaded composable containers'),
                DeclareLaunchArgument('enable_nsys', default_value='false',
@@ -67,6 +155,55 @@ def generate_launch_description():
 def launch_setup(context):
     enable_type_adapt = IfCondition(LaunchConfiguration('enable_type_adapt')).evaluate(context)
     resolution = LaunchConfiguration('resolution').perform(context)
+    memory_backend = LaunchConfiguration('memory_backend').perform(context)
+    cpu_threads = int(LaunchConfiguration('cpu_threads').perform(context))
+    iterations_per_stage = max(
+        int(LaunchConfiguration('iterations_per_stage').perform(context)), 1)
+    compact_active_pixels = IfCondition(
+        LaunchConfiguration('compact_active_pixels')).evaluate(context)
+    batch_size = max(int(LaunchConfiguration('batch_size').perform(context)), 1)
+    batch_params = [
+        {'batch_size': batch_size},
+        {'batch_timeout_ms': float(LaunchConfiguration('batch_timeout_ms').perform(context))}]
+    ingest_params = [
+        {'double_buffered_ingest': IfCondition(
+            LaunchConfiguration('double_buffered_ingest')).evaluate(context)},
+        {'ingest_timeout_ms': float(LaunchConfiguration('ingest_timeout_ms').perform(context))}]
+    progressive_scale = int(LaunchConfiguration('progressive_scale').perform(context))
+    stream_tile_params = [
+        {'stream_tile_width': int(LaunchConfiguration('stream_tile_width').perform(context))},
+        {'stream_tile_height': int(LaunchConfiguration('stream_tile_height').perform(context))}]
+    stream_tiles = all(list(param.values())[0] > 0 for param in stream_tile_params)
+    # The queues of every stage hold the tiles map_node has on their way.
+    stream_tile_params.append(
+        {'stream_tiles_in_flight':
+            int(LaunchConfiguration('stream_tiles_in_flight').perform(context))})
+    if stream_tiles and not enable_type_adapt:
+        # Tiles only carry where they lie in their frame with type adaptation.
+        raise RuntimeError('Streaming frames in tiles requires enable_type_adapt')
+    if stream_tiles:
+        # Tiles are computed in full, there is no preview of a frame.
+        progressive_scale = 0
+    # The later stages skip the blocks the preview filled in along the list of active pixels.
+    compact_active_pixels = compact_active_pixels or progressive_scale > 1
+    pixel_layout = LaunchConfiguration('pixel_layout').perform(context)
+    frame_cache_params = [
+        {'frame_cache_bytes': int(LaunchConfiguration('frame_cache_bytes').perform(context))},
+        {'frame_cache_spill_bytes': int(
+            LaunchConfiguration('frame_cache_spill_bytes').perform(context))},
+        {'frame_cache_spill_directory': LaunchConfiguration(
+            'frame_cache_spill_directory').perform(context)}]
+    iteration_budget_params = [
+        {'frame_deadline_ms': float(LaunchConfiguration('frame_deadline_ms').perform(context))},
+        {'min_iterations': int(LaunchConfiguration('min_iterations').perform(context))}]
+    split_at = int(LaunchConfiguration('split_at').perform(context))
+    pipeline_links = IfCondition(LaunchConfiguration('pipeline_links')).evaluate(context)
+    pin_link_threads = IfCondition(LaunchConfiguration('pin_link_threads')).evaluate(context)
+    static_graph = IfCondition(LaunchConfiguration('static_graph')).evaluate(context)
+    stage_threads = set(
+        name.strip() for name in LaunchConfiguration('stage_threads').perform(context).split(',')
+        if name.strip())
+    pipeline_links = pipeline_links or static_graph
     enable_mt = IfCondition(LaunchConfiguration('enable_mt')).evaluate(context)
     enable_nsys = IfCondition(LaunchConfiguration('enable_nsys')).evaluate(context)
     nsys_profile_label = LaunchConfiguration('nsys_profile_label').perform(context)
@@ -92,15 +229,72 @@ def launch_setup(context):
                                                  'height': RESOLUTIONS[resolution][1]}])
 
     # Pipeline consists of the following nodes
-    # cam2image -> Map Node -> MAX_ITERATION Julia Set Nodes -> Colorize Node
+    # cam2image -> Map Node -> Julia Set Nodes -> Colorize Node [-> Frame Assembler Node]
     #
     # Map Node - Transforms input image width and height to X and Y coordinate axis.
     #            Parameters that governs the range of the axes are following:
     #            min_x_range, max_x_range, min_y_range and max_y_range
     #
     # Julia Set Node - Generates the Julia Set for the start location given by start_x and start_y.
+    #                  Each node is a stage that runs iterations_per_stage iterations, so
+    #                  ceil((MAX_ITERATION - 1) / iterations_per_stage) nodes run them all.
+    #                  Given a progressive_scale, the first one publishes a coarse preview on
+    #                  /image_preview.
+    #
+    # Colorize Node - Colorizes the output to be consumed as an image. Given a frame_deadline_ms,
+    #                 it adapts the iterations the Julia Set Nodes run to the time frames take.
     #
-    # Colorize Node - Colorizes the output to be consumed as an image.
+    # Frame Assembler Node - Given a stream_tile_width and stream_tile_height, Map Node publishes
+    #                        each frame in tiles, which the nodes after compute one by one. This
+    #                        node copies the colors of the tiles back into their frame.
+
+    backend_params = [{'memory_backend': memory_backend}] if memory_backend else []
+    # The nodes set up their handles and buffers for the resolution of cam2image at startup.
+    geometry_params = [{'width': RESOLUTIONS[resolution][0]},
+                       {'height': RESOLUTIONS[resolution][1]}]
+    node_params = JULIASET_PARAMS + backend_params + [{'cpu_threads': cpu_threads}] + \
+        geometry_params + stream_tile_params + ingest_params
+    encoding_params = [{'encoding': PIXEL_LAYOUT_ENCODINGS.get(pixel_layout, '')}]
+
+    stage_count = math.ceil((MAX_ITERATION - 1) / iterations_per_stage)
+
+    # Nodes from juliaset_node<split_at> on (colorize_node for stage_count + 1) run in a second
+    # process, the image crosses over to it in shared memory.
+    split_at = split_at if 0 < split_at <= stage_count + 1 else 0
+
+    # Within a process, the nodes may hand frames on through pipeline links, up to colorize_node,
+    # or frame_assembler_node for tiles. The topics at the ends of the chain remain.
+    last_stage = stage_count + (2 if stream_tiles else 1)
+
+    def stage_name(stage):
+        if stage == 0:
+            return 'map_node'
+        if stage <= stage_count:
+            return 'juliaset_node%d' % stage
+        return 'colorize_node' if stage == stage_count + 1 else 'frame_assembler_node'
+
+    # In a static graph, each node runs within the publish call of the node before, in the order
+    # of the chain, unless it is given a thread of its own.
+    unknown_stages = stage_threads - set(stage_name(stage) for stage in range(1, last_stage + 1))
+    if static_graph and unknown_stages:
+        raise RuntimeError('stage_threads names nodes that are not fed through a pipeline link: ' +
+                           ', '.join(sorted(unknown_stages)))
+
+    def transport_params(stage):
+        params = []
+        if split_at and stage == split_at - 1:
+            params.append({'shared_memory_out': True})
+        elif pipeline_links and stage < last_stage:
+            params.append({'link_out': 'julia_set_link%d' % stage})
+        if split_at and stage == split_at:
+            params.append({'shared_memory_in': True})
+        elif pipeline_links and stage > 0:
+            params.append({'link_in': 'julia_set_link%d' % (stage - 1)})
+            if static_graph and stage_name(stage) not in stage_threads:
+                params.append({'link_thread': False})
+            elif pin_link_threads:
+                params.append({'link_cpu': stage % os.cpu_count()})
+        return params
 
     pipeline_nodes = [cam2image_node]
 
@@ -108,16 +302,24 @@ def launch_setup(context):
         package='julia_set',
         plugin='type_adaptation::julia_set::MapNode',
         name='map_node',
-        parameters=[{'type_adaptation_enabled': enable_type_adapt}] + JULIASET_PARAMS,
+        parameters=[{'type_adaptation_enabled': enable_type_adapt},
+                    {'pixel_layout': pixel_layout}] + node_params + transport_params(0),
         remappings=[('/image_out', '/image_out0')]))
 
-    for i in range(1, MAX_ITERATION):
+    for i in range(1, stage_count + 1):
+        first_iteration = 1 + (i - 1) * iterations_per_stage
         pipeline_nodes.append(ComposableNode(
             package='julia_set',
             plugin='type_adaptation::julia_set::JuliaSetNode',
             name='juliaset_node%d' % (i),
             parameters=[{'type_adaptation_enabled': enable_type_adapt},
-                        {'proc_id': i}] + JULIASET_PARAMS,
+                        {'compact_active_pixels': compact_active_pixels},
+                        {'progressive_scale': progressive_scale if i == 1 else 0},
+                        {'proc_id': first_iteration},
+                        {'iterations_per_stage': min(
+                            iterations_per_stage, MAX_ITERATION - first_iteration)}] +
+            node_params + encoding_params + frame_cache_params + batch_params +
+            transport_params(i),
             remappings=[('/image_in', '/image_out%d' % (i - 1)),
                         ('/image_out', '/image_out%d' % (i))]))
 
@@ -126,23 +328,44 @@ def launch_setup(context):
         plugin='type_adaptation::julia_set::ColorizeNode',
         name='colorize_node',
         parameters=[{'max_iterations': MAX_ITERATION},
-                    {'type_adaptation_enabled': enable_type_adapt}] + JULIASET_PARAMS,
-        remappings=[('/image_in', '/image_out%d' % (MAX_ITERATION - 1)),
-                    ('/image_out', '/pipeline/image_out')]))
-
-    pipeline_container = ComposableNodeContainer(
-        name='pipeline_container',
-        namespace='',
-        package='rclcpp_components',
-        executable='component_container' + ('_mt' if enable_mt else ''),
-        prefix=container_prefix,
-        sigkill_timeout='500' if enable_nsys else '5',
-        sigterm_timeout='500' if enable_nsys else '5',
-        composable_node_descriptions=pipeline_nodes,
-        output='both'
-    )
-
-    return [pipeline_container]
+                    {'type_adaptation_enabled': enable_type_adapt},
+                    {'batch_size': batch_size}] + node_params + encoding_params +
+        iteration_budget_params + transport_params(stage_count + 1),
+        remappings=[('/image_in', '/image_out%d' % stage_count),
+                    ('/image_out',
+                     '/pipeline/image_tiles' if stream_tiles else '/pipeline/image_out')]))
+
+    if stream_tiles:
+        pipeline_nodes.append(ComposableNode(
+            package='julia_set',
+            plugin='type_adaptation::julia_set::FrameAssemblerNode',
+            name='frame_assembler_node',
+            parameters=[{'type_adaptation_enabled': enable_type_adapt}] + backend_params +
+            geometry_params + stream_tile_params + transport_params(stage_count + 2),
+            remappings=[('/image_in', '/pipeline/image_tiles'),
+                        ('/image_out', '/pipeline/image_out')]))
+
+    # cam2image and map_node come before juliaset_node1.
+    process_nodes = [pipeline_nodes]
+    if split_at:
+        process_nodes = [pipeline_nodes[:split_at + 1], pipeline_nodes[split_at + 1:]]
+
+    containers = []
+    for index, nodes in enumerate(process_nodes):
+        containers.append(ComposableNodeContainer(
+            name='pipeline_container' + ('%d' % index if index else ''),
+            namespace='',
+            package='rclcpp_components',
+            executable='component_container' + ('_mt' if enable_mt else ''),
+            # Each process writes a profile of its own.
+            prefix=container_prefix + ('-%d' % index if container_prefix and index else ''),
+            sigkill_timeout='500' if enable_nsys else '5',
+            sigterm_timeout='500' if enable_nsys else '5',
+            composable_node_descriptions=nodes,
+            output='both'
+        ))
+
+    return containers
 
 
 def build_profile_name(label, enable_type_adapt, enable_mt, resolution):
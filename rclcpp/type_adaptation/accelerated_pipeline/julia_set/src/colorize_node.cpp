@@ -12,16 +12,21 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include <nvToolsExt.h>  // NOLINT
-
 #include "julia_set/colorize_node.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
 #include <memory>
+#include <string>
 #include <utility>
 
+#include "julia_set/julia_set_images.hpp"
 #include "rclcpp/rclcpp.hpp"
 #include "rclcpp_components/register_node_macro.hpp"
-#include "sensor_msgs/image_encodings.hpp"
+#include "type_adapters/backend.hpp"
 #include "type_adapters/image_container.hpp"
+#include "type_adapters/memory_parameters.hpp"
+#include "type_adapters/nvtx.hpp"
 
 namespace type_adaptation
 {
@@ -31,115 +36,235 @@ namespace julia_set
 ColorizeNode::ColorizeNode(rclcpp::NodeOptions options)
 : rclcpp::Node("colorize_node", options.use_intra_process_comms(true)),
   type_adaptation_enabled_(declare_parameter<bool>("type_adaptation_enabled", true)),
-  is_initialized{false}
+  julia_set_handles_(std::bind(&ColorizeNode::CreateHandle, this, std::placeholders::_1))
 {
   RCLCPP_INFO(
     get_logger(), "Setting up Colorize node with adaptation enabled: %s",
     type_adaptation_enabled_ ? "YES" : "NO");
 
+  memory_backend_ = example_type_adapters::declare_memory_backend(*this);
+  RCLCPP_INFO(
+    get_logger(), "Using memory backend: %s",
+    example_type_adapters::to_string(memory_backend_).c_str());
+
+  // CPU kernels split frames into tiles, worked through by a thread pool shared by the process.
+  cpu_tiling_.thread_count = static_cast<unsigned int>(
+    std::max<int64_t>(declare_parameter<int64_t>("cpu_threads", 0), 0));
+  cpu_tiling_.tile_width = static_cast<unsigned int>(
+    std::max<int64_t>(declare_parameter<int64_t>("tile_width", 128), 0));
+  cpu_tiling_.tile_height = static_cast<unsigned int>(
+    std::max<int64_t>(declare_parameter<int64_t>("tile_height", 32), 0));
+
   julia_set_params_.kMaxIterations = declare_parameter<int>("max_iterations", 50);
 
-  if (type_adaptation_enabled_) {
+  // With a frame deadline, the iterations of the Julia Set nodes are cut until frames make it
+  // through the pipeline in time, instead of queueing up.
+  const double frame_deadline_ms = declare_parameter<double>("frame_deadline_ms", 0.0);
+  const int64_t min_iterations = declare_parameter<int64_t>("min_iterations", 10);
+  if (frame_deadline_ms > 0.0) {
+    iteration_budget_ = std::make_unique<IterationBudgetController>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::duration<double, std::milli>(frame_deadline_ms)),
+      static_cast<size_t>(std::max<int64_t>(min_iterations, 1)), julia_set_params_.kMaxIterations);
+    iteration_budget_pub_ = create_publisher<diagnostic_msgs::msg::DiagnosticArray>(
+      "iteration_budget", 1);
+  }
+
+  // Given the resolution and encoding of the input, the first frame finds the handle and the
+  // buffers of the colors ready. Frames streamed in tiles take the handles of the tile sizes.
+  const int64_t height = declare_parameter<int64_t>("height", 0);
+  const int64_t width = declare_parameter<int64_t>("width", 0);
+  const std::string encoding = declare_parameter<std::string>(
+    "encoding", pixel_layout_encoding(PixelLayout::kInterleaved));
+  const uint32_t stream_tile_height = static_cast<uint32_t>(
+    std::max<int64_t>(declare_parameter<int64_t>("stream_tile_height", 0), 0));
+  const uint32_t stream_tile_width = static_cast<uint32_t>(
+    std::max<int64_t>(declare_parameter<int64_t>("stream_tile_width", 0), 0));
+  const bool stream_tiles = stream_tile_height != 0 && stream_tile_width != 0;
+  if (stream_tiles) {
+    julia_set_handles_.set_capacity(4);
+  }
+
+  // Julia Set stages that batch frames publish a whole batch at once, the queues hold them, as
+  // well as the tiles MapNode has on their way.
+  const size_t tiles_in_flight = stream_tiles_in_flight(
+    stream_tile_height, stream_tile_width,
+    declare_parameter<int64_t>("stream_tiles_in_flight", kDefaultStreamTilesInFlight));
+  const size_t queue_depth = std::max(
+    static_cast<size_t>(std::max<int64_t>(declare_parameter<int64_t>("batch_size", 1), 1)),
+    tiles_in_flight);
+
+  ImageGeometry geometry;
+  if (geometry_from_parameters(height, width, encoding, geometry)) {
+    if (stream_tiles) {
+      geometry.height = std::min(geometry.height, stream_tile_height);
+      geometry.width = std::min(geometry.width, stream_tile_width);
+    }
+    nvtxRangePushA("ColorizeNode: WarmUp");
+    auto backend = example_type_adapters::get_backend(memory_backend_);
+    julia_set_handles_.get(geometry).warm_up(*backend->create_stream());
+    // The frame being colorized and the one published before it.
+    backend->buffer_pool().reserve(
+      color_image_properties(geometry.height, geometry.width).row_step * geometry.height, 2);
+    nvtxRangePop();
+  } else if (height != 0 || width != 0) {
+    RCLCPP_WARN(
+      get_logger(), "Invalid resolution %" PRId64 "x%" PRId64 " or encoding %s, the handle is "
+      "built on the first frame", width, height, encoding.c_str());
+  }
+
+  // Stages of a fixed chain in one process may hand frames over through pipeline links instead,
+  // and the next stage takes them on a thread of its own rather than through the executor.
+  const std::string link_in = declare_parameter<std::string>("link_in", "");
+  const std::string link_out = declare_parameter<std::string>("link_out", "");
+  const example_type_adapters::PipelineLinkOptions link_options =
+    example_type_adapters::declare_pipeline_link_options(*this, queue_depth);
+
+  // A pipeline split across processes passes frames through shared memory where it is split.
+  if (!link_in.empty()) {
+    // Subscribed to once the node is set up, at the end.
+  } else if (declare_parameter<bool>("shared_memory_in", false)) {
+    shared_image_sub_ = std::make_shared<example_type_adapters::SharedImageSubscription>(
+      *this, "image_in", queue_depth,
+      std::bind(&ColorizeNode::ColorizeCallbackCustomType, this, std::placeholders::_1),
+      memory_backend_);
+  } else if (type_adaptation_enabled_) {
     custom_type_sub_ = create_subscription<type_adaptation::example_type_adapters::ImageContainer>(
-      "image_in", 1,
+      "image_in", queue_depth,
       std::bind(&ColorizeNode::ColorizeCallbackCustomType, this, std::placeholders::_1));
-    custom_type_pub_ = create_publisher<type_adaptation::example_type_adapters::ImageContainer>(
-      "image_out", 1);
   } else {
     sub_ =
       create_subscription<sensor_msgs::msg::Image>(
-      "image_in", 1, std::bind(&ColorizeNode::ColorizeCallback, this, std::placeholders::_1));
-    pub_ = create_publisher<sensor_msgs::msg::Image>("image_out", 1);
+      "image_in", queue_depth,
+      std::bind(&ColorizeNode::ColorizeCallback, this, std::placeholders::_1));
+  }
+
+  if (!link_out.empty()) {
+    link_pub_ = std::make_shared<example_type_adapters::PipelineLinkPublisher>(
+      *this, link_out, link_options);
+  } else if (declare_parameter<bool>("shared_memory_out", false)) {
+    shared_image_pub_ = std::make_shared<example_type_adapters::SharedImagePublisher>(
+      *this, "image_out", tiles_in_flight);
+  } else if (type_adaptation_enabled_) {
+    custom_type_pub_ = create_publisher<type_adaptation::example_type_adapters::ImageContainer>(
+      "image_out", tiles_in_flight);
+  } else {
+    pub_ = create_publisher<sensor_msgs::msg::Image>("image_out", tiles_in_flight);
+  }
+
+  // Frames come in on the thread of the link from here on.
+  if (!link_in.empty()) {
+    link_sub_ = std::make_shared<example_type_adapters::PipelineLinkSubscription>(
+      *this, link_in,
+      std::bind(&ColorizeNode::ColorizeCallbackCustomType, this, std::placeholders::_1),
+      link_options);
   }
 }
 
 void ColorizeNode::ColorizeCallbackCustomType(
-  std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image)
+  std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image_container)
 {
   nvtxRangePushA("ColorizeNode: ColorizeCallbackCustomType");
-  if (!is_initialized) {
-    img_property_.row_step = image->step();
-    img_property_.height = image->height();
-    img_property_.width = image->width();
-    img_property_.encoding = image->encoding();
-
-    if (image->encoding() == sensor_msgs::image_encodings::RGB8) {
-      img_property_.red_offset = 0;
-      img_property_.green_offset = 1;
-      img_property_.blue_offset = 2;
-      img_property_.color_step = 3;
-    } else if (image->encoding() == sensor_msgs::image_encodings::BGR8) {
-      img_property_.blue_offset = 0;
-      img_property_.green_offset = 1;
-      img_property_.red_offset = 2;
-      img_property_.color_step = 3;
-    } else if (image->encoding() == sensor_msgs::image_encodings::MONO8) {
-      img_property_.red_offset = 0;
-      img_property_.green_offset = 0;
-      img_property_.blue_offset = 0;
-      img_property_.color_step = 1;
-    }
-
-    julia_set_handle_ = std::make_unique<JuliaSet>(img_property_, julia_set_params_);
-    is_initialized = true;
-  }
-
-  auto out = std::make_unique<type_adaptation::example_type_adapters::ImageContainer>(
-    image->header(), image->height(), image->width(), image->encoding(),
-    image->step() / sizeof(float), image->cuda_stream());
-
-  julia_set_handle_->colorize(
-    out->cuda_mem(), reinterpret_cast<float *>(image->cuda_mem()), out->cuda_stream()->stream());
-
-  custom_type_pub_->publish(std::move(out));
+  PublishImage(Colorize(*image_container).release_container());
   nvtxRangePop();
 }
 
 void ColorizeNode::ColorizeCallback(std::unique_ptr<sensor_msgs::msg::Image> image_msg)
 {
   nvtxRangePushA("ColorizeNode: ColorizeCallback");
-  std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image =
-    std::make_unique<type_adaptation::example_type_adapters::ImageContainer>(std::move(image_msg));
-  if (!is_initialized) {
-    img_property_.row_step = image->step();
-    img_property_.height = image->height();
-    img_property_.width = image->width();
-    img_property_.encoding = image->encoding();
-
-    if (image->encoding() == sensor_msgs::image_encodings::RGB8) {
-      img_property_.red_offset = 0;
-      img_property_.green_offset = 1;
-      img_property_.blue_offset = 2;
-      img_property_.color_step = 3;
-    } else if (image->encoding() == sensor_msgs::image_encodings::BGR8) {
-      img_property_.blue_offset = 0;
-      img_property_.green_offset = 1;
-      img_property_.red_offset = 2;
-      img_property_.color_step = 3;
-    } else if (image->encoding() == sensor_msgs::image_encodings::MONO8) {
-      img_property_.red_offset = 0;
-      img_property_.green_offset = 0;
-      img_property_.blue_offset = 0;
-      img_property_.color_step = 1;
-    }
+  const type_adaptation::example_type_adapters::ImageContainer image(
+    std::move(image_msg),
+    type_adaptation::example_type_adapters::get_backend(memory_backend_)->create_stream());
+  PublishImage(Colorize(image).release_container());
+  nvtxRangePop();
+}
 
-    julia_set_handle_ = std::make_unique<JuliaSet>(img_property_, julia_set_params_);
-    is_initialized = true;
+ColorImage ColorizeNode::Colorize(
+  const type_adaptation::example_type_adapters::ImageContainer & image)
+{
+  JuliaSet & julia_set_handle = julia_set_handles_.get(geometry_of(image));
+
+  ColorImage out(image.header(), image.height(), image.width(), image.stream());
+
+  julia_set_handle.colorize(
+    out.data(), image.cdata(), region_of(image, image.step(), out.step()), *out.stream());
+  // FrameAssemblerNode puts the colors of the tiles of a frame back together.
+  const auto & tile = image.tile();
+  out.container().set_tile(tile);
+
+  // A frame streamed in tiles made it through the pipeline with its last tile.
+  if (iteration_budget_ && (tile.count == 0 || tile.index + 1 == tile.count)) {
+    UpdateIterationBudget(image.header());
   }
+  return out;
+}
 
-  auto out = std::make_unique<type_adaptation::example_type_adapters::ImageContainer>(
-    image->header(), image->height(), image->width(), image->encoding(),
-    image->step() / sizeof(float), image->cuda_stream());
+std::unique_ptr<JuliaSet> ColorizeNode::CreateHandle(const ImageGeometry & geometry) const
+{
+  return std::make_unique<JuliaSet>(
+    color_image_properties(geometry.height, geometry.width), julia_set_params_, cpu_tiling_,
+    geometry.layout);
+}
+
+void ColorizeNode::UpdateIterationBudget(const std_msgs::msg::Header & header)
+{
+  // Reports between changes, about every second at the frame rate of the example.
+  const uint64_t kReportFrames = 100;
 
-  julia_set_handle_->colorize(
-    out->cuda_mem(), reinterpret_cast<float *>(image->cuda_mem()), out->cuda_stream()->stream());
+  const bool changed = iteration_budget_->update(
+    std::chrono::nanoseconds(rclcpp::Time(header.stamp).nanoseconds()),
+    std::chrono::nanoseconds(now().nanoseconds()));
+  if (!changed && iteration_budget_->frames() % kReportFrames != 0) {
+    return;
+  }
 
-  // Convert in-place before publishing to "disable" type adaptation
-  sensor_msgs::msg::Image image_msg_out;
-  out->get_sensor_msgs_image(image_msg_out);
+  const size_t budget = iteration_budget_->budget();
+  const bool degraded = budget < iteration_budget_->max_iterations();
+  diagnostic_msgs::msg::DiagnosticStatus status;
+  status.level = degraded ?
+    diagnostic_msgs::msg::DiagnosticStatus::WARN : diagnostic_msgs::msg::DiagnosticStatus::OK;
+  status.name = std::string(get_name()) + ": iteration budget";
+  status.message = degraded ? "Iterations cut to meet the frame deadline" : "All iterations";
+  const auto add_value = [&status](const std::string & key, const std::string & value) {
+      diagnostic_msgs::msg::KeyValue key_value;
+      key_value.key = key;
+      key_value.value = value;
+      status.values.push_back(key_value);
+    };
+  add_value("iteration_budget", std::to_string(budget));
+  add_value("max_iterations", std::to_string(iteration_budget_->max_iterations()));
+  add_value(
+    "frame_deadline_ms",
+    std::to_string(
+      std::chrono::duration<double, std::milli>(iteration_budget_->deadline()).count()));
+  add_value(
+    "frame_time_ms",
+    std::to_string(
+      std::chrono::duration<double, std::milli>(iteration_budget_->frame_time()).count()));
+  add_value("frames", std::to_string(iteration_budget_->frames()));
+  add_value("deadline_misses", std::to_string(iteration_budget_->deadline_misses()));
 
-  pub_->publish(std::move(image_msg_out));
-  nvtxRangePop();
+  // The stamp is the one the budget applies from, so that every stage of a frame runs with the
+  // same budget, see JuliaSetNode::StageIterations().
+  auto diagnostics = std::make_unique<diagnostic_msgs::msg::DiagnosticArray>();
+  diagnostics->header.stamp = rclcpp::Time(iteration_budget_->budget_since().count());
+  diagnostics->status.push_back(status);
+  iteration_budget_pub_->publish(std::move(diagnostics));
+}
+
+void ColorizeNode::PublishImage(
+  std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image)
+{
+  if (link_pub_) {
+    link_pub_->publish(std::move(image));
+  } else if (shared_image_pub_) {
+    shared_image_pub_->publish(std::move(image));
+  } else if (custom_type_pub_) {
+    custom_type_pub_->publish(std::move(image));
+  } else {
+    // Convert in-place before publishing to "disable" type adaptation
+    pub_->publish(image->release_sensor_msgs_image());
+  }
 }
 
 }  // namespace julia_set
@@ -0,0 +1,285 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Built with -mavx2, only called once the CPU is known to support it.
+
+#include <immintrin.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "julia_set/cpu/julia_set_simd.hpp"
+
+namespace type_adaptation
+{
+namespace julia_set
+{
+namespace cpu
+{
+namespace avx2
+{
+namespace
+{
+constexpr size_t kLanes = 8;
+
+// Split 8 packed x, y, z pixels into a vector per channel, lane i holding pixel i. store_xyz()
+// packs them again.
+void load_xyz(const float * pixels, __m256 & x, __m256 & y, __m256 & z)
+{
+  const __m256 m03 = _mm256_insertf128_ps(
+    _mm256_castps128_ps256(_mm_loadu_ps(pixels)), _mm_loadu_ps(pixels + 12), 1);
+  const __m256 m14 = _mm256_insertf128_ps(
+    _mm256_castps128_ps256(_mm_loadu_ps(pixels + 4)), _mm_loadu_ps(pixels + 16), 1);
+  const __m256 m25 = _mm256_insertf128_ps(
+    _mm256_castps128_ps256(_mm_loadu_ps(pixels + 8)), _mm_loadu_ps(pixels + 20), 1);
+  const __m256 xy = _mm256_shuffle_ps(m14, m25, _MM_SHUFFLE(2, 1, 3, 2));
+  const __m256 yz = _mm256_shuffle_ps(m03, m14, _MM_SHUFFLE(1, 0, 2, 1));
+  x = _mm256_shuffle_ps(m03, xy, _MM_SHUFFLE(2, 0, 3, 0));
+  y = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+  z = _mm256_shuffle_ps(yz, m25, _MM_SHUFFLE(3, 0, 3, 1));
+}
+
+void store_xyz(float * pixels, __m256 x, __m256 y, __m256 z)
+{
+  const __m256 xy = _mm256_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0));
+  const __m256 yz = _mm256_shuffle_ps(y, z, _MM_SHUFFLE(3, 1, 3, 1));
+  const __m256 zx = _mm256_shuffle_ps(z, x, _MM_SHUFFLE(3, 1, 2, 0));
+  const __m256 m03 = _mm256_shuffle_ps(xy, zx, _MM_SHUFFLE(2, 0, 2, 0));
+  const __m256 m14 = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+  const __m256 m25 = _mm256_shuffle_ps(zx, yz, _MM_SHUFFLE(3, 1, 3, 1));
+  _mm_storeu_ps(pixels, _mm256_castps256_ps128(m03));
+  _mm_storeu_ps(pixels + 4, _mm256_castps256_ps128(m14));
+  _mm_storeu_ps(pixels + 8, _mm256_castps256_ps128(m25));
+  _mm_storeu_ps(pixels + 12, _mm256_extractf128_ps(m03, 1));
+  _mm_storeu_ps(pixels + 16, _mm256_extractf128_ps(m14, 1));
+  _mm_storeu_ps(pixels + 20, _mm256_extractf128_ps(m25, 1));
+}
+
+// Round down to bytes, with the saturation of the scalar code, and store 8 of them.
+void store_u8(uint8_t * destination, __m256 value)
+{
+  // The maximum returns its second operand for NaN.
+  value = _mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()), _mm256_set1_ps(255.0f));
+  const __m256i words = _mm256_cvttps_epi32(value);
+  const __m128i shorts = _mm_packus_epi32(
+    _mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+  _mm_storel_epi64(reinterpret_cast<__m128i *>(destination), _mm_packus_epi16(shorts, shorts));
+}
+
+// Constants of the escape time loop, in every lane.
+struct EscapeVectors
+{
+  explicit EscapeVectors(const EscapeParams & escape)
+  : orig_real(_mm256_set1_ps(escape.orig_real_part)),
+    orig_img(_mm256_set1_ps(escape.orig_img_part)),
+    boundary(_mm256_set1_ps(escape.boundary)),
+    two(_mm256_set1_ps(2.0f))
+  {
+  }
+
+  __m256 orig_real;
+  __m256 orig_img;
+  __m256 boundary;
+  __m256 two;
+};
+
+// Iterations on the active lanes of 8 pixels, which leaves the lanes still active in active.
+void iterate_block(
+  __m256 & real, __m256 & img, __m256 & escaped, __m256 & active, size_t curr_iteration,
+  size_t iteration_count, const EscapeVectors & escape)
+{
+  for (size_t iteration = curr_iteration; iteration < curr_iteration + iteration_count;
+    ++iteration)
+  {
+    const __m256 real_sq = _mm256_mul_ps(real, real);
+    const __m256 img_sq = _mm256_mul_ps(img, img);
+    const __m256 escapes = _mm256_and_ps(
+      active, _mm256_cmp_ps(_mm256_add_ps(real_sq, img_sq), escape.boundary, _CMP_GT_OQ));
+    escaped = _mm256_blendv_ps(escaped, _mm256_set1_ps(1.0f + iteration), escapes);
+    active = _mm256_andnot_ps(escapes, active);
+    const __m256 new_real = _mm256_add_ps(_mm256_sub_ps(real_sq, img_sq), escape.orig_real);
+    const __m256 new_img = _mm256_add_ps(
+      _mm256_mul_ps(_mm256_mul_ps(escape.two, real), img), escape.orig_img);
+    real = _mm256_blendv_ps(real, new_real, active);
+    img = _mm256_blendv_ps(img, new_img, active);
+    if (_mm256_testz_ps(active, active)) {
+      break;
+    }
+  }
+}
+
+// Colors of 8 pixels, see colorize().
+void colorize_block(
+  __m256 x, __m256 y, __m256 z, const float * lut, size_t lut_entries, uint8_t * red,
+  uint8_t * green, uint8_t * blue)
+{
+  const __m256 zero = _mm256_setzero_ps();
+  // Scaling by powers of two is exact, so these give the same results as the divisions.
+  const __m256 quarter = _mm256_set1_ps(0.25f);
+  const __m256 sixteenth = _mm256_set1_ps(0.0625f);
+  // Clamped into the LUT like color_lut_entry(), NaN goes to the first entry.
+  const __m256i entry = _mm256_cvttps_epi32(
+    _mm256_min_ps(
+      _mm256_max_ps(_mm256_sub_ps(z, _mm256_set1_ps(1.0f)), zero),
+      _mm256_set1_ps(static_cast<float>(lut_entries - 1))));
+  const __m256 escaped = _mm256_cmp_ps(z, zero, _CMP_NEQ_UQ);
+
+  const __m256 r = _mm256_blendv_ps(
+    _mm256_mul_ps(x, quarter),
+    _mm256_sub_ps(_mm256_i32gather_ps(lut, entry, 4), _mm256_mul_ps(x, sixteenth)), escaped);
+  const __m256 g = _mm256_blendv_ps(
+    _mm256_mul_ps(y, quarter),
+    _mm256_sub_ps(
+      _mm256_i32gather_ps(lut + lut_entries, entry, 4), _mm256_mul_ps(y, sixteenth)),
+    escaped);
+  const __m256 b = _mm256_blendv_ps(
+    _mm256_mul_ps(z, quarter),
+    _mm256_sub_ps(
+      _mm256_i32gather_ps(lut + 2 * lut_entries, entry, 4), _mm256_mul_ps(z, sixteenth)),
+    escaped);
+  store_u8(red, r);
+  store_u8(green, g);
+  store_u8(blue, b);
+}
+}  // namespace
+
+size_t escape_counts(
+  size_t first_col, size_t count, float img_part, const JuliaSetParams & params,
+  const EscapeParams & escape, uint32_t * counts)
+{
+  const float in_min = params.kMinColRange;
+  const float in_range = static_cast<float>(params.kMaxColRange) - in_min;
+  const __m256 col_min = _mm256_set1_ps(in_min);
+  const __m256 col_range = _mm256_set1_ps(in_range);
+  const __m256 x_min = _mm256_set1_ps(params.kMinXRange);
+  const __m256 x_range = _mm256_set1_ps(params.kMaxXRange - params.kMinXRange);
+  const __m256 orig_real = _mm256_set1_ps(escape.orig_real_part);
+  const __m256 orig_img = _mm256_set1_ps(escape.orig_img_part);
+  const __m256 boundary = _mm256_set1_ps(escape.boundary);
+  const __m256 two = _mm256_set1_ps(2.0f);
+  const __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+
+  const size_t handled = count - count % kLanes;
+  for (size_t pixel = 0; pixel < handled; pixel += kLanes) {
+    // Exact, columns are far below 2^24.
+    const __m256 col = _mm256_add_ps(_mm256_set1_ps(first_col + pixel), lanes);
+    // Map the columns on the x range, in the order of the scalar code.
+    __m256 real = _mm256_add_ps(
+      _mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(col, col_min), col_range), x_range), x_min);
+    __m256 img = _mm256_set1_ps(img_part);
+
+    __m256i counter = _mm256_setzero_si256();
+    __m256 active = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (uint32_t iteration = 0; iteration < escape.max_iterations; ++iteration) {
+      const __m256 real_sq = _mm256_mul_ps(real, real);
+      const __m256 img_sq = _mm256_mul_ps(img, img);
+      // Lanes stop counting once they escaped, NaN keeps counting like the scalar comparison.
+      active = _mm256_and_ps(
+        active, _mm256_cmp_ps(_mm256_add_ps(real_sq, img_sq), boundary, _CMP_NGT_UQ));
+      if (_mm256_testz_ps(active, active)) {
+        break;
+      }
+      counter = _mm256_sub_epi32(counter, _mm256_castps_si256(active));
+      const __m256 new_img = _mm256_mul_ps(_mm256_mul_ps(two, real), img);
+      real = _mm256_add_ps(_mm256_sub_ps(real_sq, img_sq), orig_real);
+      img = _mm256_add_ps(new_img, orig_img);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(counts + pixel), counter);
+  }
+  return handled;
+}
+
+size_t iterate(
+  float * pixels, size_t count, size_t curr_iteration, size_t iteration_count,
+  const EscapeParams & escape, uint8_t * active_masks)
+{
+  const EscapeVectors constants(escape);
+  const __m256 zero = _mm256_setzero_ps();
+
+  const size_t handled = count - count % kLanes;
+  for (size_t pixel = 0; pixel < handled; pixel += kLanes) {
+    float * block = pixels + pixel * 3;
+    __m256 real, img, escaped;
+    load_xyz(block, real, img, escaped);
+    // Pixels that already escaped keep their iteration count.
+    __m256 active = _mm256_cmp_ps(escaped, zero, _CMP_EQ_OQ);
+    if (_mm256_testz_ps(active, active)) {
+      if (active_masks) {
+        active_masks[pixel / kLanes] = 0;
+      }
+      continue;
+    }
+    iterate_block(real, img, escaped, active, curr_iteration, iteration_count, constants);
+    store_xyz(block, real, img, escaped);
+    if (active_masks) {
+      active_masks[pixel / kLanes] = static_cast<uint8_t>(_mm256_movemask_ps(active));
+    }
+  }
+  return handled;
+}
+
+size_t iterate_planes(
+  float * x, float * y, float * z, size_t count, size_t curr_iteration, size_t iteration_count,
+  const EscapeParams & escape)
+{
+  const EscapeVectors constants(escape);
+  const __m256 zero = _mm256_setzero_ps();
+
+  const size_t handled = count - count % kLanes;
+  for (size_t pixel = 0; pixel < handled; pixel += kLanes) {
+    __m256 escaped = _mm256_loadu_ps(z + pixel);
+    __m256 active = _mm256_cmp_ps(escaped, zero, _CMP_EQ_OQ);
+    if (_mm256_testz_ps(active, active)) {
+      continue;
+    }
+    __m256 real = _mm256_loadu_ps(x + pixel);
+    __m256 img = _mm256_loadu_ps(y + pixel);
+    iterate_block(real, img, escaped, active, curr_iteration, iteration_count, constants);
+    _mm256_storeu_ps(x + pixel, real);
+    _mm256_storeu_ps(y + pixel, img);
+    _mm256_storeu_ps(z + pixel, escaped);
+  }
+  return handled;
+}
+
+size_t colorize(
+  const float * pixels, size_t count, const float * lut, size_t lut_entries, uint8_t * red,
+  uint8_t * green, uint8_t * blue)
+{
+  const size_t handled = count - count % kLanes;
+  for (size_t pixel = 0; pixel < handled; pixel += kLanes) {
+    __m256 x, y, z;
+    load_xyz(pixels + pixel * 3, x, y, z);
+    colorize_block(x, y, z, lut, lut_entries, red + pixel, green + pixel, blue + pixel);
+  }
+  return handled;
+}
+
+size_t colorize_planes(
+  const float * x, const float * y, const float * z, size_t count, const float * lut,
+  size_t lut_entries, uint8_t * red, uint8_t * green, uint8_t * blue)
+{
+  const size_t handled = count - count % kLanes;
+  for (size_t pixel = 0; pixel < handled; pixel += kLanes) {
+    colorize_block(
+      _mm256_loadu_ps(x + pixel), _mm256_loadu_ps(y + pixel), _mm256_loadu_ps(z + pixel), lut,
+      lut_entries, red + pixel, green + pixel, blue + pixel);
+  }
+  return handled;
+}
+
+}  // namespace avx2
+}  // namespace cpu
+}  // namespace julia_set
+}  // namespace type_adaptation
@@ -0,0 +1,85 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Built with -mavx512f, only called once the CPU is known to support it.
+
+#include <immintrin.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "julia_set/cpu/julia_set_simd.hpp"
+
+namespace type_adaptation
+{
+namespace julia_set
+{
+namespace cpu
+{
+namespace avx512
+{
+namespace
+{
+constexpr size_t kLanes = 16;
+}  // namespace
+
+size_t escape_counts(
+  size_t first_col, size_t count, float img_part, const JuliaSetParams & params,
+  const EscapeParams & escape, uint32_t * counts)
+{
+  const float in_min = params.kMinColRange;
+  const float in_range = static_cast<float>(params.kMaxColRange) - in_min;
+  const __m512 col_min = _mm512_set1_ps(in_min);
+  const __m512 col_range = _mm512_set1_ps(in_range);
+  const __m512 x_min = _mm512_set1_ps(params.kMinXRange);
+  const __m512 x_range = _mm512_set1_ps(params.kMaxXRange - params.kMinXRange);
+  const __m512 orig_real = _mm512_set1_ps(escape.orig_real_part);
+  const __m512 orig_img = _mm512_set1_ps(escape.orig_img_part);
+  const __m512 boundary = _mm512_set1_ps(escape.boundary);
+  const __m512 two = _mm512_set1_ps(2.0f);
+  const __m512i one = _mm512_set1_epi32(1);
+  const __m512 lanes = _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+  const size_t handled = count - count % kLanes;
+  for (size_t pixel = 0; pixel < handled; pixel += kLanes) {
+    // Exact, columns are far below 2^24.
+    const __m512 col = _mm512_add_ps(_mm512_set1_ps(first_col + pixel), lanes);
+    __m512 real = _mm512_add_ps(
+      _mm512_mul_ps(_mm512_div_ps(_mm512_sub_ps(col, col_min), col_range), x_range), x_min);
+    __m512 img = _mm512_set1_ps(img_part);
+
+    __m512i counter = _mm512_setzero_si512();
+    __mmask16 active = 0xffff;
+    for (uint32_t iteration = 0; iteration < escape.max_iterations; ++iteration) {
+      const __m512 real_sq = _mm512_mul_ps(real, real);
+      const __m512 img_sq = _mm512_mul_ps(img, img);
+      active = _mm512_mask_cmp_ps_mask(
+        active, _mm512_add_ps(real_sq, img_sq), boundary, _CMP_NGT_UQ);
+      if (active == 0) {
+        break;
+      }
+      counter = _mm512_mask_add_epi32(counter, active, counter, one);
+      const __m512 new_img = _mm512_mul_ps(_mm512_mul_ps(two, real), img);
+      real = _mm512_add_ps(_mm512_sub_ps(real_sq, img_sq), orig_real);
+      img = _mm512_add_ps(new_img, orig_img);
+    }
+    _mm512_storeu_si512(counts + pixel, counter);
+  }
+  return handled;
+}
+
+}  // namespace avx512
+}  // namespace cpu
+}  // namespace julia_set
+}  // namespace type_adaptation
@@ -0,0 +1,943 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "julia_set/cpu/julia_set_kernels.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "julia_set/cpu/julia_set_simd.hpp"
+
+namespace type_adaptation
+{
+namespace julia_set
+{
+namespace cpu
+{
+namespace
+{
+struct Rgb
+{
+  float r;
+  float g;
+  float b;
+};
+
+float map_range(float input, float in_min, float in_max, float out_min, float out_max)
+{
+  return (((input - in_min) / (in_max - in_min)) * (out_max - out_min)) + out_min;
+}
+
+// Float to uint8_t conversion saturates on the GPU, do the same here.
+uint8_t saturate_u8(float value)
+{
+  if (!(value > 0.0f)) {
+    return 0;
+  }
+  if (value >= 255.0f) {
+    return 255;
+  }
+  return static_cast<uint8_t>(value);
+}
+
+Rgb hsv_to_rgb(float H, float S, float V)
+{
+  float s = S / 100;
+  float v = V / 100;
+  float C = s * v;
+  float X = C * (1 - std::abs(std::fmod(H / 60.0, 2) - 1));
+  float m = v - C;
+  float r, g, b;
+  if (H >= 0 && H < 60) {
+    r = C, g = X, b = 0;
+  } else if (H >= 60 && H < 120) {
+    r = X, g = C, b = 0;
+  } else if (H >= 120 && H < 180) {
+    r = 0, g = C, b = X;
+  } else if (H >= 180 && H < 240) {
+    r = 0, g = X, b = C;
+  } else if (H >= 240 && H < 300) {
+    r = X, g = 0, b = C;
+  } else {
+    r = C, g = 0, b = X;
+  }
+
+  return {(r + m) * 255, (g + m) * 255, (b + m) * 255};
+}
+
+const size_t kChannel = 3;
+
+// Row of a float buffer, whose rows are row_step bytes apart.
+template<typename FloatT>
+FloatT * float_row(FloatT * buffer, size_t row, size_t row_step)
+{
+  using Byte =
+    typename std::conditional<std::is_const<FloatT>::value, const uint8_t, uint8_t>::type;
+  return reinterpret_cast<FloatT *>(reinterpret_cast<Byte *>(buffer) + row * row_step);
+}
+
+enum class VectorExtension
+{
+  kNone,
+  kAvx2,
+  kAvx512,
+};
+
+// Whether the kernels were built for an extension and the CPU has it.
+bool supports_vector_extension(VectorExtension extension)
+{
+  switch (extension) {
+#ifdef JULIA_SET_HAS_AVX512
+    case VectorExtension::kAvx512:
+      return __builtin_cpu_supports("avx512f");
+#endif
+#ifdef JULIA_SET_HAS_AVX2
+    case VectorExtension::kAvx2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    case VectorExtension::kNone:
+      return true;
+    default:
+      return false;
+  }
+}
+
+VectorExtension detect_vector_extension()
+{
+  for (VectorExtension extension : {VectorExtension::kAvx512, VectorExtension::kAvx2}) {
+    if (supports_vector_extension(extension)) {
+      return extension;
+    }
+  }
+  return VectorExtension::kNone;
+}
+
+// The widest one by default, see set_vector_extension().
+std::atomic<VectorExtension> & current_vector_extension()
+{
+  static std::atomic<VectorExtension> extension{detect_vector_extension()};
+  return extension;
+}
+
+VectorExtension get_vector_extension()
+{
+  return current_vector_extension().load(std::memory_order_relaxed);
+}
+
+const char * vector_extension_name(VectorExtension extension)
+{
+  switch (extension) {
+    case VectorExtension::kAvx512:
+      return "AVX-512";
+    case VectorExtension::kAvx2:
+      return "AVX2";
+    default:
+      return "none";
+  }
+}
+
+EscapeParams escape_params(const JuliaSetParams & params)
+{
+  return EscapeParams{
+    params.kStartX * std::cos(params.kCurrentAngle),
+    params.kStartY * std::sin(params.kCurrentAngle),
+    params.kBoundaryRadius * params.kBoundaryRadius,
+    static_cast<uint32_t>(params.kMaxIterations)};
+}
+
+uint32_t escape_count(float real_part, float img_part, const EscapeParams & escape)
+{
+  uint32_t counter = 0;
+  while (counter < escape.max_iterations) {
+    if ((real_part * real_part + img_part * img_part) > escape.boundary) {
+      break;
+    }
+    float new_real_part = (real_part * real_part) - (img_part * img_part);
+    float new_img_part = 2 * real_part * img_part;
+    real_part = new_real_part + escape.orig_real_part;
+    img_part = new_img_part + escape.orig_img_part;
+    counter++;
+  }
+  return counter;
+}
+
+#if defined(JULIA_SET_HAS_AVX2) || defined(JULIA_SET_HAS_AVX512)
+// Escape iterations of the leading pixels of a row that fill whole vectors.
+size_t escape_counts_vectorized(
+  size_t first_col, size_t count, float img_part, const JuliaSetParams & params,
+  const EscapeParams & escape, uint32_t * counts)
+{
+  switch (get_vector_extension()) {
+#ifdef JULIA_SET_HAS_AVX512
+    case VectorExtension::kAvx512:
+      return avx512::escape_counts(first_col, count, img_part, params, escape, counts);
+#endif
+#ifdef JULIA_SET_HAS_AVX2
+    case VectorExtension::kAvx2:
+      return avx2::escape_counts(first_col, count, img_part, params, escape, counts);
+#endif
+    default:
+      return 0;
+  }
+}
+
+// Iterations on the leading pixels of a row that fill whole vectors, see avx2::iterate().
+size_t iterate_vectorized(
+  float * pixels, size_t count, size_t curr_iteration, size_t iteration_count,
+  const EscapeParams & escape, uint8_t * active_masks)
+{
+#ifdef JULIA_SET_HAS_AVX2
+  // Every CPU with AVX-512 has AVX2 as well.
+  if (get_vector_extension() != VectorExtension::kNone) {
+    return avx2::iterate(pixels, count, curr_iteration, iteration_count, escape, active_masks);
+  }
+#else
+  (void)pixels;
+  (void)count;
+  (void)curr_iteration;
+  (void)iteration_count;
+  (void)escape;
+  (void)active_masks;
+#endif
+  return 0;
+}
+
+// iterate_vectorized() on pixels held in a plane per channel.
+size_t iterate_planes_vectorized(
+  float * x, float * y, float * z, size_t count, size_t curr_iteration, size_t iteration_count,
+  const EscapeParams & escape)
+{
+#ifdef JULIA_SET_HAS_AVX2
+  if (get_vector_extension() != VectorExtension::kNone) {
+    return avx2::iterate_planes(x, y, z, count, curr_iteration, iteration_count, escape);
+  }
+#else
+  (void)x;
+  (void)y;
+  (void)z;
+  (void)count;
+  (void)curr_iteration;
+  (void)iteration_count;
+  (void)escape;
+#endif
+  return 0;
+}
+
+// Colors of the leading pixels of a row that fill whole vectors.
+size_t colorize_vectorized(
+  const float * pixels, size_t count, const float * lut, size_t lut_entries, uint8_t * red,
+  uint8_t * green, uint8_t * blue)
+{
+#ifdef JULIA_SET_HAS_AVX2
+  if (get_vector_extension() != VectorExtension::kNone) {
+    return avx2::colorize(pixels, count, lut, lut_entries, red, green, blue);
+  }
+#else
+  (void)pixels;
+  (void)count;
+  (void)lut;
+  (void)lut_entries;
+  (void)red;
+  (void)green;
+  (void)blue;
+#endif
+  return 0;
+}
+
+// colorize_vectorized() on pixels held in a plane per channel.
+size_t colorize_planes_vectorized(
+  const float * x, const float * y, const float * z, size_t count, const float * lut,
+  size_t lut_entries, uint8_t * red, uint8_t * green, uint8_t * blue)
+{
+#ifdef JULIA_SET_HAS_AVX2
+  if (get_vector_extension() != VectorExtension::kNone) {
+    return avx2::colorize_planes(x, y, z, count, lut, lut_entries, red, green, blue);
+  }
+#else
+  (void)x;
+  (void)y;
+  (void)z;
+  (void)count;
+  (void)lut;
+  (void)lut_entries;
+  (void)red;
+  (void)green;
+  (void)blue;
+#endif
+  return 0;
+}
+#else
+size_t escape_counts_vectorized(
+  size_t, size_t, float, const JuliaSetParams &, const EscapeParams &, uint32_t *)
+{
+  return 0;
+}
+
+size_t iterate_vectorized(float *, size_t, size_t, size_t, const EscapeParams &, uint8_t *)
+{
+  return 0;
+}
+
+size_t iterate_planes_vectorized(
+  float *, float *, float *, size_t, size_t, size_t, const EscapeParams &)
+{
+  return 0;
+}
+
+size_t colorize_vectorized(
+  const float *, size_t, const float *, size_t, uint8_t *, uint8_t *, uint8_t *)
+{
+  return 0;
+}
+
+size_t colorize_planes_vectorized(
+  const float *, const float *, const float *, size_t, const float *, size_t, uint8_t *,
+  uint8_t *, uint8_t *)
+{
+  return 0;
+}
+#endif
+
+// Entry of an escape iteration in a color LUT. Escape iterations are whole numbers, anything
+// else is clamped into the LUT.
+size_t color_lut_entry(float escaped, size_t lut_entries)
+{
+  if (!(escaped > 0.0f)) {
+    return 0;
+  }
+  if (escaped >= static_cast<float>(lut_entries - 1)) {
+    return lut_entries - 1;
+  }
+  return static_cast<size_t>(escaped);
+}
+
+// Iterations on the x, y and escape iteration of a pixel, returns whether it is still active
+// afterwards.
+bool iterate_values(
+  float & real_part, float & img_part, float & escaped, size_t curr_iteration,
+  size_t iteration_count, const EscapeParams & escape)
+{
+  // Pixels that already escaped keep their iteration count.
+  if (escaped != 0.0f) {
+    return false;
+  }
+  for (size_t iteration = curr_iteration; iteration < curr_iteration + iteration_count;
+    ++iteration)
+  {
+    if ((real_part * real_part + img_part * img_part) > escape.boundary) {
+      escaped = 1.0f + iteration;
+      return false;
+    }
+    const float new_real_part = (real_part * real_part) - (img_part * img_part);
+    img_part = 2 * real_part * img_part + escape.orig_img_part;
+    real_part = new_real_part + escape.orig_real_part;
+  }
+  return true;
+}
+
+// Iterations on a pixel, returns whether it is still active afterwards.
+bool iterate_pixel(
+  float * pixel, size_t curr_iteration, size_t iteration_count, const EscapeParams & escape)
+{
+  return iterate_values(pixel[0], pixel[1], pixel[2], curr_iteration, iteration_count, escape);
+}
+
+// Color of a pixel of x, y and escape iteration, see colorize().
+void colorize_values(
+  float x, float y, float z, const float * lut, size_t lut_entries, uint8_t & red,
+  uint8_t & green, uint8_t & blue)
+{
+  const float values[kChannel] = {x, y, z};
+  uint8_t * colors[kChannel] = {&red, &green, &blue};
+  if (z == 0.0f) {
+    for (size_t channel = 0; channel < kChannel; ++channel) {
+      *colors[channel] = saturate_u8(values[channel] / 4);
+    }
+  } else {
+    const size_t entry = color_lut_entry(z - 1, lut_entries);
+    for (size_t channel = 0; channel < kChannel; ++channel) {
+      *colors[channel] = saturate_u8(lut[channel * lut_entries + entry] - values[channel] / 16);
+    }
+  }
+}
+
+// Write count pixels of color planes into a row of the output image.
+void interleave_colors(
+  const uint8_t * red, const uint8_t * green, const uint8_t * blue, size_t count,
+  const ImageMsgProperties & img_properties, uint8_t * output)
+{
+  for (size_t col = 0; col < count; ++col) {
+    uint8_t * color_out = output + col * img_properties.color_step;
+    color_out[img_properties.red_offset] = red[col];
+    color_out[img_properties.green_offset] = green[col];
+    color_out[img_properties.blue_offset] = blue[col];
+  }
+}
+
+// Iterations on count consecutive pixels.
+void iterate_pixels(
+  float * pixels, size_t count, size_t curr_iteration, size_t iteration_count,
+  const EscapeParams & escape)
+{
+  const size_t vectorized = iterate_vectorized(
+    pixels, count, curr_iteration, iteration_count, escape, nullptr);
+  for (size_t pixel = vectorized; pixel < count; ++pixel) {
+    iterate_pixel(pixels + pixel * kChannel, curr_iteration, iteration_count, escape);
+  }
+}
+
+// iterate_pixels() on pixels first_index on, appending those still active afterwards to
+// active_out. Returns how many it appended.
+size_t iterate_pixels_active(
+  float * pixels, size_t count, size_t curr_iteration, size_t iteration_count,
+  const EscapeParams & escape, size_t first_index, uint32_t * active_out)
+{
+  // Batches keep the masks of the vectorized loop on the stack.
+  constexpr size_t kBatch = 512;
+  uint8_t active_masks[kBatch / 8];
+  size_t kept = 0;
+  for (size_t batch = 0; batch < count; batch += kBatch) {
+    float * batch_pixels = pixels + batch * kChannel;
+    const size_t batch_count = std::min(kBatch, count - batch);
+    const uint32_t batch_index = static_cast<uint32_t>(first_index + batch);
+    const size_t vectorized = iterate_vectorized(
+      batch_pixels, batch_count, curr_iteration, iteration_count, escape, active_masks);
+    for (size_t block = 0; block < vectorized / 8; ++block) {
+      const uint32_t block_index = batch_index + static_cast<uint32_t>(block * 8);
+      unsigned int mask = active_masks[block];
+      if (mask == 0xff) {
+        for (uint32_t pixel = 0; pixel < 8; ++pixel) {
+          active_out[kept + pixel] = block_index + pixel;
+        }
+        kept += 8;
+        continue;
+      }
+      for (; mask != 0; mask &= mask - 1) {
+        active_out[kept++] = block_index + static_cast<uint32_t>(__builtin_ctz(mask));
+      }
+    }
+    for (size_t pixel = vectorized; pixel < batch_count; ++pixel) {
+      if (iterate_pixel(
+          batch_pixels + pixel * kChannel, curr_iteration, iteration_count, escape))
+      {
+        active_out[kept++] = batch_index + static_cast<uint32_t>(pixel);
+      }
+    }
+  }
+  return kept;
+}
+
+// Whether a coarse pixel of refine() escaped at the same iteration as its neighbours.
+bool uniform_block(
+  const float * coarse, size_t coarse_width, size_t coarse_height, size_t col, size_t row)
+{
+  const float escaped = coarse[(row * coarse_width + col) * kChannel + 2];
+  const size_t last_row = std::min(row + 1, coarse_height - 1);
+  const size_t last_col = std::min(col + 1, coarse_width - 1);
+  for (size_t neighbour_row = row > 0 ? row - 1 : 0; neighbour_row <= last_row; ++neighbour_row) {
+    for (size_t neighbour_col = col > 0 ? col - 1 : 0; neighbour_col <= last_col;
+      ++neighbour_col)
+    {
+      if (coarse[(neighbour_row * coarse_width + neighbour_col) * kChannel + 2] != escaped) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Half precision float of a float, rounded to nearest even like __float2half_rn().
+uint16_t float_to_half(float value)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const uint32_t sign = bits & 0x80000000u;
+  bits ^= sign;
+  uint32_t half;
+  if (bits >= 0x47800000u) {
+    // At least 65536 is infinity, NaN stays NaN.
+    half = bits > 0x7f800000u ? 0x7e00u : 0x7c00u;
+  } else if (bits < 0x38800000u) {
+    // Subnormal or zero, adding the magic number rounds the mantissa into its low bits.
+    const uint32_t magic_bits = 0x3f000000u;
+    float magic;
+    std::memcpy(&magic, &magic_bits, sizeof(magic));
+    float shifted;
+    std::memcpy(&shifted, &bits, sizeof(shifted));
+    shifted += magic;
+    std::memcpy(&half, &shifted, sizeof(half));
+    half -= magic_bits;
+  } else {
+    const uint32_t mantissa_odd = (bits >> 13) & 1u;
+    bits += 0xc8000fffu + mantissa_odd;
+    half = bits >> 13;
+  }
+  return static_cast<uint16_t>(half | (sign >> 16));
+}
+
+// Float of a half precision float, which is exact.
+float half_to_float(uint16_t half)
+{
+  const uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+  const uint32_t exponent = (half >> 10) & 0x1fu;
+  const uint32_t mantissa = half & 0x3ffu;
+  uint32_t bits;
+  if (exponent == 0x1fu) {
+    bits = sign | 0x7f800000u | (mantissa << 13);
+  } else if (exponent != 0) {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  } else {
+    const float value = std::ldexp(static_cast<float>(mantissa), -24);
+    return sign ? -value : value;
+  }
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// The x and y of planar layouts are floats or the bits of half precision floats.
+float load_coordinate(float value)
+{
+  return value;
+}
+
+float load_coordinate(uint16_t value)
+{
+  return half_to_float(value);
+}
+
+void store_coordinate(float value, float & coordinate)
+{
+  coordinate = value;
+}
+
+void store_coordinate(float value, uint16_t & coordinate)
+{
+  coordinate = float_to_half(value);
+}
+
+// Planes of a row of an image in a planar layout, plane_width pixels each.
+template<typename CoordinateT, typename EscapeT>
+struct PlanarRow
+{
+  template<typename Byte>
+  PlanarRow(Byte * row, size_t plane_width)
+  : x(reinterpret_cast<CoordinateT *>(row)), y(x + plane_width),
+    escaped(reinterpret_cast<EscapeT *>(y + plane_width))
+  {
+  }
+
+  CoordinateT * x;
+  CoordinateT * y;
+  EscapeT * escaped;
+};
+
+// Batches of planar pixels are widened to floats on the stack.
+constexpr size_t kPlanarBatch = 512;
+
+// Widen count pixels of planar row planes from column first on.
+template<typename Row>
+void load_planar_batch(
+  const Row & planes, size_t first, size_t count, float * x, float * y, float * z)
+{
+  for (size_t pixel = 0; pixel < count; ++pixel) {
+    x[pixel] = load_coordinate(planes.x[first + pixel]);
+    y[pixel] = load_coordinate(planes.y[first + pixel]);
+    z[pixel] = planes.escaped[first + pixel];
+  }
+}
+
+template<typename CoordinateT, typename EscapeT>
+void map_planar_rows(
+  uint8_t * out, size_t plane_width, const JuliaSetParams & params, const ImageRegion & region)
+{
+  for (size_t row = 0; row < region.height; ++row) {
+    const float y = map_range(
+      row + region.y, params.kMinRowRange, params.kMaxRowRange, params.kMinYRange,
+      params.kMaxYRange);
+    PlanarRow<CoordinateT, EscapeT> planes(out + row * region.out_row_step, plane_width);
+    for (size_t col = region.x; col < region.x + region.width; ++col) {
+      store_coordinate(
+        map_range(
+          col, params.kMinColRange, params.kMaxColRange, params.kMinXRange, params.kMaxXRange),
+        planes.x[col]);
+      store_coordinate(y, planes.y[col]);
+      planes.escaped[col] = 0;
+    }
+  }
+}
+
+template<typename CoordinateT, typename EscapeT>
+void iterate_planar_rows(
+  uint8_t * image, size_t plane_width, size_t curr_iteration, size_t iteration_count,
+  const EscapeParams & escape, const ImageRegion & region)
+{
+  // Escape iterations beyond what the plane holds are clamped, see max_escape_iteration().
+  const float max_escaped = std::numeric_limits<EscapeT>::max();
+  float x[kPlanarBatch];
+  float y[kPlanarBatch];
+  float z[kPlanarBatch];
+
+  for (size_t row = 0; row < region.height; ++row) {
+    PlanarRow<CoordinateT, EscapeT> planes(image + row * region.in_row_step, plane_width);
+    for (size_t batch = region.x; batch < region.x + region.width; batch += kPlanarBatch) {
+      const size_t batch_count = std::min(kPlanarBatch, region.x + region.width - batch);
+      // Batches whose pixels all escaped are done, which their escape iterations tell without
+      // reading the wider x and y planes.
+      bool active = false;
+      for (size_t pixel = 0; pixel < batch_count; ++pixel) {
+        active |= planes.escaped[batch + pixel] == 0;
+      }
+      if (!active) {
+        continue;
+      }
+      load_planar_batch(planes, batch, batch_count, x, y, z);
+      size_t pixel = iterate_planes_vectorized(
+        x, y, z, batch_count, curr_iteration, iteration_count, escape);
+      for (; pixel < batch_count; ++pixel) {
+        iterate_values(x[pixel], y[pixel], z[pixel], curr_iteration, iteration_count, escape);
+      }
+      for (pixel = 0; pixel < batch_count; ++pixel) {
+        store_coordinate(x[pixel], planes.x[batch + pixel]);
+        store_coordinate(y[pixel], planes.y[batch + pixel]);
+        planes.escaped[batch + pixel] = static_cast<EscapeT>(std::min(z[pixel], max_escaped));
+      }
+    }
+  }
+}
+
+template<typename CoordinateT, typename EscapeT>
+void colorize_planar_rows(
+  uint8_t * output, const uint8_t * input, size_t plane_width,
+  const ImageMsgProperties & img_properties, const float * lut, size_t lut_entries,
+  const ImageRegion & region)
+{
+  float x[kPlanarBatch];
+  float y[kPlanarBatch];
+  float z[kPlanarBatch];
+  uint8_t planes[kChannel][kPlanarBatch];
+
+  for (size_t row = 0; row < region.height; ++row) {
+    PlanarRow<const CoordinateT, const EscapeT> input_planes(
+      input + row * region.in_row_step, plane_width);
+    uint8_t * output_row = output + row * region.out_row_step;
+    for (size_t batch = 0; batch < region.width; batch += kPlanarBatch) {
+      const size_t batch_count = std::min(kPlanarBatch, region.width - batch);
+      load_planar_batch(input_planes, region.x + batch, batch_count, x, y, z);
+      size_t col = colorize_planes_vectorized(
+        x, y, z, batch_count, lut, lut_entries, planes[0], planes[1], planes[2]);
+      for (; col < batch_count; ++col) {
+        colorize_values(
+          x[col], y[col], z[col], lut, lut_entries, planes[0][col], planes[1][col],
+          planes[2][col]);
+      }
+      interleave_colors(
+        planes[0], planes[1], planes[2], batch_count, img_properties,
+        output_row + batch * img_properties.color_step);
+    }
+  }
+}
+}  // namespace
+
+const char * vector_extension()
+{
+  return vector_extension_name(get_vector_extension());
+}
+
+bool set_vector_extension(const std::string & name)
+{
+  for (VectorExtension extension :
+    {VectorExtension::kNone, VectorExtension::kAvx2, VectorExtension::kAvx512})
+  {
+    if (name == vector_extension_name(extension)) {
+      if (!supports_vector_extension(extension)) {
+        return false;
+      }
+      current_vector_extension().store(extension, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t color_lut_entries(const JuliaSetParams & params)
+{
+  return std::max<size_t>(params.kMaxIterations, 1);
+}
+
+void color_lut(const JuliaSetParams & params, float * lut)
+{
+  const size_t lut_entries = color_lut_entries(params);
+  float * composite_lut = lut + kChannel * lut_entries;
+  for (size_t counter = 0; counter < lut_entries; ++counter) {
+    // colorize() gets the escape iteration as a float.
+    const float escaped = static_cast<float>(counter);
+    float h = std::fmod((escaped * 360 / params.kMaxIterations), 360);
+    float v = std::pow(escaped / params.kMaxIterations, .020f) * 100;
+    Rgb color = hsv_to_rgb(h, 100, v);
+    lut[counter] = color.r;
+    lut[lut_entries + counter] = color.g;
+    lut[2 * lut_entries + counter] = color.b;
+
+    h = std::fmod((counter * 360 / params.kMaxIterations), 360);
+    v = std::pow(static_cast<float>(counter) / params.kMaxIterations, .020f) * 100;
+    color = hsv_to_rgb(h, 100, v);
+    composite_lut[counter] = color.r;
+    composite_lut[lut_entries + counter] = color.g;
+    composite_lut[2 * lut_entries + counter] = color.b;
+  }
+}
+
+void julia_set_composite(
+  uint8_t * image, const ImageMsgProperties & img_properties, const JuliaSetParams & params,
+  const float * lut, const ImageRegion & region)
+{
+  const EscapeParams escape = escape_params(params);
+  const size_t lut_entries = color_lut_entries(params);
+  const float * composite_lut = lut + kChannel * lut_entries;
+  std::vector<uint32_t> counts(region.width);
+
+  for (size_t row = 0; row < region.height; ++row) {
+    uint8_t * image_row = image + row * region.out_row_step;
+    // Map height and width on a scale of -2 to 2
+    const float img_part = map_range(
+      row + region.y, params.kMinRowRange, params.kMaxRowRange, params.kMinYRange,
+      params.kMaxYRange);
+    size_t col = escape_counts_vectorized(
+      region.x, region.width, img_part, params, escape, counts.data());
+    for (; col < region.width; ++col) {
+      const float real_part = map_range(
+        col + region.x, params.kMinColRange, params.kMaxColRange, params.kMinXRange,
+        params.kMaxXRange);
+      counts[col] = escape_count(real_part, img_part, escape);
+    }
+
+    for (col = 0; col < region.width; ++col) {
+      uint8_t * pixel = image_row + col * img_properties.color_step;
+      const size_t counter = counts[col];
+      uint8_t * red = &pixel[img_properties.red_offset];
+      uint8_t * green = &pixel[img_properties.green_offset];
+      uint8_t * blue = &pixel[img_properties.blue_offset];
+      if (counter == params.kMaxIterations) {
+        *red = *red / 4;
+        *green = *green / 4;
+        *blue = *blue / 4;
+      } else {
+        *red = saturate_u8(composite_lut[counter] - *red / 16);
+        *green = saturate_u8(composite_lut[lut_entries + counter] - *green / 16);
+        *blue = saturate_u8(composite_lut[2 * lut_entries + counter] - *blue / 16);
+      }
+    }
+  }
+}
+
+void map(
+  float * out_mat, const ImageMsgProperties &, const JuliaSetParams & params,
+  const ImageRegion & region)
+{
+  for (size_t row = 0; row < region.height; ++row) {
+    const float y = map_range(
+      row + region.y, params.kMinRowRange, params.kMaxRowRange, params.kMinYRange,
+      params.kMaxYRange);
+    float * out_row = float_row(out_mat, row, region.out_row_step);
+    for (size_t col = 0; col < region.width; ++col) {
+      out_row[col * kChannel] = map_range(
+        col + region.x, params.kMinColRange, params.kMaxColRange, params.kMinXRange,
+        params.kMaxXRange);
+      out_row[col * kChannel + 1] = y;
+      out_row[col * kChannel + 2] = 0.0f;
+    }
+  }
+}
+
+void julia_set_iteration(
+  size_t curr_iteration, size_t iteration_count, float * image, const ImageMsgProperties &,
+  const JuliaSetParams & params, const ImageRegion & region)
+{
+  const EscapeParams escape = escape_params(params);
+
+  for (size_t row = 0; row < region.height; ++row) {
+    iterate_pixels(
+      float_row(image, row, region.in_row_step), region.width, curr_iteration, iteration_count,
+      escape);
+  }
+}
+
+size_t julia_set_iteration_active(
+  size_t curr_iteration, size_t iteration_count, float * image, const ImageMsgProperties &,
+  const JuliaSetParams & params, const ImageRegion & region, const uint32_t * active,
+  size_t first, size_t count, uint32_t * active_out)
+{
+  const EscapeParams escape = escape_params(params);
+  size_t kept = 0;
+  // Row of the last run, lists in ascending order only change it once in a while.
+  size_t row = 0;
+  size_t row_begin = 0;
+
+  for (size_t position = first; position < first + count; ) {
+    const size_t index = active ? active[position] : position;
+    if (index < row_begin || index >= row_begin + region.width) {
+      row = index / region.width;
+      row_begin = row * region.width;
+    }
+    // Consecutive pixels of a row take the vectorized loop. Lists are in ascending order, so a
+    // run ends where an index no longer is as far from the first as its position.
+    const size_t col = index - row_begin;
+    size_t run = std::min(first + count - position, region.width - col);
+    if (active && active[position + run - 1] != index + run - 1) {
+      size_t longest = 1;
+      while (longest + 1 < run) {
+        const size_t middle = (longest + run) / 2;
+        if (active[position + middle - 1] == index + middle - 1) {
+          longest = middle;
+        } else {
+          run = middle;
+        }
+      }
+      run = longest;
+    }
+    kept += iterate_pixels_active(
+      float_row(image, row, region.in_row_step) + col * kChannel, run, curr_iteration,
+      iteration_count, escape, index, active_out + kept);
+    position += run;
+  }
+  return kept;
+}
+
+void downsample(
+  const float * image, const ImageRegion & region, unsigned int scale, float * coarse)
+{
+  for (size_t row = 0; row < region.height; row += scale) {
+    const float * input = float_row(image, row, region.in_row_step);
+    for (size_t col = 0; col < region.width; col += scale) {
+      std::memcpy(coarse, input + col * kChannel, kChannel * sizeof(float));
+      coarse += kChannel;
+    }
+  }
+}
+
+size_t refine(
+  float * image, const ImageRegion & region, unsigned int scale, const float * coarse,
+  size_t first, size_t count, uint32_t * active_out)
+{
+  const size_t coarse_width = (region.width + scale - 1) / scale;
+  const size_t coarse_height = (region.height + scale - 1) / scale;
+  size_t kept = 0;
+  for (size_t position = first; position < first + count; ) {
+    const size_t row = position / region.width;
+    const size_t first_col = position - row * region.width;
+    const size_t end_col = std::min(first_col + (first + count - position), size_t{region.width});
+    float * pixels = float_row(image, row, region.in_row_step);
+    // Runs of the row that fall into the same block.
+    for (size_t col = first_col; col < end_col; ) {
+      const size_t coarse_col = col / scale;
+      const size_t block_end = std::min((coarse_col + 1) * scale, end_col);
+      if (uniform_block(coarse, coarse_width, coarse_height, coarse_col, row / scale)) {
+        const float * sample = coarse + ((row / scale) * coarse_width + coarse_col) * kChannel;
+        for (; col < block_end; ++col) {
+          std::memcpy(pixels + col * kChannel, sample, kChannel * sizeof(float));
+        }
+      } else {
+        for (; col < block_end; ++col) {
+          active_out[kept++] = static_cast<uint32_t>(row * region.width + col);
+        }
+      }
+    }
+    position += end_col - first_col;
+  }
+  return kept;
+}
+
+void colorize(
+  uint8_t * output, const float * input, const ImageMsgProperties & img_properties,
+  const JuliaSetParams & params, const float * lut, const ImageRegion & region)
+{
+  const size_t lut_entries = color_lut_entries(params);
+  // Batches of channel planes on the stack, interleaved into the output after.
+  constexpr size_t kBatch = 512;
+  uint8_t planes[kChannel][kBatch];
+
+  for (size_t row = 0; row < region.height; ++row) {
+    const float * input_row = float_row(input, row, region.in_row_step);
+    uint8_t * output_row = output + row * region.out_row_step;
+    for (size_t batch = 0; batch < region.width; batch += kBatch) {
+      const float * batch_pixels = input_row + batch * kChannel;
+      const size_t batch_count = std::min(kBatch, region.width - batch);
+      size_t col = colorize_vectorized(
+        batch_pixels, batch_count, lut, lut_entries, planes[0], planes[1], planes[2]);
+      for (; col < batch_count; ++col) {
+        const float * pixel = batch_pixels + col * kChannel;
+        colorize_values(
+          pixel[0], pixel[1], pixel[2], lut, lut_entries, planes[0][col], planes[1][col],
+          planes[2][col]);
+      }
+      interleave_colors(
+        planes[0], planes[1], planes[2], batch_count, img_properties,
+        output_row + batch * img_properties.color_step);
+    }
+  }
+}
+
+void map_planar(
+  uint8_t * out, PixelLayout layout, const ImageMsgProperties & img_properties,
+  const JuliaSetParams & params, const ImageRegion & region)
+{
+  if (layout == PixelLayout::kPlanar16) {
+    map_planar_rows<uint16_t, uint8_t>(out, img_properties.width, params, region);
+  } else {
+    map_planar_rows<float, uint16_t>(out, img_properties.width, params, region);
+  }
+}
+
+void julia_set_iteration_planar(
+  size_t curr_iteration, size_t iteration_count, uint8_t * image, PixelLayout layout,
+  const ImageMsgProperties & img_properties, const JuliaSetParams & params,
+  const ImageRegion & region)
+{
+  const EscapeParams escape = escape_params(params);
+  if (layout == PixelLayout::kPlanar16) {
+    iterate_planar_rows<uint16_t, uint8_t>(
+      image, img_properties.width, curr_iteration, iteration_count, escape, region);
+  } else {
+    iterate_planar_rows<float, uint16_t>(
+      image, img_properties.width, curr_iteration, iteration_count, escape, region);
+  }
+}
+
+void colorize_planar(
+  uint8_t * output, const uint8_t * input, PixelLayout layout,
+  const ImageMsgProperties & img_properties, const JuliaSetParams & params, const float * lut,
+  const ImageRegion & region)
+{
+  const size_t lut_entries = color_lut_entries(params);
+  if (layout == PixelLayout::kPlanar16) {
+    colorize_planar_rows<uint16_t, uint8_t>(
+      output, input, img_properties.width, img_properties, lut, lut_entries, region);
+  } else {
+    colorize_planar_rows<float, uint16_t>(
+      output, input, img_properties.width, img_properties, lut, lut_entries, region);
+  }
+}
+
+}  // namespace cpu
+}  // namespace julia_set
+}  // namespace type_adaptation
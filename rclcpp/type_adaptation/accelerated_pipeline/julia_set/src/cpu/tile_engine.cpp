@@ -0,0 +1,220 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "julia_set/cpu/tile_engine.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace type_adaptation
+{
+namespace julia_set
+{
+namespace cpu
+{
+namespace
+{
+size_t resolve_thread_count(size_t thread_count)
+{
+  if (thread_count != 0) {
+    return thread_count;
+  }
+  return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+}  // namespace
+
+TileEngine::TileEngine(size_t thread_count)
+{
+  thread_count = resolve_thread_count(thread_count);
+  for (size_t worker = 0; worker < thread_count; ++worker) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  for (size_t worker = 1; worker < thread_count; ++worker) {
+    workers_.emplace_back(
+      [this, worker]() {
+        uint64_t last_run = 0;
+        while (true) {
+          {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this, last_run]() {return stop_ || run_id_ != last_run;});
+            if (stop_) {
+              return;
+            }
+            last_run = run_id_;
+            ++busy_workers_;
+          }
+          work(worker);
+          {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --busy_workers_;
+          }
+          done_.notify_all();
+        }
+      });
+  }
+}
+
+TileEngine::~TileEngine()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (auto & worker : workers_) {
+    worker.join();
+  }
+}
+
+std::shared_ptr<TileEngine>
+TileEngine::shared(size_t thread_count)
+{
+  static std::mutex mutex;
+  static std::map<size_t, std::weak_ptr<TileEngine>> engines;
+
+  thread_count = resolve_thread_count(thread_count);
+  std::lock_guard<std::mutex> lock(mutex);
+  auto engine = engines[thread_count].lock();
+  if (!engine) {
+    engine = std::make_shared<TileEngine>(thread_count);
+    engines[thread_count] = engine;
+  }
+  return engine;
+}
+
+void
+TileEngine::run(
+  const ImageRegion & region, unsigned int tile_width, unsigned int tile_height,
+  const TileKernel & kernel, std::vector<TileTiming> * timings)
+{
+  if (tile_width == 0) {
+    tile_width = std::max(region.width, 1u);
+  }
+  if (tile_height == 0) {
+    tile_height = std::max(region.height, 1u);
+  }
+
+  std::lock_guard<std::mutex> run_lock(run_mutex_);
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Workers that woke up too late for the previous run may still be looking for tiles.
+    done_.wait(lock, [this]() {return busy_workers_ == 0;});
+
+    tiles_.clear();
+    for (unsigned int y = 0; y < region.height; y += tile_height) {
+      for (unsigned int x = 0; x < region.width; x += tile_width) {
+        ImageRegion tile = region;
+        tile.x = region.x + x;
+        tile.y = region.y + y;
+        tile.width = std::min(tile_width, region.width - x);
+        tile.height = std::min(tile_height, region.height - y);
+        tiles_.push_back(tile);
+      }
+    }
+    // Contiguous blocks keep the tiles of a worker next to each other in memory.
+    const size_t tile_count = tiles_.size();
+    for (size_t worker = 0; worker < queues_.size(); ++worker) {
+      std::lock_guard<std::mutex> queue_lock(queues_[worker]->mutex);
+      auto & queue = queues_[worker]->tiles;
+      queue.clear();
+      for (size_t tile = worker * tile_count / queues_.size();
+        tile < (worker + 1) * tile_count / queues_.size(); ++tile)
+      {
+        queue.push_back(tile);
+      }
+    }
+    kernel_ = &kernel;
+    record_timings_ = timings != nullptr;
+    timings_.assign(record_timings_ ? tile_count : 0, TileTiming{});
+    error_ = nullptr;
+    ++run_id_;
+  }
+  wake_.notify_all();
+
+  work(0);
+
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() {return busy_workers_ == 0;});
+    kernel_ = nullptr;
+    error = error_;
+    error_ = nullptr;
+    if (timings) {
+      timings->swap(timings_);
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void
+TileEngine::work(size_t worker)
+{
+  size_t tile = 0;
+  bool stolen = false;
+  while (next_tile(worker, tile, stolen)) {
+    const auto start = std::chrono::steady_clock::now();
+    try {
+      (*kernel_)(tiles_[tile]);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+    }
+    if (record_timings_) {
+      timings_[tile] = TileTiming{
+        tiles_[tile], worker, stolen, std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start)};
+    }
+  }
+}
+
+bool
+TileEngine::next_tile(size_t worker, size_t & tile, bool & stolen)
+{
+  {
+    Queue & own = *queues_[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tiles.empty()) {
+      tile = own.tiles.front();
+      own.tiles.pop_front();
+      stolen = false;
+      return true;
+    }
+  }
+  for (size_t offset = 1; offset < queues_.size(); ++offset) {
+    Queue & victim = *queues_[(worker + offset) % queues_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tiles.empty()) {
+      // The far end of the block, away from where its owner is working.
+      tile = victim.tiles.back();
+      victim.tiles.pop_back();
+      stolen = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace cpu
+}  // namespace julia_set
+}  // namespace type_adaptation
@@ -12,8 +12,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include "julia_set/cuda/julia_set.hpp"
+#include "julia_set/cuda/julia_set_kernels.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <math.h>  // NOLINT - include .h without directory
 #include <string>
@@ -21,6 +22,7 @@
 #include <stdio.h>
 
 #include "cuda.h"  // NOLINT - include .h without directory
+#include "cuda_fp16.h"  // NOLINT - include .h without directory
 #include "cuda_runtime.h"  // NOLINT - include .h without directory
 
 
@@ -64,22 +66,82 @@ __device__ float3 hsv_to_rgb(float H, float S, float V) {
 	return (float3) {R, G, B};
 }
 
+// Row of a buffer, whose rows are row_step bytes apart.
+template<typename T>
+__device__ T * row_of(T * buffer, size_t row, size_t row_step)
+{
+    return reinterpret_cast<T *>(reinterpret_cast<uint8_t *>(buffer) + row * row_step);
+}
+
+template<typename T>
+__device__ const T * row_of(const T * buffer, size_t row, size_t row_step)
+{
+    return reinterpret_cast<const T *>(reinterpret_cast<const uint8_t *>(buffer) + row * row_step);
+}
+
+// Entries of the color LUT, see type_adaptation::julia_set::cpu::color_lut_entries().
+__host__ __device__ size_t color_lut_entries(const type_adaptation::julia_set::JuliaSetParams & params)
+{
+    return params.kMaxIterations > 0 ? params.kMaxIterations : 1;
+}
+
+// Entry of an escape iteration in the color LUT, clamped into it.
+__device__ size_t color_lut_entry(float escaped, size_t lut_entries)
+{
+    if(!(escaped > 0.0f)) {
+        return 0;
+    }
+    if(escaped >= (float)(lut_entries - 1)) {
+        return lut_entries - 1;
+    }
+    return (size_t)escaped;
+}
+
+// Colors of the escape iterations, in the layout of type_adaptation::julia_set::cpu::color_lut()
+// and with the math the kernels used per pixel before.
+__global__ void color_lut_kernel(float * lut, const type_adaptation::julia_set::JuliaSetParams params)
+{
+    const size_t lut_entries = color_lut_entries(params);
+    float * composite_lut = lut + 3 * lut_entries;
+    for(size_t counter = (blockDim.x * blockIdx.x) + threadIdx.x; counter < lut_entries; counter += gridDim.x * blockDim.x) {
+        // colorize_kernel gets the escape iteration as a float.
+        const float escaped = (float)counter;
+        float h = fmod((escaped * 360 / params.kMaxIterations), 360);
+        float v = pow(escaped / params.kMaxIterations,.020)*100;
+        float3 color = hsv_to_rgb(h,100,v);
+        lut[counter] = color.x;
+        lut[lut_entries + counter] = color.y;
+        lut[2 * lut_entries + counter] = color.z;
+
+        h = fmod((counter * 360 / params.kMaxIterations), 360);
+        v = pow((float)counter / params.kMaxIterations,.020)*100;
+        color = hsv_to_rgb(h,100,v);
+        composite_lut[counter] = color.x;
+        composite_lut[lut_entries + counter] = color.y;
+        composite_lut[2 * lut_entries + counter] = color.z;
+    }
+}
+
 __global__ void julia_set_kernel_composite(
-    uint8_t * output, const uint8_t * input, const type_adaptation::julia_set::ImageMsgProperties img_properties, const type_adaptation::julia_set::JuliaSetParams params)
+    uint8_t * output, const uint8_t * input, const type_adaptation::julia_set::ImageMsgProperties img_properties, const type_adaptation::julia_set::JuliaSetParams params,
+    const float * lut, const type_adaptation::julia_set::ImageRegion region)
 {
+    const size_t lut_entries = color_lut_entries(params);
+    const float * composite_lut = lut + 3 * lut_entries;
+
     size_t x_idx = (blockDim.x * blockIdx.x) + threadIdx.x;
     size_t x_stride = gridDim.x * blockDim.x;
 
     size_t y_idx = (blockDim.y * blockIdx.y) + threadIdx.y;
     size_t y_stride = gridDim.y * blockDim.y;
 
-    for(size_t row = y_idx; row < img_properties.height; row += y_stride) {
-        for(size_t col = x_idx; col < img_properties.width; col += x_stride) {
-            size_t color_idx = (row * img_properties.row_step) + (col * img_properties.color_step);
+    for(size_t row = y_idx; row < region.height; row += y_stride) {
+        for(size_t col = x_idx; col < region.width; col += x_stride) {
+            size_t color_idx = (row * region.out_row_step) + (col * img_properties.color_step);
 
             // Map height and width on a scale of -2 to 2
-            float real_part = map_range(col, params.kMinColRange, params.kMaxColRange, params.kMinXRange, params.kMaxXRange);
-            float img_part = map_range(row, params.kMinRowRange, params.kMaxRowRange, params.kMinYRange, params.kMaxYRange);
+            float real_part = map_range(col + region.x, params.kMinColRange, params.kMaxColRange, params.kMinXRange, params.kMaxXRange);
+            float img_part = map_range(row + region.y, params.kMinRowRange, params.kMaxRowRange, params.kMinYRange, params.kMaxYRange);
             float orig_real_part = params.kStartX * cos(params.kCurrentAngle);
             float orig_img_part = params.kStartY * sin(params.kCurrentAngle);
             float new_real_part, new_img_part;
@@ -101,21 +163,17 @@ __global__ void julia_set_kernel_composite(
                 output[color_idx + img_properties.green_offset] = input[color_idx + img_properties.green_offset] / 4;
                 output[color_idx + img_properties.blue_offset] = input[color_idx + img_properties.blue_offset] / 4;
             } else {
-
-                float h = fmod((counter * 360 / params.kMaxIterations), 360);
-                float s = 100;
-                float v = pow((float)counter / params.kMaxIterations,.020)*100;
-                float3 color = hsv_to_rgb(h,s,v);
-                output[color_idx + img_properties.red_offset] =  color.x - input[color_idx + img_properties.red_offset] / 16;
-                output[color_idx + img_properties.green_offset] =  color.y - input[color_idx + img_properties.green_offset] / 16;
-                output[color_idx + img_properties.blue_offset] =   color.z - input[color_idx + img_properties.blue_offset] / 16;
+                output[color_idx + img_properties.red_offset] =  composite_lut[counter] - input[color_idx + img_properties.red_offset] / 16;
+                output[color_idx + img_properties.green_offset] =  composite_lut[lut_entries + counter] - input[color_idx + img_properties.green_offset] / 16;
+                output[color_idx + img_properties.blue_offset] =   composite_lut[2 * lut_entries + counter] - input[color_idx + img_properties.blue_offset] / 16;
             }
         }
     }
 }
 
 __global__ void map_kernel(
-    float * output, const type_adaptation::julia_set::ImageMsgProperties img_properties, const type_adaptation::julia_set::JuliaSetParams params)
+    float * output, const type_adaptation::julia_set::ImageMsgProperties img_properties, const type_adaptation::julia_set::JuliaSetParams params,
+    const type_adaptation::julia_set::ImageRegion region)
 {
     size_t x_idx = (blockDim.x * blockIdx.x) + threadIdx.x;
     size_t x_stride = gridDim.x * blockDim.x;
@@ -125,21 +183,25 @@ __global__ void map_kernel(
 
     const uint8_t kChannel = 3;
 
-    for(size_t row = y_idx; row < img_properties.height; row += y_stride) {
-        for(size_t col = x_idx; col < img_properties.width; col += x_stride) {
-            size_t x_idx = (row * img_properties.width * kChannel) + (col * kChannel);
+    for(size_t row = y_idx; row < region.height; row += y_stride) {
+        float * output_row = row_of(output, row, region.out_row_step);
+        for(size_t col = x_idx; col < region.width; col += x_stride) {
+            size_t x_idx = col * kChannel;
             size_t y_idx = x_idx + 1;
             size_t z_idx = y_idx + 1;
 
-            output[x_idx] = map_range(col, params.kMinColRange, params.kMaxColRange, params.kMinXRange, params.kMaxXRange);
-            output[y_idx] = map_range(row, params.kMinRowRange, params.kMaxRowRange, params.kMinYRange, params.kMaxYRange);
-            output[z_idx] = 0.0;
+            output_row[x_idx] = map_range(col + region.x, params.kMinColRange, params.kMaxColRange, params.kMinXRange, params.kMaxXRange);
+            output_row[y_idx] = map_range(row + region.y, params.kMinRowRange, params.kMaxRowRange, params.kMinYRange, params.kMaxYRange);
+            output_row[z_idx] = 0.0;
         }
     }
 }
 
-__global__ void julia_set_kernel(size_t curr_iteration,
-    float * output, const float * input, const type_adaptation::julia_set::ImageMsgProperties img_properties, const type_adaptation::julia_set::JuliaSetParams params)
+// Runs iterations curr_iteration to curr_iteration + iteration_count - 1, keeping the pixel in
+// registers in between.
+__global__ void julia_set_kernel(size_t curr_iteration, size_t iteration_count,
+    float * output_mat, const float * input_mat, const type_adaptation::julia_set::ImageMsgProperties img_properties, const type_adaptation::julia_set::JuliaSetParams params,
+    const type_adaptation::julia_set::ImageRegion region)
 {
     size_t x_idx = (blockDim.x * blockIdx.x) + threadIdx.x;
     size_t x_stride = gridDim.x * blockDim.x;
@@ -149,39 +211,186 @@ __global__ void julia_set_kernel(size_t curr_iteration,
 
     const uint8_t kChannel = 3;
 
-    for(size_t row = y_idx; row < img_properties.height; row += y_stride) {
-        for(size_t col = x_idx; col < img_properties.width; col += x_stride) {
-            size_t x_idx = (row * img_properties.width * kChannel) + (col * kChannel);
+    for(size_t row = y_idx; row < region.height; row += y_stride) {
+        float * output = row_of(output_mat, row, region.out_row_step);
+        const float * input = row_of(input_mat, row, region.in_row_step);
+        for(size_t col = x_idx; col < region.width; col += x_stride) {
+            size_t x_idx = col * kChannel;
             size_t y_idx = x_idx + 1;
             size_t z_idx = y_idx + 1;
 
+            // Pixels that already escaped keep their iteration count.
+            if(input[z_idx] != 0.0) {
+                continue;
+            }
             float real_part = input[x_idx];
             float img_part = input[y_idx];
             float orig_real_part = params.kStartX * cos(params.kCurrentAngle);
             float orig_img_part = params.kStartY * sin(params.kCurrentAngle);
             float new_real_part, new_img_part;
-          
-            if(input[z_idx] == 0.0){
+            float escaped_at = 0.0;
+
+            for(size_t iteration = curr_iteration; iteration < curr_iteration + iteration_count; ++iteration) {
                 if((real_part * real_part + img_part * img_part) > params.kBoundaryRadius * params.kBoundaryRadius) {
-                    output[z_idx] = 1.0 + curr_iteration;
-                    return;
+                    escaped_at = 1.0 + iteration;
+                    break;
                 }
                 new_real_part = (real_part * real_part) - (img_part * img_part);
                 new_img_part = 2 * real_part * img_part;
-                
-                output[x_idx] = new_real_part + orig_real_part;
-                output[y_idx] = new_img_part + orig_img_part;
-                output[z_idx] = 0.0;
+
+                real_part = new_real_part + orig_real_part;
+                img_part = new_img_part + orig_img_part;
+            }
+
+            output[x_idx] = real_part;
+            output[y_idx] = img_part;
+            output[z_idx] = escaped_at;
+        }
+    }
+}
+
+// julia_set_kernel on a list of pixels, the count followed by the indices, or on every pixel of
+// the region without one. Warps append the pixels that are still active to active_out with one
+// atomic each.
+__global__ void julia_set_active_kernel(size_t curr_iteration, size_t iteration_count,
+    float * image, const type_adaptation::julia_set::ImageMsgProperties img_properties, const type_adaptation::julia_set::JuliaSetParams params,
+    const type_adaptation::julia_set::ImageRegion region, const uint32_t * active, uint32_t * active_out)
+{
+    const uint8_t kChannel = 3;
+    const uint32_t count = active ? active[0] : region.width * region.height;
+    const uint32_t lane = threadIdx.x % warpSize;
+
+    // Whole blocks take the same turns, so every lane of a warp reaches the ballot.
+    for(uint32_t first = blockIdx.x * blockDim.x; first < count; first += gridDim.x * blockDim.x) {
+        const uint32_t position = first + threadIdx.x;
+        bool still_active = false;
+        uint32_t index = 0;
+        if(position < count) {
+            index = active ? active[1 + position] : position;
+            float * pixel = row_of(image, index / region.width, region.in_row_step) + (index % region.width) * kChannel;
+            if(pixel[2] == 0.0) {
+                float real_part = pixel[0];
+                float img_part = pixel[1];
+                float orig_real_part = params.kStartX * cos(params.kCurrentAngle);
+                float orig_img_part = params.kStartY * sin(params.kCurrentAngle);
+                float new_real_part, new_img_part;
+                float escaped_at = 0.0;
+
+                for(size_t iteration = curr_iteration; iteration < curr_iteration + iteration_count; ++iteration) {
+                    if((real_part * real_part + img_part * img_part) > params.kBoundaryRadius * params.kBoundaryRadius) {
+                        escaped_at = 1.0 + iteration;
+                        break;
+                    }
+                    new_real_part = (real_part * real_part) - (img_part * img_part);
+                    new_img_part = 2 * real_part * img_part;
+
+                    real_part = new_real_part + orig_real_part;
+                    img_part = new_img_part + orig_img_part;
+                }
+
+                pixel[0] = real_part;
+                pixel[1] = img_part;
+                pixel[2] = escaped_at;
+                still_active = escaped_at == 0.0;
+            }
+        }
+
+        const unsigned int kept = __ballot_sync(0xffffffff, still_active);
+        uint32_t base = 0;
+        if(lane == 0 && kept != 0) {
+            base = atomicAdd(active_out, __popc(kept));
+        }
+        base = __shfl_sync(0xffffffff, base, 0);
+        if(still_active) {
+            active_out[1 + base + __popc(kept & ((1u << lane) - 1))] = index;
+        }
+    }
+}
+
+// Pixels at every scale-th column and row of the region, into a coarse image with packed rows.
+__global__ void downsample_kernel(
+    const float * image, const type_adaptation::julia_set::ImageRegion region, unsigned int scale, float * coarse, size_t coarse_width, size_t coarse_height)
+{
+    size_t x_idx = (blockDim.x * blockIdx.x) + threadIdx.x;
+    size_t x_stride = gridDim.x * blockDim.x;
+
+    size_t y_idx = (blockDim.y * blockIdx.y) + threadIdx.y;
+    size_t y_stride = gridDim.y * blockDim.y;
+
+    const uint8_t kChannel = 3;
+
+    for(size_t row = y_idx; row < coarse_height; row += y_stride) {
+        const float * input = row_of(image, row * scale, region.in_row_step);
+        for(size_t col = x_idx; col < coarse_width; col += x_stride) {
+            for(uint8_t channel = 0; channel < kChannel; ++channel) {
+                coarse[(row * coarse_width + col) * kChannel + channel] = input[col * scale * kChannel + channel];
+            }
+        }
+    }
+}
+
+// Whether a coarse pixel escaped at the same iteration as its neighbours, see
+// type_adaptation::julia_set::cpu::refine().
+__device__ bool uniform_block(const float * coarse, size_t coarse_width, size_t coarse_height, size_t col, size_t row)
+{
+    const uint8_t kChannel = 3;
+    const float escaped = coarse[(row * coarse_width + col) * kChannel + 2];
+    for(size_t neighbour_row = row > 0 ? row - 1 : 0; neighbour_row <= min(row + 1, coarse_height - 1); ++neighbour_row) {
+        for(size_t neighbour_col = col > 0 ? col - 1 : 0; neighbour_col <= min(col + 1, coarse_width - 1); ++neighbour_col) {
+            if(coarse[(neighbour_row * coarse_width + neighbour_col) * kChannel + 2] != escaped) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Fills the blocks of uniform coarse pixels and appends the pixels of the others to active_out,
+// the same way as julia_set_active_kernel.
+__global__ void refine_kernel(
+    float * image, const type_adaptation::julia_set::ImageRegion region, unsigned int scale, const float * coarse, uint32_t * active_out)
+{
+    const uint8_t kChannel = 3;
+    const uint32_t count = region.width * region.height;
+    const size_t coarse_width = (region.width + scale - 1) / scale;
+    const size_t coarse_height = (region.height + scale - 1) / scale;
+    const uint32_t lane = threadIdx.x % warpSize;
+
+    for(uint32_t first = blockIdx.x * blockDim.x; first < count; first += gridDim.x * blockDim.x) {
+        const uint32_t index = first + threadIdx.x;
+        bool refined = false;
+        if(index < count) {
+            const size_t row = index / region.width;
+            const size_t col = index % region.width;
+            if(uniform_block(coarse, coarse_width, coarse_height, col / scale, row / scale)) {
+                const float * sample = coarse + ((row / scale) * coarse_width + col / scale) * kChannel;
+                float * pixel = row_of(image, row, region.in_row_step) + col * kChannel;
+                for(uint8_t channel = 0; channel < kChannel; ++channel) {
+                    pixel[channel] = sample[channel];
+                }
             } else {
-                return;
+                refined = true;
             }
         }
+
+        const unsigned int kept = __ballot_sync(0xffffffff, refined);
+        uint32_t base = 0;
+        if(lane == 0 && kept != 0) {
+            base = atomicAdd(active_out, __popc(kept));
+        }
+        base = __shfl_sync(0xffffffff, base, 0);
+        if(refined) {
+            active_out[1 + base + __popc(kept & ((1u << lane) - 1))] = index;
+        }
     }
 }
 
 __global__ void colorize_kernel(
-    uint8_t * output, const float * input, const type_adaptation::julia_set::ImageMsgProperties img_properties, const type_adaptation::julia_set::JuliaSetParams params)
+    uint8_t * output_mat, const float * input_mat, const type_adaptation::julia_set::ImageMsgProperties img_properties, const type_adaptation::julia_set::JuliaSetParams params,
+    const float * lut, const type_adaptation::julia_set::ImageRegion region)
 {
+    const size_t lut_entries = color_lut_entries(params);
+
     size_t x_idx = (blockDim.x * blockIdx.x) + threadIdx.x;
     size_t x_stride = gridDim.x * blockDim.x;
 
@@ -190,28 +399,169 @@ __global__ void colorize_kernel(
 
     const uint8_t kChannel = 3;
 
-    for(size_t row = y_idx; row < img_properties.height; row += y_stride) {
-        for(size_t col = x_idx; col < img_properties.width; col += x_stride) {
+    for(size_t row = y_idx; row < region.height; row += y_stride) {
+        uint8_t * output = row_of(output_mat, row, region.out_row_step);
+        const float * input = row_of(input_mat, row, region.in_row_step);
+        for(size_t col = x_idx; col < region.width; col += x_stride) {
             
-            size_t x_idx = (row * img_properties.width * kChannel) + (col * kChannel);
+            size_t x_idx = col * kChannel;
             size_t y_idx = x_idx + 1;
             size_t z_idx = y_idx + 1;
             
-            size_t color_idx = (row * img_properties.row_step / sizeof(4)) + (col * img_properties.color_step);
+            size_t color_idx = col * img_properties.color_step;
 
             if(input[z_idx] == (float)0.0) {
                 output[color_idx + img_properties.red_offset] = input[x_idx] / 4;
                 output[color_idx + img_properties.green_offset] = input[y_idx] / 4;
                 output[color_idx + img_properties.blue_offset] = input[z_idx] / 4;
             } else {
+                const size_t entry = color_lut_entry(input[z_idx] - 1, lut_entries);
+                output[color_idx + img_properties.red_offset] =  lut[entry] - input[x_idx] / 16;
+                output[color_idx + img_properties.green_offset] =  lut[lut_entries + entry] - input[y_idx] / 16;
+                output[color_idx + img_properties.blue_offset] =   lut[2 * lut_entries + entry] - input[z_idx] / 16;
+            }
+        }
+    }
+}
+
+// The x and y of planar layouts are floats or the bits of half precision floats.
+__device__ float load_coordinate(float value)
+{
+    return value;
+}
+
+__device__ float load_coordinate(uint16_t value)
+{
+    return __half2float(__ushort_as_half(value));
+}
+
+__device__ void store_coordinate(float value, float & coordinate)
+{
+    coordinate = value;
+}
+
+__device__ void store_coordinate(float value, uint16_t & coordinate)
+{
+    coordinate = __half_as_ushort(__float2half_rn(value));
+}
+
+// Planes of a row of an image in a planar layout, plane_width pixels each.
+template<typename CoordinateT, typename EscapeT>
+struct PlanarRow
+{
+    template<typename Byte>
+    __device__ PlanarRow(Byte * row, size_t plane_width)
+    : x(reinterpret_cast<CoordinateT *>(row)), y(x + plane_width), escaped(reinterpret_cast<EscapeT *>(y + plane_width))
+    {
+    }
+
+    CoordinateT * x;
+    CoordinateT * y;
+    EscapeT * escaped;
+};
+
+template<typename CoordinateT, typename EscapeT>
+__global__ void map_planar_kernel(
+    uint8_t * output, const type_adaptation::julia_set::ImageMsgProperties img_properties, const type_adaptation::julia_set::JuliaSetParams params,
+    const type_adaptation::julia_set::ImageRegion region)
+{
+    size_t x_idx = (blockDim.x * blockIdx.x) + threadIdx.x;
+    size_t x_stride = gridDim.x * blockDim.x;
+
+    size_t y_idx = (blockDim.y * blockIdx.y) + threadIdx.y;
+    size_t y_stride = gridDim.y * blockDim.y;
+
+    for(size_t row = y_idx; row < region.height; row += y_stride) {
+        PlanarRow<CoordinateT, EscapeT> planes(output + row * region.out_row_step, img_properties.width);
+        for(size_t col = x_idx + region.x; col < region.x + region.width; col += x_stride) {
+            store_coordinate(map_range(col, params.kMinColRange, params.kMaxColRange, params.kMinXRange, params.kMaxXRange), planes.x[col]);
+            store_coordinate(map_range(row + region.y, params.kMinRowRange, params.kMaxRowRange, params.kMinYRange, params.kMaxYRange), planes.y[col]);
+            planes.escaped[col] = 0;
+        }
+    }
+}
+
+// julia_set_kernel on an image in a planar layout. Warps read and write consecutive columns of
+// each plane, and the ones whose pixels all escaped only read the plane of escape iterations.
+template<typename CoordinateT, typename EscapeT>
+__global__ void julia_set_planar_kernel(size_t curr_iteration, size_t iteration_count,
+    uint8_t * image, const type_adaptation::julia_set::ImageMsgProperties img_properties, const type_adaptation::julia_set::JuliaSetParams params,
+    const type_adaptation::julia_set::ImageRegion region)
+{
+    size_t x_idx = (blockDim.x * blockIdx.x) + threadIdx.x;
+    size_t x_stride = gridDim.x * blockDim.x;
+
+    size_t y_idx = (blockDim.y * blockIdx.y) + threadIdx.y;
+    size_t y_stride = gridDim.y * blockDim.y;
+
+    // Escape iterations beyond what the plane holds are clamped, EscapeT is unsigned.
+    const float max_escaped = (float)(EscapeT)-1;
+
+    for(size_t row = y_idx; row < region.height; row += y_stride) {
+        PlanarRow<CoordinateT, EscapeT> planes(image + row * region.in_row_step, img_properties.width);
+        for(size_t col = x_idx + region.x; col < region.x + region.width; col += x_stride) {
+            // Pixels that already escaped keep their iteration count.
+            if(planes.escaped[col] != 0) {
+                continue;
+            }
+            float real_part = load_coordinate(planes.x[col]);
+            float img_part = load_coordinate(planes.y[col]);
+            float orig_real_part = params.kStartX * cos(params.kCurrentAngle);
+            float orig_img_part = params.kStartY * sin(params.kCurrentAngle);
+            float new_real_part, new_img_part;
+            float escaped_at = 0.0;
+
+            for(size_t iteration = curr_iteration; iteration < curr_iteration + iteration_count; ++iteration) {
+                if((real_part * real_part + img_part * img_part) > params.kBoundaryRadius * params.kBoundaryRadius) {
+                    escaped_at = 1.0 + iteration;
+                    break;
+                }
+                new_real_part = (real_part * real_part) - (img_part * img_part);
+                new_img_part = 2 * real_part * img_part;
+
+                real_part = new_real_part + orig_real_part;
+                img_part = new_img_part + orig_img_part;
+            }
+
+            store_coordinate(real_part, planes.x[col]);
+            store_coordinate(img_part, planes.y[col]);
+            planes.escaped[col] = (EscapeT)fminf(escaped_at, max_escaped);
+        }
+    }
+}
+
+template<typename CoordinateT, typename EscapeT>
+__global__ void colorize_planar_kernel(
+    uint8_t * output_mat, const uint8_t * input_mat, const type_adaptation::julia_set::ImageMsgProperties img_properties, const type_adaptation::julia_set::JuliaSetParams params,
+    const float * lut, const type_adaptation::julia_set::ImageRegion region)
+{
+    const size_t lut_entries = color_lut_entries(params);
+
+    size_t x_idx = (blockDim.x * blockIdx.x) + threadIdx.x;
+    size_t x_stride = gridDim.x * blockDim.x;
 
-                float h = fmod(((input[z_idx] - 1) * 360 / params.kMaxIterations), 360);
-                float s = 100;
-                float v = pow((float)(input[z_idx] - 1) / params.kMaxIterations,.020)*100;
-                float3 color = hsv_to_rgb(h,s,v);
-                output[color_idx + img_properties.red_offset] =  color.x - input[x_idx] / 16;
-                output[color_idx + img_properties.green_offset] =  color.y - input[y_idx] / 16;
-                output[color_idx + img_properties.blue_offset] =   color.z - input[z_idx] / 16;
+    size_t y_idx = (blockDim.y * blockIdx.y) + threadIdx.y;
+    size_t y_stride = gridDim.y * blockDim.y;
+
+    for(size_t row = y_idx; row < region.height; row += y_stride) {
+        uint8_t * output = output_mat + row * region.out_row_step;
+        PlanarRow<const CoordinateT, const EscapeT> planes(input_mat + row * region.in_row_step, img_properties.width);
+        for(size_t col = x_idx; col < region.width; col += x_stride) {
+            const float x = load_coordinate(planes.x[region.x + col]);
+            const float y = load_coordinate(planes.y[region.x + col]);
+            const float z = planes.escaped[region.x + col];
+
+            size_t color_idx = col * img_properties.color_step;
+
+            if(z == (float)0.0) {
+                output[color_idx + img_properties.red_offset] = x / 4;
+                output[color_idx + img_properties.green_offset] = y / 4;
+                output[color_idx + img_properties.blue_offset] = z / 4;
+            } else {
+                const size_t entry = color_lut_entry(z - 1, lut_entries);
+                output[color_idx + img_properties.red_offset] =  lut[entry] - x / 16;
+                output[color_idx + img_properties.green_offset] =  lut[lut_entries + entry] - y / 16;
+                output[color_idx + img_properties.blue_offset] =   lut[2 * lut_entries + entry] - z / 16;
             }
         }
     }
@@ -223,61 +573,228 @@ namespace type_adaptation
 {
 namespace julia_set
 {
-JuliaSet::JuliaSet(ImageMsgProperties img_properties, JuliaSetParams parameters): 
- image_msg_property_{img_properties},
- parameters_{parameters} {configure_kernel_execution();}
+namespace cuda
+{
+namespace
+{
+// The number of CUDA threads per block in the x direction
+const int kNumThreadsPerBlockX = 32;
+// The number of CUDA threads per block in the y direction
+const int kNumThreadsPerBlockY = 32;
+
+// The number of CUDA threads per block on a list of pixels, whole warps
+const uint32_t kNumThreadsPerList = 256;
+// Blocks on a list of pixels at most, the kernel strides over longer lists
+const uint32_t kMaxListBlocks = 4096;
+
+// Get the number of CUDA blocks & threads
+void configure_kernel_execution(
+    const ImageRegion & region, dim3 & num_of_blocks, dim3 & threads_per_block)
+{
+    size_t num_blocks_x = (region.width + kNumThreadsPerBlockX - 1) /
+                        kNumThreadsPerBlockX;
+    size_t num_blocks_y = (region.height + kNumThreadsPerBlockY - 1) /
+                        kNumThreadsPerBlockY;
+
+    num_of_blocks = dim3(num_blocks_x, num_blocks_y, 1);
+    threads_per_block = dim3(kNumThreadsPerBlockX, kNumThreadsPerBlockY, 1);
+}
+}  // namespace
+
+void color_lut(const JuliaSetParams & params, float * lut, const cudaStream_t & stream)
+{
+    const size_t lut_entries = color_lut_entries(params);
+    // Invoke CUDA kernel
+    color_lut_kernel<<<(lut_entries + kNumThreadsPerList - 1) / kNumThreadsPerList, kNumThreadsPerList, 0, stream>>>(lut,
+                                                                                                              params);
+}
+
+void julia_set_composite(
+    uint8_t * image, const ImageMsgProperties & img_properties, const JuliaSetParams & params,
+    const float * lut, const ImageRegion & region, const cudaStream_t & stream)
+{
+    dim3 num_of_blocks, threads_per_block;
+    configure_kernel_execution(region, num_of_blocks, threads_per_block);
+    // Invoke CUDA kernel
+    julia_set_kernel_composite<<<num_of_blocks, threads_per_block, 0, stream>>>(image,
+                                                                          image,
+                                                                          img_properties,
+                                                                          params,
+                                                                          lut,
+                                                                          region);
+}
+
+void map(
+    float * out_mat, const ImageMsgProperties & img_properties, const JuliaSetParams & params,
+    const ImageRegion & region, const cudaStream_t & stream)
+{
+    dim3 num_of_blocks, threads_per_block;
+    configure_kernel_execution(region, num_of_blocks, threads_per_block);
+    // Invoke CUDA kernel
+    map_kernel<<<num_of_blocks, threads_per_block, 0, stream>>>(out_mat,
+                                                              img_properties,
+                                                              params,
+                                                              region);
+}
+
+void julia_set_iteration(
+    size_t curr_iteration, size_t iteration_count, float * image,
+    const ImageMsgProperties & img_properties, const JuliaSetParams & params,
+    const ImageRegion & region, const cudaStream_t & stream)
+{
+    dim3 num_of_blocks, threads_per_block;
+    configure_kernel_execution(region, num_of_blocks, threads_per_block);
+    // Invoke CUDA kernel
+    julia_set_kernel<<<num_of_blocks, threads_per_block, 0, stream>>>(curr_iteration,
+                                                                  iteration_count,
+                                                                  image,
+                                                                  image,
+                                                                  img_properties,
+                                                                  params,
+                                                                  region);
+}
+
+void julia_set_iteration_active(
+    size_t curr_iteration, size_t iteration_count, float * image,
+    const ImageMsgProperties & img_properties, const JuliaSetParams & params,
+    const ImageRegion & region, const uint32_t * active, uint32_t capacity, uint32_t * active_out,
+    const cudaStream_t & stream)
+{
+    // Blocks past the count of the list return right away, the grid only has to cover the
+    // capacity of the list.
+    const uint32_t num_of_blocks = std::max<uint32_t>(
+        std::min<uint32_t>((capacity + kNumThreadsPerList - 1) / kNumThreadsPerList, kMaxListBlocks), 1);
+    cudaMemsetAsync(active_out, 0, sizeof(uint32_t), stream);
+    // Invoke CUDA kernel
+    julia_set_active_kernel<<<num_of_blocks, kNumThreadsPerList, 0, stream>>>(curr_iteration,
+                                                                          iteration_count,
+                                                                          image,
+                                                                          img_properties,
+                                                                          params,
+                                                                          region,
+                                                                          active,
+                                                                          active_out);
+}
 
-void JuliaSet::configure_kernel_execution() {
-    // Get the number of CUDA blocks & threads
-    size_t num_blocks_x = (image_msg_property_.width + num_threads_per_block_x_ - 1) / 
-                        num_threads_per_block_x_;
-    size_t num_blocks_y = (image_msg_property_.height + num_threads_per_block_y_ - 1) /
-                        num_threads_per_block_y_;
+void downsample(
+    const float * image, const ImageRegion & region, unsigned int scale, float * coarse,
+    const cudaStream_t & stream)
+{
+    ImageRegion coarse_region;
+    coarse_region.width = (region.width + scale - 1) / scale;
+    coarse_region.height = (region.height + scale - 1) / scale;
+    dim3 num_of_blocks, threads_per_block;
+    configure_kernel_execution(coarse_region, num_of_blocks, threads_per_block);
+    // Invoke CUDA kernel
+    downsample_kernel<<<num_of_blocks, threads_per_block, 0, stream>>>(image,
+                                                                   region,
+                                                                   scale,
+                                                                   coarse,
+                                                                   coarse_region.width,
+                                                                   coarse_region.height);
+}
 
-    num_of_blocks_ = dim3(num_blocks_x, num_blocks_y, 1);
-    threads_per_block_ = dim3(num_threads_per_block_x_, num_threads_per_block_y_, 1);
+void refine(
+    float * image, const ImageRegion & region, unsigned int scale, const float * coarse,
+    uint32_t capacity, uint32_t * active_out, const cudaStream_t & stream)
+{
+    const uint32_t num_of_blocks = std::max<uint32_t>(
+        std::min<uint32_t>((capacity + kNumThreadsPerList - 1) / kNumThreadsPerList, kMaxListBlocks), 1);
+    cudaMemsetAsync(active_out, 0, sizeof(uint32_t), stream);
+    // Invoke CUDA kernel
+    refine_kernel<<<num_of_blocks, kNumThreadsPerList, 0, stream>>>(image,
+                                                                region,
+                                                                scale,
+                                                                coarse,
+                                                                active_out);
 }
 
-void JuliaSet::compute_julia_set_composite(float & current_angle, u_int8_t * image, const cudaStream_t & stream)
+void colorize(
+    uint8_t * output, const float * input, const ImageMsgProperties & img_properties,
+    const JuliaSetParams & params, const float * lut, const ImageRegion & region,
+    const cudaStream_t & stream)
 {
-    parameters_.kCurrentAngle = current_angle;
+    dim3 num_of_blocks, threads_per_block;
+    configure_kernel_execution(region, num_of_blocks, threads_per_block);
     // Invoke CUDA kernel
-    julia_set_kernel_composite<<<num_of_blocks_, threads_per_block_, 0, stream>>>(image,
-                                                                            image,
-                                                                            image_msg_property_,
-                                                                            parameters_); 
+    colorize_kernel<<<num_of_blocks, threads_per_block, 0, stream>>>(output,
+                                                                  input,
+                                                                  img_properties,
+                                                                  params,
+                                                                  lut,
+                                                                  region);
 }
 
-void JuliaSet::map(float * out_mat, const cudaStream_t & stream)
+void map_planar(
+    uint8_t * out, PixelLayout layout, const ImageMsgProperties & img_properties,
+    const JuliaSetParams & params, const ImageRegion & region, const cudaStream_t & stream)
 {
+    dim3 num_of_blocks, threads_per_block;
+    configure_kernel_execution(region, num_of_blocks, threads_per_block);
     // Invoke CUDA kernel
-    map_kernel<<<num_of_blocks_, threads_per_block_, 0, stream>>>(out_mat,
-                                                                image_msg_property_,
-                                                                parameters_);
+    if (layout == PixelLayout::kPlanar16) {
+        map_planar_kernel<uint16_t, uint8_t><<<num_of_blocks, threads_per_block, 0, stream>>>(out,
+                                                                                          img_properties,
+                                                                                          params,
+                                                                                          region);
+    } else {
+        map_planar_kernel<float, uint16_t><<<num_of_blocks, threads_per_block, 0, stream>>>(out,
+                                                                                         img_properties,
+                                                                                         params,
+                                                                                         region);
+    }
 }
 
-void JuliaSet::compute_julia_set_pipeline(
-    size_t curr_iteration, float & current_angle, float * image, const cudaStream_t & stream)
+void julia_set_iteration_planar(
+    size_t curr_iteration, size_t iteration_count, uint8_t * image, PixelLayout layout,
+    const ImageMsgProperties & img_properties, const JuliaSetParams & params,
+    const ImageRegion & region, const cudaStream_t & stream)
 {
-    parameters_.kCurrentAngle = current_angle;
+    dim3 num_of_blocks, threads_per_block;
+    configure_kernel_execution(region, num_of_blocks, threads_per_block);
     // Invoke CUDA kernel
-    julia_set_kernel<<<num_of_blocks_, threads_per_block_, 0, stream>>>(curr_iteration,
-                                                                    image,
-                                                                    image,
-                                                                    image_msg_property_,
-                                                                    parameters_);
-  
+    if (layout == PixelLayout::kPlanar16) {
+        julia_set_planar_kernel<uint16_t, uint8_t><<<num_of_blocks, threads_per_block, 0, stream>>>(curr_iteration,
+                                                                                                iteration_count,
+                                                                                                image,
+                                                                                                img_properties,
+                                                                                                params,
+                                                                                                region);
+    } else {
+        julia_set_planar_kernel<float, uint16_t><<<num_of_blocks, threads_per_block, 0, stream>>>(curr_iteration,
+                                                                                               iteration_count,
+                                                                                               image,
+                                                                                               img_properties,
+                                                                                               params,
+                                                                                               region);
+    }
 }
 
-void JuliaSet::colorize(
-    uint8_t * output, const float * input, const cudaStream_t & stream)
+void colorize_planar(
+    uint8_t * output, const uint8_t * input, PixelLayout layout,
+    const ImageMsgProperties & img_properties, const JuliaSetParams & params, const float * lut,
+    const ImageRegion & region, const cudaStream_t & stream)
 {
+    dim3 num_of_blocks, threads_per_block;
+    configure_kernel_execution(region, num_of_blocks, threads_per_block);
     // Invoke CUDA kernel
-    colorize_kernel<<<num_of_blocks_, threads_per_block_, 0, stream>>>(output,
-                                                                    input,
-                                                                    image_msg_property_,
-                                                                    parameters_);
+    if (layout == PixelLayout::kPlanar16) {
+        colorize_planar_kernel<uint16_t, uint8_t><<<num_of_blocks, threads_per_block, 0, stream>>>(output,
+                                                                                               input,
+                                                                                               img_properties,
+                                                                                               params,
+                                                                                               lut,
+                                                                                               region);
+    } else {
+        colorize_planar_kernel<float, uint16_t><<<num_of_blocks, threads_per_block, 0, stream>>>(output,
+                                                                                              input,
+                                                                                              img_properties,
+                                                                                              params,
+                                                                                              lut,
+                                                                                              region);
+    }
 }
 
+}  // namespace cuda
 }  // namespace julia_set
 }  // namespace type_adaptation
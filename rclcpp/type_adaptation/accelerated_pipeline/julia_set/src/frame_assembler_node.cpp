@@ -0,0 +1,225 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "julia_set/frame_assembler_node.hpp"
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "julia_set/julia_set_handles.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
+#include "type_adapters/backend.hpp"
+#include "type_adapters/image_container.hpp"
+#include "type_adapters/memory_parameters.hpp"
+#include "type_adapters/nvtx.hpp"
+
+namespace type_adaptation
+{
+namespace julia_set
+{
+
+FrameAssemblerNode::FrameAssemblerNode(rclcpp::NodeOptions options)
+: rclcpp::Node("frame_assembler_node", options.use_intra_process_comms(true)),
+  type_adaptation_enabled_(declare_parameter<bool>("type_adaptation_enabled", true))
+{
+  RCLCPP_INFO(
+    get_logger(), "Setting up Frame Assembler node with adaptation enabled: %s",
+    type_adaptation_enabled_ ? "YES" : "NO");
+
+  memory_backend_ = example_type_adapters::declare_memory_backend(*this);
+
+  // Frames whose last tiles were dropped on the way make room for newer ones.
+  max_pending_frames_ = static_cast<size_t>(
+    std::max<int64_t>(declare_parameter<int64_t>("max_pending_frames", 2), 1));
+
+  // ColorizeNode publishes the tiles of a frame one after the other, the queue holds those
+  // MapNode has on their way.
+  const int64_t height = declare_parameter<int64_t>("height", 0);
+  const int64_t width = declare_parameter<int64_t>("width", 0);
+  const uint32_t stream_tile_height = static_cast<uint32_t>(
+    std::max<int64_t>(declare_parameter<int64_t>("stream_tile_height", 0), 0));
+  const uint32_t stream_tile_width = static_cast<uint32_t>(
+    std::max<int64_t>(declare_parameter<int64_t>("stream_tile_width", 0), 0));
+  const size_t queue_depth = stream_tiles_in_flight(
+    stream_tile_height, stream_tile_width,
+    declare_parameter<int64_t>("stream_tiles_in_flight", kDefaultStreamTilesInFlight));
+  ImageGeometry geometry;
+  if (stream_tiles_from_parameters(height, width, stream_tile_height, stream_tile_width) > 1 &&
+    geometry_from_parameters(
+      height, width, pixel_layout_encoding(PixelLayout::kInterleaved), geometry))
+  {
+    // The frame being assembled and the one published before it.
+    example_type_adapters::get_backend(memory_backend_)->buffer_pool().reserve(
+      color_image_properties(geometry.height, geometry.width).row_step * geometry.height, 2);
+  }
+
+  // Stages of a fixed chain in one process may hand frames over through pipeline links instead,
+  // and the next stage takes them on a thread of its own rather than through the executor.
+  const std::string link_in = declare_parameter<std::string>("link_in", "");
+  const std::string link_out = declare_parameter<std::string>("link_out", "");
+  const example_type_adapters::PipelineLinkOptions link_options =
+    example_type_adapters::declare_pipeline_link_options(*this, queue_depth);
+
+  // Tile placements only travel intra-process, through pipeline links and through shared memory,
+  // sensor_msgs images pass through as whole frames.
+  if (!link_in.empty()) {
+    // Subscribed to once the node is set up, at the end.
+  } else if (declare_parameter<bool>("shared_memory_in", false)) {
+    shared_image_sub_ = std::make_shared<example_type_adapters::SharedImageSubscription>(
+      *this, "image_in", queue_depth,
+      std::bind(&FrameAssemblerNode::AssembleCallbackCustomType, this, std::placeholders::_1),
+      memory_backend_);
+  } else if (type_adaptation_enabled_) {
+    custom_type_sub_ = create_subscription<type_adaptation::example_type_adapters::ImageContainer>(
+      "image_in", queue_depth,
+      std::bind(&FrameAssemblerNode::AssembleCallbackCustomType, this, std::placeholders::_1));
+  } else {
+    sub_ =
+      create_subscription<sensor_msgs::msg::Image>(
+      "image_in", queue_depth,
+      std::bind(&FrameAssemblerNode::AssembleCallback, this, std::placeholders::_1));
+  }
+
+  if (!link_out.empty()) {
+    link_pub_ = std::make_shared<example_type_adapters::PipelineLinkPublisher>(
+      *this, link_out, link_options);
+  } else if (declare_parameter<bool>("shared_memory_out", false)) {
+    shared_image_pub_ = std::make_shared<example_type_adapters::SharedImagePublisher>(
+      *this, "image_out", 1);
+  } else if (type_adaptation_enabled_) {
+    custom_type_pub_ = create_publisher<type_adaptation::example_type_adapters::ImageContainer>(
+      "image_out", 1);
+  } else {
+    pub_ = create_publisher<sensor_msgs::msg::Image>("image_out", 1);
+  }
+
+  // Frames come in on the thread of the link from here on.
+  if (!link_in.empty()) {
+    link_sub_ = std::make_shared<example_type_adapters::PipelineLinkSubscription>(
+      *this, link_in,
+      std::bind(&FrameAssemblerNode::AssembleCallbackCustomType, this, std::placeholders::_1),
+      link_options);
+  }
+}
+
+void FrameAssemblerNode::AssembleCallbackCustomType(
+  std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image_container)
+{
+  nvtxRangePushA("FrameAssemblerNode: AssembleCallbackCustomType");
+  Assemble(std::move(image_container));
+  nvtxRangePop();
+}
+
+void FrameAssemblerNode::AssembleCallback(std::unique_ptr<sensor_msgs::msg::Image> image_msg)
+{
+  nvtxRangePushA("FrameAssemblerNode: AssembleCallback");
+  Assemble(
+    std::make_unique<type_adaptation::example_type_adapters::ImageContainer>(
+      std::move(image_msg),
+      type_adaptation::example_type_adapters::get_backend(memory_backend_)->create_stream()));
+  nvtxRangePop();
+}
+
+void FrameAssemblerNode::Assemble(
+  std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image)
+{
+  const auto tile = image->tile();
+  if (tile.count == 0) {
+    PublishImage(std::move(image));
+    return;
+  }
+  if (tile.index >= tile.count || tile.x >= tile.frame_width ||
+    tile.y >= tile.frame_height || image->width() > tile.frame_width - tile.x ||
+    image->height() > tile.frame_height - tile.y)
+  {
+    RCLCPP_WARN(
+      get_logger(), "Tile %u of %u does not fit its frame, dropped", tile.index, tile.count);
+    return;
+  }
+
+  const int64_t stamp = rclcpp::Time(image->header().stamp).nanoseconds();
+  auto pending = pending_frames_.find(stamp);
+  if (pending != pending_frames_.end() &&
+    (pending->second.image.width() != tile.frame_width ||
+    pending->second.image.height() != tile.frame_height ||
+    pending->second.tile_count != tile.count))
+  {
+    RCLCPP_WARN(get_logger(), "Tiles of another frame with the same stamp, frame dropped");
+    pending_frames_.erase(pending);
+    pending = pending_frames_.end();
+  }
+  if (pending == pending_frames_.end()) {
+    while (pending_frames_.size() >= max_pending_frames_) {
+      const PendingFrame & oldest = pending_frames_.begin()->second;
+      RCLCPP_WARN(
+        get_logger(), "Frame missing %u of %u tiles dropped",
+        oldest.tile_count - oldest.received, oldest.tile_count);
+      pending_frames_.erase(pending_frames_.begin());
+    }
+    PendingFrame frame;
+    frame.image = ColorImage(
+      image->header(), tile.frame_height, tile.frame_width, image->stream());
+    frame.tile_count = tile.count;
+    frame.received_tiles.assign(tile.count, false);
+    pending = pending_frames_.emplace(stamp, std::move(frame)).first;
+  }
+
+  PendingFrame & frame = pending->second;
+  if (frame.received_tiles[tile.index]) {
+    // Only distinct tiles count towards the frame, or a resent one would publish it incomplete.
+    RCLCPP_WARN(get_logger(), "Tile %u of %u received twice, dropped", tile.index, tile.count);
+    return;
+  }
+  try {
+    nvtxRangePushA("FrameAssemblerNode: CopyTile");
+    frame.image.container().view(tile.x, tile.y, image->width(), image->height())
+    .copy_from(*image);
+    nvtxRangePop();
+  } catch (const std::invalid_argument & error) {
+    nvtxRangePop();
+    RCLCPP_WARN(get_logger(), "Tile %u of %u dropped: %s", tile.index, tile.count, error.what());
+    return;
+  }
+  frame.received_tiles[tile.index] = true;
+  frame.received = frame.received + 1;
+  if (frame.received < frame.tile_count) {
+    return;
+  }
+  auto out = frame.image.release_container();
+  pending_frames_.erase(pending);
+  PublishImage(std::move(out));
+}
+
+void FrameAssemblerNode::PublishImage(
+  std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image)
+{
+  if (link_pub_) {
+    link_pub_->publish(std::move(image));
+  } else if (shared_image_pub_) {
+    shared_image_pub_->publish(std::move(image));
+  } else if (custom_type_pub_) {
+    custom_type_pub_->publish(std::move(image));
+  } else {
+    // Convert in-place before publishing to "disable" type adaptation
+    pub_->publish(image->release_sensor_msgs_image());
+  }
+}
+
+}  // namespace julia_set
+}  // namespace type_adaptation
+
+RCLCPP_COMPONENTS_REGISTER_NODE(type_adaptation::julia_set::FrameAssemblerNode)
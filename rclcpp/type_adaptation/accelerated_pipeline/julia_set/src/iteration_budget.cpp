@@ -0,0 +1,83 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "julia_set/iteration_budget.hpp"
+
+#include <algorithm>
+
+namespace type_adaptation
+{
+namespace julia_set
+{
+namespace
+{
+// Frames with a new budget before it is changed again, the first ones are still in flight
+// through queues that filled up under the old one.
+const size_t kSettleFrames = 4;
+// Weight of the last frame in the average frame time is 1 / kSmoothing.
+const int64_t kSmoothing = 4;
+// The budget is cut to meet this fraction of the deadline, so that it is not missed again right
+// away, and is raised again below the next one.
+const double kCutTarget = 0.9;
+const double kRaiseBelow = 0.75;
+}  // namespace
+
+IterationBudgetController::IterationBudgetController(
+  std::chrono::nanoseconds deadline, size_t min_iterations, size_t max_iterations)
+: deadline_(deadline),
+  min_iterations_(std::max<size_t>(std::min(min_iterations, max_iterations), 1)),
+  max_iterations_(std::max(max_iterations, min_iterations_)),
+  budget_(max_iterations_)
+{
+}
+
+bool
+IterationBudgetController::update(std::chrono::nanoseconds stamp, std::chrono::nanoseconds now)
+{
+  const std::chrono::nanoseconds frame_time = now - stamp;
+  ++frames_;
+  if (frame_time > deadline_) {
+    ++deadline_misses_;
+  }
+  if (stamp < budget_since_) {
+    return false;
+  }
+
+  frame_time_ = samples_ == 0 ?
+    frame_time : frame_time_ + (frame_time - frame_time_) / kSmoothing;
+  if (++samples_ < kSettleFrames) {
+    return false;
+  }
+
+  size_t budget = budget_;
+  if (frame_time_ > deadline_) {
+    // The time of a frame grows with the iterations, if less than in proportion to them.
+    const double scale = kCutTarget * deadline_.count() / frame_time_.count();
+    budget = std::min(budget_ - 1, static_cast<size_t>(budget_ * scale));
+  } else if (frame_time_.count() < kRaiseBelow * deadline_.count()) {
+    budget = budget_ + std::max<size_t>(budget_ / 8, 1);
+  }
+  budget = std::min(std::max(budget, min_iterations_), max_iterations_);
+  if (budget == budget_) {
+    return false;
+  }
+  budget_ = budget;
+  budget_since_ = now;
+  samples_ = 0;
+  return true;
+}
+
+}  // namespace julia_set
+}  // namespace type_adaptation
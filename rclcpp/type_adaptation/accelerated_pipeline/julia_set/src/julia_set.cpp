@@ -0,0 +1,517 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "julia_set/cuda/julia_set.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "julia_set/cpu/julia_set_kernels.hpp"
+#include "julia_set/cpu/tile_engine.hpp"
+#include "type_adapters/backend.hpp"
+#ifdef TYPE_ADAPTERS_USE_CUDA
+#include "julia_set/cuda/julia_set_kernels.hpp"
+#include "type_adapters/cuda_backend.hpp"
+#endif
+
+namespace type_adaptation
+{
+namespace julia_set
+{
+#ifdef TYPE_ADAPTERS_USE_CUDA
+namespace
+{
+bool use_cuda(const JuliaSet::StreamWrapper & stream)
+{
+  return stream.backend_type() == type_adaptation::example_type_adapters::BackendType::kCuda;
+}
+}  // namespace
+#endif
+
+JuliaSet::JuliaSet(
+  ImageMsgProperties img_properties, JuliaSetParams parameters, CpuTiling tiling,
+  PixelLayout layout)
+: image_msg_property_{img_properties},
+  parameters_{parameters},
+  tiling_{tiling},
+  layout_{layout}
+{
+}
+
+void JuliaSet::compute_julia_set_composite(
+  float & current_angle, uint8_t * image, StreamWrapper & stream)
+{
+  compute_julia_set_composite(current_angle, image, ImageRegion{}, stream);
+}
+
+void JuliaSet::compute_julia_set_composite(
+  float & current_angle, uint8_t * image, const ImageRegion & region, StreamWrapper & stream)
+{
+  parameters_.kCurrentAngle = current_angle;
+  const ImageRegion resolved =
+    resolve(region, image_msg_property_.row_step, image_msg_property_.row_step);
+#ifdef TYPE_ADAPTERS_USE_CUDA
+  if (use_cuda(stream)) {
+    cuda::julia_set_composite(
+      image, image_msg_property_, parameters_, color_lut(stream), resolved,
+      example_type_adapters::cuda_stream(stream));
+    return;
+  }
+#endif
+  stream.synchronize();
+  const float * lut = color_lut(stream);
+  run_cpu(
+    resolved, image_msg_property_.color_step, image_msg_property_.color_step,
+    [&](const ImageRegion & tile, size_t, size_t out_offset) {
+      cpu::julia_set_composite(image + out_offset, image_msg_property_, parameters_, lut, tile);
+    });
+}
+
+void JuliaSet::map(void * out_mat, StreamWrapper & stream)
+{
+  map(out_mat, ImageRegion{}, stream);
+}
+
+void JuliaSet::map(void * out_mat, const ImageRegion & region, StreamWrapper & stream)
+{
+  const ImageRegion resolved = resolve(region, 0, layout_row_step());
+  uint8_t * out = static_cast<uint8_t *>(out_mat);
+#ifdef TYPE_ADAPTERS_USE_CUDA
+  if (use_cuda(stream)) {
+    if (layout_ == PixelLayout::kInterleaved) {
+      cuda::map(
+        reinterpret_cast<float *>(out), image_msg_property_, parameters_, resolved,
+        example_type_adapters::cuda_stream(stream));
+    } else {
+      cuda::map_planar(
+        out, layout_, image_msg_property_, parameters_, resolved,
+        example_type_adapters::cuda_stream(stream));
+    }
+    return;
+  }
+#endif
+  stream.synchronize();
+  run_cpu(
+    resolved, 0, layout_pixel_bytes(),
+    [&](const ImageRegion & tile, size_t, size_t out_offset) {
+      if (layout_ == PixelLayout::kInterleaved) {
+        cpu::map(
+          reinterpret_cast<float *>(out + out_offset), image_msg_property_, parameters_, tile);
+      } else {
+        cpu::map_planar(out + out_offset, layout_, image_msg_property_, parameters_, tile);
+      }
+    });
+}
+
+void JuliaSet::compute_julia_set_pipeline(
+  size_t curr_iteration, float & current_angle, void * image, StreamWrapper & stream)
+{
+  compute_julia_set_pipeline(curr_iteration, current_angle, image, ImageRegion{}, stream);
+}
+
+void JuliaSet::compute_julia_set_pipeline(
+  size_t curr_iteration, float & current_angle, void * image, const ImageRegion & region,
+  StreamWrapper & stream)
+{
+  compute_julia_set_stage(curr_iteration, 1, current_angle, image, region, stream);
+}
+
+void JuliaSet::compute_julia_set_stage(
+  size_t curr_iteration, size_t iteration_count, float & current_angle, void * image,
+  const ImageRegion & region, StreamWrapper & stream)
+{
+  parameters_.kCurrentAngle = current_angle;
+  const ImageRegion resolved = resolve(region, layout_row_step(), layout_row_step());
+  uint8_t * pixels = static_cast<uint8_t *>(image);
+#ifdef TYPE_ADAPTERS_USE_CUDA
+  if (use_cuda(stream)) {
+    if (layout_ == PixelLayout::kInterleaved) {
+      cuda::julia_set_iteration(
+        curr_iteration, iteration_count, reinterpret_cast<float *>(pixels),
+        image_msg_property_, parameters_, resolved, example_type_adapters::cuda_stream(stream));
+    } else {
+      cuda::julia_set_iteration_planar(
+        curr_iteration, iteration_count, pixels, layout_, image_msg_property_, parameters_,
+        resolved, example_type_adapters::cuda_stream(stream));
+    }
+    return;
+  }
+#endif
+  stream.synchronize();
+  run_cpu(
+    resolved, layout_pixel_bytes(), layout_pixel_bytes(),
+    [&](const ImageRegion & tile, size_t in_offset, size_t) {
+      if (layout_ == PixelLayout::kInterleaved) {
+        cpu::julia_set_iteration(
+          curr_iteration, iteration_count, reinterpret_cast<float *>(pixels + in_offset),
+          image_msg_property_, parameters_, tile);
+      } else {
+        cpu::julia_set_iteration_planar(
+          curr_iteration, iteration_count, pixels + in_offset, layout_, image_msg_property_,
+          parameters_, tile);
+      }
+    });
+}
+
+void JuliaSet::compute_julia_set_stages(
+  size_t curr_iteration, const std::vector<StageJob> & jobs)
+{
+  // Tile of one image of the batch, with the parameters of its angle.
+  struct BatchTile
+  {
+    const StageJob * job;
+    const JuliaSetParams * params;
+    ImageRegion tile;
+    size_t in_offset;
+  };
+  std::vector<JuliaSetParams> params(jobs.size(), parameters_);
+  std::vector<BatchTile> tiles;
+  for (size_t index = 0; index < jobs.size(); ++index) {
+    const StageJob & job = jobs[index];
+    params[index].kCurrentAngle = job.angle;
+    const ImageRegion resolved = resolve(job.region, layout_row_step(), layout_row_step());
+#ifdef TYPE_ADAPTERS_USE_CUDA
+    if (use_cuda(*job.stream)) {
+      float angle = job.angle;
+      compute_julia_set_stage(
+        curr_iteration, job.iteration_count, angle, job.image, resolved, *job.stream);
+      continue;
+    }
+#endif
+    job.stream->synchronize();
+    // One thread runs each image whole, like run_cpu().
+    const bool whole = tiling_.thread_count == 1;
+    const unsigned int tile_width =
+      tiling_.tile_width && !whole ? tiling_.tile_width : resolved.width;
+    const unsigned int tile_height =
+      tiling_.tile_height && !whole ? tiling_.tile_height : resolved.height;
+    for (unsigned int rows = 0; rows < resolved.height; rows += tile_height) {
+      for (unsigned int cols = 0; cols < resolved.width; cols += tile_width) {
+        ImageRegion tile = resolved;
+        tile.x = resolved.x + cols;
+        tile.y = resolved.y + rows;
+        tile.width = std::min(tile_width, resolved.width - cols);
+        tile.height = std::min(tile_height, resolved.height - rows);
+        tiles.push_back(
+          BatchTile{&job, &params[index], tile,
+            rows * resolved.in_row_step + cols * layout_pixel_bytes()});
+      }
+    }
+  }
+
+  const auto run_tile = [this, curr_iteration](const BatchTile & batch_tile) {
+      uint8_t * pixels = static_cast<uint8_t *>(batch_tile.job->image) + batch_tile.in_offset;
+      if (layout_ == PixelLayout::kInterleaved) {
+        cpu::julia_set_iteration(
+          curr_iteration, batch_tile.job->iteration_count, reinterpret_cast<float *>(pixels),
+          image_msg_property_, *batch_tile.params, batch_tile.tile);
+      } else {
+        cpu::julia_set_iteration_planar(
+          curr_iteration, batch_tile.job->iteration_count, pixels, layout_, image_msg_property_,
+          *batch_tile.params, batch_tile.tile);
+      }
+    };
+  tile_timings_.clear();
+  if (tiling_.thread_count == 1 || tiles.empty()) {
+    for (const BatchTile & batch_tile : tiles) {
+      run_tile(batch_tile);
+    }
+    return;
+  }
+  if (!tile_engine_) {
+    tile_engine_ = cpu::TileEngine::shared(tiling_.thread_count);
+  }
+  // The tiles of all images are the pixels of a list, one per tile.
+  ImageRegion list;
+  list.width = static_cast<unsigned int>(tiles.size());
+  list.height = 1;
+  tile_engine_->run(
+    list, 1, 1,
+    [&](const ImageRegion & entry) {
+      run_tile(tiles[entry.x]);
+    });
+}
+
+JuliaSet::PixelList JuliaSet::compute_julia_set_stage(
+  size_t curr_iteration, size_t iteration_count, float & current_angle, void * image,
+  const ImageRegion & region, const PixelList & active, StreamWrapper & stream)
+{
+  if (layout_ != PixelLayout::kInterleaved) {
+    compute_julia_set_stage(
+      curr_iteration, iteration_count, current_angle, image, region, stream);
+    return PixelList();
+  }
+  parameters_.kCurrentAngle = current_angle;
+  float * pixels = static_cast<float *>(image);
+  const ImageRegion resolved = resolve(region, layout_row_step(), layout_row_step());
+  const uint32_t pixel_count = resolved.width * resolved.height;
+  // Lists of every stage are as large as the first, so that they reuse the same buffers of the
+  // pool, and the count of one on the device need not be read back.
+  PixelList active_out(
+    *example_type_adapters::get_backend(stream.backend_type()),
+    active ? active.capacity() : pixel_count);
+#ifdef TYPE_ADAPTERS_USE_CUDA
+  if (use_cuda(stream)) {
+    cuda::julia_set_iteration_active(
+      curr_iteration, iteration_count, pixels, image_msg_property_, parameters_, resolved,
+      active ? active.data() : nullptr, active_out.capacity(), active_out.data(),
+      example_type_adapters::cuda_stream(stream));
+    return active_out;
+  }
+#endif
+  stream.synchronize();
+  const uint32_t count = active ? active.data()[0] : pixel_count;
+  const uint32_t * indices = active ? active.data() + 1 : nullptr;
+  active_out.data()[0] = static_cast<uint32_t>(
+    run_cpu_list(
+      resolved, count, active_out.data() + 1,
+      [&](size_t first, size_t run, uint32_t * run_out) {
+        return cpu::julia_set_iteration_active(
+          curr_iteration, iteration_count, pixels, image_msg_property_, parameters_, resolved,
+          indices, first, run, run_out);
+      }));
+  return active_out;
+}
+
+void JuliaSet::downsample(
+  const void * image, const ImageRegion & region, unsigned int scale, void * coarse,
+  StreamWrapper & stream)
+{
+  if (layout_ != PixelLayout::kInterleaved) {
+    throw std::invalid_argument("Progressive rendering needs the interleaved pixel layout");
+  }
+  const ImageRegion resolved = resolve(region, layout_row_step(), layout_row_step());
+#ifdef TYPE_ADAPTERS_USE_CUDA
+  if (use_cuda(stream)) {
+    cuda::downsample(
+      static_cast<const float *>(image), resolved, scale, static_cast<float *>(coarse),
+      example_type_adapters::cuda_stream(stream));
+    return;
+  }
+#endif
+  stream.synchronize();
+  // Only one in scale * scale pixels, not worth the threads.
+  cpu::downsample(
+    static_cast<const float *>(image), resolved, scale, static_cast<float *>(coarse));
+}
+
+JuliaSet::PixelList JuliaSet::refine(
+  void * image, const ImageRegion & region, unsigned int scale, const void * coarse,
+  StreamWrapper & stream)
+{
+  if (layout_ != PixelLayout::kInterleaved) {
+    throw std::invalid_argument("Progressive rendering needs the interleaved pixel layout");
+  }
+  float * pixels = static_cast<float *>(image);
+  const float * coarse_pixels = static_cast<const float *>(coarse);
+  const ImageRegion resolved = resolve(region, layout_row_step(), layout_row_step());
+  const uint32_t pixel_count = resolved.width * resolved.height;
+  // As large as the lists of compute_julia_set_stage() on the whole region.
+  PixelList active(*example_type_adapters::get_backend(stream.backend_type()), pixel_count);
+#ifdef TYPE_ADAPTERS_USE_CUDA
+  if (use_cuda(stream)) {
+    cuda::refine(
+      pixels, resolved, scale, coarse_pixels, active.capacity(), active.data(),
+      example_type_adapters::cuda_stream(stream));
+    return active;
+  }
+#endif
+  stream.synchronize();
+  active.data()[0] = static_cast<uint32_t>(
+    run_cpu_list(
+      resolved, pixel_count, active.data() + 1,
+      [&](size_t first, size_t run, uint32_t * run_out) {
+        return cpu::refine(pixels, resolved, scale, coarse_pixels, first, run, run_out);
+      }));
+  return active;
+}
+
+void JuliaSet::colorize(
+  uint8_t * output, const void * input, StreamWrapper & stream)
+{
+  colorize(output, input, ImageRegion{}, stream);
+}
+
+void JuliaSet::colorize(
+  uint8_t * output, const void * input, const ImageRegion & region, StreamWrapper & stream)
+{
+  const ImageRegion resolved = resolve(region, layout_row_step(), image_msg_property_.row_step);
+  const uint8_t * pixels = static_cast<const uint8_t *>(input);
+#ifdef TYPE_ADAPTERS_USE_CUDA
+  if (use_cuda(stream)) {
+    if (layout_ == PixelLayout::kInterleaved) {
+      cuda::colorize(
+        output, reinterpret_cast<const float *>(pixels), image_msg_property_, parameters_,
+        color_lut(stream), resolved, example_type_adapters::cuda_stream(stream));
+    } else {
+      cuda::colorize_planar(
+        output, pixels, layout_, image_msg_property_, parameters_, color_lut(stream), resolved,
+        example_type_adapters::cuda_stream(stream));
+    }
+    return;
+  }
+#endif
+  stream.synchronize();
+  const float * lut = color_lut(stream);
+  run_cpu(
+    resolved, layout_pixel_bytes(), image_msg_property_.color_step,
+    [&](const ImageRegion & tile, size_t in_offset, size_t out_offset) {
+      if (layout_ == PixelLayout::kInterleaved) {
+        cpu::colorize(
+          output + out_offset, reinterpret_cast<const float *>(pixels + in_offset),
+          image_msg_property_, parameters_, lut, tile);
+      } else {
+        cpu::colorize_planar(
+          output + out_offset, pixels + in_offset, layout_, image_msg_property_, parameters_,
+          lut, tile);
+      }
+    });
+}
+
+void JuliaSet::warm_up(StreamWrapper & stream)
+{
+  color_lut(stream);
+#ifdef TYPE_ADAPTERS_USE_CUDA
+  if (use_cuda(stream)) {
+    return;
+  }
+#endif
+  if (tiling_.thread_count != 1 && !tile_engine_) {
+    tile_engine_ = cpu::TileEngine::shared(tiling_.thread_count);
+  }
+}
+
+const char * JuliaSet::cpu_vector_extension()
+{
+  return cpu::vector_extension();
+}
+
+const float * JuliaSet::color_lut(StreamWrapper & stream)
+{
+  const size_t lut_size = kColorLutPlanes * cpu::color_lut_entries(parameters_);
+#ifdef TYPE_ADAPTERS_USE_CUDA
+  if (use_cuda(stream)) {
+    if (!cuda_color_lut_ || cuda_color_lut_iterations_ != parameters_.kMaxIterations) {
+      cuda_color_lut_ = example_type_adapters::get_backend(stream.backend_type())->allocate(
+        lut_size * sizeof(float));
+      cuda::color_lut(
+        parameters_, reinterpret_cast<float *>(cuda_color_lut_->device_memory()),
+        example_type_adapters::cuda_stream(stream));
+      // Later frames may come on other streams.
+      stream.synchronize();
+      cuda_color_lut_iterations_ = parameters_.kMaxIterations;
+    }
+    return reinterpret_cast<const float *>(cuda_color_lut_->device_memory());
+  }
+#else
+  static_cast<void>(stream);
+#endif
+  if (color_lut_.size() != lut_size || color_lut_iterations_ != parameters_.kMaxIterations) {
+    color_lut_.resize(lut_size);
+    cpu::color_lut(parameters_, color_lut_.data());
+    color_lut_iterations_ = parameters_.kMaxIterations;
+  }
+  return color_lut_.data();
+}
+
+ImageRegion JuliaSet::resolve(
+  const ImageRegion & region, size_t default_in_row_step, size_t default_out_row_step) const
+{
+  ImageRegion resolved = region;
+  if (resolved.width == 0 || resolved.height == 0) {
+    resolved.width = image_msg_property_.width - resolved.x;
+    resolved.height = image_msg_property_.height - resolved.y;
+  }
+  if (resolved.in_row_step == 0) {
+    resolved.in_row_step = default_in_row_step;
+  }
+  if (resolved.out_row_step == 0) {
+    resolved.out_row_step = default_out_row_step;
+  }
+  return resolved;
+}
+
+template<typename Kernel>
+void JuliaSet::run_cpu(
+  const ImageRegion & region, size_t in_pixel_bytes, size_t out_pixel_bytes,
+  const Kernel & kernel)
+{
+  if (tiling_.thread_count == 1) {
+    tile_timings_.clear();
+    kernel(region, 0, 0);
+    return;
+  }
+  if (!tile_engine_) {
+    tile_engine_ = cpu::TileEngine::shared(tiling_.thread_count);
+  }
+  tile_engine_->run(
+    region, tiling_.tile_width, tiling_.tile_height,
+    [&](const ImageRegion & tile) {
+      const size_t rows = tile.y - region.y;
+      const size_t cols = tile.x - region.x;
+      kernel(
+        tile, rows * region.in_row_step + cols * in_pixel_bytes,
+        rows * region.out_row_step + cols * out_pixel_bytes);
+    },
+    &tile_timings_);
+}
+
+template<typename Kernel>
+size_t JuliaSet::run_cpu_list(
+  const ImageRegion & region, size_t count, uint32_t * active_out, const Kernel & kernel)
+{
+  if (tiling_.thread_count == 1 || count == 0) {
+    tile_timings_.clear();
+    return kernel(0, count, active_out);
+  }
+  if (!tile_engine_) {
+    tile_engine_ = cpu::TileEngine::shared(tiling_.thread_count);
+  }
+  // Runs of as many pixels as a tile of the region has.
+  const size_t run_length = std::max<size_t>(
+    static_cast<size_t>(tiling_.tile_width ? tiling_.tile_width : region.width) *
+    (tiling_.tile_height ? tiling_.tile_height : region.height), 1);
+  std::vector<size_t> kept((count + run_length - 1) / run_length);
+  ImageRegion list;
+  list.width = static_cast<unsigned int>(count);
+  list.height = 1;
+  tile_engine_->run(
+    list, static_cast<unsigned int>(std::min(run_length, count)), 1,
+    [&](const ImageRegion & run) {
+      kept[run.x / run_length] = kernel(run.x, run.width, active_out + run.x);
+    },
+    &tile_timings_);
+
+  size_t total = 0;
+  for (size_t run = 0; run < kept.size(); ++run) {
+    std::memmove(active_out + total, active_out + run * run_length, kept[run] * sizeof(uint32_t));
+    total += kept[run];
+  }
+  return total;
+}
+
+size_t JuliaSet::layout_row_step() const
+{
+  return pixel_layout_row_step(layout_, image_msg_property_.width);
+}
+
+size_t JuliaSet::layout_pixel_bytes() const
+{
+  return layout_ == PixelLayout::kInterleaved ? kFloatChannels * sizeof(float) : 0;
+}
+
+}  // namespace julia_set
+}  // namespace type_adaptation
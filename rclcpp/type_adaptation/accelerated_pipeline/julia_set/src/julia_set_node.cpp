@@ -12,33 +12,79 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include <nvToolsExt.h>  // NOLINT
-
 #include "julia_set/julia_set_node.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
 #include <cmath>
+#include <cstring>
 #include <memory>
+#include <stdexcept>
+#include <string>
 #include <utility>
+#include <vector>
 
+#include "julia_set/julia_set_images.hpp"
 #include "rclcpp/rclcpp.hpp"
 #include "rclcpp_components/register_node_macro.hpp"
-#include "sensor_msgs/image_encodings.hpp"
+#include "type_adapters/backend.hpp"
 #include "type_adapters/image_container.hpp"
+#include "type_adapters/memory_parameters.hpp"
+#include "type_adapters/nvtx.hpp"
 
 namespace type_adaptation
 {
 namespace julia_set
 {
+namespace
+{
+// Mix value into hash, as boost::hash_combine does.
+void hash_combine(uint64_t & hash, uint64_t value)
+{
+  hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+}
+
+void hash_combine(uint64_t & hash, float value)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  hash_combine(hash, static_cast<uint64_t>(bits));
+}
+}  // namespace
 
 JuliaSetNode::JuliaSetNode(rclcpp::NodeOptions options)
 : rclcpp::Node("julia_set_node", options.use_intra_process_comms(true)),
   type_adaptation_enabled_(declare_parameter<bool>("type_adaptation_enabled", true)),
   proc_id_(declare_parameter<uint8_t>("proc_id", 1)),
-  is_initialized{false}
+  iterations_per_stage_(static_cast<size_t>(
+      std::max<int64_t>(declare_parameter<int64_t>("iterations_per_stage", 1), 1))),
+  compact_active_pixels_(declare_parameter<bool>("compact_active_pixels", false)),
+  batch_size_(static_cast<size_t>(
+      std::max<int64_t>(declare_parameter<int64_t>("batch_size", 1), 1))),
+  julia_set_handles_(std::bind(&JuliaSetNode::CreateHandle, this, std::placeholders::_1)),
+  preview_handles_(std::bind(&JuliaSetNode::CreateHandle, this, std::placeholders::_1))
 {
   RCLCPP_INFO(
     get_logger(), "Setting up Julia Set node with adaptation enabled: %s",
     type_adaptation_enabled_ ? "YES" : "NO");
 
+  memory_backend_ = example_type_adapters::declare_memory_backend(*this);
+  RCLCPP_INFO(
+    get_logger(), "Using memory backend: %s",
+    example_type_adapters::to_string(memory_backend_).c_str());
+  if (memory_backend_ == example_type_adapters::BackendType::kHost) {
+    RCLCPP_INFO(
+      get_logger(), "CPU kernels vector extension: %s", JuliaSet::cpu_vector_extension());
+  }
+
+  // CPU kernels split frames into tiles, worked through by a thread pool shared by the process.
+  cpu_tiling_.thread_count = static_cast<unsigned int>(
+    std::max<int64_t>(declare_parameter<int64_t>("cpu_threads", 0), 0));
+  cpu_tiling_.tile_width = static_cast<unsigned int>(
+    std::max<int64_t>(declare_parameter<int64_t>("tile_width", 128), 0));
+  cpu_tiling_.tile_height = static_cast<unsigned int>(
+    std::max<int64_t>(declare_parameter<int64_t>("tile_height", 32), 0));
+
   julia_set_params_.kMinXRange = declare_parameter<float>("min_x_range", -2.5);
   julia_set_params_.kMaxXRange = declare_parameter<float>("max_x_range", 2.5);
   julia_set_params_.kMinYRange = declare_parameter<float>("min_y_range", -1.5);
@@ -48,114 +94,531 @@ JuliaSetNode::JuliaSetNode(rclcpp::NodeOptions options)
   julia_set_params_.kBoundaryRadius = declare_parameter<float>("boundary_radius", 16.0);
   julia_set_params_.kMaxIterations = declare_parameter<int>("max_iterations", 50);
 
-  if (type_adaptation_enabled_) {
+  // The animation repeats every 360 frames, so its frames can be served from a cache once they
+  // were computed.
+  const int64_t frame_cache_bytes = declare_parameter<int64_t>("frame_cache_bytes", 0);
+  const int64_t frame_cache_spill_bytes = declare_parameter<int64_t>("frame_cache_spill_bytes", 0);
+  const std::string frame_cache_spill_directory =
+    declare_parameter<std::string>("frame_cache_spill_directory", "");
+  if (frame_cache_bytes > 0 ||
+    (frame_cache_spill_bytes > 0 && !frame_cache_spill_directory.empty()))
+  {
+    frame_cache_ = std::make_unique<example_type_adapters::FrameCache>(
+      static_cast<size_t>(std::max<int64_t>(frame_cache_bytes, 0)),
+      static_cast<size_t>(std::max<int64_t>(frame_cache_spill_bytes, 0)),
+      frame_cache_spill_directory);
+  }
+
+  // The first stage may render a coarse preview of each frame, later stages only compute the
+  // blocks the preview does not resolve.
+  const int64_t progressive_scale = declare_parameter<int64_t>("progressive_scale", 0);
+  if (progressive_scale > 1 && proc_id_ != 1) {
+    RCLCPP_WARN(get_logger(), "Only the first stage renders progressively, proc_id is not 1");
+  } else if (progressive_scale > 1) {
+    progressive_scale_ = static_cast<unsigned int>(progressive_scale);
+    if (type_adaptation_enabled_) {
+      custom_type_preview_pub_ =
+        create_publisher<type_adaptation::example_type_adapters::ImageContainer>(
+        "image_preview", 1);
+    } else {
+      preview_pub_ = create_publisher<sensor_msgs::msg::Image>("image_preview", 1);
+    }
+  }
+
+  // Frames queue up to a batch, which waits no longer than batch_timeout_ms for its last ones.
+  const double batch_timeout_ms = declare_parameter<double>("batch_timeout_ms", 10.0);
+  if (batch_size_ > 1) {
+    batch_.reserve(batch_size_);
+    batch_timer_ = create_wall_timer(
+      std::chrono::duration<double, std::milli>(std::max(batch_timeout_ms, 0.0)),
+      std::bind(&JuliaSetNode::BatchTimeout, this));
+    batch_timer_->cancel();
+  }
+
+  // Given the resolution and encoding of the input, the first frame finds the handles and the
+  // buffers of the stage ready. Frames streamed in tiles take the handles of the tile sizes,
+  // those of the tiles at the right and bottom edges included.
+  const int64_t height = declare_parameter<int64_t>("height", 0);
+  const int64_t width = declare_parameter<int64_t>("width", 0);
+  const std::string encoding = declare_parameter<std::string>(
+    "encoding", pixel_layout_encoding(PixelLayout::kInterleaved));
+  const uint32_t stream_tile_height = static_cast<uint32_t>(
+    std::max<int64_t>(declare_parameter<int64_t>("stream_tile_height", 0), 0));
+  const uint32_t stream_tile_width = static_cast<uint32_t>(
+    std::max<int64_t>(declare_parameter<int64_t>("stream_tile_width", 0), 0));
+  const bool stream_tiles = stream_tile_height != 0 && stream_tile_width != 0;
+  if (stream_tiles) {
+    julia_set_handles_.set_capacity(4);
+  }
+  ImageGeometry geometry;
+  if (geometry_from_parameters(height, width, encoding, geometry)) {
+    if (stream_tiles) {
+      geometry.height = std::min(geometry.height, stream_tile_height);
+      geometry.width = std::min(geometry.width, stream_tile_width);
+    }
+    WarmUp(geometry);
+  } else if (height != 0 || width != 0) {
+    RCLCPP_WARN(
+      get_logger(), "Invalid resolution %" PRId64 "x%" PRId64 " or encoding %s, the handle is "
+      "built on the first frame", width, height, encoding.c_str());
+  }
+
+  // The queue holds a batch, or the tiles MapNode has on their way.
+  const size_t queue_depth = std::max(
+    batch_size_,
+    stream_tiles_in_flight(
+      stream_tile_height, stream_tile_width,
+      declare_parameter<int64_t>("stream_tiles_in_flight", kDefaultStreamTilesInFlight)));
+
+  iteration_budget_sub_ = create_subscription<diagnostic_msgs::msg::DiagnosticArray>(
+    "iteration_budget", 1,
+    std::bind(&JuliaSetNode::IterationBudgetCallback, this, std::placeholders::_1));
+
+  // Stages of a fixed chain in one process may hand frames over through pipeline links instead,
+  // and the next stage takes them on a thread of its own rather than through the executor.
+  const std::string link_in = declare_parameter<std::string>("link_in", "");
+  const std::string link_out = declare_parameter<std::string>("link_out", "");
+  const example_type_adapters::PipelineLinkOptions link_options =
+    example_type_adapters::declare_pipeline_link_options(*this, queue_depth);
+
+  // A pipeline split across processes passes frames through shared memory where it is split.
+  if (!link_in.empty()) {
+    // Subscribed to once the node is set up, at the end.
+  } else if (declare_parameter<bool>("shared_memory_in", false)) {
+    shared_image_sub_ = std::make_shared<example_type_adapters::SharedImageSubscription>(
+      *this, "image_in", queue_depth,
+      std::bind(&JuliaSetNode::JuliaSetCallbackCustomType, this, std::placeholders::_1),
+      memory_backend_);
+  } else if (type_adaptation_enabled_) {
     custom_type_sub_ = create_subscription<type_adaptation::example_type_adapters::ImageContainer>(
-      "image_in", 1,
+      "image_in", queue_depth,
       std::bind(&JuliaSetNode::JuliaSetCallbackCustomType, this, std::placeholders::_1));
-    custom_type_pub_ = create_publisher<type_adaptation::example_type_adapters::ImageContainer>(
-      "image_out", 1);
   } else {
     sub_ =
       create_subscription<sensor_msgs::msg::Image>(
-      "image_in", 1, std::bind(&JuliaSetNode::JuliaSetCallback, this, std::placeholders::_1));
-    pub_ = create_publisher<sensor_msgs::msg::Image>("image_out", 1);
+      "image_in", queue_depth,
+      std::bind(&JuliaSetNode::JuliaSetCallback, this, std::placeholders::_1));
+    // A transfer worker may convert each message while the frame before is computed.
+    if (declare_parameter<bool>("double_buffered_ingest", false)) {
+      ingest_ = std::make_unique<example_type_adapters::ImageIngest>(memory_backend_);
+      ingest_timer_ = create_wall_timer(
+        std::chrono::duration<double, std::milli>(
+          std::max(declare_parameter<double>("ingest_timeout_ms", 50.0), 0.0)),
+        std::bind(&JuliaSetNode::FlushIngest, this));
+      ingest_timer_->cancel();
+    }
+  }
+
+  if (!link_out.empty()) {
+    link_pub_ = std::make_shared<example_type_adapters::PipelineLinkPublisher>(
+      *this, link_out, link_options);
+  } else if (declare_parameter<bool>("shared_memory_out", false)) {
+    shared_image_pub_ = std::make_shared<example_type_adapters::SharedImagePublisher>(
+      *this, "image_out", queue_depth);
+  } else if (type_adaptation_enabled_) {
+    custom_type_pub_ = create_publisher<type_adaptation::example_type_adapters::ImageContainer>(
+      "image_out", queue_depth);
+  } else {
+    pub_ = create_publisher<sensor_msgs::msg::Image>("image_out", queue_depth);
+  }
+
+  // Frames come in on the thread of the link from here on.
+  if (!link_in.empty()) {
+    link_sub_ = std::make_shared<example_type_adapters::PipelineLinkSubscription>(
+      *this, link_in,
+      std::bind(&JuliaSetNode::JuliaSetCallbackCustomType, this, std::placeholders::_1),
+      link_options);
   }
 }
 
 void JuliaSetNode::JuliaSetCallbackCustomType(
-  std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image)
+  std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image_container)
 {
   nvtxRangePushA("JuliaSetNode: JuliaSetCallbackCustomType");
-  if (!is_initialized) {
-    img_property_.row_step = image->step();
-    img_property_.height = image->height();
-    img_property_.width = image->width();
-    img_property_.encoding = image->encoding();
-
-    if (image->encoding() == sensor_msgs::image_encodings::RGB8) {
-      img_property_.red_offset = 0;
-      img_property_.green_offset = 1;
-      img_property_.blue_offset = 2;
-      img_property_.color_step = 3;
-    } else if (image->encoding() == sensor_msgs::image_encodings::BGR8) {
-      img_property_.blue_offset = 0;
-      img_property_.green_offset = 1;
-      img_property_.red_offset = 2;
-      img_property_.color_step = 3;
-    } else if (image->encoding() == sensor_msgs::image_encodings::MONO8) {
-      img_property_.red_offset = 0;
-      img_property_.green_offset = 0;
-      img_property_.blue_offset = 0;
-      img_property_.color_step = 1;
-    }
+  ProcessImage(std::move(image_container));
+  nvtxRangePop();
+}
 
-    julia_set_params_.kMaxColRange = image->width();
-    julia_set_params_.kMaxRowRange = image->height();
-    julia_set_handle_ = std::make_unique<JuliaSet>(img_property_, julia_set_params_);
+void JuliaSetNode::JuliaSetCallback(std::unique_ptr<sensor_msgs::msg::Image> image_msg)
+{
+  nvtxRangePushA("JuliaSetNode: JuliaSetCallback");
+  if (ingest_) {
+    // The frame before is computed while this one is converted.
+    ingest_->push(
+      std::move(image_msg), std::bind(&JuliaSetNode::ProcessImage, this, std::placeholders::_1));
+    ingest_timer_->reset();
+    RCLCPP_INFO_THROTTLE(
+      get_logger(), *get_clock(), 5000, "Ingest overlap efficiency: %.2f",
+      ingest_->statistics().overlap_efficiency());
+  } else {
+    ProcessImage(
+      std::make_unique<type_adaptation::example_type_adapters::ImageContainer>(
+        std::move(image_msg),
+        type_adaptation::example_type_adapters::get_backend(memory_backend_)->create_stream()));
+  }
+  nvtxRangePop();
+}
+
+void JuliaSetNode::ProcessImage(
+  std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image)
+{
+  if (batch_size_ > 1) {
+    QueueFrame(std::move(image));
+  } else {
+    ComputeStage(*image);
 
-    is_initialized = true;
+    PublishImage(std::move(image));
   }
+}
 
-  if (counter_ == SIZE_MAX) {counter_ = 0;}
-  float angle = (counter_ % 360) * M_PI / 180.0;
-  counter_ = counter_ + 1;
+void JuliaSetNode::FlushIngest()
+{
+  // Subscriptions and the timer share the default callback group, so they never run at once.
+  ingest_timer_->cancel();
+  ingest_->flush(std::bind(&JuliaSetNode::ProcessImage, this, std::placeholders::_1));
+}
+
+void JuliaSetNode::QueueFrame(
+  std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image)
+{
+  // Frames come in on the thread of a pipeline link, if any, and the timer fires on the executor.
+  std::lock_guard<std::mutex> lock(batch_mutex_);
+  batch_.push_back(std::move(image));
+  if (batch_.size() >= batch_size_) {
+    FlushBatch();
+  } else if (batch_.size() == 1) {
+    // The latency cap runs from the first frame of the batch on.
+    batch_timer_->reset();
+  }
+}
 
-  julia_set_handle_->compute_julia_set_pipeline(
-    proc_id_, angle, reinterpret_cast<float *>(image->cuda_mem()), image->cuda_stream()->stream());
+void JuliaSetNode::BatchTimeout()
+{
+  std::lock_guard<std::mutex> lock(batch_mutex_);
+  FlushBatch();
+}
 
-  custom_type_pub_->publish(std::move(image));
+void JuliaSetNode::FlushBatch()
+{
+  batch_timer_->cancel();
+  if (batch_.empty()) {
+    return;
+  }
+  nvtxRangePushA("JuliaSetNode: FlushBatch");
+  std::vector<std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer>> images;
+  images.swap(batch_);
+  batch_.reserve(batch_size_);
+  ComputeStages(images);
+  // In the order the frames came in.
+  for (auto & image : images) {
+    PublishImage(std::move(image));
+  }
   nvtxRangePop();
 }
 
-void JuliaSetNode::JuliaSetCallback(std::unique_ptr<sensor_msgs::msg::Image> image_msg)
+void JuliaSetNode::IterationBudgetCallback(
+  std::unique_ptr<diagnostic_msgs::msg::DiagnosticArray> diagnostics)
 {
-  nvtxRangePushA("JuliaSetNode: JuliaSetCallback");
-  std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image =
-    std::make_unique<type_adaptation::example_type_adapters::ImageContainer>(std::move(image_msg));
-  if (!is_initialized) {
-    img_property_.row_step = image->step();
-    img_property_.height = image->height();
-    img_property_.width = image->width();
-    img_property_.encoding = image->encoding();
-
-    if (image->encoding() == sensor_msgs::image_encodings::RGB8) {
-      img_property_.red_offset = 0;
-      img_property_.green_offset = 1;
-      img_property_.blue_offset = 2;
-      img_property_.color_step = 3;
-    } else if (image->encoding() == sensor_msgs::image_encodings::BGR8) {
-      img_property_.blue_offset = 0;
-      img_property_.green_offset = 1;
-      img_property_.red_offset = 2;
-      img_property_.color_step = 3;
-    } else if (image->encoding() == sensor_msgs::image_encodings::MONO8) {
-      img_property_.red_offset = 0;
-      img_property_.green_offset = 0;
-      img_property_.blue_offset = 0;
-      img_property_.color_step = 1;
+  for (const auto & status : diagnostics->status) {
+    for (const auto & value : status.values) {
+      if (value.key != "iteration_budget") {
+        continue;
+      }
+      size_t budget;
+      try {
+        budget = std::stoull(value.value);
+      } catch (const std::logic_error &) {
+        RCLCPP_WARN(get_logger(), "Invalid iteration budget %s", value.value.c_str());
+        return;
+      }
+      std::lock_guard<std::mutex> lock(iteration_budget_mutex_);
+      if (budget != iteration_budget_) {
+        previous_iteration_budget_ = iteration_budget_;
+        iteration_budget_ = budget;
+        iteration_budget_since_ = rclcpp::Time(diagnostics->header.stamp).nanoseconds();
+      }
+      return;
     }
+  }
+}
 
-    julia_set_params_.kMaxColRange = image->width();
-    julia_set_params_.kMaxRowRange = image->height();
-    julia_set_handle_ = std::make_unique<JuliaSet>(img_property_, julia_set_params_);
+size_t JuliaSetNode::IterationBudget(const std_msgs::msg::Header & header)
+{
+  std::lock_guard<std::mutex> lock(iteration_budget_mutex_);
+  const size_t budget = rclcpp::Time(header.stamp).nanoseconds() >= iteration_budget_since_ ?
+    iteration_budget_ : previous_iteration_budget_;
+  return std::min(budget, julia_set_params_.kMaxIterations);
+}
 
-    is_initialized = true;
+size_t JuliaSetNode::StageIterations(const std_msgs::msg::Header & header)
+{
+  const size_t budget = IterationBudget(header);
+  // Stages run iterations proc_id_ on, up to the budget like up to kMaxIterations.
+  if (budget <= proc_id_) {
+    return 0;
   }
+  return std::min(iterations_per_stage_, budget - proc_id_);
+}
 
-  if (counter_ == SIZE_MAX) {counter_ = 0;}
-  float angle = (counter_ % 360) * M_PI / 180.0;
-  counter_ = counter_ + 1;
+void JuliaSetNode::ComputeStage(type_adaptation::example_type_adapters::ImageContainer & image)
+{
+  StageFrame frame;
+  if (!BeginStage(image, frame)) {
+    return;
+  }
+  RunStage(image, frame);
+  EndStage(image, frame);
+}
 
-  julia_set_handle_->compute_julia_set_pipeline(
-    proc_id_, angle, reinterpret_cast<float *>(image->cuda_mem()), image->cuda_stream()->stream());
+void JuliaSetNode::ComputeStages(
+  std::vector<std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer>> & images)
+{
+  std::vector<StageFrame> frames(images.size());
+  std::vector<bool> computed(images.size(), false);
+  std::vector<StageJob> jobs;
+  for (size_t index = 0; index < images.size(); ++index) {
+    auto & image = *images[index];
+    // The handle of a new geometry replaces the one the batch so far runs on.
+    if (!jobs.empty() && geometry_of(image) != julia_set_handles_.geometry()) {
+      julia_set_handles_.current()->compute_julia_set_stages(proc_id_, jobs);
+      jobs.clear();
+    }
+    if (!BeginStage(image, frames[index])) {
+      continue;
+    }
+    computed[index] = true;
+    // Active pixel lists are produced frame by frame.
+    if (compact_active_pixels_ || progressive_scale_ > 1) {
+      RunStage(image, frames[index]);
+      continue;
+    }
+    StageJob job;
+    // Writable access may clone the image onto a new stream, so it comes before stream().
+    job.image = image.data();
+    job.region = region_of(image, image.step(), image.step());
+    job.angle = frames[index].angle;
+    job.iteration_count = frames[index].iteration_count;
+    job.stream = image.stream().get();
+    jobs.push_back(job);
+  }
+  if (!jobs.empty()) {
+    julia_set_handles_.current()->compute_julia_set_stages(proc_id_, jobs);
+  }
+  for (size_t index = 0; index < images.size(); ++index) {
+    if (computed[index]) {
+      EndStage(*images[index], frames[index]);
+    }
+  }
+}
+
+bool JuliaSetNode::BeginStage(
+  type_adaptation::example_type_adapters::ImageContainer & image, StageFrame & frame)
+{
+  // MapNode picks the layout, the handle follows it and the resolution.
+  julia_set_handles_.get(geometry_of(image));
 
-  // Convert in-place before publishing to "disable" type adaptation
-  sensor_msgs::msg::Image image_msg_out;
-  image->get_sensor_msgs_image(image_msg_out);
-  pub_->publish(std::move(image_msg_out));
+  // The tiles of a frame share its angle, which moves on with the next frame.
+  const auto & tile = image.tile();
+  const int64_t stamp = rclcpp::Time(image.header().stamp).nanoseconds();
+  if (tile.count == 0 || stamp != tile_frame_stamp_) {
+    if (counter_ == SIZE_MAX) {counter_ = 0;}
+    angle_index_ = counter_ % 360;
+    counter_ = counter_ + 1;
+  }
+  tile_frame_stamp_ = tile.count == 0 ? INT64_MIN : stamp;
+  frame.angle_index = angle_index_;
+  frame.angle = frame.angle_index * M_PI / 180.0;
+
+  frame.iteration_count = StageIterations(image.header());
+  if (frame.iteration_count == 0) {
+    // Beyond the budget, the frame passes through as it is.
+    return false;
+  }
+  // Frames cut short by the budget are not the ones the cache holds for their angle, and frames
+  // of an unknown grid, e.g. received as a sensor_msgs::msg::Image, may not be of its grid.
+  frame.use_frame_cache = frame_cache_ && frame.iteration_count == iterations_per_stage_ &&
+    image.source_generation() != 0;
+
+  if (frame.use_frame_cache) {
+    const uint64_t generation = FrameCacheGeneration(image);
+    if (generation != frame_cache_generation_) {
+      frame_cache_->clear();
+      frame_cache_generation_ = generation;
+    }
+    frame.frame_cache_key = FrameCacheKey(image, frame.angle_index);
+    example_type_adapters::ImageContainer cached;
+    // Tiles of another size at the same index were cut from frames of other stream tiles.
+    if (frame_cache_->find(frame.frame_cache_key, cached) &&
+      cached.height() == image.height() && cached.width() == image.width())
+    {
+      cached.header() = image.header();
+      cached.set_tile(tile);
+      image = std::move(cached);
+      return false;
+    }
+  }
+  return true;
+}
+
+void JuliaSetNode::RunStage(
+  type_adaptation::example_type_adapters::ImageContainer & image, StageFrame & frame)
+{
+  // Writable access may clone the image onto a new stream, so it comes before stream().
+  uint8_t * pixels = image.data();
+  const ImageRegion region = region_of(image, image.step(), image.step());
+  JuliaSet & julia_set_handle = *julia_set_handles_.current();
+  // A preview of a tile is no preview of the frame, tiles are computed in full.
+  const bool progressive = progressive_scale_ > 1 &&
+    julia_set_handle.layout() == PixelLayout::kInterleaved && image.tile().count == 0;
+  if (progressive) {
+    image.set_active_pixels(RenderPreview(image, frame.angle, IterationBudget(image.header())));
+  }
+  if (!compact_active_pixels_ && !progressive) {
+    julia_set_handle.compute_julia_set_stage(
+      proc_id_, frame.iteration_count, frame.angle, pixels, region, *image.stream());
+  } else {
+    // Later stages only visit the pixels that are still active after this one.
+    image.set_active_pixels(
+      julia_set_handle.compute_julia_set_stage(
+        proc_id_, frame.iteration_count, frame.angle, pixels, region, image.active_pixels(),
+        *image.stream()));
+  }
+}
+
+void JuliaSetNode::EndStage(
+  const type_adaptation::example_type_adapters::ImageContainer & image, const StageFrame & frame)
+{
+  if (frame.use_frame_cache) {
+    // The cached copy outlives the tile, it must not hold its place in the window of MapNode.
+    type_adaptation::example_type_adapters::ImageContainer cached(image);
+    auto tile = cached.tile();
+    tile.in_flight.reset();
+    cached.set_tile(tile);
+    try {
+      frame_cache_->insert(frame.frame_cache_key, cached);
+    } catch (const std::runtime_error & error) {
+      RCLCPP_WARN(get_logger(), "Frame not cached: %s", error.what());
+    }
+  }
+}
+
+type_adaptation::example_type_adapters::PixelList JuliaSetNode::RenderPreview(
+  type_adaptation::example_type_adapters::ImageContainer & image, float angle,
+  size_t iteration_budget)
+{
+  nvtxRangePushA("JuliaSetNode: RenderPreview");
+  const uint32_t coarse_height = (image.height() + progressive_scale_ - 1) / progressive_scale_;
+  const uint32_t coarse_width = (image.width() + progressive_scale_ - 1) / progressive_scale_;
+  JuliaSet & preview_handle =
+    preview_handles_.get(ImageGeometry{coarse_height, coarse_width, PixelLayout::kInterleaved});
+  JuliaSet & julia_set_handle = *julia_set_handles_.current();
+
+  uint8_t * pixels = image.data();
+  const ImageRegion region = region_of(image, image.step(), image.step());
+  FloatImage coarse(image.header(), coarse_height, coarse_width, image.stream());
+  julia_set_handle.downsample(pixels, region, progressive_scale_, coarse.data(), *image.stream());
+  if (iteration_budget > proc_id_) {
+    preview_handle.compute_julia_set_stage(
+      proc_id_, iteration_budget - proc_id_, angle, coarse.data(), ImageRegion{},
+      *image.stream());
+  }
+
+  ColorImage preview(image.header(), coarse_height, coarse_width, image.stream());
+  preview_handle.colorize(preview.data(), coarse.cdata(), *image.stream());
+  if (custom_type_preview_pub_) {
+    custom_type_preview_pub_->publish(preview.release_container());
+  } else {
+    preview_pub_->publish(preview.release_container()->release_sensor_msgs_image());
+  }
+
+  auto active = julia_set_handle.refine(
+    pixels, region, progressive_scale_, coarse.cdata(), *image.stream());
+  nvtxRangePop();
+  return active;
+}
+
+std::unique_ptr<JuliaSet> JuliaSetNode::CreateHandle(const ImageGeometry & geometry) const
+{
+  JuliaSetParams params = julia_set_params_;
+  params.kMaxColRange = geometry.width;
+  params.kMaxRowRange = geometry.height;
+  return std::make_unique<JuliaSet>(
+    color_image_properties(geometry.height, geometry.width), params, cpu_tiling_,
+    geometry.layout);
+}
+
+void JuliaSetNode::WarmUp(const ImageGeometry & geometry)
+{
+  nvtxRangePushA("JuliaSetNode: WarmUp");
+  auto backend = example_type_adapters::get_backend(memory_backend_);
+  auto stream = backend->create_stream();
+  julia_set_handles_.get(geometry).warm_up(*stream);
+  if (progressive_scale_ > 1 && geometry.layout == PixelLayout::kInterleaved) {
+    preview_handles_.get(
+      ImageGeometry{
+        (geometry.height + progressive_scale_ - 1) / progressive_scale_,
+        (geometry.width + progressive_scale_ - 1) / progressive_scale_,
+        PixelLayout::kInterleaved}).warm_up(*stream);
+  }
+  // The first stage clones the grid of MapNode into a buffer of its own, the frames of a batch
+  // and the one published before them each take one.
+  backend->buffer_pool().reserve(
+    pixel_layout_row_step(geometry.layout, geometry.width) * geometry.height, batch_size_ + 1);
   nvtxRangePop();
 }
 
+uint64_t JuliaSetNode::FrameCacheGeneration(
+  const type_adaptation::example_type_adapters::ImageContainer & image) const
+{
+  // Frames computed with other parameters, from another grid, or of another resolution, are
+  // stale. The ranges of the grid are those of MapNode, which may change them at runtime, so
+  // the generation it stamped on the grid stands for them. Tiles are told apart by their keys,
+  // only the resolution of their frame and the number of tiles matter.
+  const auto & tile = image.tile();
+  uint64_t generation = 0;
+  hash_combine(
+    generation, static_cast<uint64_t>(tile.count == 0 ? image.width() : tile.frame_width));
+  hash_combine(
+    generation, static_cast<uint64_t>(tile.count == 0 ? image.height() : tile.frame_height));
+  hash_combine(generation, static_cast<uint64_t>(tile.count));
+  hash_combine(generation, static_cast<uint64_t>(julia_set_handles_.geometry().layout));
+  hash_combine(generation, static_cast<uint64_t>(proc_id_));
+  hash_combine(generation, static_cast<uint64_t>(iterations_per_stage_));
+  hash_combine(generation, static_cast<uint64_t>(compact_active_pixels_));
+  hash_combine(generation, image.source_generation());
+  hash_combine(generation, julia_set_params_.kStartX);
+  hash_combine(generation, julia_set_params_.kStartY);
+  hash_combine(generation, julia_set_params_.kBoundaryRadius);
+  hash_combine(generation, static_cast<uint64_t>(julia_set_params_.kMaxIterations));
+  return generation;
+}
+
+uint64_t JuliaSetNode::FrameCacheKey(
+  const type_adaptation::example_type_adapters::ImageContainer & image,
+  size_t angle_index) const
+{
+  const auto & tile = image.tile();
+  if (tile.count == 0) {
+    return angle_index;
+  }
+  return static_cast<uint64_t>(angle_index) * tile.count + tile.index;
+}
+
+void JuliaSetNode::PublishImage(
+  std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image)
+{
+  if (link_pub_) {
+    link_pub_->publish(std::move(image));
+  } else if (shared_image_pub_) {
+    shared_image_pub_->publish(std::move(image));
+  } else if (custom_type_pub_) {
+    custom_type_pub_->publish(std::move(image));
+  } else {
+    // Convert in-place before publishing to "disable" type adaptation
+    pub_->publish(image->release_sensor_msgs_image());
+  }
+}
+
 }  // namespace julia_set
 }  // namespace type_adaptation
 
@@ -12,16 +12,25 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include <nvToolsExt.h>  // NOLINT
-
 #include "julia_set/map_node.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <utility>
+#include <vector>
 
+#include "julia_set/julia_set_images.hpp"
 #include "rclcpp/rclcpp.hpp"
 #include "rclcpp_components/register_node_macro.hpp"
-#include "sensor_msgs/image_encodings.hpp"
+#include "type_adapters/backend.hpp"
 #include "type_adapters/image_container.hpp"
+#include "type_adapters/memory_parameters.hpp"
+#include "type_adapters/nvtx.hpp"
 
 namespace type_adaptation
 {
@@ -31,27 +40,163 @@ namespace julia_set
 MapNode::MapNode(rclcpp::NodeOptions options)
 : rclcpp::Node("map_node", options.use_intra_process_comms(true)),
   type_adaptation_enabled_(declare_parameter<bool>("type_adaptation_enabled", true)),
-  is_initialized{false}
+  julia_set_handles_(std::bind(&MapNode::CreateHandle, this, std::placeholders::_1))
 {
   RCLCPP_INFO(
     get_logger(), "Setting up Map node with adaptation enabled: %s",
     type_adaptation_enabled_ ? "YES" : "NO");
 
+  memory_backend_ = example_type_adapters::declare_memory_backend(*this);
+  RCLCPP_INFO(
+    get_logger(), "Using memory backend: %s",
+    example_type_adapters::to_string(memory_backend_).c_str());
+
+  // CPU kernels split frames into tiles, worked through by a thread pool shared by the process.
+  cpu_tiling_.thread_count = static_cast<unsigned int>(
+    std::max<int64_t>(declare_parameter<int64_t>("cpu_threads", 0), 0));
+  cpu_tiling_.tile_width = static_cast<unsigned int>(
+    std::max<int64_t>(declare_parameter<int64_t>("tile_width", 128), 0));
+  cpu_tiling_.tile_height = static_cast<unsigned int>(
+    std::max<int64_t>(declare_parameter<int64_t>("tile_height", 32), 0));
+
   julia_set_params_.kMinXRange = declare_parameter<double>("min_x_range", -2.5);
   julia_set_params_.kMaxXRange = declare_parameter<double>("max_x_range", 2.5);
   julia_set_params_.kMinYRange = declare_parameter<double>("min_y_range", -1.5);
   julia_set_params_.kMaxYRange = declare_parameter<double>("max_y_range", 1.5);
+  grid_generation_ = static_cast<uint64_t>(
+    std::chrono::steady_clock::now().time_since_epoch().count());
+
+  // Planar layouts take fewer bytes per pixel through the pipeline, as long as their escape
+  // iterations hold max_iterations.
+  const std::string pixel_layout = declare_parameter<std::string>("pixel_layout", "interleaved");
+  pixel_layout_ = pixel_layout_from_string(pixel_layout);
+  const int64_t max_iterations = declare_parameter<int64_t>("max_iterations", 50);
+  if (max_iterations > static_cast<int64_t>(max_escape_iteration(pixel_layout_))) {
+    RCLCPP_WARN(
+      get_logger(), "Pixel layout %s holds no more than %zu iterations, using interleaved",
+      pixel_layout.c_str(), max_escape_iteration(pixel_layout_));
+    pixel_layout_ = PixelLayout::kInterleaved;
+  }
+  RCLCPP_INFO(get_logger(), "Using pixel layout: %s", pixel_layout_encoding(pixel_layout_));
+
+  // Frames of very high resolutions may be streamed in tiles, which the stages after compute one
+  // by one and FrameAssemblerNode puts back together. No more than stream_tiles_in_flight tiles
+  // are on their way at a time, the next one is only computed once FrameAssemblerNode took one,
+  // or a queue dropped it.
+  stream_tile_height_ = static_cast<uint32_t>(
+    std::max<int64_t>(declare_parameter<int64_t>("stream_tile_height", 0), 0));
+  stream_tile_width_ = static_cast<uint32_t>(
+    std::max<int64_t>(declare_parameter<int64_t>("stream_tile_width", 0), 0));
+  if ((stream_tile_height_ == 0) != (stream_tile_width_ == 0)) {
+    RCLCPP_WARN(
+      get_logger(), "Stream tiles of %ux%u, both sides are needed, publishing whole frames",
+      stream_tile_width_, stream_tile_height_);
+    stream_tile_height_ = 0;
+    stream_tile_width_ = 0;
+  }
+
+  // Given the resolution of the input, the grid is computed before the first frame comes in.
+  // Tiles are computed for each frame instead, there is no grid of the frame to keep.
+  const int64_t height = declare_parameter<int64_t>("height", 0);
+  const int64_t width = declare_parameter<int64_t>("width", 0);
+  const size_t tiles_in_flight = stream_tiles_in_flight(
+    stream_tile_height_, stream_tile_width_,
+    declare_parameter<int64_t>("stream_tiles_in_flight", kDefaultStreamTilesInFlight));
+  ImageGeometry geometry;
+  if (stream_tile_width_ != 0) {
+    RCLCPP_INFO(
+      get_logger(), "Streaming frames in tiles of %ux%u, %zu of them in flight",
+      stream_tile_width_, stream_tile_height_, tiles_in_flight);
+    tile_window_ = std::make_unique<example_type_adapters::InFlightWindow>(tiles_in_flight);
+  } else if (geometry_from_parameters(
+      height, width, pixel_layout_encoding(pixel_layout_), geometry))
+  {
+    nvtxRangePushA("MapNode: PrepareGrid");
+    ComputeGrid(
+      geometry, example_type_adapters::get_backend(memory_backend_)->create_stream());
+    nvtxRangePop();
+  } else if (height != 0 || width != 0) {
+    RCLCPP_WARN(
+      get_logger(), "Invalid resolution %" PRId64 "x%" PRId64 ", the grid is computed on the "
+      "first frame", width, height);
+  }
+  // The ranges can change at runtime, the grid is computed again for the next frame.
+  parameters_callback_ = add_on_set_parameters_callback(
+    std::bind(&MapNode::OnSetParameters, this, std::placeholders::_1));
+
+  // Stages of a fixed chain in one process may hand frames over through pipeline links instead,
+  // and the next stage takes them on a thread of its own rather than through the executor.
+  const std::string link_in = declare_parameter<std::string>("link_in", "");
+  const std::string link_out = declare_parameter<std::string>("link_out", "");
 
-  if (type_adaptation_enabled_) {
+  // A pipeline split across processes passes frames through shared memory where it is split.
+  if (!link_in.empty()) {
+    // Subscribed to once the node is set up, at the end.
+  } else if (declare_parameter<bool>("shared_memory_in", false)) {
+    shared_image_sub_ = std::make_shared<example_type_adapters::SharedImageSubscription>(
+      *this, "image_in", 1,
+      std::bind(&MapNode::MapCallbackCustomType, this, std::placeholders::_1), memory_backend_);
+  } else if (type_adaptation_enabled_) {
     custom_type_sub_ = create_subscription<type_adaptation::example_type_adapters::ImageContainer>(
       "image_in", 1, std::bind(&MapNode::MapCallbackCustomType, this, std::placeholders::_1));
-    custom_type_pub_ = create_publisher<type_adaptation::example_type_adapters::ImageContainer>(
-      "image_out", 1);
   } else {
     sub_ =
       create_subscription<sensor_msgs::msg::Image>(
       "image_in", 1, std::bind(&MapNode::MapCallback, this, std::placeholders::_1));
-    pub_ = create_publisher<sensor_msgs::msg::Image>("image_out", 1);
+    // A transfer worker may convert each message while the grid of the frame before is published.
+    if (declare_parameter<bool>("double_buffered_ingest", false)) {
+      ingest_ = std::make_unique<example_type_adapters::ImageIngest>(memory_backend_);
+      ingest_timer_ = create_wall_timer(
+        std::chrono::duration<double, std::milli>(
+          std::max(declare_parameter<double>("ingest_timeout_ms", 50.0), 0.0)),
+        std::bind(&MapNode::FlushIngest, this));
+      ingest_timer_->cancel();
+    }
+  }
+
+  // The queue holds the tiles on their way.
+  const size_t queue_depth = tiles_in_flight;
+  const example_type_adapters::PipelineLinkOptions link_options =
+    example_type_adapters::declare_pipeline_link_options(*this, queue_depth);
+  if (!link_out.empty()) {
+    link_pub_ = std::make_shared<example_type_adapters::PipelineLinkPublisher>(
+      *this, link_out, link_options);
+  } else if (declare_parameter<bool>("shared_memory_out", false)) {
+    shared_image_pub_ = std::make_shared<example_type_adapters::SharedImagePublisher>(
+      *this, "image_out", queue_depth);
+  } else if (type_adaptation_enabled_) {
+    custom_type_pub_ = create_publisher<type_adaptation::example_type_adapters::ImageContainer>(
+      "image_out", queue_depth);
+  } else {
+    pub_ = create_publisher<sensor_msgs::msg::Image>("image_out", queue_depth);
+  }
+
+  // Tiles are computed and published on a thread of their own, which waits for room in the window
+  // without holding up the executor.
+  if (tile_window_) {
+    tile_thread_ = std::thread(&MapNode::StreamTiles, this);
+  }
+
+  // Frames come in on the thread of the link from here on.
+  if (!link_in.empty()) {
+    link_sub_ = std::make_shared<example_type_adapters::PipelineLinkSubscription>(
+      *this, link_in,
+      std::bind(&MapNode::MapCallbackCustomType, this, std::placeholders::_1),
+      link_options);
+  }
+}
+
+MapNode::~MapNode()
+{
+  // The subscriptions may still call ProcessImage(), which only hands frames to the thread.
+  if (tile_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(tile_mutex_);
+      stop_tiles_ = true;
+    }
+    tile_condition_.notify_one();
+    tile_window_->close();
+    tile_thread_.join();
   }
 }
 
@@ -59,52 +204,229 @@ void MapNode::MapCallbackCustomType(
   std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image)
 {
   nvtxRangePushA("MapNode: MapCallbackCustomType");
-  if (!is_initialized) {
-    img_property_.height = image->height();
-    img_property_.width = image->width();
+  ProcessImage(std::move(image));
+  nvtxRangePop();
+}
+
+void MapNode::MapCallback(std::unique_ptr<sensor_msgs::msg::Image> image_msg)
+{
+  nvtxRangePushA("MapNode: MapCallback");
+  if (ingest_) {
+    ingest_->push(
+      std::move(image_msg), std::bind(&MapNode::ProcessImage, this, std::placeholders::_1));
+    ingest_timer_->reset();
+    RCLCPP_INFO_THROTTLE(
+      get_logger(), *get_clock(), 5000, "Ingest overlap efficiency: %.2f",
+      ingest_->statistics().overlap_efficiency());
+  } else {
+    ProcessImage(
+      std::make_unique<type_adaptation::example_type_adapters::ImageContainer>(
+        std::move(image_msg),
+        type_adaptation::example_type_adapters::get_backend(memory_backend_)->create_stream()));
+  }
+  nvtxRangePop();
+}
+
+void MapNode::ProcessImage(
+  std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image)
+{
+  if (tile_window_) {
+    {
+      std::lock_guard<std::mutex> lock(tile_mutex_);
+      if (pending_frame_) {
+        RCLCPP_WARN_THROTTLE(
+          get_logger(), *get_clock(), 1000,
+          "Frame dropped, the tiles of the frame before are still on their way");
+      }
+      pending_frame_ = std::move(image);
+    }
+    tile_condition_.notify_one();
+  } else {
+    PublishImage(
+      std::make_unique<type_adaptation::example_type_adapters::ImageContainer>(Grid(*image)));
+  }
+}
 
-    julia_set_params_.kMaxColRange = image->width();
-    julia_set_params_.kMaxRowRange = image->height();
+void MapNode::FlushIngest()
+{
+  // Subscriptions and the timer share the default callback group, so they never run at once.
+  ingest_timer_->cancel();
+  ingest_->flush(std::bind(&MapNode::ProcessImage, this, std::placeholders::_1));
+}
 
-    julia_set_handle_ = std::make_unique<JuliaSet>(img_property_, julia_set_params_);
-    is_initialized = true;
+type_adaptation::example_type_adapters::ImageContainer MapNode::Grid(
+  const type_adaptation::example_type_adapters::ImageContainer & image)
+{
+  std::lock_guard<std::mutex> lock(grid_mutex_);
+  if (grid_.height() != image.height() || grid_.width() != image.width()) {
+    // The grid of the resolution before is kept, in case the frames go back to it.
+    std::swap(grid_, spare_grid_);
+    if (grid_.height() != image.height() || grid_.width() != image.width()) {
+      nvtxRangePushA("MapNode: ComputeGrid");
+      ComputeGrid(ImageGeometry{image.height(), image.width(), pixel_layout_}, image.stream());
+      nvtxRangePop();
+    }
   }
 
-  auto out = std::make_unique<type_adaptation::example_type_adapters::ImageContainer>(
-    image->header(), image->height(), image->width(), image->encoding(),
-    image->step() * sizeof(float), image->cuda_stream());
-  julia_set_handle_->map(reinterpret_cast<float *>(out->cuda_mem()), out->cuda_stream()->stream());
+  // Shares the memory of the grid, later stages clone it when they first write to it.
+  type_adaptation::example_type_adapters::ImageContainer out(grid_);
+  out.header() = image.header();
+  out.set_source_generation(grid_generation_);
+  return out;
+}
 
-  custom_type_pub_->publish(std::move(out));
-  nvtxRangePop();
+void MapNode::ComputeGrid(
+  const ImageGeometry & geometry,
+  std::shared_ptr<type_adaptation::example_type_adapters::StreamWrapper> stream)
+{
+  const uint32_t step =
+    static_cast<uint32_t>(pixel_layout_row_step(geometry.layout, geometry.width));
+  grid_ = type_adaptation::example_type_adapters::ImageContainer(
+    std_msgs::msg::Header(), geometry.height, geometry.width,
+    pixel_layout_encoding(geometry.layout), step, std::move(stream));
+  julia_set_handles_.get(geometry).map(grid_.data(), region_of(grid_, 0, step), *grid_.stream());
 }
 
-void MapNode::MapCallback(std::unique_ptr<sensor_msgs::msg::Image> image_msg)
+void MapNode::StreamTiles()
 {
-  nvtxRangePushA("MapNode: MapCallback");
-  std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image =
-    std::make_unique<type_adaptation::example_type_adapters::ImageContainer>(std::move(image_msg));
-  if (!is_initialized) {
-    img_property_.height = image->height();
-    img_property_.width = image->width();
+  while (true) {
+    std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image;
+    {
+      std::unique_lock<std::mutex> lock(tile_mutex_);
+      tile_condition_.wait(lock, [this] {return stop_tiles_ || pending_frame_;});
+      if (stop_tiles_) {
+        return;
+      }
+      image = std::move(pending_frame_);
+    }
+    PublishTiles(*image);
+  }
+}
 
-    julia_set_params_.kMaxColRange = image->width();
-    julia_set_params_.kMaxRowRange = image->height();
+void MapNode::PublishTiles(const type_adaptation::example_type_adapters::ImageContainer & image)
+{
+  // The tiles of a frame are all of the same grid, even if the ranges change in between.
+  JuliaSetParams params;
+  uint64_t grid_generation = 0;
+  {
+    std::lock_guard<std::mutex> lock(grid_mutex_);
+    params = julia_set_params_;
+    grid_generation = grid_generation_;
+  }
+  const uint32_t count =
+    stream_tile_count(image.height(), image.width(), stream_tile_height_, stream_tile_width_);
+  for (uint32_t index = 0; index < count; ++index) {
+    std::shared_ptr<void> in_flight = tile_window_->acquire();
+    if (!in_flight) {
+      // The node is shutting down.
+      return;
+    }
+    nvtxRangePushA("MapNode: ComputeTile");
+    auto tile = stream_tile(
+      image.height(), image.width(), stream_tile_height_, stream_tile_width_, index);
+    const ImageGeometry geometry{
+      std::min(stream_tile_height_, image.height() - tile.y),
+      std::min(stream_tile_width_, image.width() - tile.x), pixel_layout_};
+    const uint32_t step =
+      static_cast<uint32_t>(pixel_layout_row_step(geometry.layout, geometry.width));
+    // Each tile takes a buffer of its own, which the stages after pass on down the pipeline.
+    auto out = std::make_unique<type_adaptation::example_type_adapters::ImageContainer>(
+      image.header(), geometry.height, geometry.width, pixel_layout_encoding(geometry.layout),
+      step, image.stream());
+    CreateTileHandle(geometry, tile, params)->map(
+      out->data(), region_of(*out, 0, step), *out->stream());
+    tile.in_flight = std::move(in_flight);
+    out->set_tile(tile);
+    out->set_source_generation(grid_generation);
+    nvtxRangePop();
+    PublishImage(std::move(out));
+  }
+}
 
-    julia_set_handle_ = std::make_unique<JuliaSet>(img_property_, julia_set_params_);
-    is_initialized = true;
+std::unique_ptr<JuliaSet> MapNode::CreateHandle(const ImageGeometry & geometry) const
+{
+  type_adaptation::example_type_adapters::TilePlacement frame;
+  frame.frame_width = geometry.width;
+  frame.frame_height = geometry.height;
+  return CreateTileHandle(geometry, frame, julia_set_params_);
+}
+
+std::unique_ptr<JuliaSet> MapNode::CreateTileHandle(
+  const ImageGeometry & geometry,
+  const type_adaptation::example_type_adapters::TilePlacement & tile,
+  const JuliaSetParams & ranges) const
+{
+  ImageMsgProperties properties;
+  properties.height = geometry.height;
+  properties.width = geometry.width;
+
+  // Pixels of the tile map to the coordinates of the pixels of the frame they are.
+  JuliaSetParams params = ranges;
+  params.kMinColRange = -static_cast<int64_t>(tile.x);
+  params.kMaxColRange = static_cast<int64_t>(tile.frame_width) - tile.x;
+  params.kMinRowRange = -static_cast<int64_t>(tile.y);
+  params.kMaxRowRange = static_cast<int64_t>(tile.frame_height) - tile.y;
+  return std::make_unique<JuliaSet>(properties, params, cpu_tiling_, geometry.layout);
+}
+
+rcl_interfaces::msg::SetParametersResult MapNode::OnSetParameters(
+  const std::vector<rclcpp::Parameter> & parameters)
+{
+  rcl_interfaces::msg::SetParametersResult result;
+  result.successful = true;
+
+  std::lock_guard<std::mutex> lock(grid_mutex_);
+  JuliaSetParams params = julia_set_params_;
+  for (const auto & parameter : parameters) {
+    float * range = nullptr;
+    if (parameter.get_name() == "min_x_range") {
+      range = &params.kMinXRange;
+    } else if (parameter.get_name() == "max_x_range") {
+      range = &params.kMaxXRange;
+    } else if (parameter.get_name() == "min_y_range") {
+      range = &params.kMinYRange;
+    } else if (parameter.get_name() == "max_y_range") {
+      range = &params.kMaxYRange;
+    } else {
+      continue;
+    }
+    if (parameter.get_type() != rclcpp::ParameterType::PARAMETER_DOUBLE) {
+      result.successful = false;
+      result.reason = parameter.get_name() + " must be a double";
+      return result;
+    }
+    *range = static_cast<float>(parameter.as_double());
   }
 
-  auto out = std::make_unique<type_adaptation::example_type_adapters::ImageContainer>(
-    image->header(), image->height(), image->width(), image->encoding(),
-    image->step() * sizeof(float), image->cuda_stream());
-  julia_set_handle_->map(reinterpret_cast<float *>(out->cuda_mem()), out->cuda_stream()->stream());
+  if (params.kMinXRange != julia_set_params_.kMinXRange ||
+    params.kMaxXRange != julia_set_params_.kMaxXRange ||
+    params.kMinYRange != julia_set_params_.kMinYRange ||
+    params.kMaxYRange != julia_set_params_.kMaxYRange)
+  {
+    julia_set_params_ = params;
+    // Caches of later stages keyed on the generation of the old grid no longer match.
+    grid_generation_ = grid_generation_ + 1;
+    // Frames already published keep the memory of the old grid.
+    julia_set_handles_.reset();
+    grid_ = type_adaptation::example_type_adapters::ImageContainer();
+    spare_grid_ = type_adaptation::example_type_adapters::ImageContainer();
+  }
+  return result;
+}
 
-  // Convert in-place before publishing to "disable" type adaptation
-  sensor_msgs::msg::Image image_msg_out;
-  out->get_sensor_msgs_image(image_msg_out);
-  pub_->publish(std::move(image_msg_out));
-  nvtxRangePop();
+void MapNode::PublishImage(
+  std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image)
+{
+  if (link_pub_) {
+    link_pub_->publish(std::move(image));
+  } else if (shared_image_pub_) {
+    shared_image_pub_->publish(std::move(image));
+  } else if (custom_type_pub_) {
+    custom_type_pub_->publish(std::move(image));
+  } else {
+    // Convert in-place before publishing to "disable" type adaptation
+    pub_->publish(image->release_sensor_msgs_image());
+  }
 }
 
 }  // namespace julia_set
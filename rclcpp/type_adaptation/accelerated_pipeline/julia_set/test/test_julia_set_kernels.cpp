@@ -0,0 +1,223 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "julia_set/cpu/julia_set_kernels.hpp"
+#include "julia_set/cuda/julia_set.hpp"
+#include "julia_set/julia_set_images.hpp"
+#include "type_adapters/backend.hpp"
+#include "type_adapters/pixel_list.hpp"
+
+using type_adaptation::example_type_adapters::BackendType;
+using type_adaptation::example_type_adapters::MemoryWrapper;
+using type_adaptation::example_type_adapters::PixelList;
+using type_adaptation::example_type_adapters::StreamWrapper;
+using type_adaptation::example_type_adapters::get_backend;
+using type_adaptation::julia_set::CpuTiling;
+using type_adaptation::julia_set::ImageRegion;
+using type_adaptation::julia_set::JuliaSet;
+using type_adaptation::julia_set::JuliaSetParams;
+using type_adaptation::julia_set::PixelLayout;
+using type_adaptation::julia_set::StageJob;
+using type_adaptation::julia_set::color_image_properties;
+using type_adaptation::julia_set::pixel_layout_row_step;
+namespace cpu = type_adaptation::julia_set::cpu;
+
+namespace
+{
+// Odd sizes, so that rows end in pixels that fill no whole vector.
+const unsigned int kHeight = 37;
+const unsigned int kWidth = 53;
+const size_t kIterations = 50;
+const float kAngle = 0.7f;
+const float kOtherAngle = 2.1f;
+
+// How the iterations of a frame are run.
+enum class Variant
+{
+  kPipeline,  // One kernel per iteration, on one thread
+  kFused,  // All iterations in one kernel
+  kTiled,  // All iterations in one kernel, tile by tile on a thread pool
+  kActiveList,  // Two stages, the second on the pixels the first left active
+  kBatched,  // One batch with a frame of another angle
+};
+
+const char * variant_name(Variant variant)
+{
+  switch (variant) {
+    case Variant::kPipeline:
+      return "pipeline";
+    case Variant::kFused:
+      return "fused";
+    case Variant::kTiled:
+      return "tiled";
+    case Variant::kActiveList:
+      return "active list";
+    default:
+      return "batched";
+  }
+}
+
+// Escape iterations of a frame and its colors.
+struct Frame
+{
+  std::vector<uint8_t> pixels;
+  std::vector<uint8_t> colors;
+};
+
+JuliaSet make_handle(PixelLayout layout, const CpuTiling & tiling)
+{
+  JuliaSetParams params;
+  params.kMaxIterations = kIterations;
+  params.kMaxColRange = kWidth;
+  params.kMaxRowRange = kHeight;
+  return JuliaSet(color_image_properties(kHeight, kWidth), params, tiling, layout);
+}
+
+Frame compute(PixelLayout layout, Variant variant)
+{
+  CpuTiling tiling;
+  if (variant == Variant::kTiled || variant == Variant::kBatched) {
+    tiling.thread_count = 4;
+    tiling.tile_width = 16;
+    tiling.tile_height = 8;
+  }
+  JuliaSet handle = make_handle(layout, tiling);
+  auto backend = get_backend(BackendType::kHost);
+  auto stream = backend->create_stream();
+  const size_t bytes = pixel_layout_row_step(layout, kWidth) * kHeight;
+  auto image = backend->allocate(bytes);
+  handle.map(image->device_memory(), *stream);
+
+  float angle = kAngle;
+  switch (variant) {
+    case Variant::kPipeline:
+      for (size_t iteration = 0; iteration < kIterations; ++iteration) {
+        handle.compute_julia_set_pipeline(iteration, angle, image->device_memory(), *stream);
+      }
+      break;
+    case Variant::kFused:
+    case Variant::kTiled:
+      handle.compute_julia_set_stage(
+        0, kIterations, angle, image->device_memory(), ImageRegion{}, *stream);
+      break;
+    case Variant::kActiveList: {
+        const size_t first = kIterations / 3;
+        PixelList active = handle.compute_julia_set_stage(
+          0, first, angle, image->device_memory(), ImageRegion{}, PixelList(), *stream);
+        handle.compute_julia_set_stage(
+          first, kIterations - first, angle, image->device_memory(), ImageRegion{}, active,
+          *stream);
+        break;
+      }
+    case Variant::kBatched: {
+        auto other = backend->allocate(bytes);
+        handle.map(other->device_memory(), *stream);
+        auto other_stream = backend->create_stream();
+        std::vector<StageJob> jobs(2);
+        jobs[0] = StageJob{other->device_memory(), ImageRegion{}, kOtherAngle, kIterations,
+          other_stream.get()};
+        jobs[1] = StageJob{image->device_memory(), ImageRegion{}, kAngle, kIterations,
+          stream.get()};
+        handle.compute_julia_set_stages(0, jobs);
+        break;
+      }
+  }
+
+  Frame frame;
+  frame.pixels.assign(image->device_memory(), image->device_memory() + bytes);
+  frame.colors.resize(static_cast<size_t>(kHeight) * kWidth * 3);
+  handle.colorize(frame.colors.data(), image->device_memory(), *stream);
+  stream->synchronize();
+  return frame;
+}
+
+// Vector extensions of the kernels that this build and CPU can run.
+std::vector<std::string> vector_extensions()
+{
+  const std::string widest = cpu::vector_extension();
+  std::vector<std::string> extensions;
+  for (const char * extension : {"none", "AVX2", "AVX-512"}) {
+    if (cpu::set_vector_extension(extension)) {
+      extensions.push_back(extension);
+    }
+  }
+  cpu::set_vector_extension(widest);
+  return extensions;
+}
+
+class JuliaSetKernels : public ::testing::Test
+{
+protected:
+  void TearDown() override
+  {
+    cpu::set_vector_extension(widest_);
+  }
+
+  const std::string widest_{cpu::vector_extension()};
+};
+}  // namespace
+
+TEST_F(JuliaSetKernels, ScalarCodeIsAlwaysAvailable)
+{
+  EXPECT_TRUE(cpu::set_vector_extension("none"));
+  EXPECT_STREQ(cpu::vector_extension(), "none");
+  EXPECT_FALSE(cpu::set_vector_extension("SSE"));
+  EXPECT_STREQ(cpu::vector_extension(), "none");
+}
+
+TEST_F(JuliaSetKernels, VariantsAreBitIdenticalToTheScalarPipeline)
+{
+  ASSERT_TRUE(cpu::set_vector_extension("none"));
+  const Frame reference = compute(PixelLayout::kInterleaved, Variant::kPipeline);
+
+  for (const std::string & extension : vector_extensions()) {
+    ASSERT_TRUE(cpu::set_vector_extension(extension));
+    for (Variant variant :
+      {Variant::kPipeline, Variant::kFused, Variant::kTiled, Variant::kActiveList,
+        Variant::kBatched})
+    {
+      const Frame frame = compute(PixelLayout::kInterleaved, variant);
+      EXPECT_EQ(frame.pixels, reference.pixels) << extension << " " << variant_name(variant);
+      EXPECT_EQ(frame.colors, reference.colors) << extension << " " << variant_name(variant);
+    }
+  }
+}
+
+TEST_F(JuliaSetKernels, Planar32ColorsMatchTheInterleavedLayout)
+{
+  ASSERT_TRUE(cpu::set_vector_extension("none"));
+  const Frame reference = compute(PixelLayout::kInterleaved, Variant::kPipeline);
+  const Frame planar_reference = compute(PixelLayout::kPlanar32, Variant::kPipeline);
+  EXPECT_EQ(planar_reference.colors, reference.colors);
+
+  for (const std::string & extension : vector_extensions()) {
+    ASSERT_TRUE(cpu::set_vector_extension(extension));
+    for (Variant variant : {Variant::kFused, Variant::kTiled, Variant::kBatched}) {
+      const Frame frame = compute(PixelLayout::kPlanar32, variant);
+      EXPECT_EQ(frame.pixels, planar_reference.pixels) <<
+        extension << " " << variant_name(variant);
+      EXPECT_EQ(frame.colors, reference.colors) << extension << " " << variant_name(variant);
+    }
+  }
+}
@@ -0,0 +1,165 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "julia_set/cpu/tile_engine.hpp"
+
+using type_adaptation::julia_set::ImageRegion;
+using type_adaptation::julia_set::TileTiming;
+using type_adaptation::julia_set::cpu::TileEngine;
+
+namespace
+{
+// Region not at the origin and not a whole number of tiles.
+ImageRegion make_region()
+{
+  ImageRegion region;
+  region.x = 5;
+  region.y = 3;
+  region.width = 70;
+  region.height = 45;
+  region.in_row_step = 256;
+  region.out_row_step = 512;
+  return region;
+}
+
+// Visits of each pixel of the whole image the region is part of.
+class PixelVisits
+{
+public:
+  explicit PixelVisits(const ImageRegion & region)
+  : width_(region.x + region.width), visits_(width_ * (region.y + region.height))
+  {
+  }
+
+  void
+  visit(const ImageRegion & tile)
+  {
+    for (unsigned int y = tile.y; y < tile.y + tile.height; ++y) {
+      for (unsigned int x = tile.x; x < tile.x + tile.width; ++x) {
+        visits_[y * width_ + x].fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  int
+  visits(unsigned int x, unsigned int y) const
+  {
+    return visits_[y * width_ + x].load();
+  }
+
+private:
+  size_t width_;
+  std::vector<std::atomic<int>> visits_;
+};
+}  // namespace
+
+TEST(TileEngine, ThreadCountIncludesTheCaller)
+{
+  EXPECT_EQ(TileEngine(1).thread_count(), 1u);
+  EXPECT_EQ(TileEngine(3).thread_count(), 3u);
+  EXPECT_GE(TileEngine(0).thread_count(), 1u);
+}
+
+TEST(TileEngine, RunsEveryPixelOfTheRegionOnce)
+{
+  const ImageRegion region = make_region();
+  for (size_t thread_count : {1, 4}) {
+    TileEngine engine(thread_count);
+    PixelVisits pixels(region);
+    engine.run(
+      region, 16, 8, [&](const ImageRegion & tile) {
+        EXPECT_EQ(tile.in_row_step, region.in_row_step);
+        EXPECT_EQ(tile.out_row_step, region.out_row_step);
+        pixels.visit(tile);
+      });
+
+    for (unsigned int y = 0; y < region.y + region.height; ++y) {
+      for (unsigned int x = 0; x < region.x + region.width; ++x) {
+        const bool inside = x >= region.x && y >= region.y;
+        ASSERT_EQ(pixels.visits(x, y), inside ? 1 : 0) << "pixel " << x << ", " << y;
+      }
+    }
+  }
+}
+
+TEST(TileEngine, ZeroTileSizeRunsTheWholeRegion)
+{
+  const ImageRegion region = make_region();
+  TileEngine engine(2);
+  std::vector<TileTiming> timings;
+  engine.run(region, 0, 0, [](const ImageRegion &) {}, &timings);
+  ASSERT_EQ(timings.size(), 1u);
+  EXPECT_EQ(timings[0].tile.x, region.x);
+  EXPECT_EQ(timings[0].tile.y, region.y);
+  EXPECT_EQ(timings[0].tile.width, region.width);
+  EXPECT_EQ(timings[0].tile.height, region.height);
+}
+
+TEST(TileEngine, TimingsAreInRowMajorOrder)
+{
+  const ImageRegion region = make_region();
+  TileEngine engine(4);
+  std::vector<TileTiming> timings;
+  engine.run(region, 16, 8, [](const ImageRegion &) {}, &timings);
+
+  // 5 tiles per row of 70 pixels and 6 rows of tiles over 45 rows.
+  ASSERT_EQ(timings.size(), 30u);
+  for (size_t i = 0; i < timings.size(); ++i) {
+    const ImageRegion & tile = timings[i].tile;
+    EXPECT_EQ(tile.x, region.x + (i % 5) * 16) << "tile " << i;
+    EXPECT_EQ(tile.y, region.y + (i / 5) * 8) << "tile " << i;
+    EXPECT_EQ(tile.width, i % 5 == 4 ? 6u : 16u) << "tile " << i;
+    EXPECT_EQ(tile.height, i / 5 == 5 ? 5u : 8u) << "tile " << i;
+    EXPECT_LT(timings[i].worker, engine.thread_count()) << "tile " << i;
+  }
+}
+
+TEST(TileEngine, RethrowsOnceAllTilesAreDone)
+{
+  const ImageRegion region = make_region();
+  TileEngine engine(4);
+  std::atomic<int> tiles{0};
+  EXPECT_THROW(
+    engine.run(
+      region, 16, 8, [&](const ImageRegion & tile) {
+        tiles.fetch_add(1);
+        if (tile.x == region.x && tile.y == region.y) {
+          throw std::runtime_error("kernel failed");
+        }
+      }),
+    std::runtime_error);
+  EXPECT_EQ(tiles.load(), 30);
+
+  // The engine stays usable.
+  tiles = 0;
+  engine.run(region, 16, 8, [&](const ImageRegion &) {tiles.fetch_add(1);});
+  EXPECT_EQ(tiles.load(), 30);
+}
+
+TEST(TileEngine, SharedEnginesAreReusedPerThreadCount)
+{
+  auto engine = TileEngine::shared(3);
+  EXPECT_EQ(engine->thread_count(), 3u);
+  EXPECT_EQ(TileEngine::shared(3), engine);
+  EXPECT_NE(TileEngine::shared(2), engine);
+}
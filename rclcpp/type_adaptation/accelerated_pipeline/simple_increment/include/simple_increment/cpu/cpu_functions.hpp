@@ -0,0 +1,24 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SIMPLE_INCREMENT__CPU__CPU_FUNCTIONS_HPP_
+#define SIMPLE_INCREMENT__CPU__CPU_FUNCTIONS_HPP_
+
+#include <cstdint>
+
+void cpu_compute_inc(int size, const uint8_t * source, uint8_t * destination);
+
+void cpu_compute_inc_inplace(int size, uint8_t * image);
+
+#endif  // SIMPLE_INCREMENT__CPU__CPU_FUNCTIONS_HPP_
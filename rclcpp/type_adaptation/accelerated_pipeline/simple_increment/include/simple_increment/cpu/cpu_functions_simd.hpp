@@ -0,0 +1,48 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SIMPLE_INCREMENT__CPU__CPU_FUNCTIONS_SIMD_HPP_
+#define SIMPLE_INCREMENT__CPU__CPU_FUNCTIONS_SIMD_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace simple_increment
+{
+namespace cpu
+{
+
+// Vectorized increments of the CPU kernels. Each handles the leading bytes that fill whole
+// vectors and returns how many it handled, the caller finishes the rest. Source and destination
+// may be the same buffer.
+
+#ifdef SIMPLE_INCREMENT_HAS_AVX2
+namespace avx2
+{
+size_t increment(size_t size, const uint8_t * source, uint8_t * destination);
+}  // namespace avx2
+#endif
+
+#ifdef SIMPLE_INCREMENT_HAS_AVX512
+namespace avx512
+{
+size_t increment(size_t size, const uint8_t * source, uint8_t * destination);
+}  // namespace avx512
+#endif
+
+}  // namespace cpu
+}  // namespace simple_increment
+
+#endif  // SIMPLE_INCREMENT__CPU__CPU_FUNCTIONS_SIMD_HPP_
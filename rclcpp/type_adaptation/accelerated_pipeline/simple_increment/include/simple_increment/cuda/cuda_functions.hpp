@@ -16,7 +16,10 @@
 #ifndef SIMPLE_INCREMENT__CUDA__CUDA_FUNCTIONS_HPP_
 #define SIMPLE_INCREMENT__CUDA__CUDA_FUNCTIONS_HPP_
 
+#include <cstdint>
+
 #include "cuda.h"  // NOLINT
+#include "cuda_runtime.h"  // NOLINT
 
 void cuda_compute_inc(
   int size, const uint8_t * source, uint8_t * destination, const cudaStream_t & stream);
@@ -15,6 +15,7 @@
 
 """Launch the GPU pipeline for Simple Increment Example."""
 
+import os
 import platform
 
 from launch import LaunchDescription
@@ -33,7 +34,6 @@ RESOLUTIONS = {'16K': (15360, 8640),
 IMAGE_HZ = 100.0
 
 IMAGE_PROC_COUNT = 20
-INPLACE_ENABLED = True
 
 launch_args = [DeclareLaunchArgument('config', default_value='pipeline',
                                      description='Graph configuration (pipeline|composite)'),
@@ -41,6 +41,23 @@ launch_args = [DeclareLaunchArgument('config', default_value='pipeline',
                                      description='Enable type adaptation mode'),
                DeclareLaunchArgument('resolution', default_value='1080p',
                                      description='Resolution key (16K|8K|4K|1080p|720p|480p)'),
+               DeclareLaunchArgument('memory_backend', default_value='',
+                                     description='Image memory backend (host|cuda), '
+                                                 'empty for the build default'),
+               DeclareLaunchArgument('inplace_enabled', default_value='true',
+                                     description='Increment the received image in place '
+                                                 'rather than into copies of it'),
+               DeclareLaunchArgument('double_buffered_ingest', default_value='false',
+                                     description='Without type adaptation, convert each image '
+                                                 'on a transfer thread while the one before is '
+                                                 'incremented'),
+               DeclareLaunchArgument('pipeline_links', default_value='false',
+                                     description='Hand frames from each inc_node of the pipeline '
+                                                 'to the next through a lock-free ring rather '
+                                                 'than a topic, on a thread of the next node'),
+               DeclareLaunchArgument('pin_link_threads', default_value='false',
+                                     description='Pin the thread of each inc_node fed through a '
+                                                 'pipeline link to a CPU of its own'),
                DeclareLaunchArgument('enable_mt', default_value='false',
                                      description='Enable multithreaded composable containers'),
                DeclareLaunchArgument('enable_nsys', default_value='false',
@@ -63,6 +80,27 @@ def launch_setup(context):
     config = LaunchConfiguration('config').perform(context)
     enable_type_adapt = IfCondition(LaunchConfiguration('enable_type_adapt')).evaluate(context)
     resolution = LaunchConfiguration('resolution').perform(context)
+    memory_backend = LaunchConfiguration('memory_backend').perform(context)
+    inplace_enabled = IfCondition(LaunchConfiguration('inplace_enabled')).evaluate(context)
+    backend_params = [{'memory_backend': memory_backend}] if memory_backend else []
+    ingest_params = [{'double_buffered_ingest': IfCondition(
+        LaunchConfiguration('double_buffered_ingest')).evaluate(context)}]
+    node_params = backend_params + ingest_params
+    pipeline_links = IfCondition(LaunchConfiguration('pipeline_links')).evaluate(context)
+    pin_link_threads = IfCondition(LaunchConfiguration('pin_link_threads')).evaluate(context)
+
+    # The topics at the ends of the pipeline remain, the links only connect the inc_nodes.
+    def link_params(index):
+        params = []
+        if not pipeline_links:
+            return params
+        if index < IMAGE_PROC_COUNT - 1:
+            params.append({'link_out': 'inc_link%d' % index})
+        if index > 0:
+            params.append({'link_in': 'inc_link%d' % (index - 1)})
+            if pin_link_threads:
+                params.append({'link_cpu': index % os.cpu_count()})
+        return params
     enable_mt = IfCondition(LaunchConfiguration(
         'enable_mt')).evaluate(context)
     enable_nsys = IfCondition(LaunchConfiguration(
@@ -95,8 +133,8 @@ def launch_setup(context):
         plugin='type_adaptation::simple_increment::IncNode',
         name='inc_node',
         parameters=[{'proc_count': IMAGE_PROC_COUNT},
-                    {'inplace_enabled': INPLACE_ENABLED},
-                    {'type_adaptation_enabled': enable_type_adapt}],
+                    {'inplace_enabled': inplace_enabled},
+                    {'type_adaptation_enabled': enable_type_adapt}] + node_params,
         remappings=[('/image_out', '/composite/image_out')])
 
     composite_container = ComposableNodeContainer(
@@ -119,8 +157,9 @@ def launch_setup(context):
         package='simple_increment',
         plugin='type_adaptation::simple_increment::IncNode',
         name='inc_node0',
-        parameters=[{'inplace_enabled': INPLACE_ENABLED},
-                    {'type_adaptation_enabled': enable_type_adapt}],
+        parameters=[{'inplace_enabled': inplace_enabled},
+                    {'type_adaptation_enabled': enable_type_adapt}] + node_params +
+        link_params(0),
         remappings=[('/image_out', '/image_out0')]))
 
     for i in range(1, IMAGE_PROC_COUNT - 1):
@@ -128,8 +167,9 @@ def launch_setup(context):
             package='simple_increment',
             plugin='type_adaptation::simple_increment::IncNode',
             name='inc_node%d' % (i),
-            parameters=[{'inplace_enabled': INPLACE_ENABLED},
-                        {'type_adaptation_enabled': enable_type_adapt}],
+            parameters=[{'inplace_enabled': inplace_enabled},
+                        {'type_adaptation_enabled': enable_type_adapt}] + node_params +
+            link_params(i),
             remappings=[('/image_in', '/image_out%d' % (i - 1)),
                         ('/image_out', '/image_out%d' % (i))]))
 
@@ -137,8 +177,9 @@ def launch_setup(context):
         package='simple_increment',
         plugin='type_adaptation::simple_increment::IncNode',
         name='inc_node%d' % (IMAGE_PROC_COUNT - 1),
-        parameters=[{'inplace_enabled': INPLACE_ENABLED},
-                    {'type_adaptation_enabled': enable_type_adapt}],
+        parameters=[{'inplace_enabled': inplace_enabled},
+                    {'type_adaptation_enabled': enable_type_adapt}] + node_params +
+        link_params(IMAGE_PROC_COUNT - 1),
         remappings=[('/image_in', '/image_out%d' % (IMAGE_PROC_COUNT - 1 - 1)),
                     ('/image_out', '/pipeline/image_out')]))
 
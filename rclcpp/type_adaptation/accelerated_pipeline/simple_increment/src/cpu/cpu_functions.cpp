@@ -0,0 +1,95 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "simple_increment/cpu/cpu_functions.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+
+#include "simple_increment/cpu/cpu_functions_simd.hpp"
+
+namespace
+{
+using Increment = size_t (*)(size_t size, const uint8_t * source, uint8_t * destination);
+
+// Increment of the widest vector extension the CPU supports beyond the baseline, if any.
+Increment detect_increment()
+{
+#ifdef SIMPLE_INCREMENT_HAS_AVX512
+  if (__builtin_cpu_supports("avx512bw")) {
+    return simple_increment::cpu::avx512::increment;
+  }
+#endif
+#ifdef SIMPLE_INCREMENT_HAS_AVX2
+  if (__builtin_cpu_supports("avx2")) {
+    return simple_increment::cpu::avx2::increment;
+  }
+#endif
+  return nullptr;
+}
+
+Increment get_increment()
+{
+  static const Increment increment = detect_increment();
+  return increment;
+}
+
+// Increment with the 16 byte vectors every CPU of the architecture has.
+size_t baseline_increment(size_t size, const uint8_t * source, uint8_t * destination)
+{
+  size_t index = 0;
+#if defined(__SSE2__)
+  const __m128i one = _mm_set1_epi8(1);
+  for (; index + 16 <= size; index += 16) {
+    const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + index));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + index), _mm_add_epi8(value, one));
+  }
+#elif defined(__ARM_NEON)
+  const uint8x16_t one = vdupq_n_u8(1);
+  for (; index + 16 <= size; index += 16) {
+    vst1q_u8(destination + index, vaddq_u8(vld1q_u8(source + index), one));
+  }
+#else
+  (void)source;
+  (void)destination;
+  (void)size;
+#endif
+  return index;
+}
+}  // namespace
+
+void cpu_compute_inc(int size, const uint8_t * source, uint8_t * destination)
+{
+  const size_t bytes = size > 0 ? static_cast<size_t>(size) : 0;
+  size_t index = 0;
+  if (const Increment increment = get_increment()) {
+    index = increment(bytes, source, destination);
+  }
+  index += baseline_increment(bytes - index, source + index, destination + index);
+  for (; index < bytes; ++index) {
+    destination[index] = source[index] + 1;
+  }
+}
+
+void cpu_compute_inc_inplace(int size, uint8_t * image)
+{
+  cpu_compute_inc(size, image, image);
+}
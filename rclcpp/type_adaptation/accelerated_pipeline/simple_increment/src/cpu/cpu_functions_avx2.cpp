@@ -0,0 +1,69 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Built with -mavx2, only called once the CPU is known to support it.
+
+#include <immintrin.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "simple_increment/cpu/cpu_functions_simd.hpp"
+
+namespace simple_increment
+{
+namespace cpu
+{
+namespace avx2
+{
+
+namespace
+{
+__m256i load(const uint8_t * source)
+{
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(source));
+}
+
+void store(uint8_t * destination, __m256i value)
+{
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(destination), value);
+}
+}  // namespace
+
+size_t increment(size_t size, const uint8_t * source, uint8_t * destination)
+{
+  constexpr size_t kBytes = 32;
+  const __m256i one = _mm256_set1_epi8(1);
+  size_t index = 0;
+  // Four vectors per loop keep the loads of the next ones in flight.
+  for (; index + 4 * kBytes <= size; index += 4 * kBytes) {
+    const __m256i a = load(source + index);
+    const __m256i b = load(source + index + kBytes);
+    const __m256i c = load(source + index + 2 * kBytes);
+    const __m256i d = load(source + index + 3 * kBytes);
+    store(destination + index, _mm256_add_epi8(a, one));
+    store(destination + index + kBytes, _mm256_add_epi8(b, one));
+    store(destination + index + 2 * kBytes, _mm256_add_epi8(c, one));
+    store(destination + index + 3 * kBytes, _mm256_add_epi8(d, one));
+  }
+  for (; index + kBytes <= size; index += kBytes) {
+    store(destination + index, _mm256_add_epi8(load(source + index), one));
+  }
+  return index;
+}
+
+}  // namespace avx2
+}  // namespace cpu
+}  // namespace simple_increment
@@ -0,0 +1,57 @@
+// Copyright (c) 2021, NVIDIA CORPORATION.  All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Built with -mavx512bw, only called once the CPU is known to support it.
+
+#include <immintrin.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "simple_increment/cpu/cpu_functions_simd.hpp"
+
+namespace simple_increment
+{
+namespace cpu
+{
+namespace avx512
+{
+
+size_t increment(size_t size, const uint8_t * source, uint8_t * destination)
+{
+  constexpr size_t kBytes = 64;
+  const __m512i one = _mm512_set1_epi8(1);
+  size_t index = 0;
+  // Four vectors per loop keep the loads of the next ones in flight.
+  for (; index + 4 * kBytes <= size; index += 4 * kBytes) {
+    const __m512i a = _mm512_loadu_si512(source + index);
+    const __m512i b = _mm512_loadu_si512(source + index + kBytes);
+    const __m512i c = _mm512_loadu_si512(source + index + 2 * kBytes);
+    const __m512i d = _mm512_loadu_si512(source + index + 3 * kBytes);
+    _mm512_storeu_si512(destination + index, _mm512_add_epi8(a, one));
+    _mm512_storeu_si512(destination + index + kBytes, _mm512_add_epi8(b, one));
+    _mm512_storeu_si512(destination + index + 2 * kBytes, _mm512_add_epi8(c, one));
+    _mm512_storeu_si512(destination + index + 3 * kBytes, _mm512_add_epi8(d, one));
+  }
+  for (; index + kBytes <= size; index += kBytes) {
+    _mm512_storeu_si512(
+      destination + index, _mm512_add_epi8(_mm512_loadu_si512(source + index), one));
+  }
+  return index;
+}
+
+}  // namespace avx512
+}  // namespace cpu
+}  // namespace simple_increment
@@ -24,12 +24,23 @@ void myinc(int size, const uint8_t * source, uint8_t * destination)
   }
 }
 
+namespace
+{
+constexpr int kThreadsPerBlock = 256;
+
+// Blocks that give every byte of the image a thread of its own.
+int block_count(int size)
+{
+  return size > 0 ? (size + kThreadsPerBlock - 1) / kThreadsPerBlock : 1;
+}
+}  // namespace
+
 void cuda_compute_inc(int size, const uint8_t * source, uint8_t * destination, const cudaStream_t & stream)
 {
-  myinc<<<64, 64, 0, stream>>>(size, source, destination);
+  myinc<<<block_count(size), kThreadsPerBlock, 0, stream>>>(size, source, destination);
 }
 
 void cuda_compute_inc_inplace(int size, uint8_t * image, const cudaStream_t & stream)
 {
-  myinc<<<64, 64, 0, stream>>>(size, image, image);
+  myinc<<<block_count(size), kThreadsPerBlock, 0, stream>>>(size, image, image);
 }
@@ -13,17 +13,27 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include <nvToolsExt.h>  // NOLINT
-
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <string>
 #include <utility>
 
 #include "rclcpp/rclcpp.hpp"
 #include "rclcpp_components/register_node_macro.hpp"
 #include "sensor_msgs/msg/image.hpp"
 
+#include "type_adapters/backend.hpp"
 #include "type_adapters/image_container.hpp"
+#include "type_adapters/image_ingest.hpp"
+#include "type_adapters/memory_parameters.hpp"
+#include "type_adapters/nvtx.hpp"
+#include "type_adapters/pipeline_link.hpp"
+#include "simple_increment/cpu/cpu_functions.hpp"
+#ifdef TYPE_ADAPTERS_USE_CUDA
+#include "type_adapters/cuda_backend.hpp"
 #include "simple_increment/cuda/cuda_functions.hpp"
+#endif
 
 RCLCPP_USING_CUSTOM_TYPE_AS_ROS_MESSAGE_TYPE(
   type_adaptation::example_type_adapters::ImageContainer,
@@ -33,6 +43,37 @@ namespace type_adaptation
 {
 namespace simple_increment
 {
+namespace
+{
+using type_adaptation::example_type_adapters::BackendType;
+using type_adaptation::example_type_adapters::StreamWrapper;
+
+// Run the increment where the image lives: with CUDA, or on the CPU once the transfers queued on
+// the stream are done.
+void compute_inc(int size, const uint8_t * source, uint8_t * destination, StreamWrapper & stream)
+{
+#ifdef TYPE_ADAPTERS_USE_CUDA
+  if (stream.backend_type() == BackendType::kCuda) {
+    cuda_compute_inc(size, source, destination, example_type_adapters::cuda_stream(stream));
+    return;
+  }
+#endif
+  stream.synchronize();
+  cpu_compute_inc(size, source, destination);
+}
+
+void compute_inc_inplace(int size, uint8_t * image, StreamWrapper & stream)
+{
+#ifdef TYPE_ADAPTERS_USE_CUDA
+  if (stream.backend_type() == BackendType::kCuda) {
+    cuda_compute_inc_inplace(size, image, example_type_adapters::cuda_stream(stream));
+    return;
+  }
+#endif
+  stream.synchronize();
+  cpu_compute_inc_inplace(size, image);
+}
+}  // namespace
 
 class IncNode : public rclcpp::Node
 {
@@ -49,71 +90,151 @@ public:
     RCLCPP_INFO(
       get_logger(), "Type adaptation enabled: %s", type_adaptation_enabled_ ? "YES" : "NO");
 
-    if (type_adaptation_enabled_) {
+    memory_backend_ = example_type_adapters::declare_memory_backend(*this);
+    RCLCPP_INFO(
+      get_logger(), "Using memory backend: %s",
+      example_type_adapters::to_string(memory_backend_).c_str());
+
+    // Stages of a fixed chain in one process may hand frames over through pipeline links instead,
+    // and the next stage takes them on a thread of its own rather than through the executor.
+    const std::string link_in = declare_parameter<std::string>("link_in", "");
+    const std::string link_out = declare_parameter<std::string>("link_out", "");
+    const example_type_adapters::PipelineLinkOptions link_options =
+      example_type_adapters::declare_pipeline_link_options(*this, 1);
+
+    if (!link_in.empty()) {
+      // Subscribed to once the node is set up, at the end.
+    } else if (type_adaptation_enabled_) {
       custom_type_sub_ =
         create_subscription<type_adaptation::example_type_adapters::ImageContainer>(
         "image_in", 1, std::bind(&IncNode::custom_type_callback, this, std::placeholders::_1));
-      custom_type_pub_ = create_publisher<type_adaptation::example_type_adapters::ImageContainer>(
-        "image_out", 1);
     } else {
       sub_ =
         create_subscription<sensor_msgs::msg::Image>(
         "image_in", 1, std::bind(&IncNode::callback, this, std::placeholders::_1));
+      // A transfer worker may convert each message while the frame before is incremented.
+      if (declare_parameter<bool>("double_buffered_ingest", false)) {
+        ingest_ = std::make_unique<example_type_adapters::ImageIngest>(memory_backend_);
+        ingest_timer_ = create_wall_timer(
+          std::chrono::duration<double, std::milli>(
+            std::max(declare_parameter<double>("ingest_timeout_ms", 50.0), 0.0)),
+          std::bind(&IncNode::flush_ingest, this));
+        ingest_timer_->cancel();
+      }
+    }
+
+    if (!link_out.empty()) {
+      link_pub_ = std::make_shared<example_type_adapters::PipelineLinkPublisher>(
+        *this, link_out, link_options);
+    } else if (type_adaptation_enabled_) {
+      custom_type_pub_ = create_publisher<type_adaptation::example_type_adapters::ImageContainer>(
+        "image_out", 1);
+    } else {
       pub_ = create_publisher<sensor_msgs::msg::Image>("image_out", 1);
     }
+
+    // Frames come in on the thread of the link from here on.
+    if (!link_in.empty()) {
+      link_sub_ = std::make_shared<example_type_adapters::PipelineLinkSubscription>(
+        *this, link_in,
+        std::bind(&IncNode::custom_type_callback, this, std::placeholders::_1),
+        link_options);
+    }
   }
 
   void custom_type_callback(
     std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image)
   {
     nvtxRangePushA("IncNode: Image custom_type_callback");
-    for (int i = 0; i < proc_count_; i++) {
-      if (inplace_enabled_) {
-        cuda_compute_inc_inplace(
-          image->size_in_bytes(), image->cuda_mem(),
-          image->cuda_stream()->stream());
-      } else {
-        auto copy = std::make_unique<type_adaptation::example_type_adapters::ImageContainer>(
-          image->header(), image->height(),
-          image->width(), image->encoding(), image->step(), image->cuda_stream());
-        cuda_compute_inc(
-          image->size_in_bytes(), image->cuda_mem(),
-          copy->cuda_mem(), copy->cuda_stream()->stream());
-        image = std::move(copy);
-      }
-    }
-    custom_type_pub_->publish(std::move(image));
+    process_image(std::move(image));
     nvtxRangePop();
   }
 
   void callback(std::unique_ptr<sensor_msgs::msg::Image> image_msg)
   {
     nvtxRangePushA("IncNode: Image callback");
-    using ImageContainer = type_adaptation::example_type_adapters::ImageContainer;
-    std::unique_ptr<ImageContainer> image = std::make_unique<ImageContainer>(std::move(image_msg));
-    for (int i = 0; i < proc_count_; i++) {
-      if (inplace_enabled_) {
-        cuda_compute_inc_inplace(
-          image->size_in_bytes(), image->cuda_mem(),
-          image->cuda_stream()->stream());
-      } else {
-        auto copy = std::make_unique<ImageContainer>(
-          image->header(), image->height(), image->width(), image->encoding(),
-          image->step(), image->cuda_stream());
-        cuda_compute_inc(
-          image->size_in_bytes(), image->cuda_mem(),
-          copy->cuda_mem(), copy->cuda_stream()->stream());
-        image = std::move(copy);
-      }
+    if (ingest_) {
+      // The frame before is incremented while this one is converted.
+      ingest_->push(
+        std::move(image_msg), std::bind(&IncNode::process_image, this, std::placeholders::_1));
+      ingest_timer_->reset();
+      RCLCPP_INFO_THROTTLE(
+        get_logger(), *get_clock(), 5000, "Ingest overlap efficiency: %.2f",
+        ingest_->statistics().overlap_efficiency());
+    } else {
+      process_image(
+        std::make_unique<type_adaptation::example_type_adapters::ImageContainer>(
+          std::move(image_msg),
+          type_adaptation::example_type_adapters::get_backend(memory_backend_)->create_stream()));
     }
-    // Convert in-place before publishing to "disable" type adaptation
-    sensor_msgs::msg::Image image_msg_out;
-    image->get_sensor_msgs_image(image_msg_out);
-    pub_->publish(image_msg_out);
     nvtxRangePop();
   }
 
 private:
+  std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> increment(
+    std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image)
+  {
+    using ImageContainer = type_adaptation::example_type_adapters::ImageContainer;
+    if (inplace_enabled_) {
+      for (int i = 0; i < proc_count_; i++) {
+        compute_inc_inplace(
+          image->size_in_bytes(), image->data(),
+          *image->stream());
+      }
+      return image;
+    }
+    if (proc_count_ < 1) {
+      return image;
+    }
+
+    // Each increment reads the result of the one before, so two buffers, allocated once per
+    // image, take turns as source and destination.
+    auto front = std::make_unique<ImageContainer>(
+      image->header(), image->height(), image->width(), image->encoding(),
+      image->step(), image->stream());
+    compute_inc(
+      image->size_in_bytes(), image->cdata(),
+      front->data(), *front->stream());
+    if (proc_count_ > 1) {
+      auto back = std::make_unique<ImageContainer>(
+        image->header(), image->height(), image->width(), image->encoding(),
+        image->step(), image->stream());
+      for (int i = 1; i < proc_count_; i++) {
+        compute_inc(
+          front->size_in_bytes(), front->cdata(),
+          back->data(), *back->stream());
+        std::swap(front, back);
+      }
+    }
+    return front;
+  }
+
+  void process_image(std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image)
+  {
+    publish_image(increment(std::move(image)));
+  }
+
+  // Publish on whichever publisher the node was configured with.
+  void publish_image(std::unique_ptr<type_adaptation::example_type_adapters::ImageContainer> image)
+  {
+    if (link_pub_) {
+      link_pub_->publish(std::move(image));
+    } else if (custom_type_pub_) {
+      custom_type_pub_->publish(std::move(image));
+    } else {
+      // Convert in-place before publishing to "disable" type adaptation
+      pub_->publish(image->release_sensor_msgs_image());
+    }
+  }
+
+  // Increment the frame the ingest staged last, once no message followed it in time.
+  void flush_ingest()
+  {
+    // Subscriptions and the timer share the default callback group, so they never run at once.
+    ingest_timer_->cancel();
+    ingest_->flush(std::bind(&IncNode::process_image, this, std::placeholders::_1));
+  }
+
   // Publisher and subscriber when type_adaptation is enabled
   rclcpp::Subscription<type_adaptation::example_type_adapters::ImageContainer>::SharedPtr
     custom_type_sub_ {nullptr};
@@ -123,10 +244,23 @@ private:
   // Publisher and subscriber when type_adaptation is disabled
   rclcpp::Subscription<sensor_msgs::msg::Image>::SharedPtr sub_{nullptr};
   rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr pub_{nullptr};
+  // Double-buffered conversion of sensor_msgs images, when enabled, and the timer that caps how
+  // long a staged frame waits for the next message
+  std::unique_ptr<type_adaptation::example_type_adapters::ImageIngest> ingest_;
+  rclcpp::TimerBase::SharedPtr ingest_timer_{nullptr};
 
   const int proc_count_;
   const bool inplace_enabled_;
   const bool type_adaptation_enabled_;
+  // Backend of the frames the node creates itself, see declare_memory_backend()
+  BackendType memory_backend_{};
+
+  // Publisher and subscriber when frames are handed over through pipeline links, the subscriber
+  // last so that its thread stops before the rest of the node is destroyed
+  std::shared_ptr<type_adaptation::example_type_adapters::PipelineLinkPublisher> link_pub_{
+    nullptr};
+  std::shared_ptr<type_adaptation::example_type_adapters::PipelineLinkSubscription> link_sub_{
+    nullptr};
 };
 
 }  // namespace simple_increment